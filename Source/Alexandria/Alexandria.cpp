@@ -1,7 +1,24 @@
-// Copyright 1998-2017 Epic Games, Inc. All Rights Reserved.
-
-#include "Alexandria.h"
-
-
-IMPLEMENT_PRIMARY_GAME_MODULE( FDefaultGameModuleImpl, Alexandria, "Alexandria" );
- 
\ No newline at end of file
+// Copyright 1998-2017 Epic Games, Inc. All Rights Reserved.
+
+#include "Alexandria.h"
+#include "AlexandriaCharacter.h"
+
+class FAlexandriaModule : public FDefaultGameModuleImpl
+{
+public:
+	virtual void StartupModule() override
+	{
+		// Radiance assets start streaming with the map instead of blocking the first character
+		PreLoadMapHandle = FCoreUObjectDelegates::PreLoadMap.AddStatic( &AAlexandriaCharacter::PreloadRadianceAssets );
+	}
+
+	virtual void ShutdownModule() override
+	{
+		FCoreUObjectDelegates::PreLoadMap.Remove( PreLoadMapHandle );
+	}
+
+private:
+	FDelegateHandle PreLoadMapHandle;
+};
+
+IMPLEMENT_PRIMARY_GAME_MODULE( FAlexandriaModule, Alexandria, "Alexandria" );
@@ -1,8 +1,8 @@
-// Copyright 1998-2017 Epic Games, Inc. All Rights Reserved.
-
-#ifndef __ALEXANDRIA_H__
-#define __ALEXANDRIA_H__
-
-#include "EngineMinimal.h"
-
-#endif
+// Copyright 1998-2017 Epic Games, Inc. All Rights Reserved.
+
+#ifndef __ALEXANDRIA_H__
+#define __ALEXANDRIA_H__
+
+#include "EngineMinimal.h"
+
+#endif
@@ -1,683 +1,1956 @@
-// Copyright 1998-2017 Epic Games, Inc. All Rights Reserved.
-
-#include "Alexandria.h"
-#include "Kismet/HeadMountedDisplayFunctionLibrary.h"
-#include "AlexandriaCharacter.h"
-#include "PrecomputedLightVolume.h"
-#include "Components/LightComponent.h"
-#include "Runtime/Engine/Classes/Engine/Engine.h"
-#include "Runtime/Engine/Classes/Engine/Light.h"
-#include "Runtime/Engine/Classes/Engine/DirectionalLight.h"
-#include "Runtime/Engine/Classes/Engine/PointLight.h"
-#include "Runtime/Engine/Public/SceneManagement.h"
-#include "Engine/LocalPlayer.h"
-#include "EngineUtils.h"
-#include "DrawDebugHelpers.h"
-#include "Engine/LevelBounds.h"
-#include "CollisionQueryParams.h"
-#include "Materials/MaterialInstanceDynamic.h"
-#include "ParticleHelper.h"
-#include "Particles/ParticleSystem.h"
-#include "Particles/ParticleSystemComponent.h"
-
-#define print_color(text, time, color) if (GEngine) GEngine->AddOnScreenDebugMessage(-1, time, color, text)
-#define print(text) if (GEngine) GEngine->AddOnScreenDebugMessage(-1, 1.5, FColor::White, text )
-//////////////////////////////////////////////////////////////////////////
-// AAlexandriaCharacter
-
-const FName AAlexandriaCharacter::EmissiveStrName( TEXT( "EmissiveStrength" ) );
-const FName AAlexandriaCharacter::MatOpacityName( TEXT( "Opacity" ) );
-
-AAlexandriaCharacter::AAlexandriaCharacter():
-	bInnerRadiance(false),
-	InnerRadianceDecayTime(4.f),
-	Lucidity(0.f),
-	SunIntensity(0.f),
-	AbsorbVelocity(1.5f), 
-	ConsumeVelocity(3.f),
-	TimeSinceLastUptick(0.f),
-	SunlightTemperature( 1850.f, 5750.f )
-
-{
-	
-
-	// Capsule Component
-	{
-		
-		// Set size for collision capsule
-		SetRootComponent( GetCapsuleComponent() );
-		GetCapsuleComponent()->InitCapsuleSize( 42.f, 96.0f );
-		
-		//SetRootComponent( GetCapsuleComponent() );
-		PrimaryActorTick.bCanEverTick = true;
-	}
-
-	// Radiance Setup
-	// Setup Light
-	{
-		static const FName SMSocketName( TEXT( "BackSocket" ) );
-		RadianceLight = CreateDefaultSubobject<UPointLightComponent>( TEXT( "RadianceLight" ) );
-		RadianceLight->SetupAttachment( GetMesh(), SMSocketName );
-	}
-
-	// Setup Globe
-	{
-		RadianceGlobe = CreateDefaultSubobject<UStaticMeshComponent>( TEXT( "RadianceGlobe" ) );
-		static ConstructorHelpers::FObjectFinder<UMaterial> RadMatRef( TEXT( "Material'/Game/Alexandria/Character/RadianceGlobeMaterial.RadianceGlobeMaterial'" ) );
-		if (RadMatRef.Succeeded()) {
-			RadianceMaterial = RadMatRef.Object;
-		}
-		static ConstructorHelpers::FObjectFinder<UStaticMesh> StaticRadianceGlobe( TEXT( "Material'/Game/Alexandria/Character/RadianceGlobeSphere.RadianceGlobeSphere'" ) );
-		if (StaticRadianceGlobe.Succeeded()) {
-			RadianceGlobeMesh = StaticRadianceGlobe.Object;
-
-			
-			RadianceGlobe->SetStaticMesh( RadianceGlobeMesh );
-			RadianceGlobe->bOwnerNoSee = false;
-			RadianceGlobe->bCastDynamicShadow = true;
-			RadianceGlobe->CastShadow = true;
-			RadianceGlobe->SetSimulatePhysics( false );
-			RadianceGlobe->BodyInstance.SetObjectType( ECollisionChannel::ECC_WorldDynamic );
-			RadianceGlobe->BodyInstance.SetCollisionEnabled( ECollisionEnabled::QueryOnly );
-			RadianceGlobe->BodyInstance.SetResponseToAllChannels( ECollisionResponse::ECR_Ignore );
-			RadianceGlobe->BodyInstance.SetResponseToChannel( ECollisionChannel::ECC_Pawn, ECollisionResponse::ECR_Block );
-			RadianceGlobe->BodyInstance.SetResponseToChannel( ECollisionChannel::ECC_WorldStatic, ECollisionResponse::ECR_Block );
-			RadianceGlobe->BodyInstance.SetResponseToChannel( ECollisionChannel::ECC_WorldDynamic, ECollisionResponse::ECR_Block );
-			RadianceGlobe->Mobility = EComponentMobility::Movable;
-			RadianceGlobe->SetHiddenInGame( false );
-			RadianceGlobe->SetupAttachment( RadianceLight );
-			RadianceGlobe->bAutoRegister = true;
-		}
-	}
-
-	// Setup Emitter
-	
-	{
-		RadianceFire = CreateDefaultSubobject<UParticleSystemComponent>( TEXT( "RadianceFire" ) );
-		static ConstructorHelpers::FObjectFinder<UParticleSystem> FireEmitter( TEXT( "ParticleSystem'/Game/Alexandria/Particle/P_Fire.P_Fire'" ) );
-		if (FireEmitter.Succeeded()) {
-			RadianceFireEmitter = FireEmitter.Object;
-			RadianceFire->SetTemplate( RadianceFireEmitter );
-			RadianceFire->bAutoActivate = true;
-			RadianceFire->bAutoRegister = true;
-			RadianceFire->bVisible = true;
-			RadianceFire->bVisualizeComponent = true;
-			static const FName CenterSocket( TEXT( "Center" ) );
-			RadianceFire->SetupAttachment( RadianceGlobe, CenterSocket );
-			//RadianceFire->bAutoActivate = HasInnerRadiance();
-		}
-			
-	}
-	
-
-	// FLucidMovement Base values
-	{
-		LucidAirControl.Base = 0.2f;
-		LucidGravity.Base = GetCharacterMovement()->GravityScale;
-		LucidMoveSpeed.Base = GetCharacterMovement()->MaxWalkSpeed;
-		LucidAcceleration.Base = GetCharacterMovement()->MaxAcceleration;
-		LucidLateralAirFriction.Base = GetCharacterMovement()->FallingLateralFriction;
-		LucidJumpZ.Base = 600.f;
-		SunlightIntensity.Base = 2500.f;
-		SunlightTemperature.Base = 1.f;
-
-		RadianceGlobe->GetMaterial( 0 )->GetScalarParameterValue( MatOpacityName, MaterialOpacity.Base );
-		RadianceGlobe->GetMaterial( 0 )->GetScalarParameterValue( EmissiveStrName, EmissiveStrength.Base );
-	}
-
-	
-	// Player Input/Controls
-	{
-		// set our turn rates for input
-		BaseTurnRate = 45.f;
-		BaseLookUpRate = 45.f;
-
-		// Don't rotate when the controller rotates. Let that just affect the camera.
-		bUseControllerRotationPitch = false;
-		bUseControllerRotationYaw = false;
-		bUseControllerRotationRoll = false;
-
-	}
-
-	// Player Movement
-	{
-		// Configure character movement
-		GetCharacterMovement()->bOrientRotationToMovement = true; // Character moves in the direction of input...	
-		GetCharacterMovement()->RotationRate = FRotator( 0.0f, 540.0f, 0.0f ); // ...at this rotation rate
-		GetCharacterMovement()->JumpZVelocity = LucidJumpZ.Base;
-		GetCharacterMovement()->AirControl = LucidAirControl.Base;
-		GetCharacterMovement()->BrakingDecelerationFalling = GetCharacterMovement()->BrakingDecelerationWalking / 2.f;
-		GetCharacterMovement()->bForceMaxAccel = false;
-	}
-
-	// Camera Setup
-	{
-		// Create a camera boom (pulls in towards the player if there is a collision)
-		CameraBoom = CreateDefaultSubobject<USpringArmComponent>( TEXT( "CameraBoom" ) );
-		CameraBoom->SetupAttachment( RootComponent );
-		CameraBoom->TargetArmLength = 300.0f; // The camera follows at this distance behind the character	
-		CameraBoom->bUsePawnControlRotation = true; // Rotate the arm based on the controller
-
-		// Create a follow camera
-		FollowCamera = CreateDefaultSubobject<UCameraComponent>( TEXT( "FollowCamera" ) );
-		FollowCamera->SetupAttachment( CameraBoom, USpringArmComponent::SocketName ); // Attach the camera to the end of the boom and let the boom adjust to match the controller orientation
-		FollowCamera->bUsePawnControlRotation = false; // Camera does not rotate relative to arm
-	}
-
-	SunColor = RadianceLight->GetLightColor();
-
-
-
-	// Note: The skeletal mesh and anim blueprint references on the Mesh component (inherited from Character) 
-	// are set in the derived blueprint asset named MyCharacter (to avoid direct content references in C++)
-}
-
-//////////////////////////////////////////////////////////////////////////
-// Input
-
-void AAlexandriaCharacter::SetupPlayerInputComponent(class UInputComponent* PlayerInputComponent)
-{
-	
-	// Set up gameplay key bindings
-	check(PlayerInputComponent);
-	PlayerInputComponent->BindAction("Jump", IE_Pressed, this, &ACharacter::Jump);
-	PlayerInputComponent->BindAction("Jump", IE_Released, this, &ACharacter::StopJumping);
-
-	PlayerInputComponent->BindAxis("MoveForward", this, &AAlexandriaCharacter::MoveForward);
-	PlayerInputComponent->BindAxis("MoveRight", this, &AAlexandriaCharacter::MoveRight);
-
-	// We have 2 versions of the rotation bindings to handle different kinds of devices differently
-	// "turn" handles devices that provide an absolute delta, such as a mouse.
-	// "turnrate" is for devices that we choose to treat as a rate of change, such as an analog joystick
-	PlayerInputComponent->BindAxis("Turn", this, &APawn::AddControllerYawInput);
-	PlayerInputComponent->BindAxis("TurnRate", this, &AAlexandriaCharacter::TurnAtRate);
-	PlayerInputComponent->BindAxis("LookUp", this, &APawn::AddControllerPitchInput);
-	PlayerInputComponent->BindAxis("LookUpRate", this, &AAlexandriaCharacter::LookUpAtRate);
-
-	// handle touch devices
-	PlayerInputComponent->BindTouch(IE_Pressed, this, &AAlexandriaCharacter::TouchStarted);
-	PlayerInputComponent->BindTouch(IE_Released, this, &AAlexandriaCharacter::TouchStopped);
-
-	// VR headset functionality
-	PlayerInputComponent->BindAction("ResetVR", IE_Pressed, this, &AAlexandriaCharacter::OnResetVR);
-}
-
-float AAlexandriaCharacter::CalcLucidity( const float DeltaSeconds )
-{
-	// Data to be collected
-	FSHVectorRGB3 Radiance;
-	float Shadowing = 0.f;
-	float Weight = 0.f;
-	FVector SkyBent = FVector::ZeroVector;
-	const FBoxSphereBounds PlayerBounds( GetCapsuleComponent()->Bounds );
-	//const float IncidentLuminance = CalcPlayerIncidentRadiance( PlayerBounds, Radiance, Shadowing, Weight, SkyBent );
-
-
-	// Get Lucidity from Light Levels affecting player
-	const float TickLucidity = (GetSolarIllumination( 4 ) + CalcDynamicLightRadiance( 4 ) /*+ IncidentLuminance */);
-	float DeltaLucidity = TickLucidity - GetLucidity();
-	const float MaxDeltaLucidity = SunIntensity*DeltaSeconds / BaseSunIntensity;
-	
-	if (DeltaLucidity > 0.f)
-	{	
-		TimeSinceLastUptick = 0.f;
-		DeltaLucidity *= AbsorbVelocity;
-		if (HasInnerRadiance()) {
-			DeltaLucidity *= InnerRadianceDecayTime;
-		}
-		DeltaLucidity = FMath::Min<float>( DeltaLucidity, MaxDeltaLucidity );
-	}
-	else if (DeltaLucidity < 0.f)
-	{
-		
-		DeltaLucidity *= ConsumeVelocity;
-		DeltaLucidity = -1.f*FMath::Min<float>( FMath::Abs<float>(DeltaLucidity), MaxDeltaLucidity );
-		if (HasInnerRadiance()) {
-			if (TimeSinceLastUptick < 3.0f) {
-				return GetLucidity();
-			}
-			DeltaLucidity /= (InnerRadianceDecayTime*2);
-		}
-	}
-	return FMath::Clamp<float>( GetLucidity()+DeltaLucidity, 0.f, 1.f );
-}
-
-void AAlexandriaCharacter::UpdateMovementParams( const float DeltaSeconds )
-{
-	UCharacterMovementComponent *Mvmt = GetCharacterMovement();
-	// Apply Scalar
-	Mvmt->AirControl = LucidAirControl.GetProperty(Lucidity);
-	Mvmt->MaxAcceleration = LucidAcceleration.GetProperty( Lucidity );
-	Mvmt->MaxWalkSpeed = LucidMoveSpeed.GetProperty(Lucidity);
-	Mvmt->GravityScale = LucidGravity.GetProperty( Lucidity );
-	Mvmt->FallingLateralFriction = LucidLateralAirFriction.GetProperty( Lucidity );
-	Mvmt->JumpZVelocity = LucidJumpZ.GetProperty( Lucidity );
-
-	// Apply Inv Scalar
-	
-
-	// Debug Prints
-	/*
-	print_color( FString::Printf( TEXT( "MaxWalkSpeed:    %f" ), Mvmt->MaxWalkSpeed ), DeltaSeconds, FColor::White );
-	print_color( FString::Printf( TEXT( "MaxAccelaration: %f" ), Mvmt->MaxAcceleration ), DeltaSeconds, FColor::White );
-	print_color( FString::Printf( TEXT( "JumpZVelocity:   %f" ), Mvmt->JumpZVelocity ), DeltaSeconds, FColor::White );
-	print_color( FString::Printf( TEXT( "GravityScale:    %f" ), Mvmt->GravityScale ), DeltaSeconds, FColor::White );
-	print_color( FString::Printf( TEXT( "AirControl:      %f" ), Mvmt->AirControl ), DeltaSeconds, FColor::White );
-	*/
-
-}
-
-void AAlexandriaCharacter::UpdateVisualFeedback( const float DeltaSeconds )
-{
-	GetRadianceLight()->SetIntensity( SunlightIntensity.GetProperty( Lucidity ) );
-	//GetRadianceLight()->SetLightColor( SunColor*Lucidity );
-	GetRadianceLight()->SetTemperature( SunlightTemperature.GetProperty( Lucidity ) );
-	RadianceGlobe->SetScalarParameterValueOnMaterials( MatOpacityName, MaterialOpacity.GetProperty( Lucidity ) );
-	RadianceGlobe->SetScalarParameterValueOnMaterials( EmissiveStrName, EmissiveStrength.GetProperty( Lucidity ) );
-	RadianceGlobe->GetMaterial( 0 )->SetEmissiveBoost( Lucidity );
-	RadianceGlobe->GetMaterial( 0 )->SetDiffuseBoost( Lucidity );
-
-	if (HasInnerRadiance()) {
-		if (!RadianceFire->IsActive() && (Lucidity > SMALL_NUMBER)) {
-			RadianceFire->ActivateSystem( false );
-		}
-		else if (RadianceFire->IsActive() && (Lucidity <= SMALL_NUMBER)) {
-			RadianceFire->DeactivateSystem();
-		}
-		RadianceFire->SetRelativeScale3D( FVector( Lucidity ));
-	}
-}
-
-
-void AAlexandriaCharacter::OnResetVR()
-{
-	UHeadMountedDisplayFunctionLibrary::ResetOrientationAndPosition();
-}
-
-void AAlexandriaCharacter::TouchStarted(ETouchIndex::Type FingerIndex, FVector Location)
-{
-		Jump();
-}
-
-void AAlexandriaCharacter::TouchStopped(ETouchIndex::Type FingerIndex, FVector Location)
-{
-		StopJumping();
-}
-
-void AAlexandriaCharacter::TurnAtRate(float Rate)
-{
-	// calculate delta for this frame from the rate information
-	AddControllerYawInput(Rate * BaseTurnRate * GetWorld()->GetDeltaSeconds());
-}
-
-void AAlexandriaCharacter::LookUpAtRate(float Rate)
-{
-	// calculate delta for this frame from the rate information
-	AddControllerPitchInput(Rate * BaseLookUpRate * GetWorld()->GetDeltaSeconds());
-}
-
-void AAlexandriaCharacter::MoveForward(float Value)
-{
-	if ((Controller != nullptr) && (Value != 0.0f))
-	{
-		// find out which way is forward
-		const FRotator Rotation = Controller->GetControlRotation();
-		const FRotator YawRotation(0, Rotation.Yaw, 0);
-
-		// get forward vector
-		const FVector Direction = FRotationMatrix(YawRotation).GetUnitAxis(EAxis::X);
-		AddMovementInput(Direction, Value);
-	}
-}
-
-void AAlexandriaCharacter::MoveRight(float Value)
-{
-	if ( (Controller != nullptr) && (Value != 0.0f) )
-	{
-		// find out which way is right
-		const FRotator Rotation = Controller->GetControlRotation();
-		const FRotator YawRotation(0, Rotation.Yaw, 0);
-	
-		// get right vector 
-		const FVector Direction = FRotationMatrix(YawRotation).GetUnitAxis(EAxis::Y);
-		// add movement in that direction
-		AddMovementInput(Direction, Value);
-	}
-}
-void AAlexandriaCharacter::DebugPrintRadiance( const float DrawTime, const FVector PollPoint, const FSHVectorRGB3 &Radiance, const float Shadowing, const float Weight, const FVector &SkyBent, const float Luminance ) const
-{
-	if (GEngine) {
-		FLinearColor IntegralRadiance = Radiance.CalcIntegral();
-		const FColor TextColor = IntegralRadiance.ToFColor( true );
-		GEngine->AddOnScreenDebugMessage( INDEX_NONE,
-			DrawTime,
-			FColor::White,
-			FString::Printf( TEXT( "Poll Point: %s" ), *PollPoint.ToString() ) );
-
-		const FString LuminanceMsg = FString::Printf( TEXT( "Luminance: %f" ), Luminance );
-		GEngine->AddOnScreenDebugMessage( INDEX_NONE,
-			DrawTime,
-			TextColor,
-			LuminanceMsg );
-
-		GEngine->AddOnScreenDebugMessage( INDEX_NONE,
-			DrawTime,
-			TextColor,
-			FString::Printf( TEXT( "IntegralRadiance: %s" ), *IntegralRadiance.ToString() ) );
-
-		GEngine->AddOnScreenDebugMessage( INDEX_NONE,
-			DrawTime,
-			FColor::White,
-			FString::Printf( TEXT( "Shadowing: %f" ), Shadowing ) );
-
-		GEngine->AddOnScreenDebugMessage( INDEX_NONE,
-			DrawTime,
-			FColor::White,
-			FString::Printf( TEXT( "Weight: %f" ), Weight ) );
-
-		GEngine->AddOnScreenDebugMessage( INDEX_NONE,
-			DrawTime,
-			FColor::White,
-			FString::Printf( TEXT( "SkyBent: %s" ), *SkyBent.ToString() ) );
-	}
-}
-
-void AAlexandriaCharacter::Tick( float DeltaSeconds )
-{
-	Super::Tick( DeltaSeconds );
-
-	Lucidity = CalcLucidity( DeltaSeconds );
-
-
-	
-	UpdateVisualFeedback( DeltaSeconds );
-	UpdateMovementParams( DeltaSeconds );
-
-	// Debug Prints
-	/*
-	float print_val = -1.f;
-	RadianceGlobe->GetMaterial( 0 )->GetScalarParameterValue( MatOpacityName, print_val );
-	print_color( FString::Printf( TEXT( "MatOpacity: %f" ), print_val ), DeltaSeconds, FColor::White );
-
-	print_val = -1.f;
-	RadianceGlobe->GetMaterial( 0 )->GetScalarParameterValue( EmissiveStrName, print_val );
-	print_color( FString::Printf( TEXT( "EmissiveStr: %f" ), print_val ), DeltaSeconds, FColor::White );
-	DrawDebugString( GetWorld(), 
-		(FVector(GetCapsuleComponent()->Bounds.Origin.X, GetCapsuleComponent()->Bounds.Origin.Y, GetCapsuleComponent()->Bounds.Origin.Z+50.f)- GetCapsuleComponent()->Bounds.Origin), 
-		FString::SanitizeFloat( GetLucidity() ), 
-		this, 
-		GetSun()->GetLightComponent()->GetLightColor().ToFColor(false), 
-		DeltaSeconds, 
-		false );
-		*/
-	//DebugPrintRadiance( DeltaSeconds, PlayerBounds.GetBox().GetCenter(), Radiance, Shadowing, Weight, SkyBent, GetLucidity() );
-
-}
-
-void AAlexandriaCharacter::PostInitializeComponents()
-{
-	Super::PostInitializeComponents();
-	if (RadianceMaterial == nullptr)
-	{
-		return;
-	}
-	RadianceMaterialInst = UMaterialInstanceDynamic::Create(RadianceMaterial, this, FName(TEXT("DynamicRadianceInst") ));
-	RadianceGlobe->SetMaterial( 0, RadianceMaterialInst );
-
-	if (HasInnerRadiance()) {
-		RadianceFire->ActivateSystem();
-	}
-	else {
-		RadianceFire->DeactivateSystem();
-	}
-}
-
-void AAlexandriaCharacter::BeginPlay()
-{
-	Super::BeginPlay();
-	if (Sun == nullptr)
-	{
-		TActorIterator<ADirectionalLight> DLightItr( GetWorld() );
-		if (DLightItr) {
-			Sun = *DLightItr;
-			ULightComponent *LightComp = GetSun()->GetLightComponent();
-			//const FVector LightPos( LightComp->GetLightPosition() );
-			const float Intensity = LightComp->ComputeLightBrightness();
-			BaseSunIntensity = Intensity;
-		}
-	}
-
-
-}
-
-ULocalPlayer* AAlexandriaCharacter::GetLocalPlayer() const
-{
-	ULocalPlayer* LocPlayer = nullptr;
-	if (GetController()->IsLocalPlayerController())
-	{
-		LocPlayer = Cast<APlayerController, AController>(GetController())->GetLocalPlayer();
-	}
-	return LocPlayer;
-}
-
-FSceneView* AAlexandriaCharacter::GetPlayerSceneView( ULocalPlayer* LocPlayer )
-{
-	if (LocPlayer != nullptr)
-	{
-		FSceneViewFamilyContext ViewFamily( FSceneViewFamily::ConstructionValues(
-			LocPlayer->ViewportClient->Viewport,
-			LocPlayer->GetWorld()->Scene,
-			LocPlayer->ViewportClient->EngineShowFlags ).SetRealtimeUpdate( true ) );
-		FVector ViewLocation;
-		FRotator ViewRotation;
-
-		return LocPlayer->CalcSceneView( &ViewFamily, ViewLocation, ViewRotation, LocPlayer->ViewportClient->Viewport );
-	}
-	return nullptr;
-}
-
-float AAlexandriaCharacter::CalcPlayerIncidentRadiance( const FBoxSphereBounds &Bounds, FSHVectorRGB3 &Radiance, float &Shadowing, float &Weight, FVector &SkyBent ) const
-{
-	if (!GetWorld()->AreAlwaysLoadedLevelsLoaded()) {
-		return 0.f;
-	}
-	const FLevelCollection* const ActiveLevels = GetWorld()->GetActiveLevelCollection();
-	if (ActiveLevels == nullptr)
-	{
-		return 0.f;
-	}
-	const FVector PollPoint = Bounds.GetBox().GetCenter();
-
-	FSHVectorRGB3 LocRadiance;
-	float LocWeight = 0.f;
-	float LocShadowing = 0.f;
-	float LocLuminance = 0.f;
-	FVector LocSkyBent = FVector::ZeroVector;	
-	
-	for (TSet<ULevel*>::TConstIterator LevelIter( ActiveLevels->GetLevels().CreateConstIterator() );
-		LevelIter; ++LevelIter)
-	{
-		ULevel* Level = *LevelIter;
-		if (Level != nullptr)
-		{
-			FPrecomputedLightVolume* PLV = Level->PrecomputedLightVolume;
-			if (PLV != nullptr)
-			{
-				PLV->InterpolateIncidentRadiancePoint( PollPoint, LocWeight, LocShadowing, LocRadiance, LocSkyBent );
-			}
-		}
-	}
-
-	if (LocWeight > SMALL_NUMBER )
-	{
-		const float InvWeight = 1.f / LocWeight;
-		LocRadiance *= InvWeight;
-		LocShadowing *= InvWeight;
-	}
-	else if (LocShadowing <= SMALL_NUMBER) {
-		return 0.0f;
-	}
-
-	Radiance += LocRadiance;
-	SkyBent += LocSkyBent;
-	Weight += LocWeight;
-	Shadowing += LocShadowing;
-	return Dot( LocRadiance, FSHVector3::AmbientFunction() ).GetLuminance();
-}
-
-
-
-float AAlexandriaCharacter::CalcDynamicLightRadiance( const int32 AvailableTraces ) const
-{
-	float Luminance = 0.f;
-	int32 TraceCount = 0;
-
-	for (TObjectIterator<UPointLightComponent> LightIter; LightIter; ++LightIter)
-	{
-		if (TraceCount >= AvailableTraces)
-		{
-			break;
-		}
-		UPointLightComponent *LightComp= *LightIter;
-		static const FName CompTag = FName( TEXT( "Lucidity" ) );
-		
-		if ((LightComp == nullptr) || (!LightComp->ComponentHasTag( CompTag )) || (LightComp->AffectsPrimitive( GetMesh() ) == false))
-		{
-			continue;
-		}
-
-		//Get Light info for calculating effect on player
-		const FVector LightPos = FVector( LightComp->GetLightPosition() );
-		const float DistanceToPlayer = FMath::Abs<float>( FVector::Dist( LightPos, GetActorLocation() ) );
-		const float BaseBrightness = LightComp->ComputeLightBrightness();
-		float Brightness = 0.f;
-		if (BaseBrightness > SMALL_NUMBER) {
-			const float AttenRadius = LightComp->AttenuationRadius;
-			if ((AttenRadius> SMALL_NUMBER) && (DistanceToPlayer<AttenRadius)) {
-				const float Scalar = (AttenRadius - DistanceToPlayer) / AttenRadius;
-				Brightness = BaseSunIntensity*Scalar;
-			}
-		}
-		Luminance += Brightness;
-		++TraceCount;
-		/*
-		print_color( FString::SanitizeFloat( DistanceToPlayer ), GetWorld()->GetDeltaSeconds(), FColor::Red );
-		print_color( FString::SanitizeFloat( LightComp->AttenuationRadius), GetWorld()->GetDeltaSeconds(), FColor::Red );
-		print_color( FString::SanitizeFloat( Brightness ), GetWorld()->GetDeltaSeconds(), FColor::Green );
-		print_color( FString::SanitizeFloat( GetLucidity() ), GetWorld()->GetDeltaSeconds(), FColor::Yellow);
-		print_color( FString::SanitizeFloat( BaseSunIntensity ), GetWorld()->GetDeltaSeconds(), FColor::Yellow );
-		print_color( LightComp->GetFName().ToString(), GetWorld()->GetDeltaSeconds(), FColor::White );
-		*/
-	}
-	if (TraceCount > 0)
-	{
-		Luminance/= (float)TraceCount;
-	}
-	return Luminance/BaseSunIntensity;
-
-}
-
-float AAlexandriaCharacter::GetSolarIllumination( const int32 AvailableTraces )
-{
-	if (GetSun() == nullptr) {
-		return 0.f;
-	}
-	
-	// return value
-	float Solarity = 0.f;
-	int32 TraceCount = 0;
-	//Get Light info for calculating effect on player
-
-	ULightComponent *LightComp = GetSun()->GetLightComponent();
-	const FVector LightPos( LightComp->GetLightPosition() );
-	const FLinearColor TempSunColor = (LightComp->bUseTemperature) ? FLinearColor::MakeFromColorTemperature( LightComp->Temperature ) : LightComp->GetLightColor();
-	const float Intensity = LightComp->ComputeLightBrightness();
-	SunIntensity = Intensity;
-	
-	RadianceColor = TempSunColor;
-	if (Intensity < SMALL_NUMBER ){
-		return 0.f;
-
-	}
-
-	// Get ray traces projected onto plane
-	FVector Plane( LightComp->GetDirection() );
-	if (!Plane.IsNormalized())
-	{
-		Plane.Normalize();
-	}
-	const FVector InvPlane( Plane*-1.f );
-	for (int32 i = 0; i < AvailableTraces; i++)
-	{
-		// Seed start position
-		FVector Start( LightPos );
-		FVector End( GetPollPoint() );
-		FVector EndVector( End - GetActorLocation() );
-
-		// Project End onto inverse plane
-		float cs = FVector::DotProduct( EndVector.GetSafeNormal(), InvPlane );
-		if (cs > SMALL_NUMBER)
-		{
-			End = End + InvPlane*(FVector::DotProduct( EndVector, InvPlane ) / cs);
-		}
-
-		float t = 0.f;
-		// Get the projected starting point on the plane from the End point
-		FVector EndStartVec( Start - End );
-		cs = FVector::DotProduct( EndStartVec.GetSafeNormal(), Plane );
-		if (cs > SMALL_NUMBER)
-		{
-			t = FVector::DotProduct( EndStartVec, Plane ) / cs;
-			Start = End + (InvPlane*t);
-		}
-
-		/*
-		t = 0.f;
-		FVector StartEndVec( End - Start );
-		cs = FVector::DotProduct( StartEndVec.GetSafeNormal(), InvPlane );
-		if (cs > SMALL_NUMBER)
-		{
-			t = (FVector::DotProduct( StartEndVec, InvPlane ) / cs)* 0.75f;
-			End = Start + (Plane*t);
-		}
-		*/
-
-
-		FVector HitLocation = FVector::ZeroVector;
-		FVector HitNormal = FVector::ForwardVector;
-		FHitResult Result = FHitResult( ForceInit );
-		FCollisionQueryParams CollQParms = FCollisionQueryParams::DefaultQueryParam;
-		CollQParms.bTraceComplex = true;
-		bool bHitPlayer = GetWorld()->LineTraceSingleByProfile( Result, Start, End, UCollisionProfile::BlockAll_ProfileName, CollQParms );
-		AActor *HitActor = Result.GetActor();
-		if ((HitActor == nullptr) || (HitActor == this))
-		{
-			Solarity += Intensity;
-			//DrawDebugLine( GetWorld(), Start, End, LightComp->GetLightColor().ToFColor( false ), false, GetWorld()->GetDeltaSeconds()*FMath::FRandRange( 1.f, 5.f ) );
-
-		}
-		else
-		{
-			//print_color( HitActor->GetFName().ToString(), GetWorld()->GetDeltaSeconds(), FColor::White );
-		}
-
-	}
-
-	if (AvailableTraces > 0)
-	{
-		Solarity /= (float)AvailableTraces;
-	}
-	return Solarity/BaseSunIntensity;
-}
-
-FVector AAlexandriaCharacter::GetPollPoint() const
-{
-	FVector PollPoint( GetActorLocation() );
-	PollPoint.X += FMath::FRandRange( -50.f, 50.f );
-	PollPoint.Y += FMath::FRandRange( -50.f, 50.f );
-	PollPoint.Z += FMath::FRandRange( -90.f, 100.f );
-
-	return PollPoint;
-}
-
-
+// Copyright 1998-2017 Epic Games, Inc. All Rights Reserved.
+
+#include "Alexandria.h"
+#include "Kismet/HeadMountedDisplayFunctionLibrary.h"
+#include "AlexandriaCharacter.h"
+#include "AlexandriaGameMode.h"
+#include "LucidLightRegistry.h"
+#include "LucidSunVisibilityVolume.h"
+#include "LucidityStats.h"
+#include "LucidityManager.h"
+#include "LucidLightingSnapshot.h"
+#include "LucidLevelData.h"
+#include "LucidFirePool.h"
+#include "LucidityRecorder.h"
+#include "LucidOccluders.h"
+#include "PrecomputedLightVolume.h"
+#include "Components/LightComponent.h"
+#include "Runtime/Engine/Classes/Engine/Engine.h"
+#include "Runtime/Engine/Classes/Engine/Light.h"
+#include "Runtime/Engine/Classes/Engine/DirectionalLight.h"
+#include "Runtime/Engine/Classes/Engine/PointLight.h"
+#include "Runtime/Engine/Public/SceneManagement.h"
+#include "Engine/LocalPlayer.h"
+#include "EngineUtils.h"
+#include "DrawDebugHelpers.h"
+#include "Engine/LevelBounds.h"
+#include "CollisionQueryParams.h"
+#include "Materials/MaterialInstanceDynamic.h"
+#include "ParticleHelper.h"
+#include "Particles/ParticleSystem.h"
+#include "Particles/ParticleSystemComponent.h"
+#include "UnrealNetwork.h"
+#include "Engine/StreamableManager.h"
+
+#define print_color(text, time, color) if (GEngine) GEngine->AddOnScreenDebugMessage(-1, time, color, text)
+#define print(text) if (GEngine) GEngine->AddOnScreenDebugMessage(-1, 1.5, FColor::White, text )
+
+namespace LucidProperty
+{
+	// Handles into LucidProperties, in the order RefreshLucidProperties packs them
+	enum Type
+	{
+		AirControl,
+		Acceleration,
+		MoveSpeed,
+		Gravity,
+		LateralAirFriction,
+		JumpZ,
+		SunlightIntensity,
+		SunlightTemperature,
+		MaterialOpacity,
+		EmissiveStrength,
+		Count
+	};
+}
+//////////////////////////////////////////////////////////////////////////
+// AAlexandriaCharacter
+
+const FName AAlexandriaCharacter::EmissiveStrName( TEXT( "EmissiveStrength" ) );
+const FName AAlexandriaCharacter::MatOpacityName( TEXT( "Opacity" ) );
+const FName AAlexandriaCharacter::SunTraceTag( TEXT( "LucidSunTrace" ) );
+
+const float FLucidityNetState::MaxTickLucidity = 2.f;
+
+namespace LucidAssets
+{
+	// Outlives every character, the preload started in PreLoadMap keeps its assets referenced here
+	static FStreamableManager& GetStreamable()
+	{
+		static FStreamableManager Streamable;
+		return Streamable;
+	}
+
+	// Startup timing, logged once per process so async and -LucidSyncAssets runs can be compared
+	static double FirstPlayableTime = 0.0;
+	static double CosmeticsReadyTime = 0.0;
+
+	static void LogStartupTiming()
+	{
+		if ((FirstPlayableTime > 0.0) && (CosmeticsReadyTime > 0.0))
+		{
+			UE_LOG( AlexandriaLog, Log, TEXT( "Lucidity startup (%s radiance assets): first playable frame %.3fs, cosmetics bound %.3fs after start" ),
+				FParse::Param( FCommandLine::Get(), TEXT( "LucidSyncAssets" ) ) ? TEXT( "synchronous" ) : TEXT( "streamed" ),
+				FirstPlayableTime - GStartTime, CosmeticsReadyTime - GStartTime );
+		}
+	}
+
+	static void RecordFirstPlayableFrame()
+	{
+		if (FirstPlayableTime == 0.0)
+		{
+			FirstPlayableTime = FPlatformTime::Seconds();
+			LogStartupTiming();
+		}
+	}
+
+	static void RecordCosmeticsReady()
+	{
+		if (CosmeticsReadyTime == 0.0)
+		{
+			CosmeticsReadyTime = FPlatformTime::Seconds();
+			LogStartupTiming();
+		}
+	}
+}
+
+namespace LucidityNet
+{
+	// Payload bits sent for NetLucidity, against an estimate for replicating the raw members
+	static uint64 QuantizedBits = 0;
+	static uint64 NaiveBits = 0;
+	static double MeasureStartTime = 0.0;
+
+	// The same state as float Lucidity and TickLucidity plus the inner radiance flag, against its quantized form
+	static const uint32 NaiveBitsPerUpdate = 32 + 32 + 1;
+	static const uint32 QuantizedBitsPerUpdate = 10 + 8 + 1;
+
+	static void ReportNetStats( const TArray<FString> &Args, UWorld* World )
+	{
+		if ((World == nullptr) || (World->GetNetMode() == NM_Client) || (World->GetNetMode() == NM_Standalone))
+		{
+			UE_LOG( AlexandriaLog, Warning, TEXT( "Lucidity.NetStats runs on a listen or dedicated server" ) );
+			return;
+		}
+
+		int32 NumCharacters = 0;
+		for (TActorIterator<AAlexandriaCharacter> It( World ); It; ++It)
+		{
+			++NumCharacters;
+		}
+
+		const double Now = FPlatformTime::Seconds();
+		const double Elapsed = (MeasureStartTime > 0.0) ? (Now - MeasureStartTime) : 0.0;
+		if ((Elapsed > 0.0) && (NumCharacters > 0))
+		{
+			const double Scale = 1.0 / (8.0*Elapsed*NumCharacters);
+			UE_LOG( AlexandriaLog, Display, TEXT( "Lucidity.NetStats: %d characters over %.1fs, quantized %.1f B/s per character, naive float %.1f B/s per character" ),
+				NumCharacters, Elapsed, QuantizedBits*Scale, NaiveBits*Scale );
+		}
+		else
+		{
+			UE_LOG( AlexandriaLog, Display, TEXT( "Lucidity.NetStats: measuring, run again to report" ) );
+		}
+		QuantizedBits = 0;
+		NaiveBits = 0;
+		MeasureStartTime = Now;
+	}
+
+	static FAutoConsoleCommandWithWorldAndArgs NetStatsCommand(
+		TEXT( "Lucidity.NetStats" ),
+		TEXT( "Reports replicated Lucidity bytes per second per character since the last call, quantized against naive float replication" ),
+		FConsoleCommandWithWorldAndArgsDelegate::CreateStatic( &ReportNetStats ) );
+}
+
+namespace LucidRadianceLod
+{
+	static void ReportRadianceLod( const TArray<FString> &Args, UWorld* World )
+	{
+		if (World == nullptr)
+		{
+			return;
+		}
+
+		FLucidRadianceLodCensus Census;
+		for (TActorIterator<AAlexandriaCharacter> It( World ); It; ++It)
+		{
+			It->AddToRadianceLodCensus( Census );
+		}
+		Census.Log( TEXT( "Lucidity.RadianceLod" ) );
+
+		const FLucidFirePool* Pool = FLucidFirePool::Get( World );
+		UE_LOG( AlexandriaLog, Display, TEXT( "Lucidity.RadianceLod fire pool: %d in use, %d free" ), Pool->NumInUse(), Pool->NumFree() );
+	}
+
+	static FAutoConsoleCommandWithWorldAndArgs RadianceLodCommand(
+		TEXT( "Lucidity.RadianceLod" ),
+		TEXT( "Reports how many lucid characters are at each radiance LOD and how many lights, shadow casters and fires they keep active" ),
+		FConsoleCommandWithWorldAndArgsDelegate::CreateStatic( &ReportRadianceLod ) );
+}
+
+void FLucidityNetState::Quantize( const float InLucidity, const float InTickLucidity, const bool bInInnerRadiance )
+{
+	Lucidity = (uint16)FMath::RoundToInt( FMath::Clamp( InLucidity, 0.f, 1.f )*(LucidityLevels - 1) );
+	TickLucidity = (uint8)FMath::RoundToInt( FMath::Clamp( InTickLucidity / MaxTickLucidity, 0.f, 1.f )*(TickLucidityLevels - 1) );
+	bInnerRadiance = bInInnerRadiance ? 1 : 0;
+}
+
+bool FLucidityNetState::NetSerialize( FArchive &Ar, class UPackageMap* Map, bool &bOutSuccess )
+{
+	uint32 Value = Lucidity;
+	Ar.SerializeInt( Value, LucidityLevels );
+	Lucidity = (uint16)Value;
+
+	Value = TickLucidity;
+	Ar.SerializeInt( Value, TickLucidityLevels );
+	TickLucidity = (uint8)Value;
+
+	uint8 Flag = bInnerRadiance;
+	Ar.SerializeBits( &Flag, 1 );
+	bInnerRadiance = Flag & 1;
+
+	// Counted per send, for both encodings, so the comparison is over the same updates and connections
+	if (Ar.IsSaving())
+	{
+		LucidityNet::QuantizedBits += LucidityNet::QuantizedBitsPerUpdate;
+		LucidityNet::NaiveBits += LucidityNet::NaiveBitsPerUpdate;
+	}
+	bOutSuccess = true;
+	return true;
+}
+
+AAlexandriaCharacter::AAlexandriaCharacter():
+	bInnerRadiance(false),
+	InnerRadianceDecayTime(4.f),
+	Lucidity(0.f),
+	SunIntensity(0.f),
+	AbsorbVelocity(1.5f), 
+	ConsumeVelocity(3.f),
+	TimeSinceLastUptick(0.f),
+	SunTraceLatency(ELucidTraceLatency::Synchronous),
+	bPendingSunKey(false),
+	AsyncSunVisibility(0.f),
+	bUseBakedSunVisibility(true),
+	MovableOccluderRange(2000.f),
+	bTemporalSunSampling(true),
+	SunRaysPerTick(2),
+	bReuseSunVisibility(true),
+	SunVisibilityCellSize(100.f),
+	SunVisibilityTolerance(25.f),
+	SunVisibilityAngleTolerance(1.f),
+	SunVisibilityIntensityTolerance(0.1f),
+	bUseIncidentRadiance(false),
+	IncidentRadianceScale(1.f),
+	IncidentRadianceCellSize(200.f),
+	IncidentRadianceTolerance(50.f),
+	MaxDynamicLights(4),
+	bTraceLightOcclusion(false),
+	LightVisibilityTolerance(25.f),
+	bQuantizeVisualFeedback(true),
+	VisualLucidityStep(1.f / 64.f),
+	RadianceShadowSignificance(0.6f),
+	RadianceLightSignificance(0.3f),
+	RadianceFireSignificance(0.1f),
+	RadianceLodHysteresis(0.05f),
+	FireIgniteLucidity(0.05f),
+	FireExtinguishLucidity(0.01f),
+	MatOpacityIndex(INDEX_NONE),
+	EmissiveStrIndex(INDEX_NONE),
+	LastVisualLucidity(-1.f),
+	RadianceLod(ELucidRadianceLod::Full),
+	NextRadianceLodTime(0.f),
+	bRadianceFireLit(false),
+	bDecoupledLucidityTick(true),
+	MinLucidityInterval(1.f / 30.f),
+	MaxLucidityInterval(0.5f),
+	SignificanceNearDistance(1000.f),
+	SignificanceFarDistance(8000.f),
+	SignificanceChangeRate(0.5f),
+	AppliedLucidity(0.f),
+	LucidityChangeRate(0.f),
+	LastLucidityUpdateTime(-1.f),
+	LucidityBlendFrom(0.f),
+	LucidityBlendTime(0.f),
+	LucidityBlendDuration(0.f),
+	bBatchedLucidity(false),
+	bRadianceAssetsBound(false),
+	MinNetLucidityInterval(0.1f),
+	MaxNetLucidityInterval(1.f),
+	NetLucidityTolerance(0.05f),
+	LastTickLucidity(0.f),
+	LastNetPublishTime(-1.f),
+	SunTraceGrant(MaxSunRaysPerUpdate),
+	SunlightTemperature( 1850.f, 5750.f )
+
+{
+	
+
+	// Capsule Component
+	{
+		
+		// Set size for collision capsule
+		SetRootComponent( GetCapsuleComponent() );
+		GetCapsuleComponent()->InitCapsuleSize( 42.f, 96.0f );
+		
+		//SetRootComponent( GetCapsuleComponent() );
+		PrimaryActorTick.bCanEverTick = true;
+
+		// Lucidity integrates on its own, slower tick, see TickLucidity
+		LucidityTick.bCanEverTick = true;
+		LucidityTick.bStartWithTickEnabled = true;
+		LucidityTick.TickGroup = TG_PrePhysics;
+		LucidityTick.TickInterval = 0.f;
+	}
+
+	// Radiance Setup. The light, fire and globe material are cosmetic and skipped where nothing is ever rendered,
+	// the globe itself always exists since other pawns and the world collide with it
+	bCosmeticLucidity = ShouldCreateCosmetics();
+	{
+		static const FName SMSocketName( TEXT( "BackSocket" ) );
+
+		// Setup Light
+		if (bCosmeticLucidity)
+		{
+			RadianceLight = CreateDefaultSubobject<UPointLightComponent>( TEXT( "RadianceLight" ) );
+			RadianceLight->SetupAttachment( GetMesh(), SMSocketName );
+		}
+
+		// Setup Globe
+		{
+			RadianceGlobe = CreateDefaultSubobject<UStaticMeshComponent>( TEXT( "RadianceGlobe" ) );
+			RadianceGlobeMesh = FStringAssetReference( TEXT( "/Game/Alexandria/Character/RadianceGlobeSphere.RadianceGlobeSphere" ) );
+			RadianceGlobe->bOwnerNoSee = false;
+			RadianceGlobe->bCastDynamicShadow = bCosmeticLucidity;
+			RadianceGlobe->CastShadow = bCosmeticLucidity;
+			RadianceGlobe->SetSimulatePhysics( false );
+			RadianceGlobe->BodyInstance.SetObjectType( ECollisionChannel::ECC_WorldDynamic );
+			RadianceGlobe->BodyInstance.SetCollisionEnabled( ECollisionEnabled::QueryOnly );
+			RadianceGlobe->BodyInstance.SetResponseToAllChannels( ECollisionResponse::ECR_Ignore );
+			RadianceGlobe->BodyInstance.SetResponseToChannel( ECollisionChannel::ECC_Pawn, ECollisionResponse::ECR_Block );
+			RadianceGlobe->BodyInstance.SetResponseToChannel( ECollisionChannel::ECC_WorldStatic, ECollisionResponse::ECR_Block );
+			RadianceGlobe->BodyInstance.SetResponseToChannel( ECollisionChannel::ECC_WorldDynamic, ECollisionResponse::ECR_Block );
+			RadianceGlobe->Mobility = EComponentMobility::Movable;
+			RadianceGlobe->SetHiddenInGame( !bCosmeticLucidity );
+			RadianceGlobe->SetVisibility( bCosmeticLucidity );
+			if (bCosmeticLucidity)
+			{
+				RadianceGlobe->SetupAttachment( RadianceLight );
+			}
+			else
+			{
+				// Same place the light would hold it
+				RadianceGlobe->SetupAttachment( GetMesh(), SMSocketName );
+			}
+			RadianceGlobe->bAutoRegister = true;
+		}
+
+		if (bCosmeticLucidity)
+		{
+			RadianceMaterial = FStringAssetReference( TEXT( "/Game/Alexandria/Character/RadianceGlobeMaterial.RadianceGlobeMaterial" ) );
+			// Setup Emitter, the component comes from FLucidFirePool while the fire burns
+			RadianceFireEmitter = FStringAssetReference( TEXT( "/Game/Alexandria/Particle/P_Fire.P_Fire" ) );
+		}
+	}
+
+	// FLucidMovement Base values
+	{
+		LucidAirControl.Base = 0.2f;
+		LucidGravity.Base = GetCharacterMovement()->GravityScale;
+		LucidMoveSpeed.Base = GetCharacterMovement()->MaxWalkSpeed;
+		LucidAcceleration.Base = GetCharacterMovement()->MaxAcceleration;
+		LucidLateralAirFriction.Base = GetCharacterMovement()->FallingLateralFriction;
+		LucidJumpZ.Base = 600.f;
+		SunlightIntensity.Base = 2500.f;
+		SunlightTemperature.Base = 1.f;
+
+		// Negative bases are read from the radiance material once it is loaded
+		MaterialOpacity.Base = -1.f;
+		EmissiveStrength.Base = -1.f;
+	}
+
+	
+	// Player Input/Controls
+	{
+		// set our turn rates for input
+		BaseTurnRate = 45.f;
+		BaseLookUpRate = 45.f;
+
+		// Don't rotate when the controller rotates. Let that just affect the camera.
+		bUseControllerRotationPitch = false;
+		bUseControllerRotationYaw = false;
+		bUseControllerRotationRoll = false;
+
+	}
+
+	// Player Movement
+	{
+		// Configure character movement
+		GetCharacterMovement()->bOrientRotationToMovement = true; // Character moves in the direction of input...	
+		GetCharacterMovement()->RotationRate = FRotator( 0.0f, 540.0f, 0.0f ); // ...at this rotation rate
+		GetCharacterMovement()->JumpZVelocity = LucidJumpZ.Base;
+		GetCharacterMovement()->AirControl = LucidAirControl.Base;
+		GetCharacterMovement()->BrakingDecelerationFalling = GetCharacterMovement()->BrakingDecelerationWalking / 2.f;
+		GetCharacterMovement()->bForceMaxAccel = false;
+	}
+
+	// Camera Setup
+	{
+		// Create a camera boom (pulls in towards the player if there is a collision)
+		CameraBoom = CreateDefaultSubobject<USpringArmComponent>( TEXT( "CameraBoom" ) );
+		CameraBoom->SetupAttachment( RootComponent );
+		CameraBoom->TargetArmLength = 300.0f; // The camera follows at this distance behind the character	
+		CameraBoom->bUsePawnControlRotation = true; // Rotate the arm based on the controller
+
+		// Create a follow camera
+		FollowCamera = CreateDefaultSubobject<UCameraComponent>( TEXT( "FollowCamera" ) );
+		FollowCamera->SetupAttachment( CameraBoom, USpringArmComponent::SocketName ); // Attach the camera to the end of the boom and let the boom adjust to match the controller orientation
+		FollowCamera->bUsePawnControlRotation = false; // Camera does not rotate relative to arm
+	}
+
+	SunColor = bCosmeticLucidity ? RadianceLight->GetLightColor() : FLinearColor::White;
+
+
+
+	// Note: The skeletal mesh and anim blueprint references on the Mesh component (inherited from Character) 
+	// are set in the derived blueprint asset named MyCharacter (to avoid direct content references in C++)
+}
+
+bool AAlexandriaCharacter::ShouldCreateCosmetics()
+{
+#if UE_SERVER
+	return false;
+#else
+	// The editor and cooker need the components on class defaults; -LucidCosmetics keeps them headless for comparison.
+	// Commandlets that measure the game, like the Lucidity benchmark, clear IsEditor so GIsEditor is false when they spawn
+	return GIsEditor || FApp::CanEverRender() || FParse::Param( FCommandLine::Get(), TEXT( "LucidCosmetics" ) );
+#endif
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Input
+
+void AAlexandriaCharacter::SetupPlayerInputComponent(class UInputComponent* PlayerInputComponent)
+{
+	
+	// Set up gameplay key bindings
+	check(PlayerInputComponent);
+	PlayerInputComponent->BindAction("Jump", IE_Pressed, this, &ACharacter::Jump);
+	PlayerInputComponent->BindAction("Jump", IE_Released, this, &ACharacter::StopJumping);
+
+	PlayerInputComponent->BindAxis("MoveForward", this, &AAlexandriaCharacter::MoveForward);
+	PlayerInputComponent->BindAxis("MoveRight", this, &AAlexandriaCharacter::MoveRight);
+
+	// We have 2 versions of the rotation bindings to handle different kinds of devices differently
+	// "turn" handles devices that provide an absolute delta, such as a mouse.
+	// "turnrate" is for devices that we choose to treat as a rate of change, such as an analog joystick
+	PlayerInputComponent->BindAxis("Turn", this, &APawn::AddControllerYawInput);
+	PlayerInputComponent->BindAxis("TurnRate", this, &AAlexandriaCharacter::TurnAtRate);
+	PlayerInputComponent->BindAxis("LookUp", this, &APawn::AddControllerPitchInput);
+	PlayerInputComponent->BindAxis("LookUpRate", this, &AAlexandriaCharacter::LookUpAtRate);
+
+	// handle touch devices
+	PlayerInputComponent->BindTouch(IE_Pressed, this, &AAlexandriaCharacter::TouchStarted);
+	PlayerInputComponent->BindTouch(IE_Released, this, &AAlexandriaCharacter::TouchStopped);
+
+	// VR headset functionality
+	PlayerInputComponent->BindAction("ResetVR", IE_Pressed, this, &AAlexandriaCharacter::OnResetVR);
+}
+
+float AAlexandriaCharacter::CalcLucidity( const float DeltaSeconds )
+{
+	SCOPE_CYCLE_COUNTER( STAT_LucidCalcLucidity );
+	LUCIDITY_PHASE_SCOPE( CalcLucidity );
+	if (Role == ROLE_SimulatedProxy)
+	{
+		return ExtrapolateLucidity( DeltaSeconds );
+	}
+
+	const float IncidentLuminance = CalcIncidentLuminance();
+
+	// Get Lucidity from Light Levels affecting player
+	const float TickLucidity = (GetSolarIllumination( SunTraceGrant ) + CalcDynamicLightRadiance() + IncidentLuminance);
+	return IntegrateLucidity( TickLucidity, DeltaSeconds );
+}
+
+float AAlexandriaCharacter::CalcIncidentLuminance()
+{
+	if (!bUseIncidentRadiance)
+	{
+		return 0.f;
+	}
+	// Data to be collected
+	FSHVectorRGB3 Radiance;
+	float Shadowing = 0.f;
+	float Weight = 0.f;
+	FVector SkyBent = FVector::ZeroVector;
+	const FBoxSphereBounds PlayerBounds( GetCapsuleComponent()->Bounds );
+	const float Luminance = IncidentRadianceScale*CalcPlayerIncidentRadiance( PlayerBounds, Radiance, Shadowing, Weight, SkyBent );
+	if (FLucidityRecorder::IsRecording())
+	{
+		FLucidityRecorder::RecordIncidentLuminance( this, Luminance );
+	}
+	return Luminance;
+}
+
+float AAlexandriaCharacter::IntegrateLucidity( const float TickLucidity, const float DeltaSeconds )
+{
+	LastTickLucidity = TickLucidity;
+	const float MaxDeltaLucidity = SunIntensity*DeltaSeconds / BaseSunIntensity;
+	return LucidIntegration::Step( GetLucidity(), TickLucidity, MaxDeltaLucidity, AbsorbVelocity, ConsumeVelocity, InnerRadianceDecayTime, HasInnerRadiance(), TimeSinceLastUptick );
+}
+
+void AAlexandriaCharacter::UpdateMovementParams( const float DeltaSeconds )
+{
+	SCOPE_CYCLE_COUNTER( STAT_LucidMovementParams );
+	LUCIDITY_PHASE_SCOPE( MovementParams );
+	UCharacterMovementComponent *Mvmt = GetCharacterMovement();
+	// Apply Scalar
+	LucidProperties.Evaluate( AppliedLucidity );
+	Mvmt->AirControl = LucidProperties.Get( LucidProperty::AirControl );
+	Mvmt->MaxAcceleration = LucidProperties.Get( LucidProperty::Acceleration );
+	Mvmt->MaxWalkSpeed = LucidProperties.Get( LucidProperty::MoveSpeed );
+	Mvmt->GravityScale = LucidProperties.Get( LucidProperty::Gravity );
+	Mvmt->FallingLateralFriction = LucidProperties.Get( LucidProperty::LateralAirFriction );
+	Mvmt->JumpZVelocity = LucidProperties.Get( LucidProperty::JumpZ );
+
+	// Apply Inv Scalar
+	
+
+	// Debug Prints
+	/*
+	print_color( FString::Printf( TEXT( "MaxWalkSpeed:    %f" ), Mvmt->MaxWalkSpeed ), DeltaSeconds, FColor::White );
+	print_color( FString::Printf( TEXT( "MaxAccelaration: %f" ), Mvmt->MaxAcceleration ), DeltaSeconds, FColor::White );
+	print_color( FString::Printf( TEXT( "JumpZVelocity:   %f" ), Mvmt->JumpZVelocity ), DeltaSeconds, FColor::White );
+	print_color( FString::Printf( TEXT( "GravityScale:    %f" ), Mvmt->GravityScale ), DeltaSeconds, FColor::White );
+	print_color( FString::Printf( TEXT( "AirControl:      %f" ), Mvmt->AirControl ), DeltaSeconds, FColor::White );
+	*/
+
+}
+
+void AAlexandriaCharacter::UpdateVisualFeedback( const float DeltaSeconds )
+{
+	SCOPE_CYCLE_COUNTER( STAT_LucidVisualFeedback );
+	LUCIDITY_PHASE_SCOPE( VisualFeedback );
+	// Light intensity, temperature, two material scalars, emissive and diffuse boost
+	static const int32 PushesPerUpdate = 6;
+	static const int32 MaterialPushesPerUpdate = 4;
+
+	if (!bQuantizeVisualFeedback || (RadianceMaterialInst == nullptr))
+	{
+		LucidProperties.Evaluate( AppliedLucidity );
+		GetRadianceLight()->SetIntensity( LucidProperties.Get( LucidProperty::SunlightIntensity ) );
+		//GetRadianceLight()->SetLightColor( SunColor*Lucidity );
+		GetRadianceLight()->SetTemperature( LucidProperties.Get( LucidProperty::SunlightTemperature ) );
+		RadianceGlobe->SetScalarParameterValueOnMaterials( MatOpacityName, LucidProperties.Get( LucidProperty::MaterialOpacity ) );
+		RadianceGlobe->SetScalarParameterValueOnMaterials( EmissiveStrName, LucidProperties.Get( LucidProperty::EmissiveStrength ) );
+		RadianceGlobe->GetMaterial( 0 )->SetEmissiveBoost( AppliedLucidity );
+		RadianceGlobe->GetMaterial( 0 )->SetDiffuseBoost( AppliedLucidity );
+		INC_DWORD_STAT_BY( STAT_LucidRenderStateUpdates, PushesPerUpdate );
+		INC_DWORD_STAT_BY( STAT_LucidMaterialPushes, MaterialPushesPerUpdate );
+		UpdateRadianceFire( AppliedLucidity, true );
+		return;
+	}
+
+	// Only push render state when the quantized value moves
+	const float Step = FMath::Max( VisualLucidityStep, KINDA_SMALL_NUMBER );
+	const float VisualLucidity = FMath::Clamp( FMath::RoundToFloat( AppliedLucidity / Step )*Step, 0.f, 1.f );
+	const bool bChanged = (VisualLucidity != LastVisualLucidity);
+	if (bChanged)
+	{
+		LastVisualLucidity = VisualLucidity;
+		LucidProperties.Evaluate( VisualLucidity );
+		GetRadianceLight()->SetIntensity( LucidProperties.Get( LucidProperty::SunlightIntensity ) );
+		GetRadianceLight()->SetTemperature( LucidProperties.Get( LucidProperty::SunlightTemperature ) );
+		RadianceMaterialInst->SetScalarParameterByIndex( MatOpacityIndex, LucidProperties.Get( LucidProperty::MaterialOpacity ) );
+		RadianceMaterialInst->SetScalarParameterByIndex( EmissiveStrIndex, LucidProperties.Get( LucidProperty::EmissiveStrength ) );
+		RadianceMaterialInst->SetEmissiveBoost( VisualLucidity );
+		RadianceMaterialInst->SetDiffuseBoost( VisualLucidity );
+		INC_DWORD_STAT_BY( STAT_LucidRenderStateUpdates, PushesPerUpdate );
+		INC_DWORD_STAT_BY( STAT_LucidMaterialPushes, MaterialPushesPerUpdate );
+	}
+	else
+	{
+		INC_DWORD_STAT_BY( STAT_LucidRenderStateSkips, PushesPerUpdate );
+	}
+	UpdateRadianceFire( VisualLucidity, bChanged );
+}
+
+void AAlexandriaCharacter::UpdateRadianceFire( const float VisualLucidity, const bool bScaleChanged )
+{
+	// Separate ignite and extinguish levels, so Lucidity hovering near zero cannot flicker the fire
+	bRadianceFireLit = HasInnerRadiance() && LucidRadianceLod::ShouldBurn( GetRadianceLodSettings(), VisualLucidity, bRadianceFireLit );
+	UParticleSystem* Template = bRadianceFireLit ? GetRadianceFireTemplate() : nullptr;
+	if (Template == nullptr)
+	{
+		ReleaseRadianceFire();
+		return;
+	}
+
+	bool bRescale = bScaleChanged;
+	if (RadianceFire == nullptr)
+	{
+		static const FName CenterSocket( TEXT( "Center" ) );
+		RadianceFire = FLucidFirePool::Get( GetWorld() )->Acquire( Template, RadianceGlobe, CenterSocket );
+		bRescale = true;
+	}
+	else if (RadianceFire->Template != Template)
+	{
+		RadianceFire->SetTemplate( Template );
+	}
+	if (!RadianceFire->IsActive())
+	{
+		RadianceFire->ActivateSystem( false );
+	}
+
+	if (bRescale) {
+		RadianceFire->SetRelativeScale3D( FVector( VisualLucidity ) );
+		INC_DWORD_STAT( STAT_LucidRenderStateUpdates );
+	}
+	else {
+		INC_DWORD_STAT( STAT_LucidRenderStateSkips );
+	}
+}
+
+FLucidRadianceLodSettings AAlexandriaCharacter::GetRadianceLodSettings() const
+{
+	FLucidRadianceLodSettings Settings;
+	Settings.ShadowSignificance = RadianceShadowSignificance;
+	Settings.LightSignificance = RadianceLightSignificance;
+	Settings.FireSignificance = RadianceFireSignificance;
+	Settings.Hysteresis = RadianceLodHysteresis;
+	Settings.IgniteLucidity = FireIgniteLucidity;
+	Settings.ExtinguishLucidity = FireExtinguishLucidity;
+	return Settings;
+}
+
+void AAlexandriaCharacter::UpdateRadianceLod()
+{
+	// Decided without components too, so headless runs report the LOD the game would pick
+	const float Now = GetWorld()->GetTimeSeconds();
+	if (Now < NextRadianceLodTime)
+	{
+		return;
+	}
+	NextRadianceLodTime = Now + LucidRadianceLod::UpdateInterval;
+
+	const ELucidRadianceLod NewLod = LucidRadianceLod::Select( GetRadianceLodSettings(), CalcViewSignificance(), RadianceLod );
+	if (NewLod != RadianceLod)
+	{
+		RadianceLod = NewLod;
+		INC_DWORD_STAT( STAT_LucidRadianceLodChanges );
+		if (bRadianceAssetsBound)
+		{
+			ApplyRadianceLod();
+		}
+	}
+}
+
+void AAlexandriaCharacter::ApplyRadianceLod()
+{
+	const bool bShadows = LucidRadianceLod::HasShadows( RadianceLod );
+	RadianceLight->SetVisibility( LucidRadianceLod::HasLight( RadianceLod ) );
+	RadianceLight->SetCastShadows( bShadows );
+	RadianceGlobe->SetCastShadow( bShadows );
+	UpdateRadianceFire( (LastVisualLucidity >= 0.f) ? LastVisualLucidity : AppliedLucidity, true );
+}
+
+UParticleSystem* AAlexandriaCharacter::GetRadianceFireTemplate() const
+{
+	if (!LucidRadianceLod::HasFire( RadianceLod ))
+	{
+		return nullptr;
+	}
+	// Without a cheap emitter the full one burns at every level that shows fire
+	if (LucidRadianceLod::HasFullFire( RadianceLod ) || RadianceFireEmitterLow.IsNull())
+	{
+		return RadianceFireEmitter.Get();
+	}
+	return RadianceFireEmitterLow.Get();
+}
+
+void AAlexandriaCharacter::ReleaseRadianceFire()
+{
+	if (RadianceFire != nullptr)
+	{
+		FLucidFirePool* Pool = FLucidFirePool::Get( GetWorld() );
+		if (Pool != nullptr)
+		{
+			Pool->Release( RadianceFire );
+		}
+		RadianceFire = nullptr;
+	}
+}
+
+void AAlexandriaCharacter::AddToRadianceLodCensus( FLucidRadianceLodCensus &Census ) const
+{
+	const bool bLight = (RadianceLight != nullptr) && RadianceLight->IsVisible();
+	Census.Add( RadianceLod, bLight, bLight && RadianceLight->CastShadows, (RadianceFire != nullptr) && RadianceFire->IsActive() );
+}
+
+
+void AAlexandriaCharacter::OnResetVR()
+{
+	UHeadMountedDisplayFunctionLibrary::ResetOrientationAndPosition();
+}
+
+void AAlexandriaCharacter::TouchStarted(ETouchIndex::Type FingerIndex, FVector Location)
+{
+		Jump();
+}
+
+void AAlexandriaCharacter::TouchStopped(ETouchIndex::Type FingerIndex, FVector Location)
+{
+		StopJumping();
+}
+
+void AAlexandriaCharacter::TurnAtRate(float Rate)
+{
+	// calculate delta for this frame from the rate information
+	AddControllerYawInput(Rate * BaseTurnRate * GetWorld()->GetDeltaSeconds());
+}
+
+void AAlexandriaCharacter::LookUpAtRate(float Rate)
+{
+	// calculate delta for this frame from the rate information
+	AddControllerPitchInput(Rate * BaseLookUpRate * GetWorld()->GetDeltaSeconds());
+}
+
+void AAlexandriaCharacter::MoveForward(float Value)
+{
+	if ((Controller != nullptr) && (Value != 0.0f))
+	{
+		// find out which way is forward
+		const FRotator Rotation = Controller->GetControlRotation();
+		const FRotator YawRotation(0, Rotation.Yaw, 0);
+
+		// get forward vector
+		const FVector Direction = FRotationMatrix(YawRotation).GetUnitAxis(EAxis::X);
+		AddMovementInput(Direction, Value);
+	}
+}
+
+void AAlexandriaCharacter::MoveRight(float Value)
+{
+	if ( (Controller != nullptr) && (Value != 0.0f) )
+	{
+		// find out which way is right
+		const FRotator Rotation = Controller->GetControlRotation();
+		const FRotator YawRotation(0, Rotation.Yaw, 0);
+	
+		// get right vector 
+		const FVector Direction = FRotationMatrix(YawRotation).GetUnitAxis(EAxis::Y);
+		// add movement in that direction
+		AddMovementInput(Direction, Value);
+	}
+}
+void AAlexandriaCharacter::DebugPrintRadiance( const float DrawTime, const FVector PollPoint, const FSHVectorRGB3 &Radiance, const float Shadowing, const float Weight, const FVector &SkyBent, const float Luminance ) const
+{
+	if (GEngine) {
+		FLinearColor IntegralRadiance = Radiance.CalcIntegral();
+		const FColor TextColor = IntegralRadiance.ToFColor( true );
+		GEngine->AddOnScreenDebugMessage( INDEX_NONE,
+			DrawTime,
+			FColor::White,
+			FString::Printf( TEXT( "Poll Point: %s" ), *PollPoint.ToString() ) );
+
+		const FString LuminanceMsg = FString::Printf( TEXT( "Luminance: %f" ), Luminance );
+		GEngine->AddOnScreenDebugMessage( INDEX_NONE,
+			DrawTime,
+			TextColor,
+			LuminanceMsg );
+
+		GEngine->AddOnScreenDebugMessage( INDEX_NONE,
+			DrawTime,
+			TextColor,
+			FString::Printf( TEXT( "IntegralRadiance: %s" ), *IntegralRadiance.ToString() ) );
+
+		GEngine->AddOnScreenDebugMessage( INDEX_NONE,
+			DrawTime,
+			FColor::White,
+			FString::Printf( TEXT( "Shadowing: %f" ), Shadowing ) );
+
+		GEngine->AddOnScreenDebugMessage( INDEX_NONE,
+			DrawTime,
+			FColor::White,
+			FString::Printf( TEXT( "Weight: %f" ), Weight ) );
+
+		GEngine->AddOnScreenDebugMessage( INDEX_NONE,
+			DrawTime,
+			FColor::White,
+			FString::Printf( TEXT( "SkyBent: %s" ), *SkyBent.ToString() ) );
+	}
+}
+
+void AAlexandriaCharacter::Tick( float DeltaSeconds )
+{
+	Super::Tick( DeltaSeconds );
+
+	if (bDecoupledLucidityTick)
+	{
+		// Lucidity itself is integrated by LucidityTick, blend the applied value towards it
+		LucidityBlendTime += DeltaSeconds;
+		const float Alpha = (LucidityBlendDuration > SMALL_NUMBER) ? FMath::Min( LucidityBlendTime / LucidityBlendDuration, 1.f ) : 1.f;
+		AppliedLucidity = FMath::Lerp( LucidityBlendFrom, Lucidity, Alpha );
+	}
+	else
+	{
+		// Same trace grants and sun trace setup as LucidityTick. A deferred frame keeps its Lucidity,
+		// the next granted one integrates the whole gap
+		const float Now = GetWorld()->GetTimeSeconds();
+		if (AcquireLucidityTraces( Now, false ))
+		{
+			const float Elapsed = BeginLucidityUpdate( Now, DeltaSeconds );
+			if (Elapsed > 0.f)
+			{
+				FinishLucidityUpdate( CalcLucidity( Elapsed ), Elapsed );
+			}
+		}
+		AppliedLucidity = Lucidity;
+	}
+
+	UpdateRadianceLod();
+	if (bRadianceAssetsBound)
+	{
+		UpdateVisualFeedback( DeltaSeconds );
+	}
+	if (IsLocallyControlled())
+	{
+		LucidAssets::RecordFirstPlayableFrame();
+	}
+	UpdateMovementParams( DeltaSeconds );
+
+	// Debug Prints
+	/*
+	float print_val = -1.f;
+	RadianceGlobe->GetMaterial( 0 )->GetScalarParameterValue( MatOpacityName, print_val );
+	print_color( FString::Printf( TEXT( "MatOpacity: %f" ), print_val ), DeltaSeconds, FColor::White );
+
+	print_val = -1.f;
+	RadianceGlobe->GetMaterial( 0 )->GetScalarParameterValue( EmissiveStrName, print_val );
+	print_color( FString::Printf( TEXT( "EmissiveStr: %f" ), print_val ), DeltaSeconds, FColor::White );
+	DrawDebugString( GetWorld(), 
+		(FVector(GetCapsuleComponent()->Bounds.Origin.X, GetCapsuleComponent()->Bounds.Origin.Y, GetCapsuleComponent()->Bounds.Origin.Z+50.f)- GetCapsuleComponent()->Bounds.Origin), 
+		FString::SanitizeFloat( GetLucidity() ), 
+		this, 
+		GetSun()->GetLightComponent()->GetLightColor().ToFColor(false), 
+		DeltaSeconds, 
+		false );
+		*/
+	//DebugPrintRadiance( DeltaSeconds, PlayerBounds.GetBox().GetCenter(), Radiance, Shadowing, Weight, SkyBent, GetLucidity() );
+
+}
+
+void AAlexandriaCharacter::PostInitializeComponents()
+{
+	Super::PostInitializeComponents();
+	// Without cosmetics only the globe's mesh is loaded, for its collision
+	if (!IsTemplate())
+	{
+		LoadRadianceAssets();
+	}
+}
+
+void AAlexandriaCharacter::LoadRadianceAssets()
+{
+	TArray<FStringAssetReference> Pending;
+	if (RadianceGlobeMesh.IsPending())
+	{
+		Pending.Add( RadianceGlobeMesh.ToStringReference() );
+	}
+	if (bCosmeticLucidity)
+	{
+		if (RadianceMaterial.IsPending())
+		{
+			Pending.Add( RadianceMaterial.ToStringReference() );
+		}
+		if (RadianceFireEmitter.IsPending())
+		{
+			Pending.Add( RadianceFireEmitter.ToStringReference() );
+		}
+		if (RadianceFireEmitterLow.IsPending())
+		{
+			Pending.Add( RadianceFireEmitterLow.ToStringReference() );
+		}
+	}
+
+	// Editor previews have no frame to wait for, and -LucidSyncAssets restores the blocking load for comparison
+	const bool bSynchronous = !GetWorld()->IsGameWorld() || FParse::Param( FCommandLine::Get(), TEXT( "LucidSyncAssets" ) );
+	if ((Pending.Num() == 0) || bSynchronous)
+	{
+		for (const FStringAssetReference &Asset : Pending)
+		{
+			Asset.TryLoad();
+		}
+		BindRadianceAssets();
+		return;
+	}
+	LucidAssets::GetStreamable().RequestAsyncLoad( Pending, FStreamableDelegate::CreateUObject( this, &AAlexandriaCharacter::BindRadianceAssets ) );
+}
+
+void AAlexandriaCharacter::PreloadRadianceAssets( const FString &MapName )
+{
+	if (GIsEditor)
+	{
+		return;
+	}
+
+	const AAlexandriaCharacter* Defaults = GetDefault<AAlexandriaCharacter>();
+	TArray<FStringAssetReference> Assets;
+	Assets.Add( Defaults->RadianceGlobeMesh.ToStringReference() );
+	if (ShouldCreateCosmetics())
+	{
+		Assets.Add( Defaults->RadianceMaterial.ToStringReference() );
+		Assets.Add( Defaults->RadianceFireEmitter.ToStringReference() );
+		if (!Defaults->RadianceFireEmitterLow.IsNull())
+		{
+			Assets.Add( Defaults->RadianceFireEmitterLow.ToStringReference() );
+		}
+	}
+	LucidAssets::GetStreamable().RequestAsyncLoad( Assets, FStreamableDelegate() );
+}
+
+void AAlexandriaCharacter::BindRadianceAssets()
+{
+	if (IsPendingKill() || bRadianceAssetsBound)
+	{
+		return;
+	}
+
+	UStaticMesh* GlobeMesh = RadianceGlobeMesh.Get();
+	if (GlobeMesh != nullptr)
+	{
+		RadianceGlobe->SetStaticMesh( GlobeMesh );
+	}
+	if (!bCosmeticLucidity)
+	{
+		return;
+	}
+	bRadianceAssetsBound = true;
+	LucidAssets::RecordCosmeticsReady();
+
+	UMaterial* Material = RadianceMaterial.Get();
+	if (Material == nullptr)
+	{
+		return;
+	}
+	if (MaterialOpacity.Base < 0.f)
+	{
+		Material->GetScalarParameterValue( MatOpacityName, MaterialOpacity.Base );
+	}
+	if (EmissiveStrength.Base < 0.f)
+	{
+		Material->GetScalarParameterValue( EmissiveStrName, EmissiveStrength.Base );
+	}
+	RefreshLucidProperties();
+
+	RadianceMaterialInst = UMaterialInstanceDynamic::Create(Material, this, FName(TEXT("DynamicRadianceInst") ));
+	RadianceGlobe->SetMaterial( 0, RadianceMaterialInst );
+
+	// Resolve the parameter slots once so quantized updates write straight to them
+	RadianceMaterialInst->InitializeScalarParameterAndGetIndex( MatOpacityName, MaterialOpacity.Base, MatOpacityIndex );
+	RadianceMaterialInst->InitializeScalarParameterAndGetIndex( EmissiveStrName, EmissiveStrength.Base, EmissiveStrIndex );
+	LastVisualLucidity = -1.f;
+
+	ApplyRadianceLod();
+}
+
+void AAlexandriaCharacter::BeginPlay()
+{
+	Super::BeginPlay();
+	// Without an assigned sun, follow the brightest directional light
+	const FLucidLightingFrameRef Lighting = GetLightingFrame();
+	if (Sun == nullptr)
+	{
+		Sun = Lighting->GetPrimarySun();
+	}
+	const FLucidSunState &SunState = Lighting->FindSun( GetSun() );
+	if (SunState.bValid)
+	{
+		BaseSunIntensity = SunState.Intensity;
+	}
+
+	SunTraceGeneration = 0;
+	UpdateSunTraceSetup();
+
+	MovableOccluderParams = FCollisionObjectQueryParams();
+	MovableOccluderParams.AddObjectTypesToQuery( ECC_WorldDynamic );
+	MovableOccluderParams.AddObjectTypesToQuery( ECC_PhysicsBody );
+	MovableOccluderParams.AddObjectTypesToQuery( ECC_Pawn );
+	PendingSunTraces.Reset();
+	bSunRaysOnBvh = false;
+	bMovableOccludersNearSun = false;
+	SunVisibilityCache = FLucidSunVisibilityCache();
+	PendingSunRays.Reset();
+	bPendingSunKey = false;
+	AsyncSunVisibility = 0.f;
+	ExposureSampler.Reset();
+	LightVisibility.Reset();
+	RefreshLucidProperties();
+
+	// Spread LOD decisions of characters spawned together over frames
+	NextRadianceLodTime = GetWorld()->GetTimeSeconds() + FMath::FRand()*LucidRadianceLod::UpdateInterval;
+
+	// Many lucid characters update together, see FLucidityManager
+	if (bDecoupledLucidityTick && (Role != ROLE_SimulatedProxy) && FLucidityManager::IsBatchingEnabled())
+	{
+		LucidityTick.SetTickFunctionEnable( false );
+		FLucidityManager::Get( GetWorld() )->AddAgent( this );
+		bBatchedLucidity = true;
+	}
+}
+
+void AAlexandriaCharacter::RefreshLucidProperties()
+{
+	BuildLucidPropertyTable( LucidProperties );
+
+	// Pushed values were computed from the old table
+	LastVisualLucidity = -1.f;
+}
+
+void AAlexandriaCharacter::BuildLucidPropertyTable( FLucidPropertyTable &Table ) const
+{
+	const FLucidMoveProperty* Properties[LucidProperty::Count];
+	Properties[LucidProperty::AirControl] = &LucidAirControl;
+	Properties[LucidProperty::Acceleration] = &LucidAcceleration;
+	Properties[LucidProperty::MoveSpeed] = &LucidMoveSpeed;
+	Properties[LucidProperty::Gravity] = &LucidGravity;
+	Properties[LucidProperty::LateralAirFriction] = &LucidLateralAirFriction;
+	Properties[LucidProperty::JumpZ] = &LucidJumpZ;
+	Properties[LucidProperty::SunlightIntensity] = &SunlightIntensity;
+	Properties[LucidProperty::SunlightTemperature] = &SunlightTemperature;
+	Properties[LucidProperty::MaterialOpacity] = &MaterialOpacity;
+	Properties[LucidProperty::EmissiveStrength] = &EmissiveStrength;
+	Table.Build( Properties, LucidProperty::Count );
+}
+
+void AAlexandriaCharacter::GetLifetimeReplicatedProps( TArray<FLifetimeProperty> &OutLifetimeProps ) const
+{
+	Super::GetLifetimeReplicatedProps( OutLifetimeProps );
+	DOREPLIFETIME( AAlexandriaCharacter, NetLucidity );
+}
+
+void AAlexandriaCharacter::PublishNetLucidity( const float Significance )
+{
+	if ((Role != ROLE_Authority) || (GetNetMode() == NM_Standalone))
+	{
+		return;
+	}
+
+	FLucidityNetState State;
+	State.Quantize( Lucidity, LastTickLucidity, HasInnerRadiance() );
+	if (State == NetLucidity)
+	{
+		return;
+	}
+
+	// Replicated only when the quantized state moves, and no more often than significance allows
+	const float Now = GetWorld()->GetTimeSeconds();
+	const float Interval = FMath::Lerp( MaxNetLucidityInterval, MinNetLucidityInterval, Significance );
+	const bool bInnerRadianceChanged = (State.bInnerRadiance != NetLucidity.bInnerRadiance);
+	if (!bInnerRadianceChanged && (LastNetPublishTime >= 0.f) && ((Now - LastNetPublishTime) < Interval))
+	{
+		return;
+	}
+	NetLucidity = State;
+	LastNetPublishTime = Now;
+}
+
+void AAlexandriaCharacter::OnRep_NetLucidity()
+{
+	bInnerRadiance = (NetLucidity.bInnerRadiance != 0);
+	const float ServerLucidity = NetLucidity.GetLucidity();
+	if (Role == ROLE_SimulatedProxy)
+	{
+		// Extrapolation restarts from the server's state. TimeSinceLastUptick is not sent: nothing advances it,
+		// it only ever resets on a rise, so the proxy's own copy already matches
+		Lucidity = ServerLucidity;
+	}
+	else if (FMath::Abs( ServerLucidity - Lucidity ) > NetLucidityTolerance)
+	{
+		// The owning client predicts from its own traces and is only corrected when it drifts
+		Lucidity = ServerLucidity;
+	}
+}
+
+float AAlexandriaCharacter::ExtrapolateLucidity( const float DeltaSeconds )
+{
+	if (GetSun() != nullptr)
+	{
+		ApplySunState( GetLightingFrame()->FindSun( GetSun() ) );
+	}
+	return IntegrateLucidity( NetLucidity.GetTickLucidity(), DeltaSeconds );
+}
+
+void AAlexandriaCharacter::EndPlay( const EEndPlayReason::Type EndPlayReason )
+{
+	ReleaseRadianceFire();
+	if (bBatchedLucidity)
+	{
+		FLucidityManager* Manager = FLucidityManager::Find( GetWorld() );
+		if (Manager != nullptr)
+		{
+			Manager->RemoveAgent( this );
+		}
+		bBatchedLucidity = false;
+	}
+	Super::EndPlay( EndPlayReason );
+}
+
+void AAlexandriaCharacter::RegisterActorTickFunctions( bool bRegister )
+{
+	Super::RegisterActorTickFunctions( bRegister );
+
+	if (bRegister)
+	{
+		if (bDecoupledLucidityTick && LucidityTick.bCanEverTick)
+		{
+			LucidityTick.Target = this;
+			LucidityTick.SetTickFunctionEnable( true );
+			LucidityTick.RegisterTickFunction( GetLevel() );
+			// Let the actor tick blend towards a value integrated this frame
+			PrimaryActorTick.AddPrerequisite( this, LucidityTick );
+		}
+	}
+	else if (LucidityTick.IsTickFunctionRegistered())
+	{
+		LucidityTick.UnRegisterTickFunction();
+	}
+}
+
+void AAlexandriaCharacter::TickLucidity( float DeltaSeconds )
+{
+	UpdateLucidity( GetWorld()->GetTimeSeconds(), DeltaSeconds );
+}
+
+void AAlexandriaCharacter::UpdateLucidity( const float Now, const float DeltaSeconds, const bool bForce )
+{
+	if (!AcquireLucidityTraces( Now, bForce ))
+	{
+		// Try again next frame rather than a whole interval later
+		LucidityTick.TickInterval = 0.f;
+		return;
+	}
+
+	const float Elapsed = BeginLucidityUpdate( Now, DeltaSeconds );
+	if (Elapsed <= 0.f)
+	{
+		return;
+	}
+	FinishLucidityUpdate( CalcLucidity( Elapsed ), Elapsed );
+}
+
+bool AAlexandriaCharacter::IsLucidityDue( const float Now ) const
+{
+	return (LastLucidityUpdateTime < 0.f) || ((Now - LastLucidityUpdateTime) >= LucidityTick.TickInterval);
+}
+
+bool AAlexandriaCharacter::AcquireLucidityTraces( const float Now, const bool bForce )
+{
+	// Proxies extrapolate the server's value and trace nothing
+	const bool bTraces = (Role != ROLE_SimulatedProxy);
+	bMovableOccludersNearSun = false;
+	const int32 SunWanted = (bTraces && (GetSun() != nullptr) && NeedsSunRays()) ? GetSunRaysWanted() : 0;
+
+	int32 Granted = SunWanted;
+	FLucidityManager* Manager = (!bForce && (Granted > 0)) ? FLucidityManager::Get( GetWorld() ) : nullptr;
+	if (Manager != nullptr)
+	{
+		// Overdue characters climb the ranking, so deferred updates are never starved
+		const float Staleness = (LastLucidityUpdateTime >= 0.f) ? (Now - LastLucidityUpdateTime) / FMath::Max( MaxLucidityInterval, SMALL_NUMBER ) : 1.f;
+		Granted = Manager->GetTraceScheduler().Acquire( FLucidTraceScheduler::CalcPriority( CalcLuciditySignificance(), Staleness ), Granted );
+		if (Granted == 0)
+		{
+			return false;
+		}
+	}
+
+	// Light occlusion rays are drawn per light from their own per frame cap, see GetLightVisibility
+	SunTraceGrant = Granted;
+	return true;
+}
+
+int32 AAlexandriaCharacter::GetSunRaysWanted() const
+{
+	return bTemporalSunSampling ? FMath::Min( SunRaysPerTick, MaxSunRaysPerUpdate ) : MaxSunRaysPerUpdate;
+}
+
+bool AAlexandriaCharacter::NeedsSunRays()
+{
+	const FLucidLightingFrameRef Lighting = GetLightingFrame();
+	const FLucidSunState &SunState = Lighting->FindSun( GetSun() );
+	if (!SunState.bValid || (SunState.Intensity < SMALL_NUMBER))
+	{
+		return false;
+	}
+
+	// Cache keys carry the occluder generation, which the update would otherwise only pick up after this
+	UpdateSunTraceSetup();
+	bMovableOccludersNearSun = HasMovableOccluders( SunState.Direction );
+	return bMovableOccludersNearSun || (!CanSampleBakedSunVisibility( SunState.Direction ) && !IsSunVisibilityReusable( SunState ));
+}
+
+float AAlexandriaCharacter::BeginLucidityUpdate( const float Now, const float DeltaSeconds )
+{
+	// The update interval changes with significance, so measure the real step
+	const float Elapsed = (LastLucidityUpdateTime >= 0.f) ? (Now - LastLucidityUpdateTime) : DeltaSeconds;
+	LastLucidityUpdateTime = Now;
+	UpdateSunTraceSetup();
+	if (FLucidityRecorder::IsRecording() && (Elapsed > 0.f))
+	{
+		FLucidityRecorder::BeginUpdate( this, Elapsed );
+	}
+	return Elapsed;
+}
+
+void AAlexandriaCharacter::UpdateSunTraceSetup()
+{
+	const FLucidOccluders* Occluders = FLucidOccluders::Get( GetWorld() );
+	const uint32 Generation = (Occluders != nullptr) ? Occluders->GetGeneration() : 1;
+	if (Generation == SunTraceGeneration)
+	{
+		return;
+	}
+	SunTraceGeneration = Generation;
+
+	// Sun rays share one query setup, rebuilt only when occluder proxies come or go instead of per ray
+	const FLucidTraceSetup Setup = FLucidOccluders::GetTraceSetup( GetWorld() );
+	SunTraceParams = FCollisionQueryParams( SunTraceTag, Setup.bTraceComplex, this );
+	SunTraceResponse = Setup.Response;
+	SunTraceChannel = Setup.Channel;
+}
+
+void AAlexandriaCharacter::FinishLucidityUpdate( const float NewLucidity, const float Elapsed )
+{
+	if (FLucidityRecorder::IsRecording())
+	{
+		FLucidityRecorder::EndUpdate( this, NewLucidity );
+	}
+	LucidityChangeRate = FMath::Abs( NewLucidity - Lucidity ) / Elapsed;
+	Lucidity = NewLucidity;
+
+	// Next update is sooner the more this character matters
+	const float Significance = CalcLuciditySignificance();
+	LucidityTick.TickInterval = FMath::Lerp( MaxLucidityInterval, MinLucidityInterval, Significance );
+	PublishNetLucidity( Significance );
+
+	LucidityBlendFrom = AppliedLucidity;
+	LucidityBlendTime = 0.f;
+	LucidityBlendDuration = LucidityTick.TickInterval;
+}
+
+float AAlexandriaCharacter::GatherBatchedExposure( const FLucidSunState &SunState, TArray<FLucidSunRay> &OutRays, float &OutSunScale )
+{
+	OutSunScale = 0.f;
+	const float Exposure = CalcDynamicLightRadiance() + CalcIncidentLuminance();
+	if (!SunState.bValid)
+	{
+		return Exposure;
+	}
+
+	ApplySunState( SunState );
+	if (SunState.Intensity < SMALL_NUMBER)
+	{
+		return Exposure;
+	}
+
+	const float SunScale = SunState.Intensity / BaseSunIntensity;
+	float Visibility = 0.f;
+	if (SampleBakedSunVisibility( SunState.Direction, GetSunRaysWanted(), bMovableOccludersNearSun, Visibility ) || PrepareSunRays( SunState, bMovableOccludersNearSun, Visibility ))
+	{
+		return Exposure + Visibility*SunScale;
+	}
+
+	// Traced by the batch, see ResolveSunRays
+	BuildSunRays( SunState, BeginSunSampling( SunState, SunTraceGrant ), OutRays );
+	OutSunScale = SunScale;
+	return Exposure;
+}
+
+float AAlexandriaCharacter::CalcLuciditySignificance() const
+{
+	if (IsLocallyControlled())
+	{
+		return 1.f;
+	}
+
+	// A fast changing value needs updates regardless of where it is seen from
+	const float ChangeFactor = FMath::Clamp( LucidityChangeRate / FMath::Max( SignificanceChangeRate, SMALL_NUMBER ), 0.f, 1.f );
+
+	return FMath::Max( CalcViewSignificance(), ChangeFactor );
+}
+
+float AAlexandriaCharacter::CalcViewSignificance() const
+{
+	if (IsLocallyControlled())
+	{
+		return 1.f;
+	}
+
+	// Distance to the closest player view
+	float ClosestDistSq = BIG_NUMBER;
+	for (FConstPlayerControllerIterator Iterator = GetWorld()->GetPlayerControllerIterator(); Iterator; ++Iterator)
+	{
+		const APlayerController* PlayerController = Iterator->Get();
+		if (PlayerController != nullptr)
+		{
+			FVector ViewLocation;
+			FRotator ViewRotation;
+			PlayerController->GetPlayerViewPoint( ViewLocation, ViewRotation );
+			ClosestDistSq = FMath::Min( ClosestDistSq, FVector::DistSquared( ViewLocation, GetActorLocation() ) );
+		}
+	}
+	const float DistanceRange = FMath::Max( SignificanceFarDistance - SignificanceNearDistance, 1.f );
+	const float DistanceFactor = 1.f - FMath::Clamp( (FMath::Sqrt( ClosestDistSq ) - SignificanceNearDistance) / DistanceRange, 0.f, 1.f );
+
+	// Nothing is rendered on a dedicated server or in a headless run, so visibility only counts where frames are drawn
+	const bool bOnScreen = (GetNetMode() == NM_DedicatedServer) || !FApp::CanEverRender() || ((GetWorld()->GetTimeSeconds() - GetLastRenderTime()) <= 0.2f);
+	const float VisibilityFactor = bOnScreen ? 1.f : 0.25f;
+
+	return DistanceFactor*VisibilityFactor;
+}
+
+void FLucidityTickFunction::ExecuteTick( float DeltaTime, ELevelTick TickType, ENamedThreads::Type CurrentThread, const FGraphEventRef &MyCompletionGraphEvent )
+{
+	if ((Target != nullptr) && !Target->IsPendingKillOrUnreachable() && (TickType != LEVELTICK_ViewportsOnly))
+	{
+		FScopeCycleCounterUObject ActorScope( Target );
+		Target->TickLucidity( DeltaTime );
+	}
+}
+
+FString FLucidityTickFunction::DiagnosticMessage()
+{
+	return Target->GetFullName() + TEXT( "[TickLucidity]" );
+}
+
+ULocalPlayer* AAlexandriaCharacter::GetLocalPlayer() const
+{
+	ULocalPlayer* LocPlayer = nullptr;
+	if (GetController()->IsLocalPlayerController())
+	{
+		LocPlayer = Cast<APlayerController, AController>(GetController())->GetLocalPlayer();
+	}
+	return LocPlayer;
+}
+
+FSceneView* AAlexandriaCharacter::GetPlayerSceneView( ULocalPlayer* LocPlayer )
+{
+	if (LocPlayer != nullptr)
+	{
+		FSceneViewFamilyContext ViewFamily( FSceneViewFamily::ConstructionValues(
+			LocPlayer->ViewportClient->Viewport,
+			LocPlayer->GetWorld()->Scene,
+			LocPlayer->ViewportClient->EngineShowFlags ).SetRealtimeUpdate( true ) );
+		FVector ViewLocation;
+		FRotator ViewRotation;
+
+		return LocPlayer->CalcSceneView( &ViewFamily, ViewLocation, ViewRotation, LocPlayer->ViewportClient->Viewport );
+	}
+	return nullptr;
+}
+
+float AAlexandriaCharacter::CalcPlayerIncidentRadiance( const FBoxSphereBounds &Bounds, FSHVectorRGB3 &Radiance, float &Shadowing, float &Weight, FVector &SkyBent )
+{
+	SCOPE_CYCLE_COUNTER( STAT_LucidIncidentRadiance );
+	if (!GetWorld()->AreAlwaysLoadedLevelsLoaded()) {
+		return 0.f;
+	}
+	const FLucidLevelData* LevelData = FLucidLevelData::Get( GetWorld() );
+	if (LevelData == nullptr)
+	{
+		return 0.f;
+	}
+	const FVector PollPoint = Bounds.GetBox().GetCenter();
+	const FIntVector Cell(
+		FMath::FloorToInt( PollPoint.X / IncidentRadianceCellSize ),
+		FMath::FloorToInt( PollPoint.Y / IncidentRadianceCellSize ),
+		FMath::FloorToInt( PollPoint.Z / IncidentRadianceCellSize ) );
+
+	// Reuse the last sample while we stay in its cell and no level has streamed in or out since
+	FLucidIncidentRadianceCache &Cache = IncidentRadianceCache;
+	const bool bLevelStillLoaded = !Cache.bHasLevel || (Cache.Level.IsValid() && Cache.Level->bIsVisible);
+	if (Cache.bValid && bLevelStillLoaded && (Cache.Generation == LevelData->GetGeneration()) && (Cache.Cell == Cell)
+		&& (FVector::DistSquared( Cache.PollPoint, PollPoint ) <= FMath::Square( IncidentRadianceTolerance )))
+	{
+		RecordIncidentCacheLookup( true );
+	}
+	else
+	{
+		RecordIncidentCacheLookup( false );
+
+		FSHVectorRGB3 LocRadiance;
+		float LocWeight = 0.f;
+		float LocShadowing = 0.f;
+		FVector LocSkyBent = FVector::ZeroVector;
+		ULevel* SampledLevel = nullptr;
+
+		// Only loaded levels whose bounds contain the point can contribute samples
+		TArray<ULevel*, TInlineAllocator<4>> Levels;
+		LevelData->FindLevels( PollPoint, Levels );
+		for (ULevel* Level : Levels)
+		{
+			const float WeightBefore = LocWeight;
+			Level->PrecomputedLightVolume->InterpolateIncidentRadiancePoint( PollPoint, LocWeight, LocShadowing, LocRadiance, LocSkyBent );
+			if ((SampledLevel == nullptr) && (LocWeight > WeightBefore))
+			{
+				SampledLevel = Level;
+			}
+		}
+
+		if (LocWeight > SMALL_NUMBER )
+		{
+			const float InvWeight = 1.f / LocWeight;
+			LocRadiance *= InvWeight;
+			LocShadowing *= InvWeight;
+		}
+
+		Cache.bValid = true;
+		Cache.Generation = LevelData->GetGeneration();
+		Cache.Cell = Cell;
+		Cache.PollPoint = PollPoint;
+		Cache.Level = SampledLevel;
+		Cache.bHasLevel = (SampledLevel != nullptr);
+		Cache.Radiance = LocRadiance;
+		Cache.Weight = LocWeight;
+		Cache.Shadowing = LocShadowing;
+		Cache.SkyBent = LocSkyBent;
+		// SH to luminance once per refresh rather than per tick
+		Cache.Luminance = ((LocWeight > SMALL_NUMBER) || (LocShadowing > SMALL_NUMBER)) ?
+			Dot( LocRadiance, FSHVector3::AmbientFunction() ).GetLuminance() : 0.f;
+	}
+
+	if (Cache.Luminance <= 0.f)
+	{
+		return 0.f;
+	}
+	Radiance += Cache.Radiance;
+	SkyBent += Cache.SkyBent;
+	Weight += Cache.Weight;
+	Shadowing += Cache.Shadowing;
+	return Cache.Luminance;
+}
+
+void AAlexandriaCharacter::RecordIncidentCacheLookup( const bool bHit )
+{
+	static FLucidFrameHitRate HitRate;
+	if (bHit)
+	{
+		INC_DWORD_STAT( STAT_LucidIncidentCacheHits );
+	}
+	else
+	{
+		INC_DWORD_STAT( STAT_LucidIncidentCacheMisses );
+	}
+	SET_FLOAT_STAT( STAT_LucidIncidentCacheHitRate, HitRate.Add( bHit ) );
+}
+
+
+
+float AAlexandriaCharacter::CalcDynamicLightRadiance()
+{
+	SCOPE_CYCLE_COUNTER( STAT_LucidDynamicLightRadiance );
+	LUCIDITY_PHASE_SCOPE( DynamicLightRadiance );
+	FLucidLightRegistry* Registry = FLucidLightRegistry::Get( GetWorld() );
+	if (Registry == nullptr)
+	{
+		return 0.f;
+	}
+
+	// Candidates come back nearest first, so the cap keeps the closest lights that reach the mesh
+	Registry->QueryLights( GetCapsuleComponent()->Bounds, MaxDynamicLights, LightCandidates, GetMesh() );
+
+	struct FLightContribution
+	{
+		const FLucidLightCandidate* Candidate;
+		const FLucidLocalLightState* State;
+		float Brightness;
+	};
+	TArray<FLightContribution, TInlineAllocator<8>> Contributions;
+
+	const FLucidLightingFrameRef Lighting = GetLightingFrame();
+	const FVector PlayerLocation = GetActorLocation();
+	for (const FLucidLightCandidate &Candidate : LightCandidates)
+	{
+		UPointLightComponent *LightComp = Candidate.Light;
+		// Lights registered since this frame's snapshot are picked up next frame
+		const FLucidLocalLightState* LightState = Lighting->FindLocalLight( LightComp );
+		if (LightState == nullptr)
+		{
+			continue;
+		}
+
+		//Get Light info for calculating effect on player
+		const float DistanceToPlayer = FVector::Dist( LightState->Position, PlayerLocation );
+		float Brightness = 0.f;
+		if (LightState->Brightness > SMALL_NUMBER) {
+			Brightness = BaseSunIntensity*CalcLightAttenuation( *LightState, DistanceToPlayer );
+		}
+		Contributions.Add( { &Candidate, LightState, Brightness } );
+		INC_DWORD_STAT( STAT_LucidLightsAccepted );
+		/*
+		print_color( FString::SanitizeFloat( DistanceToPlayer ), GetWorld()->GetDeltaSeconds(), FColor::Red );
+		print_color( FString::SanitizeFloat( LightComp->AttenuationRadius), GetWorld()->GetDeltaSeconds(), FColor::Red );
+		print_color( FString::SanitizeFloat( Brightness ), GetWorld()->GetDeltaSeconds(), FColor::Green );
+		print_color( FString::SanitizeFloat( GetLucidity() ), GetWorld()->GetDeltaSeconds(), FColor::Yellow);
+		print_color( FString::SanitizeFloat( BaseSunIntensity ), GetWorld()->GetDeltaSeconds(), FColor::Yellow );
+		print_color( LightComp->GetFName().ToString(), GetWorld()->GetDeltaSeconds(), FColor::White );
+		*/
+	}
+
+	// Brightest first, so the occlusion budget goes to the lights that move Lucidity most
+	Contributions.Sort( []( const FLightContribution &A, const FLightContribution &B ) { return A.Brightness > B.Brightness; } );
+
+	for (FLucidLightVisibility &Entry : LightVisibility)
+	{
+		Entry.bCandidate = false;
+	}
+
+	// Proxies extrapolate the server's value and trace nothing
+	FLucidityManager* Manager = (bTraceLightOcclusion && (Role != ROLE_SimulatedProxy)) ? FLucidityManager::Get( GetWorld() ) : nullptr;
+	FLucidTraceScheduler* Scheduler = (Manager != nullptr) ? &Manager->GetTraceScheduler() : nullptr;
+
+	float Luminance = 0.f;
+	const bool bRecording = FLucidityRecorder::IsRecording();
+	for (const FLightContribution &Contribution : Contributions)
+	{
+		float Visibility = 0.f;
+		if (Contribution.Brightness > 0.f)
+		{
+			Visibility = GetLightVisibility( *Contribution.Candidate, PlayerLocation, Scheduler );
+			Luminance += Contribution.Brightness*Visibility;
+		}
+		if (bRecording)
+		{
+			FLucidityRecorder::RecordLight( this, *Contribution.State, Visibility );
+		}
+	}
+	LightVisibility.RemoveAllSwap( []( const FLucidLightVisibility &Entry ) { return !Entry.bCandidate; } );
+
+	if (Contributions.Num() > 0)
+	{
+		Luminance/= (float)Contributions.Num();
+	}
+	return Luminance/BaseSunIntensity;
+
+}
+
+float AAlexandriaCharacter::CalcLightAttenuation( const FLucidLocalLightState &Light, const float Distance )
+{
+	const float Radius = Light.AttenuationRadius;
+	if ((Radius <= SMALL_NUMBER) || (Distance >= Radius))
+	{
+		return 0.f;
+	}
+
+	const float DistanceRatioSq = FMath::Square( Distance / Radius );
+	if (Light.bInverseSquaredFalloff)
+	{
+		// 1/d^2, kept finite next to the light by the +1, then windowed to reach zero at the radius
+		const float Window = FMath::Square( 1.f - FMath::Square( DistanceRatioSq ) );
+		return Window / (FMath::Square( Distance ) + 1.f);
+	}
+	return FMath::Pow( 1.f - DistanceRatioSq, Light.FalloffExponent );
+}
+
+float AAlexandriaCharacter::GetLightVisibility( const FLucidLightCandidate &Candidate, const FVector &Target, FLucidTraceScheduler* Scheduler )
+{
+	if (!bTraceLightOcclusion)
+	{
+		return 1.f;
+	}
+
+	FLucidLightVisibility* Entry = LightVisibility.FindByPredicate( [&]( const FLucidLightVisibility &Cached ) { return Cached.Light.Get() == Candidate.Light; } );
+	const float ToleranceSq = FMath::Square( LightVisibilityTolerance );
+	if ((Entry != nullptr)
+		&& (FVector::DistSquared( Entry->LightPosition, Candidate.Position ) <= ToleranceSq)
+		&& (FVector::DistSquared( Entry->TargetPosition, Target ) <= ToleranceSq))
+	{
+		Entry->bCandidate = true;
+		INC_DWORD_STAT( STAT_LucidLightVisibilityHits );
+		return Entry->Visibility;
+	}
+
+	// Out of rays, a light seen before keeps its stale answer and a new one counts as unoccluded
+	if ((Scheduler == nullptr) || !Scheduler->AcquireLightTrace())
+	{
+		if (Entry != nullptr)
+		{
+			Entry->bCandidate = true;
+			return Entry->Visibility;
+		}
+		return 1.f;
+	}
+
+	// The light's own fixture would otherwise block it
+	FCollisionQueryParams TraceParams( SunTraceParams );
+	TraceParams.AddIgnoredActor( Candidate.Light->GetOwner() );
+	const bool bBlocked = GetWorld()->LineTraceTestByChannel( Candidate.Position, Target, SunTraceChannel, TraceParams, SunTraceResponse );
+	FLucidityProfile::AddTraces( 1 );
+	INC_DWORD_STAT( STAT_LucidLightTraces );
+
+	if (Entry == nullptr)
+	{
+		Entry = &LightVisibility[LightVisibility.AddDefaulted()];
+		Entry->Light = Candidate.Light;
+	}
+	Entry->LightPosition = Candidate.Position;
+	Entry->TargetPosition = Target;
+	Entry->Visibility = bBlocked ? 0.f : 1.f;
+	Entry->bCandidate = true;
+	return Entry->Visibility;
+}
+
+float AAlexandriaCharacter::GetSolarIllumination( const int32 AvailableTraces )
+{
+	SCOPE_CYCLE_COUNTER( STAT_LucidSolarIllumination );
+	LUCIDITY_PHASE_SCOPE( SolarIllumination );
+	if (GetSun() == nullptr) {
+		return 0.f;
+	}
+	
+	//Get Light info for calculating effect on player
+	const FLucidLightingFrameRef Lighting = GetLightingFrame();
+	const FLucidSunState &SunState = Lighting->FindSun( GetSun() );
+	ApplySunState( SunState );
+	if (SunState.Intensity < SMALL_NUMBER ){
+		return 0.f;
+
+	}
+
+	float Visibility = 0.f;
+	if (!SampleBakedSunVisibility( SunState.Direction, GetSunRaysWanted(), bMovableOccludersNearSun, Visibility ) && !PrepareSunRays( SunState, bMovableOccludersNearSun, Visibility ))
+	{
+		const int32 RayCount = BeginSunSampling( SunState, AvailableTraces );
+		// The BVH is cheap enough to trace right away, only scene queries are worth reading back late
+		Visibility = ((SunTraceLatency == ELucidTraceLatency::OneFrameLate) && !bSunRaysOnBvh) ?
+			TraceSunVisibilityAsync( SunState, RayCount ) :
+			TraceSunVisibility( SunState, RayCount );
+		if (FLucidityRecorder::IsRecording())
+		{
+			FLucidityRecorder::RecordSunVisibility( this, Visibility, false );
+		}
+	}
+	return Visibility*SunState.Intensity/BaseSunIntensity;
+}
+
+FLucidLightingFrameRef AAlexandriaCharacter::GetLightingFrame() const
+{
+	return FLucidLightingSnapshot::Get( GetWorld() )->GetFrame();
+}
+
+void AAlexandriaCharacter::ApplySunState( const FLucidSunState &SunState )
+{
+	SunIntensity = SunState.Intensity;
+	RadianceColor = SunState.Color;
+	if (FLucidityRecorder::IsRecording())
+	{
+		FLucidityRecorder::RecordSun( this, SunState );
+	}
+}
+
+int32 AAlexandriaCharacter::BeginSunSampling( const FLucidSunState &SunState, const int32 AvailableTraces )
+{
+	// Accumulated exposure only needs a ray or two per tick
+	if (bTemporalSunSampling)
+	{
+		ExposureSampler.Validate( GetActorLocation(), SunState.Direction );
+		return FMath::Min( AvailableTraces, SunRaysPerTick );
+	}
+	return AvailableTraces;
+}
+
+bool AAlexandriaCharacter::SampleBakedSunVisibility( const FVector &Plane, const int32 NumSamples, const bool bMovableOccluders, float &OutVisibility ) const
+{
+	if (!bUseBakedSunVisibility)
+	{
+		return false;
+	}
+	const FLucidBakedVisibility* Baked = FLucidBakedVisibility::Get( GetWorld() );
+	if ((Baked == nullptr) || !Baked->HasVolumes())
+	{
+		return false;
+	}
+
+	// The bake only knows static collision, anything movable between us and the sun needs live rays
+	if (bMovableOccluders)
+	{
+		return false;
+	}
+
+	const int32 SampleCount = FMath::Max( NumSamples, 1 );
+	float Visibility = 0.f;
+	for (int32 i = 0; i < SampleCount; i++)
+	{
+		// A poll point past the edge of the bake falls back to the character's own location, as CanSampleBakedSunVisibility checked
+		float Sample = 0.f;
+		if (!Baked->SampleVisibility( GetPollPoint(), Plane, Sample ) && !Baked->SampleVisibility( GetActorLocation(), Plane, Sample ))
+		{
+			return false;
+		}
+		Visibility += Sample;
+	}
+	OutVisibility = Visibility / (float)SampleCount;
+	if (FLucidityRecorder::IsRecording())
+	{
+		FLucidityRecorder::RecordSunVisibility( this, OutVisibility, true );
+	}
+	return true;
+}
+
+bool AAlexandriaCharacter::CanSampleBakedSunVisibility( const FVector &Plane ) const
+{
+	const FLucidBakedVisibility* Baked = bUseBakedSunVisibility ? FLucidBakedVisibility::Get( GetWorld() ) : nullptr;
+	float Sample = 0.f;
+	return (Baked != nullptr) && Baked->HasVolumes() && Baked->SampleVisibility( GetActorLocation(), Plane, Sample );
+}
+
+bool AAlexandriaCharacter::HasMovableOccluders( const FVector &Plane ) const
+{
+	// Only worth a sweep when the bake, the reused visibility or the BVH would otherwise answer
+	const FLucidBakedVisibility* Baked = bUseBakedSunVisibility ? FLucidBakedVisibility::Get( GetWorld() ) : nullptr;
+	const FLucidOccluders* Occluders = FLucidOccluders::Get( GetWorld() );
+	if (!bReuseSunVisibility && ((Baked == nullptr) || !Baked->HasVolumes()) && ((Occluders == nullptr) || !Occluders->CanTraceBvh()))
+	{
+		return false;
+	}
+
+	const FVector Location = GetActorLocation();
+	FLucidityProfile::AddTraces( 1 );
+	return GetWorld()->SweepTestByObjectType( Location, Location - Plane*MovableOccluderRange, FQuat::Identity, MovableOccluderParams,
+		FCollisionShape::MakeSphere( GetCapsuleComponent()->GetScaledCapsuleRadius()*2.f ), SunTraceParams );
+}
+
+bool AAlexandriaCharacter::PrepareSunRays( const FLucidSunState &SunState, const bool bMovableOccluders, float &OutVisibility )
+{
+	// Neither the reused visibility nor the BVH know about anything that moves
+	const FLucidOccluders* Occluders = FLucidOccluders::Get( GetWorld() );
+	bSunRaysOnBvh = (Occluders != nullptr) && Occluders->CanTraceBvh() && !bMovableOccluders;
+	if (!bReuseSunVisibility)
+	{
+		return false;
+	}
+
+	FLucidSunVisibilityCache &Cache = SunVisibilityCache;
+	const bool bHit = !bMovableOccluders && IsSunVisibilityReusable( SunState );
+	RecordSunVisibilityLookup( bHit );
+	if (bHit)
+	{
+		// Rays still in flight were traced for the same answer
+		PendingSunTraces.Reset();
+		bPendingSunKey = false;
+		OutVisibility = Cache.Visibility;
+		if (FLucidityRecorder::IsRecording())
+		{
+			// Replayed as recorded, like a baked sample, since no rays were traced
+			FLucidityRecorder::RecordSunVisibility( this, OutVisibility, true );
+		}
+		return true;
+	}
+
+	// The rays traced for this key refill the cache, unless a movable occluder may shade them any moment
+	Cache.bValid = false;
+	Cache.bPending = !bMovableOccluders;
+	Cache.PendingKey.Cell = GetSunVisibilityCell();
+	Cache.PendingKey.Location = GetActorLocation();
+	Cache.PendingKey.SunDirection = SunState.Direction;
+	Cache.PendingKey.SunIntensity = SunState.Intensity;
+	Cache.PendingKey.OccluderGeneration = SunTraceGeneration;
+	return false;
+}
+
+FIntVector AAlexandriaCharacter::GetSunVisibilityCell() const
+{
+	const FVector Location = GetActorLocation();
+	return FIntVector(
+		FMath::FloorToInt( Location.X / SunVisibilityCellSize ),
+		FMath::FloorToInt( Location.Y / SunVisibilityCellSize ),
+		FMath::FloorToInt( Location.Z / SunVisibilityCellSize ) );
+}
+
+bool AAlexandriaCharacter::IsSunVisibilityReusable( const FLucidSunState &SunState ) const
+{
+	const FLucidSunVisibilityCache &Cache = SunVisibilityCache;
+	const FLucidSunVisibilityKey &Key = Cache.Key;
+	return bReuseSunVisibility && Cache.bValid && (Key.Cell == GetSunVisibilityCell()) && (Key.OccluderGeneration == SunTraceGeneration)
+		&& (FVector::DistSquared( Key.Location, GetActorLocation() ) <= FMath::Square( SunVisibilityTolerance ))
+		&& (FVector::DotProduct( Key.SunDirection, SunState.Direction ) >= FMath::Cos( FMath::DegreesToRadians( SunVisibilityAngleTolerance ) ))
+		&& (FMath::Abs( SunState.Intensity - Key.SunIntensity ) <= Key.SunIntensity*SunVisibilityIntensityTolerance);
+}
+
+void AAlexandriaCharacter::RecordSunVisibilityLookup( const bool bHit )
+{
+	static FLucidFrameHitRate HitRate;
+	if (bHit)
+	{
+		INC_DWORD_STAT( STAT_LucidSunVisibilityHits );
+	}
+	else
+	{
+		INC_DWORD_STAT( STAT_LucidSunVisibilityMisses );
+	}
+	SET_FLOAT_STAT( STAT_LucidSunVisibilityHitRate, HitRate.Add( bHit ) );
+	FLucidityProfile::AddSunVisibilityLookup( bHit );
+}
+
+FVector AAlexandriaCharacter::NextSunPollPoint( int32 &OutStratum )
+{
+	if (bTemporalSunSampling)
+	{
+		return GetActorLocation() + ExposureSampler.NextOffset( OutStratum );
+	}
+	OutStratum = INDEX_NONE;
+	return GetPollPoint();
+}
+
+void AAlexandriaCharacter::BuildSunRays( const FLucidSunState &SunState, const int32 Count, TArray<FLucidSunRay> &OutRays )
+{
+	const FVector &Plane = SunState.Direction;
+	const FVector InvPlane( Plane*-1.f );
+
+	for (int32 i = 0; i < Count; i++)
+	{
+		FLucidSunRay &Ray = OutRays[OutRays.AddUninitialized()];
+
+		// Seed start position
+		FVector Start( SunState.LightPosition );
+		FVector End( NextSunPollPoint( Ray.Stratum ) );
+		FVector EndVector( End - GetActorLocation() );
+
+		// Project End onto inverse plane
+		float cs = FVector::DotProduct( EndVector.GetSafeNormal(), InvPlane );
+		if (cs > SMALL_NUMBER)
+		{
+			End = End + InvPlane*(FVector::DotProduct( EndVector, InvPlane ) / cs);
+		}
+
+		float t = 0.f;
+		// Get the projected starting point on the plane from the End point
+		FVector EndStartVec( Start - End );
+		cs = FVector::DotProduct( EndStartVec.GetSafeNormal(), Plane );
+		if (cs > SMALL_NUMBER)
+		{
+			t = FVector::DotProduct( EndStartVec, Plane ) / cs;
+			Start = End + (InvPlane*t);
+		}
+
+		Ray.Start = Start;
+		Ray.End = End;
+	}
+}
+
+bool AAlexandriaCharacter::TraceSunRay( const FLucidSunRay &Ray ) const
+{
+	return !GetWorld()->LineTraceTestByChannel( Ray.Start, Ray.End, SunTraceChannel, SunTraceParams, SunTraceResponse );
+}
+
+float AAlexandriaCharacter::ResolveSunRays( const FLucidSunRay* Rays, const bool* bLit, const int32 Count )
+{
+	int32 LitCount = 0;
+	for (int32 i = 0; i < Count; i++)
+	{
+		if (Rays[i].Stratum != INDEX_NONE)
+		{
+			ExposureSampler.AddSample( Rays[i].Stratum, bLit[i] ? 1.f : 0.f );
+		}
+		if (bLit[i])
+		{
+			++LitCount;
+			//DrawDebugLine( GetWorld(), Rays[i].Start, Rays[i].End, FColor::Yellow, false, GetWorld()->GetDeltaSeconds()*FMath::FRandRange( 1.f, 5.f ) );
+		}
+	}
+	const float TickVisibility = (Count > 0) ? ((float)LitCount / (float)Count) : 0.f;
+	const float Visibility = bTemporalSunSampling ? ExposureSampler.GetExposure( TickVisibility ) : TickVisibility;
+
+	// Only a settled estimate is reused, a temporal one once every stratum has been sampled
+	if (SunVisibilityCache.bPending && (Count > 0) && (!bTemporalSunSampling || ExposureSampler.HasSampledAllStrata()))
+	{
+		SunVisibilityCache.Key = SunVisibilityCache.PendingKey;
+		SunVisibilityCache.Visibility = Visibility;
+		SunVisibilityCache.bValid = true;
+		SunVisibilityCache.bPending = false;
+	}
+	if (FLucidityRecorder::IsRecording())
+	{
+		FLucidityRecorder::RecordSunRays( this, Rays, bLit, Count );
+		FLucidityRecorder::RecordSunVisibility( this, Visibility, false );
+	}
+	return Visibility;
+}
+
+float AAlexandriaCharacter::TraceSunVisibility( const FLucidSunState &SunState, const int32 AvailableTraces )
+{
+	if (AvailableTraces <= 0)
+	{
+		return 0.f;
+	}
+
+	SunRays.Reset();
+	BuildSunRays( SunState, AvailableTraces, SunRays );
+
+	FLucidityProfile::AddTraces( SunRays.Num() );
+	TArray<bool, TInlineAllocator<8>> Lit;
+	if (bSunRaysOnBvh)
+	{
+		Lit.SetNumUninitialized( SunRays.Num() );
+		FLucidOccluders::Get( GetWorld() )->TraceRays( SunRays.GetData(), SunRays.Num(), Lit.GetData() );
+	}
+	else
+	{
+		for (const FLucidSunRay &Ray : SunRays)
+		{
+			Lit.Add( TraceSunRay( Ray ) );
+		}
+	}
+	return ResolveSunRays( SunRays.GetData(), Lit.GetData(), SunRays.Num() );
+}
+
+float AAlexandriaCharacter::TraceSunVisibilityAsync( const FLucidSunState &SunState, const int32 AvailableTraces )
+{
+	UWorld* World = GetWorld();
+
+	// Fold in the rays submitted last frame, their results are ready by now
+	SunRays.Reset();
+	TArray<bool, TInlineAllocator<8>> Lit;
+	for (int32 i = 0; i < PendingSunTraces.Num(); i++)
+	{
+		FTraceDatum Datum;
+		if (World->QueryTraceData( PendingSunTraces[i], Datum ))
+		{
+			SunRays.Add( PendingSunRays[i] );
+			Lit.Add( FHitResult::GetFirstBlockingHit( Datum.OutHits ) == nullptr );
+		}
+	}
+	PendingSunTraces.Reset();
+
+	// Those rays refill the cache under the key they were submitted with, this update's key goes with this update's rays
+	FLucidSunVisibilityCache &Cache = SunVisibilityCache;
+	const FLucidSunVisibilityKey SubmitKey = Cache.PendingKey;
+	const bool bSubmitKey = Cache.bPending;
+	Cache.PendingKey = PendingSunKey;
+	Cache.bPending = bPendingSunKey;
+
+	// Keep the previous answer if nothing resolved (first frame, or the handles expired)
+	if (SunRays.Num() > 0)
+	{
+		AsyncSunVisibility = ResolveSunRays( SunRays.GetData(), Lit.GetData(), SunRays.Num() );
+	}
+	else if (bTemporalSunSampling)
+	{
+		AsyncSunVisibility = ExposureSampler.GetExposure( AsyncSunVisibility );
+	}
+
+	// Submit this frame's rays, to be read back next frame, keyed as of now
+	Cache.bPending = false;
+	PendingSunKey = SubmitKey;
+	bPendingSunKey = bSubmitKey;
+	PendingSunRays.Reset();
+	BuildSunRays( SunState, AvailableTraces, PendingSunRays );
+	FLucidityProfile::AddTraces( PendingSunRays.Num() );
+	for (const FLucidSunRay &Ray : PendingSunRays)
+	{
+		PendingSunTraces.Add( World->AsyncLineTraceByChannel( EAsyncTraceType::Single, Ray.Start, Ray.End, SunTraceChannel, SunTraceParams, SunTraceResponse ) );
+	}
+	return AsyncSunVisibility;
+}
+
+FVector AAlexandriaCharacter::GetPollPoint() const
+{
+	FVector PollPoint( GetActorLocation() );
+	PollPoint.X += FMath::FRandRange( -50.f, 50.f );
+	PollPoint.Y += FMath::FRandRange( -50.f, 50.f );
+	PollPoint.Z += FMath::FRandRange( -90.f, 100.f );
+
+	return PollPoint;
+}
+
+
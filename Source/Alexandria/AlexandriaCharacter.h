@@ -1,242 +1,807 @@
-// Copyright 1998-2017 Epic Games, Inc. All Rights Reserved.
-#pragma once
-#include "GameFramework/Character.h"
-#include "AlexandriaCharacter.generated.h"
-
-
-//Struct for Movement Scalars for factoring Lucidity mechanic
-USTRUCT()
-struct FLucidMoveProperty 
-{
-	GENERATED_USTRUCT_BODY()
-
-	float Base;
-	UPROPERTY( EditAnywhere, BlueprintReadWrite, meta = (ClampMin = "0.0", UIMin = "0") )
-	float Min;
-	UPROPERTY( EditAnywhere, BlueprintReadWrite, meta = (ClampMin = "0.0", UIMin = "0") )
-	float Max;
-	UPROPERTY( EditAnywhere, BlueprintReadWrite )
-	uint32 InverseScale:1;
-
-	FLucidMoveProperty( const float MinimumValue = 0.5f, const float MaximumValue = 3.5f, uint32 inv = false ) :
-		Base( 0.f ),
-		Min( FMath::Min<float>( MinimumValue, MaximumValue ) ),
-		Max( FMath::Max<float>( MinimumValue, MaximumValue ) )
-	{}
-	float GetProperty( const float LucidValue ) const {
-		return (InverseScale == true) ?
-			(Base / (Min + LucidValue*(Max - Min))) :
-			(Base*(Min + LucidValue*(Max - Min)));
-	}
-};
-
-UCLASS(config=Game)
-class AAlexandriaCharacter : public ACharacter
-{
-	GENERATED_BODY()
-	/** Camera boom positioning the camera behind the character */
-	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = Camera, meta = (AllowPrivateAccess = "true"))
-	class USpringArmComponent* CameraBoom;
-
-	/** Follow camera */
-	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = Camera, meta = (AllowPrivateAccess = "true"))
-	class UCameraComponent* FollowCamera;
-
-	UPROPERTY( VisibleAnywhere, BlueprintReadWrite, Category = "Lucidity (Radiance)", meta = (AllowPrivateAccess = "true") )
-	class UPointLightComponent* RadianceLight;
-
-	UPROPERTY( VisibleAnywhere, BlueprintReadWrite, Category = "Lucidity (Radiance)", meta = (AllowPrivateAccess = "true") )
-	class UStaticMeshComponent* RadianceGlobe;
-
-	class UStaticMesh* RadianceGlobeMesh;
-	
-	class UMaterial* RadianceMaterial;
-	
-	class UMaterialInstanceDynamic* RadianceMaterialInst;
-
-	class UParticleSystem* RadianceFireEmitter;
-
-	UPROPERTY( VisibleAnywhere, BlueprintReadWrite, Category = "Lucidity (Radiance)", meta = (AllowPrivateAccess = "true") )
-	class UParticleSystemComponent* RadianceFire;
-	
-
-protected:
-	
-
-public:
-	AAlexandriaCharacter();
-
-	/** Base turn rate, in deg/sec. Other scaling may affect final turn rate. */
-	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category=Camera)
-	float BaseTurnRate;
-
-	/** Base look up/down rate, in deg/sec. Other scaling may affect final rate. */
-	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category=Camera)
-	float BaseLookUpRate;
-
-protected:
-	UPROPERTY( Category = "Lucidity (Radiance)", EditAnywhere, BlueprintReadOnly )
-	class ADirectionalLight* Sun;
-
-
-	UPROPERTY( Category = "Lucidity (Radiance)", EditAnywhere, BlueprintReadWrite )
-	FLinearColor RadianceColor;
-
-	UPROPERTY( Category = "Lucidity (Movement)", EditAnywhere, BlueprintReadWrite)
-	struct FLucidMoveProperty LucidMoveSpeed;
-
-	UPROPERTY( Category = "Lucidity (Movement)", EditAnywhere, BlueprintReadWrite)
-	struct FLucidMoveProperty LucidAcceleration;
-
-	UPROPERTY( Category = "Lucidity (Movement)", EditAnywhere, BlueprintReadWrite)
-	struct FLucidMoveProperty LucidGravity;
-
-	UPROPERTY( Category = "Lucidity (Movement)", EditAnywhere, BlueprintReadWrite)
-	struct FLucidMoveProperty LucidAirControl;
-
-	UPROPERTY( Category = "Lucidity (Movement)", EditAnywhere, BlueprintReadWrite )
-	struct FLucidMoveProperty LucidJumpZ;
-
-	UPROPERTY( Category = "Lucidity (Movement)", EditAnywhere, BlueprintReadWrite)
-	struct FLucidMoveProperty LucidLateralAirFriction;
-
-	UPROPERTY( Category = "Lucidity (Radiance)", EditAnywhere, BlueprintReadWrite )
-	struct FLucidMoveProperty MaterialOpacity;
-
-	UPROPERTY( Category = "Lucidity (Radiance)", EditAnywhere, BlueprintReadWrite )
-	struct FLucidMoveProperty EmissiveStrength;
-
-	UPROPERTY( Category = "Lucidity (Radiance)", EditAnywhere, BlueprintReadWrite )
-	struct FLucidMoveProperty SunlightIntensity;
-
-	struct FLucidMoveProperty SunlightTemperature;
-
-	UPROPERTY( Category = "Lucidity (Radiance)", EditAnywhere, BlueprintReadWrite )
-	uint32 bInnerRadiance : 1;
-
-	UPROPERTY( Category = "Lucidity (Radiance)", EditAnywhere, BlueprintReadWrite )
-	float InnerRadianceDecayTime;
-
-
-
-
-
-	// Rate at which Lucidity decays when exposed to shadow
-	UPROPERTY( Category = "Lucidity (Radiance)", EditAnywhere, BlueprintReadWrite, meta=( ClampMin = "0", UIMin = "0" ) )
-	float AbsorbVelocity;
-
-	UPROPERTY( Category = "Lucidity (Radiance)", EditAnywhere, BlueprintReadWrite, meta = (ClampMin = "0", UIMin = "0") )
-	float ConsumeVelocity;
-
-
-
-public:
-
-	virtual void Tick( float DeltaSeconds );
-
-	virtual void PostInitializeComponents();
-
-	virtual void BeginPlay();
-
-	void DebugPrintRadiance( const float DrawTime, const FVector PollPoint, const FSHVectorRGB3 &Radiance, const float Shadowing, const float Weight, const FVector &SkyBent, const float Luminance ) const;
-
-	class ULocalPlayer* GetLocalPlayer() const;
-
-	static FSceneView* GetPlayerSceneView( ULocalPlayer* LocPlayer );
-
-	FORCEINLINE static float GetMoveScalar( FLucidMoveProperty LucidMove, const float LucidValue) { return LucidMove.Min + LucidValue*(LucidMove.Max - LucidMove.Min); }
-
-protected:
-
-	UFUNCTION( BlueprintCallable )
-	void GiveInnerRadiance() { bInnerRadiance = true; }
-
-	UFUNCTION( BlueprintCallable )
-	bool HasInnerRadiance() const { return bInnerRadiance; }
-
-	/** Resets HMD orientation in VR. */
-	void OnResetVR();
-
-	/** Called for forwards/backward input */
-	void MoveForward(float Value);
-
-	/** Called for side to side input */
-	void MoveRight(float Value);
-
-	/** 
-	 * Called via input to turn at a given rate. 
-	 * @param Rate	This is a normalized rate, i.e. 1.0 means 100% of desired turn rate
-	 */
-	void TurnAtRate(float Rate);
-
-	/**
-	 * Called via input to turn look up/down at a given rate. 
-	 * @param Rate	This is a normalized rate, i.e. 1.0 means 100% of desired turn rate
-	 */
-	void LookUpAtRate(float Rate);
-
-	float CalcPlayerIncidentRadiance( const FBoxSphereBounds &Bounds, FSHVectorRGB3 &Radiance, float &Shadowing, float &Weight, FVector &SkyBent ) const;
-
-	float CalcDynamicLightRadiance( const int32 AvailableTraces ) const;
-
-	// Updates the Sun properties and gets its current effect on the player
-	float GetSolarIllumination( const int32 AvailableTraces );
-
-	FVector GetPollPoint() const;
-
-	//float GetLuminanceOfBlock( const FBoxSphereBounds &Bounds );
-
-	/** Handler for when a touch input begins. */
-	void TouchStarted(ETouchIndex::Type FingerIndex, FVector Location);
-
-	/** Handler for when a touch input stops. */
-	void TouchStopped(ETouchIndex::Type FingerIndex, FVector Location);
-
-protected:
-	// APawn interface
-	virtual void SetupPlayerInputComponent(class UInputComponent* PlayerInputComponent) override;
-	// End of APawn interface
-
-private:
-
-	// current amount of illumination (1.f - 0.f)
-	float Lucidity;
-
-	float SunIntensity;
-	float BaseSunIntensity;
-
-	float TimeSinceLastUptick;
-
-	FLinearColor SunColor;
-	// Determines whether or not Lucidity is maintained when exposed to darkness.
-
-	static const FName MatOpacityName;
-	static const FName EmissiveStrName;
-
-	float CalcLucidity( const float DeltaSeconds );
-	void UpdateMovementParams( const float DeltaSeconds );
-	void UpdateVisualFeedback( const float DeltaSeconds );
-
-	
-
-public:
-	/** Returns CameraBoom subobject **/
-	FORCEINLINE class USpringArmComponent* GetCameraBoom() const { return CameraBoom; }
-	/** Returns FollowCamera subobject **/
-	FORCEINLINE class UCameraComponent* GetFollowCamera() const { return FollowCamera; }
-	
-	FORCEINLINE class UPointLightComponent* GetRadianceLight() const { return RadianceLight; }
-	FORCEINLINE class UStaticMeshComponent* GetRadianceGlobe() const { return RadianceGlobe; }
-
-	FORCEINLINE class ADirectionalLight* GetSun() const { return Sun; }
-	FORCEINLINE float GetLucidity() const { return Lucidity; }
-	FORCEINLINE float GetAbsorbtionRate() const { return AbsorbVelocity; }
-	
-	
-	
-};
-
-
-
-
-
+// Copyright 1998-2017 Epic Games, Inc. All Rights Reserved.
+#pragma once
+#include "GameFramework/Character.h"
+#include "WorldCollision.h"
+#include "LucidLightRegistry.h"
+#include "LucidExposureSampler.h"
+#include "LucidityTypes.h"
+#include "LucidLightingSnapshot.h"
+#include "LucidPropertyTable.h"
+#include "LucidRadianceLod.h"
+#include "Curves/CurveFloat.h"
+#include "AlexandriaCharacter.generated.h"
+
+class UStaticMesh;
+class UMaterial;
+class UParticleSystem;
+
+
+//Struct for Movement Scalars for factoring Lucidity mechanic
+USTRUCT()
+struct FLucidMoveProperty 
+{
+	GENERATED_USTRUCT_BODY()
+
+	float Base;
+	UPROPERTY( EditAnywhere, BlueprintReadWrite, meta = (ClampMin = "0.0", UIMin = "0") )
+	float Min;
+	UPROPERTY( EditAnywhere, BlueprintReadWrite, meta = (ClampMin = "0.0", UIMin = "0") )
+	float Max;
+	UPROPERTY( EditAnywhere, BlueprintReadWrite )
+	uint32 InverseScale:1;
+	// Optional 0-1 shape applied to Lucidity before scaling, baked into a lookup table for the property table
+	UPROPERTY( EditAnywhere, BlueprintReadWrite )
+	UCurveFloat* Response;
+
+	FLucidMoveProperty( const float MinimumValue = 0.5f, const float MaximumValue = 3.5f, uint32 inv = false ) :
+		Base( 0.f ),
+		Min( FMath::Min<float>( MinimumValue, MaximumValue ) ),
+		Max( FMath::Max<float>( MinimumValue, MaximumValue ) ),
+		InverseScale( inv ),
+		Response( nullptr )
+	{}
+	float GetProperty( const float LucidValue ) const {
+		const float Alpha = (Response != nullptr) ? Response->GetFloatValue( LucidValue ) : LucidValue;
+		return (InverseScale == true) ?
+			(Base / (Min + Alpha*(Max - Min))) :
+			(Base*(Min + Alpha*(Max - Min)));
+	}
+};
+
+// When sun visibility rays are resolved relative to the tick that needs them
+UENUM( BlueprintType )
+enum class ELucidTraceLatency : uint8
+{
+	// Blocking traces on the game thread, results used the same frame
+	Synchronous,
+	// Rays submitted through the async trace API in frame N, folded into Lucidity in frame N+1
+	OneFrameLate
+};
+
+// Last precomputed light volume sample, reused until the poll point leaves its cell
+struct FLucidIncidentRadianceCache
+{
+	TWeakObjectPtr<ULevel> Level;
+	FIntVector Cell;
+	FVector PollPoint;
+	FSHVectorRGB3 Radiance;
+	float Shadowing;
+	float Weight;
+	FVector SkyBent;
+	float Luminance;
+	// FLucidLevelData generation the sample was taken at
+	uint32 Generation;
+	bool bHasLevel;
+	bool bValid;
+
+	FLucidIncidentRadianceCache() :
+		Cell( FIntVector::ZeroValue ),
+		PollPoint( FVector::ZeroVector ),
+		Shadowing( 0.f ),
+		Weight( 0.f ),
+		SkyBent( FVector::ZeroVector ),
+		Luminance( 0.f ),
+		Generation( 0 ),
+		bHasLevel( false ),
+		bValid( false )
+	{}
+};
+
+// Where and under which sun and occluders a sun visibility was traced
+struct FLucidSunVisibilityKey
+{
+	FIntVector Cell;
+	FVector Location;
+	FVector SunDirection;
+	float SunIntensity;
+	// FLucidOccluders generation, proxies coming or going change what the rays would have hit
+	uint32 OccluderGeneration;
+
+	FLucidSunVisibilityKey() :
+		Cell( FIntVector::ZeroValue ),
+		Location( FVector::ZeroVector ),
+		SunDirection( FVector::ZeroVector ),
+		SunIntensity( 0.f ),
+		OccluderGeneration( 0 )
+	{}
+};
+
+// Last traced sun visibility, reused until the character moves, the sun or the occluders change or something movable comes near
+struct FLucidSunVisibilityCache
+{
+	FLucidSunVisibilityKey Key;
+	float Visibility;
+	bool bValid;
+	// The rays traced this update may refill the cache under PendingKey once resolved
+	FLucidSunVisibilityKey PendingKey;
+	bool bPending;
+
+	FLucidSunVisibilityCache() :
+		Visibility( 0.f ),
+		bValid( false ),
+		bPending( false )
+	{}
+};
+
+// Traced occlusion of one dynamic light, reused until the light or the character moves
+struct FLucidLightVisibility
+{
+	TWeakObjectPtr<UPointLightComponent> Light;
+	FVector LightPosition;
+	FVector TargetPosition;
+	float Visibility;
+	// Still among the character's candidate lights, entries left behind are dropped
+	bool bCandidate;
+};
+
+// Integrates a character's Lucidity on its own interval, separate from the actor tick
+USTRUCT()
+struct FLucidityTickFunction : public FTickFunction
+{
+	GENERATED_USTRUCT_BODY()
+
+	class AAlexandriaCharacter* Target;
+
+	FLucidityTickFunction() : Target( nullptr ) {}
+
+	virtual void ExecuteTick( float DeltaTime, ELevelTick TickType, ENamedThreads::Type CurrentThread, const FGraphEventRef &MyCompletionGraphEvent ) override;
+	virtual FString DiagnosticMessage() override;
+};
+
+template<>
+struct TStructOpsTypeTraits<FLucidityTickFunction> : public TStructOpsTypeTraitsBase
+{
+	enum
+	{
+		WithCopy = false
+	};
+};
+
+// Server owned Lucidity as replicated, 19 bits on the wire
+USTRUCT()
+struct FLucidityNetState
+{
+	GENERATED_USTRUCT_BODY()
+
+	static const uint32 LucidityLevels = 1024;
+	static const uint32 TickLucidityLevels = 256;
+	// Exposure above this integrates no differently for replication purposes
+	static const float MaxTickLucidity;
+
+	uint16 Lucidity;
+	uint8 TickLucidity;
+	uint8 bInnerRadiance;
+
+	FLucidityNetState() :
+		Lucidity( 0 ),
+		TickLucidity( 0 ),
+		bInnerRadiance( 0 )
+	{}
+
+	void Quantize( const float InLucidity, const float InTickLucidity, const bool bInInnerRadiance );
+
+	FORCEINLINE float GetLucidity() const { return (float)Lucidity / (LucidityLevels - 1); }
+	FORCEINLINE float GetTickLucidity() const { return (float)TickLucidity*MaxTickLucidity / (TickLucidityLevels - 1); }
+
+	bool NetSerialize( FArchive &Ar, class UPackageMap* Map, bool &bOutSuccess );
+
+	bool operator==( const FLucidityNetState &Other ) const
+	{
+		return (Lucidity == Other.Lucidity) && (TickLucidity == Other.TickLucidity) && (bInnerRadiance == Other.bInnerRadiance);
+	}
+};
+
+template<>
+struct TStructOpsTypeTraits<FLucidityNetState> : public TStructOpsTypeTraitsBase
+{
+	enum
+	{
+		WithNetSerializer = true,
+		WithIdenticalViaEquality = true
+	};
+};
+
+UCLASS(config=Game)
+class AAlexandriaCharacter : public ACharacter
+{
+	GENERATED_BODY()
+	/** Camera boom positioning the camera behind the character */
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = Camera, meta = (AllowPrivateAccess = "true"))
+	class USpringArmComponent* CameraBoom;
+
+	/** Follow camera */
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = Camera, meta = (AllowPrivateAccess = "true"))
+	class UCameraComponent* FollowCamera;
+
+	UPROPERTY( VisibleAnywhere, BlueprintReadWrite, Category = "Lucidity (Radiance)", meta = (AllowPrivateAccess = "true") )
+	class UPointLightComponent* RadianceLight;
+
+	UPROPERTY( VisibleAnywhere, BlueprintReadWrite, Category = "Lucidity (Radiance)", meta = (AllowPrivateAccess = "true") )
+	class UStaticMeshComponent* RadianceGlobe;
+
+	// Radiance assets are soft referenced and streamed in after the character, see LoadRadianceAssets
+	UPROPERTY( Category = "Lucidity (Radiance)", EditDefaultsOnly )
+	TAssetPtr<UStaticMesh> RadianceGlobeMesh;
+
+	UPROPERTY( Category = "Lucidity (Radiance)", EditDefaultsOnly )
+	TAssetPtr<UMaterial> RadianceMaterial;
+
+	UPROPERTY( Category = "Lucidity (Radiance)", EditDefaultsOnly )
+	TAssetPtr<UParticleSystem> RadianceFireEmitter;
+
+	// Burns instead of RadianceFireEmitter below full radiance LOD, none means no fire there
+	UPROPERTY( Category = "Lucidity (Radiance)", EditDefaultsOnly )
+	TAssetPtr<UParticleSystem> RadianceFireEmitterLow;
+
+	class UMaterialInstanceDynamic* RadianceMaterialInst;
+
+	// Taken from the world's FLucidFirePool while the fire burns, null otherwise
+	UPROPERTY( Transient, BlueprintReadOnly, Category = "Lucidity (Radiance)", meta = (AllowPrivateAccess = "true") )
+	class UParticleSystemComponent* RadianceFire;
+	
+
+protected:
+	
+
+public:
+	AAlexandriaCharacter();
+
+	/** Base turn rate, in deg/sec. Other scaling may affect final turn rate. */
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category=Camera)
+	float BaseTurnRate;
+
+	/** Base look up/down rate, in deg/sec. Other scaling may affect final rate. */
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category=Camera)
+	float BaseLookUpRate;
+
+protected:
+	UPROPERTY( Category = "Lucidity (Radiance)", EditAnywhere, BlueprintReadOnly )
+	class ADirectionalLight* Sun;
+
+
+	UPROPERTY( Category = "Lucidity (Radiance)", EditAnywhere, BlueprintReadWrite )
+	FLinearColor RadianceColor;
+
+	UPROPERTY( Category = "Lucidity (Movement)", EditAnywhere, BlueprintReadWrite)
+	struct FLucidMoveProperty LucidMoveSpeed;
+
+	UPROPERTY( Category = "Lucidity (Movement)", EditAnywhere, BlueprintReadWrite)
+	struct FLucidMoveProperty LucidAcceleration;
+
+	UPROPERTY( Category = "Lucidity (Movement)", EditAnywhere, BlueprintReadWrite)
+	struct FLucidMoveProperty LucidGravity;
+
+	UPROPERTY( Category = "Lucidity (Movement)", EditAnywhere, BlueprintReadWrite)
+	struct FLucidMoveProperty LucidAirControl;
+
+	UPROPERTY( Category = "Lucidity (Movement)", EditAnywhere, BlueprintReadWrite )
+	struct FLucidMoveProperty LucidJumpZ;
+
+	UPROPERTY( Category = "Lucidity (Movement)", EditAnywhere, BlueprintReadWrite)
+	struct FLucidMoveProperty LucidLateralAirFriction;
+
+	UPROPERTY( Category = "Lucidity (Radiance)", EditAnywhere, BlueprintReadWrite )
+	struct FLucidMoveProperty MaterialOpacity;
+
+	UPROPERTY( Category = "Lucidity (Radiance)", EditAnywhere, BlueprintReadWrite )
+	struct FLucidMoveProperty EmissiveStrength;
+
+	UPROPERTY( Category = "Lucidity (Radiance)", EditAnywhere, BlueprintReadWrite )
+	struct FLucidMoveProperty SunlightIntensity;
+
+	struct FLucidMoveProperty SunlightTemperature;
+
+	UPROPERTY( Category = "Lucidity (Radiance)", EditAnywhere, BlueprintReadWrite )
+	uint32 bInnerRadiance : 1;
+
+	UPROPERTY( Category = "Lucidity (Radiance)", EditAnywhere, BlueprintReadWrite )
+	float InnerRadianceDecayTime;
+
+
+
+
+
+	// Rate at which Lucidity decays when exposed to shadow
+	UPROPERTY( Category = "Lucidity (Radiance)", EditAnywhere, BlueprintReadWrite, meta=( ClampMin = "0", UIMin = "0" ) )
+	float AbsorbVelocity;
+
+	UPROPERTY( Category = "Lucidity (Radiance)", EditAnywhere, BlueprintReadWrite, meta = (ClampMin = "0", UIMin = "0") )
+	float ConsumeVelocity;
+
+	// Whether sun rays block the game thread or are read back one frame late
+	UPROPERTY( Category = "Lucidity (Radiance)", EditAnywhere, BlueprintReadWrite )
+	ELucidTraceLatency SunTraceLatency;
+
+	// Sample the level's baked sun visibility volume instead of tracing, when one is loaded
+	UPROPERTY( Category = "Lucidity (Radiance)", EditAnywhere, BlueprintReadWrite )
+	uint32 bUseBakedSunVisibility : 1;
+
+	// How far towards the sun to look for movable occluders the bake cannot know about
+	UPROPERTY( Category = "Lucidity (Radiance)", EditAnywhere, BlueprintReadWrite, meta = (ClampMin = "0", UIMin = "0") )
+	float MovableOccluderRange;
+
+	// Spread sun rays over the poll volume across ticks and accumulate their results
+	UPROPERTY( Category = "Lucidity (Radiance)", EditAnywhere, BlueprintReadWrite )
+	uint32 bTemporalSunSampling : 1;
+
+	// Sun rays per tick when sampling temporally, at most MaxSunRaysPerUpdate
+	UPROPERTY( Category = "Lucidity (Radiance)", EditAnywhere, BlueprintReadWrite, meta = (ClampMin = "1", UIMin = "1", ClampMax = "4", UIMax = "4") )
+	int32 SunRaysPerTick;
+
+	// Keep the last traced sun visibility and issue no sun rays while nothing it depends on has changed
+	UPROPERTY( Category = "Lucidity (Radiance)", EditAnywhere, BlueprintReadWrite )
+	uint32 bReuseSunVisibility : 1;
+
+	// The reused sun visibility is traced again once the character leaves this cell...
+	UPROPERTY( Category = "Lucidity (Radiance)", EditAnywhere, BlueprintReadWrite, meta = (ClampMin = "1", UIMin = "1") )
+	float SunVisibilityCellSize;
+
+	// ...or moves further than this from where it was traced...
+	UPROPERTY( Category = "Lucidity (Radiance)", EditAnywhere, BlueprintReadWrite, meta = (ClampMin = "0", UIMin = "0") )
+	float SunVisibilityTolerance;
+
+	// ...or the sun turns by more than this many degrees...
+	UPROPERTY( Category = "Lucidity (Radiance)", EditAnywhere, BlueprintReadWrite, meta = (ClampMin = "0", UIMin = "0") )
+	float SunVisibilityAngleTolerance;
+
+	// ...or its intensity changes by more than this fraction, or a movable occluder comes within MovableOccluderRange
+	UPROPERTY( Category = "Lucidity (Radiance)", EditAnywhere, BlueprintReadWrite, meta = (ClampMin = "0", UIMin = "0") )
+	float SunVisibilityIntensityTolerance;
+
+	// Count baked GI and bounce light from the precomputed light volume towards Lucidity.
+	// Off by default: the volume's luminance is not on the sun and light radiance scale, tune IncidentRadianceScale first
+	UPROPERTY( Category = "Lucidity (Radiance)", EditAnywhere, BlueprintReadWrite )
+	uint32 bUseIncidentRadiance : 1;
+
+	UPROPERTY( Category = "Lucidity (Radiance)", EditAnywhere, BlueprintReadWrite, meta = (ClampMin = "0", UIMin = "0") )
+	float IncidentRadianceScale;
+
+	// The cached light volume sample is kept until the poll point leaves this cell...
+	UPROPERTY( Category = "Lucidity (Radiance)", EditAnywhere, BlueprintReadWrite, meta = (ClampMin = "1", UIMin = "1") )
+	float IncidentRadianceCellSize;
+
+	// ...or moves further than this from where it was taken
+	UPROPERTY( Category = "Lucidity (Radiance)", EditAnywhere, BlueprintReadWrite, meta = (ClampMin = "0", UIMin = "0") )
+	float IncidentRadianceTolerance;
+
+	// Most "Lucidity" tagged lights considered per update, nearest first
+	UPROPERTY( Category = "Lucidity (Radiance)", EditAnywhere, BlueprintReadWrite, meta = (ClampMin = "0", UIMin = "0") )
+	int32 MaxDynamicLights;
+
+	// Trace towards dynamic lights so walls and furniture between them and the character block their light.
+	// Rays come from the world's per frame lucidity.LightOcclusionBudget, brightest lights first
+	UPROPERTY( Category = "Lucidity (Radiance)", EditAnywhere, BlueprintReadWrite )
+	uint32 bTraceLightOcclusion : 1;
+
+	// A light's visibility is traced again once it or the character moves further than this
+	UPROPERTY( Category = "Lucidity (Radiance)", EditAnywhere, BlueprintReadWrite, meta = (ClampMin = "0", UIMin = "0") )
+	float LightVisibilityTolerance;
+
+	// Quantize Lucidity for the light and globe material, skipping pushes while the step is unchanged
+	UPROPERTY( Category = "Lucidity (Radiance)", EditAnywhere, BlueprintReadWrite )
+	uint32 bQuantizeVisualFeedback : 1;
+
+	UPROPERTY( Category = "Lucidity (Radiance)", EditAnywhere, BlueprintReadWrite, meta = (ClampMin = "0.001", UIMin = "0.001", ClampMax = "1", UIMax = "1") )
+	float VisualLucidityStep;
+
+	// View significance below which the radiance light and globe stop casting shadows...
+	UPROPERTY( Category = "Lucidity (Radiance)", EditAnywhere, BlueprintReadWrite, meta = (ClampMin = "0", UIMin = "0", ClampMax = "1", UIMax = "1") )
+	float RadianceShadowSignificance;
+
+	// ...the radiance light is turned off...
+	UPROPERTY( Category = "Lucidity (Radiance)", EditAnywhere, BlueprintReadWrite, meta = (ClampMin = "0", UIMin = "0", ClampMax = "1", UIMax = "1") )
+	float RadianceLightSignificance;
+
+	// ...and the fire goes out
+	UPROPERTY( Category = "Lucidity (Radiance)", EditAnywhere, BlueprintReadWrite, meta = (ClampMin = "0", UIMin = "0", ClampMax = "1", UIMax = "1") )
+	float RadianceFireSignificance;
+
+	// Significance a character must move past a threshold before its radiance LOD changes
+	UPROPERTY( Category = "Lucidity (Radiance)", EditAnywhere, BlueprintReadWrite, meta = (ClampMin = "0", UIMin = "0", ClampMax = "0.5", UIMax = "0.5") )
+	float RadianceLodHysteresis;
+
+	// Lucidity the inner radiance fire lights above...
+	UPROPERTY( Category = "Lucidity (Radiance)", EditAnywhere, BlueprintReadWrite, meta = (ClampMin = "0", UIMin = "0", ClampMax = "1", UIMax = "1") )
+	float FireIgniteLucidity;
+
+	// ...and goes out below
+	UPROPERTY( Category = "Lucidity (Radiance)", EditAnywhere, BlueprintReadWrite, meta = (ClampMin = "0", UIMin = "0", ClampMax = "1", UIMax = "1") )
+	float FireExtinguishLucidity;
+
+	// Integrate Lucidity on LucidityTick at a significance scaled rate, interpolating the applied value every frame
+	UPROPERTY( Category = "Lucidity (Update Rate)", EditAnywhere, BlueprintReadWrite )
+	uint32 bDecoupledLucidityTick : 1;
+
+	// Interval used at full significance
+	UPROPERTY( Category = "Lucidity (Update Rate)", EditAnywhere, BlueprintReadWrite, meta = (ClampMin = "0", UIMin = "0") )
+	float MinLucidityInterval;
+
+	// Interval used at zero significance
+	UPROPERTY( Category = "Lucidity (Update Rate)", EditAnywhere, BlueprintReadWrite, meta = (ClampMin = "0", UIMin = "0") )
+	float MaxLucidityInterval;
+
+	// Distance to the closest player view where significance starts to fall off...
+	UPROPERTY( Category = "Lucidity (Update Rate)", EditAnywhere, BlueprintReadWrite, meta = (ClampMin = "0", UIMin = "0") )
+	float SignificanceNearDistance;
+
+	// ...and where it reaches zero
+	UPROPERTY( Category = "Lucidity (Update Rate)", EditAnywhere, BlueprintReadWrite, meta = (ClampMin = "0", UIMin = "0") )
+	float SignificanceFarDistance;
+
+	// Lucidity change per second that always gets the full update rate
+	UPROPERTY( Category = "Lucidity (Update Rate)", EditAnywhere, BlueprintReadWrite, meta = (ClampMin = "0", UIMin = "0") )
+	float SignificanceChangeRate;
+
+	// Interval between replicated Lucidity updates at full significance...
+	UPROPERTY( Category = "Lucidity (Network)", EditAnywhere, BlueprintReadWrite, meta = (ClampMin = "0", UIMin = "0") )
+	float MinNetLucidityInterval;
+
+	// ...and at zero significance
+	UPROPERTY( Category = "Lucidity (Network)", EditAnywhere, BlueprintReadWrite, meta = (ClampMin = "0", UIMin = "0") )
+	float MaxNetLucidityInterval;
+
+	// Error the owning client's predicted Lucidity may have before the server's value replaces it
+	UPROPERTY( Category = "Lucidity (Network)", EditAnywhere, BlueprintReadWrite, meta = (ClampMin = "0", UIMin = "0", ClampMax = "1", UIMax = "1") )
+	float NetLucidityTolerance;
+
+
+
+public:
+
+	virtual void Tick( float DeltaSeconds );
+
+	virtual void PostInitializeComponents();
+
+	virtual void BeginPlay();
+
+	virtual void EndPlay( const EEndPlayReason::Type EndPlayReason ) override;
+
+	virtual void RegisterActorTickFunctions( bool bRegister ) override;
+
+	/** Integrates Lucidity, called from LucidityTick */
+	void TickLucidity( float DeltaSeconds );
+
+	/**
+	 * Integrates Lucidity at world time Now, skipped if no time has passed since the last update
+	 * or the trace budget defers it. bForce traces outside the budget.
+	 */
+	void UpdateLucidity( const float Now, const float DeltaSeconds, const bool bForce = false );
+
+	/** 0-1 importance of this character's Lucidity, from view distance, visibility and change rate */
+	float CalcLuciditySignificance() const;
+
+	/** 0-1 importance of this character to the players' views, from distance and visibility only */
+	float CalcViewSignificance() const;
+
+	FORCEINLINE ELucidRadianceLod GetRadianceLod() const { return RadianceLod; }
+
+	/** Counts this character and its active radiance components at its LOD */
+	void AddToRadianceLodCensus( FLucidRadianceLodCensus &Census ) const;
+
+	/** Whether the Lucidity interval has elapsed, for the batched update */
+	bool IsLucidityDue( const float Now ) const;
+
+	/**
+	 * Asks the world's trace budget for this update's sun and light rays, bForce takes them regardless.
+	 * No sun rays are asked for when the bake or the reused visibility will answer.
+	 * @return false if the update is deferred to a later frame
+	 */
+	bool AcquireLucidityTraces( const float Now, const bool bForce );
+
+	/** Starts a Lucidity update at world time Now, returns the real time since the last one */
+	float BeginLucidityUpdate( const float Now, const float DeltaSeconds );
+
+	/** Traces the sun on the Lucidity channel against occluder proxies while every loaded level has them */
+	void UpdateSunTraceSetup();
+
+	/** Stores the integrated Lucidity and schedules the next update from its significance */
+	void FinishLucidityUpdate( const float NewLucidity, const float Elapsed );
+
+	/**
+	 * Exposure from everything but traced sun rays, for the batched update.
+	 * Sun rays still to trace are appended to OutRays, OutSunScale is what their visibility is worth.
+	 */
+	float GatherBatchedExposure( const FLucidSunState &SunState, TArray<FLucidSunRay> &OutRays, float &OutSunScale );
+
+	/** Traces one sun ray, true if it reaches the player. Safe to call from worker threads */
+	bool TraceSunRay( const FLucidSunRay &Ray ) const;
+
+	/** Folds traced rays into the exposure history and returns the sun visibility */
+	float ResolveSunRays( const FLucidSunRay* Rays, const bool* bLit, const int32 Count );
+
+	/** Packs this character's Lucidity driven properties into Table, as RefreshLucidProperties does */
+	void BuildLucidPropertyTable( FLucidPropertyTable &Table ) const;
+
+	void DebugPrintRadiance( const float DrawTime, const FVector PollPoint, const FSHVectorRGB3 &Radiance, const float Shadowing, const float Weight, const FVector &SkyBent, const float Luminance ) const;
+
+	class ULocalPlayer* GetLocalPlayer() const;
+
+	static FSceneView* GetPlayerSceneView( ULocalPlayer* LocPlayer );
+
+	FORCEINLINE static float GetMoveScalar( const FLucidMoveProperty &LucidMove, const float LucidValue) { return LucidMove.Min + LucidValue*(LucidMove.Max - LucidMove.Min); }
+
+protected:
+
+	UFUNCTION( BlueprintCallable )
+	void GiveInnerRadiance() { bInnerRadiance = true; }
+
+	UFUNCTION()
+	void OnRep_NetLucidity();
+
+	UFUNCTION( BlueprintCallable )
+	bool HasInnerRadiance() const { return bInnerRadiance; }
+
+	/** Repacks the Lucidity property table, call after changing a FLucidMoveProperty at runtime */
+	UFUNCTION( BlueprintCallable, Category = "Lucidity (Movement)" )
+	void RefreshLucidProperties();
+
+	/** Resets HMD orientation in VR. */
+	void OnResetVR();
+
+	/** Called for forwards/backward input */
+	void MoveForward(float Value);
+
+	/** Called for side to side input */
+	void MoveRight(float Value);
+
+	/** 
+	 * Called via input to turn at a given rate. 
+	 * @param Rate	This is a normalized rate, i.e. 1.0 means 100% of desired turn rate
+	 */
+	void TurnAtRate(float Rate);
+
+	/**
+	 * Called via input to turn look up/down at a given rate. 
+	 * @param Rate	This is a normalized rate, i.e. 1.0 means 100% of desired turn rate
+	 */
+	void LookUpAtRate(float Rate);
+
+	float CalcPlayerIncidentRadiance( const FBoxSphereBounds &Bounds, FSHVectorRGB3 &Radiance, float &Shadowing, float &Weight, FVector &SkyBent );
+
+	static void RecordIncidentCacheLookup( const bool bHit );
+
+	// Falloff weighted light from nearby dynamic lights, occlusion rays drawn from the world's light occlusion budget
+	float CalcDynamicLightRadiance();
+
+	// Attenuation of Light at Distance as the renderer computes it: the falloff exponent ramp, or 1/(d^2+1) inside
+	// the radius window for inverse squared lights
+	static float CalcLightAttenuation( const FLucidLocalLightState &Light, const float Distance );
+
+	// Cached visibility of Candidate from Target, traced again once either has moved while Scheduler has rays left
+	float GetLightVisibility( const FLucidLightCandidate &Candidate, const FVector &Target, class FLucidTraceScheduler* Scheduler );
+
+	// Updates the Sun properties and gets its current effect on the player
+	float GetSolarIllumination( const int32 AvailableTraces );
+
+	// This frame's lighting snapshot of the world
+	FLucidLightingFrameRef GetLightingFrame() const;
+
+	// Takes on the sun's intensity and colour
+	void ApplySunState( const FLucidSunState &SunState );
+
+	// Prepares the exposure sampler, returns how many sun rays to trace this tick
+	int32 BeginSunSampling( const FLucidSunState &SunState, const int32 AvailableTraces );
+
+	// Sun rays an update traces when it traces any, before the trace budget has its say
+	int32 GetSunRaysWanted() const;
+
+	// False when this update's sun visibility needs no rays: no sun to speak of, or the bake or the reused visibility answers.
+	// Sweeps for movable occluders on the way, once for the whole update, see bMovableOccludersNearSun.
+	bool NeedsSunRays();
+
+	// Averages baked visibility over poll points, false if there is no bake here or something movable may shadow us
+	bool SampleBakedSunVisibility( const FVector &Plane, const int32 NumSamples, const bool bMovableOccluders, float &OutVisibility ) const;
+
+	// Whether SampleBakedSunVisibility has a bake to sample here, leaving movable occluders aside
+	bool CanSampleBakedSunVisibility( const FVector &Plane ) const;
+
+	// Sweeps towards the sun for movable occluders, which neither the bake nor the occluder BVH know about.
+	// Done once per update and only when one of them could answer, its result is passed down to both.
+	bool HasMovableOccluders( const FVector &Plane ) const;
+
+	/**
+	 * True with the reused sun visibility while it is still valid. Otherwise keys the cache on this update's rays
+	 * and sends them to the occluder BVH while it covers the world and nothing movable is in the way.
+	 */
+	bool PrepareSunRays( const FLucidSunState &SunState, const bool bMovableOccluders, float &OutVisibility );
+
+	// Reuse cache cell of the character's location
+	FIntVector GetSunVisibilityCell() const;
+
+	// Whether SunVisibilityCache still holds this update's answer, leaving movable occluders aside
+	bool IsSunVisibilityReusable( const FLucidSunState &SunState ) const;
+
+	static void RecordSunVisibilityLookup( const bool bHit );
+
+	// Next poll point for a sun ray, OutStratum is INDEX_NONE unless sampling temporally
+	FVector NextSunPollPoint( int32 &OutStratum );
+
+	// Appends Count rays from the sun plane towards the next poll points
+	void BuildSunRays( const FLucidSunState &SunState, const int32 Count, TArray<FLucidSunRay> &OutRays );
+
+	// Fraction of sun rays reaching the player, traced on the game thread or the occluder BVH
+	float TraceSunVisibility( const FLucidSunState &SunState, const int32 AvailableTraces );
+
+	// Fraction of last frame's sun rays reaching the player, submitting this frame's rays for the next
+	float TraceSunVisibilityAsync( const FLucidSunState &SunState, const int32 AvailableTraces );
+
+	FVector GetPollPoint() const;
+
+	//float GetLuminanceOfBlock( const FBoxSphereBounds &Bounds );
+
+	/** Handler for when a touch input begins. */
+	void TouchStarted(ETouchIndex::Type FingerIndex, FVector Location);
+
+	/** Handler for when a touch input stops. */
+	void TouchStopped(ETouchIndex::Type FingerIndex, FVector Location);
+
+protected:
+	// APawn interface
+	virtual void SetupPlayerInputComponent(class UInputComponent* PlayerInputComponent) override;
+	// End of APawn interface
+
+private:
+
+	// current amount of illumination (1.f - 0.f)
+	float Lucidity;
+
+	// Lucidity as applied to movement and visuals, blended towards Lucidity between lucidity ticks
+	float AppliedLucidity;
+	float LucidityChangeRate;
+	float LastLucidityUpdateTime;
+	float LucidityBlendFrom;
+	float LucidityBlendTime;
+	float LucidityBlendDuration;
+
+	FLucidityTickFunction LucidityTick;
+
+	float SunIntensity;
+	float BaseSunIntensity;
+
+	float TimeSinceLastUptick;
+
+	FLinearColor SunColor;
+
+	// Sun trace setup, shared by every ray until occluder proxies come or go
+	FCollisionQueryParams SunTraceParams;
+	FCollisionResponseParams SunTraceResponse;
+	TEnumAsByte<ECollisionChannel> SunTraceChannel;
+	uint32 SunTraceGeneration;
+	FCollisionObjectQueryParams MovableOccluderParams;
+	// This update's sun rays trace the occluder BVH instead of the physics scene, see PrepareSunRays
+	bool bSunRaysOnBvh;
+	// Something movable lies towards the sun this update, swept once by NeedsSunRays
+	bool bMovableOccludersNearSun;
+
+	// Rays submitted last frame in OneFrameLate mode
+	TArray<FTraceHandle> PendingSunTraces;
+	TArray<FLucidSunRay> PendingSunRays;
+	// The cache key those rays were submitted under, they refill the cache with it when read back
+	FLucidSunVisibilityKey PendingSunKey;
+	bool bPendingSunKey;
+	// Scratch list of rays traced this tick
+	TArray<FLucidSunRay> SunRays;
+	float AsyncSunVisibility;
+
+	static const FName SunTraceTag;
+
+	// Sun rays an update asks the trace budget for when not sampling temporally
+	static const int32 MaxSunRaysPerUpdate = 4;
+
+	FLucidExposureSampler ExposureSampler;
+
+	FLucidIncidentRadianceCache IncidentRadianceCache;
+
+	FLucidSunVisibilityCache SunVisibilityCache;
+
+	// Scratch list reused by CalcDynamicLightRadiance to avoid a per-tick allocation
+	TArray<FLucidLightCandidate> LightCandidates;
+	// Occlusion of the current candidate lights
+	TArray<FLucidLightVisibility> LightVisibility;
+
+	// Sun rays granted to the current Lucidity update by the trace budget
+	int32 SunTraceGrant;
+	// Determines whether or not Lucidity is maintained when exposed to darkness.
+
+	static const FName MatOpacityName;
+	static const FName EmissiveStrName;
+
+	// Parameter slots on RadianceMaterialInst, resolved in PostInitializeComponents
+	int32 MatOpacityIndex;
+	int32 EmissiveStrIndex;
+
+	// Quantized Lucidity last pushed to the light and material
+	float LastVisualLucidity;
+
+	ELucidRadianceLod RadianceLod;
+	float NextRadianceLodTime;
+
+	// Fire hysteresis state, kept while the LOD hides the fire
+	uint32 bRadianceFireLit : 1;
+
+	// Server owned Lucidity, published at a significance scaled rate
+	UPROPERTY( ReplicatedUsing = OnRep_NetLucidity )
+	FLucidityNetState NetLucidity;
+
+	// Exposure the last integration step moved towards, replicated so proxies can extrapolate
+	float LastTickLucidity;
+	float LastNetPublishTime;
+
+	// Movement and visual properties, packed in BeginPlay
+	FLucidPropertyTable LucidProperties;
+
+	// Updated by the world's FLucidityManager instead of LucidityTick
+	uint32 bBatchedLucidity : 1;
+
+	// Whether the radiance light, fire and material exist and the globe renders, see ShouldCreateCosmetics.
+	// The globe and its collision exist either way
+	uint32 bCosmeticLucidity : 1;
+
+	// False on dedicated servers and headless (-nullrhi) runs, where only gameplay Lucidity is needed
+	static bool ShouldCreateCosmetics();
+
+	// Set once the radiance assets are bound, visual feedback waits for it while gameplay Lucidity runs
+	uint32 bRadianceAssetsBound : 1;
+
+	// Streams the radiance assets in, or loads them at once outside game worlds and with -LucidSyncAssets
+	void LoadRadianceAssets();
+
+	// Applies the loaded mesh, material and emitter to the radiance components
+	void BindRadianceAssets();
+
+	float CalcLucidity( const float DeltaSeconds );
+	// Simulated proxies integrate towards the replicated exposure instead of tracing
+	float ExtrapolateLucidity( const float DeltaSeconds );
+	void PublishNetLucidity( const float Significance );
+	float CalcIncidentLuminance();
+	float IntegrateLucidity( const float TickLucidity, const float DeltaSeconds );
+	void UpdateMovementParams( const float DeltaSeconds );
+	void UpdateVisualFeedback( const float DeltaSeconds );
+	void UpdateRadianceFire( const float VisualLucidity, const bool bScaleChanged );
+
+	FLucidRadianceLodSettings GetRadianceLodSettings() const;
+	// Re-decides the radiance LOD every LucidRadianceLod::UpdateInterval
+	void UpdateRadianceLod();
+	// Switches the light, shadows and fire to RadianceLod
+	void ApplyRadianceLod();
+	UParticleSystem* GetRadianceFireTemplate() const;
+	void ReleaseRadianceFire();
+
+	
+
+public:
+	/** Returns CameraBoom subobject **/
+	FORCEINLINE class USpringArmComponent* GetCameraBoom() const { return CameraBoom; }
+	/** Returns FollowCamera subobject **/
+	FORCEINLINE class UCameraComponent* GetFollowCamera() const { return FollowCamera; }
+	
+	FORCEINLINE class UPointLightComponent* GetRadianceLight() const { return RadianceLight; }
+	FORCEINLINE class UStaticMeshComponent* GetRadianceGlobe() const { return RadianceGlobe; }
+	FORCEINLINE bool HasCosmeticLucidity() const { return bCosmeticLucidity; }
+
+	// Starts streaming the default radiance assets while a map loads, bound to PreLoadMap by the game module
+	static void PreloadRadianceAssets( const FString &MapName );
+
+	FORCEINLINE class ADirectionalLight* GetSun() const { return Sun; }
+	FORCEINLINE float GetLucidity() const { return Lucidity; }
+	FORCEINLINE float GetAbsorbtionRate() const { return AbsorbVelocity; }
+
+	// Packs integration inputs and writes results back directly
+	friend class FLucidityBatch;
+	// Configures spawned agents per benchmark run
+	friend class ULucidityBenchmarkCommandlet;
+	// Reads update inputs and integration parameters while recording
+	friend class FLucidityRecorder;
+	// Replays recorded light contributions through CalcLightAttenuation
+	friend class ULucidityReplayCommandlet;
+	// Evaluates light attenuation over the navigable area
+	friend class FLucidCostField;
+	
+	
+	
+};
+
+
+
+
+
@@ -1,21 +1,21 @@
-// Copyright 1998-2017 Epic Games, Inc. All Rights Reserved.
-#pragma once
-#include "Logging/LogMacros.h"
-#include "GameFramework/GameModeBase.h"
-#include "AlexandriaGameMode.generated.h"
-
-DECLARE_LOG_CATEGORY_EXTERN( AlexandriaLog, Log, All );
-
-UCLASS(minimalapi)
-class AAlexandriaGameMode : public AGameModeBase
-{
-	GENERATED_BODY()
-
-public:
-	AAlexandriaGameMode();
-};
-
-
-
-
-
+// Copyright 1998-2017 Epic Games, Inc. All Rights Reserved.
+#pragma once
+#include "Logging/LogMacros.h"
+#include "GameFramework/GameModeBase.h"
+#include "AlexandriaGameMode.generated.h"
+
+DECLARE_LOG_CATEGORY_EXTERN( AlexandriaLog, Log, All );
+
+UCLASS(minimalapi)
+class AAlexandriaGameMode : public AGameModeBase
+{
+	GENERATED_BODY()
+
+public:
+	AAlexandriaGameMode();
+};
+
+
+
+
+
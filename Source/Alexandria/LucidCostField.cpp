@@ -0,0 +1,504 @@
+// Copyright 1998-2017 Epic Games, Inc. All Rights Reserved.
+
+#include "Alexandria.h"
+#include "LucidCostField.h"
+#include "AlexandriaCharacter.h"
+#include "AlexandriaGameMode.h"
+#include "LucidLightRegistry.h"
+#include "LucidityStats.h"
+#include "Async/Async.h"
+#include "AI/Navigation/NavigationSystem.h"
+#include "AI/Navigation/RecastNavMesh.h"
+#include "Components/CapsuleComponent.h"
+#include "Components/PointLightComponent.h"
+
+namespace LucidCostField
+{
+	static TAutoConsoleVariable<int32> CVarCellsPerBatch(
+		TEXT( "lucidity.CostFieldCellsPerBatch" ),
+		128,
+		TEXT( "Dirty cost field polygons evaluated per background batch, each costs a sun trace and one trace per reaching light." ),
+		ECVF_Default );
+
+	static TAutoConsoleVariable<int32> CVarTilesPerFrame(
+		TEXT( "lucidity.CostFieldTilesPerFrame" ),
+		4,
+		TEXT( "Navmesh tiles the cost field sweeps for new or removed polygons per frame." ),
+		ECVF_Default );
+
+	// Edge of the buckets polygon sample points are grouped in, horizontally and vertically
+	static const float BucketSize = 200.f;
+	// Offset keeping packed bucket coordinates positive, as the light registry's cells
+	static const int32 BucketCoordBias = 1 << 20;
+
+	// While polygons are being refreshed, path queries see their new values at most this much later
+	static const double PublishInterval = 0.5;
+
+	// Sun changes below these leave the field as it is
+	static const float SunToleranceDegrees = 2.f;
+	static const float SunIntensityTolerance = 0.05f;
+
+	static const FName TraceTag( TEXT( "LucidCostField" ) );
+
+	static bool HasSunChanged( const FLucidSunState &Old, const FLucidSunState &New )
+	{
+		if (Old.bValid != New.bValid)
+		{
+			return true;
+		}
+		return (FVector::DotProduct( Old.Direction, New.Direction ) < FMath::Cos( FMath::DegreesToRadians( SunToleranceDegrees ) ))
+			|| (FMath::Abs( New.Intensity - Old.Intensity ) > SunIntensityTolerance*FMath::Max( Old.Intensity, SMALL_NUMBER ));
+	}
+
+	static bool HasLightChanged( const FLucidLocalLightState &Old, const FLucidLocalLightState &New )
+	{
+		return (Old.Position != New.Position) || (Old.Brightness != New.Brightness) || (Old.AttenuationRadius != New.AttenuationRadius)
+			|| (Old.FalloffExponent != New.FalloffExponent) || (Old.bInverseSquaredFalloff != New.bInverseSquaredFalloff);
+	}
+
+	static uint64 BucketKey( const int32 X, const int32 Y, const int32 Z )
+	{
+		const uint64 Mask = (1ull << 21) - 1;
+		return (((uint64)(X + BucketCoordBias) & Mask) << 42) | (((uint64)(Y + BucketCoordBias) & Mask) << 21) | ((uint64)(Z + BucketCoordBias) & Mask);
+	}
+
+	static uint64 BucketKey( const FVector &Point )
+	{
+		return BucketKey( FMath::FloorToInt( Point.X / BucketSize ), FMath::FloorToInt( Point.Y / BucketSize ), FMath::FloorToInt( Point.Z / BucketSize ) );
+	}
+}
+
+//////////////////////////////////////////////////////////////////////////
+// FLucidCostField
+
+FLucidCostField::FLucidCostField( UWorld* InWorld ) :
+	World( InWorld ),
+	Grid( MakeShareable( new FLucidCostGrid() ) ),
+	bValuesChanged( false ),
+	LastPublishTime( 0.0 ),
+	NextTile( 0 ),
+	SweepStamp( 1 ),
+	BaseSunIntensity( 1.f ),
+	TraceSetup( FLucidOccluders::GetTraceSetup( InWorld ) ),
+	TraceGeneration( 0 ),
+	LastTickFrame( 0 )
+{
+	SampleHeight = GetDefault<AAlexandriaCharacter>()->GetCapsuleComponent()->GetScaledCapsuleHalfHeight();
+}
+
+FLucidCostField::~FLucidCostField()
+{
+	// The batch traces against the world, which must outlive it
+	if (InFlight.IsValid())
+	{
+		InFlightTask.Wait();
+	}
+}
+
+FLucidCostField* FLucidCostField::Get( UWorld* World )
+{
+	return TLucidPerWorld<FLucidCostField>::Get( World );
+}
+
+FLucidCostField* FLucidCostField::Find( const UWorld* World )
+{
+	return TLucidPerWorld<FLucidCostField>::Find( World );
+}
+
+bool FLucidCostField::IsTickable() const
+{
+	return World.IsValid();
+}
+
+TStatId FLucidCostField::GetStatId() const
+{
+	RETURN_QUICK_DECLARE_CYCLE_STAT( FLucidCostField, STATGROUP_Tickables );
+}
+
+void FLucidCostField::Tick( float DeltaTime )
+{
+	if (LastTickFrame == GFrameCounter)
+	{
+		return;
+	}
+	LastTickFrame = GFrameCounter;
+	SCOPE_CYCLE_COUNTER( STAT_LucidCostField );
+
+	CollectBatch();
+	SweepNavMesh();
+	RefreshTraceSetup();
+	RefreshLighting();
+	if (!InFlight.IsValid())
+	{
+		DispatchBatch();
+	}
+	Publish();
+}
+
+void FLucidCostField::SweepNavMesh()
+{
+	UNavigationSystem* NavSys = World->GetNavigationSystem();
+	const ARecastNavMesh* NavMesh = Cast<ARecastNavMesh>( (NavSys != nullptr) ? NavSys->GetMainNavData( FNavigationSystem::DontCreate ) : nullptr );
+	if (NavMesh == nullptr)
+	{
+		return;
+	}
+
+	const int32 NumTiles = NavMesh->GetNavMeshTilesCount();
+	const int32 TilesPerFrame = FMath::Max( LucidCostField::CVarTilesPerFrame.GetValueOnGameThread(), 1 );
+	TArray<FNavPoly> Polys;
+	for (int32 Step = 0; Step < TilesPerFrame; Step++)
+	{
+		if (NextTile >= NumTiles)
+		{
+			// Sweep finished, drop polygons that were rebuilt away or streamed out
+			for (auto It = Cells.CreateIterator(); It; ++It)
+			{
+				if (It.Value().SweepStamp != SweepStamp)
+				{
+					bValuesChanged |= (Values.Remove( It.Key() ) > 0);
+					TArray<NavNodeRef>* Bucket = Buckets.Find( It.Value().Bucket );
+					if (Bucket != nullptr)
+					{
+						Bucket->RemoveSingleSwap( It.Key(), false );
+						if (Bucket->Num() == 0)
+						{
+							Buckets.Remove( It.Value().Bucket );
+						}
+					}
+					It.RemoveCurrent();
+				}
+			}
+			SweepStamp++;
+			NextTile = 0;
+			if (NumTiles == 0)
+			{
+				break;
+			}
+		}
+
+		Polys.Reset();
+		NavMesh->GetPolysInTile( NextTile++, Polys );
+		for (const FNavPoly &Poly : Polys)
+		{
+			// A rebuilt tile hands out new refs, its old polygons drop out at the end of the sweep
+			FCell* Cell = Cells.Find( Poly.Ref );
+			if (Cell == nullptr)
+			{
+				Cell = &Cells.Add( Poly.Ref );
+				Cell->Point = Poly.Center + FVector( 0.f, 0.f, SampleHeight );
+				Cell->Bucket = LucidCostField::BucketKey( Cell->Point );
+				Cell->bDirty = false;
+				Buckets.FindOrAdd( Cell->Bucket ).Add( Poly.Ref );
+				DirtyCell( Poly.Ref );
+			}
+			Cell->SweepStamp = SweepStamp;
+		}
+	}
+	SET_DWORD_STAT( STAT_LucidCostFieldCells, Cells.Num() );
+}
+
+void FLucidCostField::RefreshTraceSetup()
+{
+	const FLucidOccluders* Occluders = FLucidOccluders::Get( World.Get() );
+	const uint32 Generation = (Occluders != nullptr) ? Occluders->GetGeneration() : 1;
+	if (Generation == TraceGeneration)
+	{
+		return;
+	}
+	TraceGeneration = Generation;
+
+	// Same occluders the characters' sun and light traces see, the field is traced again when they switch
+	const FLucidTraceSetup Setup = FLucidOccluders::GetTraceSetup( World.Get() );
+	if ((Setup.Channel != TraceSetup.Channel) || (Setup.bTraceComplex != TraceSetup.bTraceComplex))
+	{
+		DirtyAll();
+	}
+	TraceSetup = Setup;
+}
+
+void FLucidCostField::RefreshLighting()
+{
+	const FLucidLightingFrameRef Frame = FLucidLightingSnapshot::Get( World.Get() )->GetFrame();
+	if (Lighting.Get() == &Frame.Get())
+	{
+		return;
+	}
+
+	const FLucidSunState &NewSun = Frame->FindSun( Frame->GetPrimarySun() );
+	if (!Lighting.IsValid())
+	{
+		// Sun contributions are relative to the sun at creation, as characters' are to the sun at BeginPlay
+		Sun = NewSun;
+		BaseSunIntensity = (NewSun.bValid && (NewSun.Intensity > SMALL_NUMBER)) ? NewSun.Intensity : 1.f;
+		Lighting = Frame;
+		return;
+	}
+
+	if (LucidCostField::HasSunChanged( Sun, NewSun ))
+	{
+		Sun = NewSun;
+		DirtyAll();
+	}
+	else
+	{
+		for (const auto &Pair : Frame->GetLocalLights())
+		{
+			const FLucidLocalLightState* Old = Lighting->FindLocalLight( Pair.Key );
+			if ((Old == nullptr) || LucidCostField::HasLightChanged( *Old, Pair.Value ))
+			{
+				DirtySphere( Pair.Value.Position, Pair.Value.AttenuationRadius );
+				if (Old != nullptr)
+				{
+					DirtySphere( Old->Position, Old->AttenuationRadius );
+				}
+			}
+		}
+		for (const auto &Pair : Lighting->GetLocalLights())
+		{
+			if (Frame->FindLocalLight( Pair.Key ) == nullptr)
+			{
+				DirtySphere( Pair.Value.Position, Pair.Value.AttenuationRadius );
+			}
+		}
+	}
+	Lighting = Frame;
+}
+
+void FLucidCostField::DirtyCell( const NavNodeRef Key )
+{
+	FCell* Cell = Cells.Find( Key );
+	if ((Cell != nullptr) && !Cell->bDirty)
+	{
+		Cell->bDirty = true;
+		DirtyCells.Add( Key );
+	}
+}
+
+void FLucidCostField::DirtyAll()
+{
+	DirtyCells.Reset();
+	for (auto &Pair : Cells)
+	{
+		Pair.Value.bDirty = true;
+		DirtyCells.Add( Pair.Key );
+	}
+}
+
+void FLucidCostField::DirtySphere( const FVector &Center, const float Radius )
+{
+	using LucidCostField::BucketSize;
+	const FIntVector Min( FMath::FloorToInt( (Center.X - Radius) / BucketSize ), FMath::FloorToInt( (Center.Y - Radius) / BucketSize ), FMath::FloorToInt( (Center.Z - Radius) / BucketSize ) );
+	const FIntVector Max( FMath::FloorToInt( (Center.X + Radius) / BucketSize ), FMath::FloorToInt( (Center.Y + Radius) / BucketSize ), FMath::FloorToInt( (Center.Z + Radius) / BucketSize ) );
+	const FIntVector Span = Max - Min + FIntVector( 1, 1, 1 );
+
+	// A light spanning more buckets than the field has filled is cheaper to test polygon by polygon
+	if ((int64)Span.X*Span.Y*Span.Z > Buckets.Num())
+	{
+		const float ReachSq = FMath::Square( Radius + BucketSize );
+		for (auto &Pair : Cells)
+		{
+			if (FVector::DistSquared( Pair.Value.Point, Center ) <= ReachSq)
+			{
+				DirtyCell( Pair.Key );
+			}
+		}
+		return;
+	}
+
+	for (int32 X = Min.X; X <= Max.X; X++)
+	{
+		for (int32 Y = Min.Y; Y <= Max.Y; Y++)
+		{
+			for (int32 Z = Min.Z; Z <= Max.Z; Z++)
+			{
+				const TArray<NavNodeRef>* Bucket = Buckets.Find( LucidCostField::BucketKey( X, Y, Z ) );
+				if (Bucket != nullptr)
+				{
+					for (const NavNodeRef Key : *Bucket)
+					{
+						DirtyCell( Key );
+					}
+				}
+			}
+		}
+	}
+}
+
+void FLucidCostField::DispatchBatch()
+{
+	if ((DirtyCells.Num() == 0) || !Lighting.IsValid())
+	{
+		return;
+	}
+
+	UWorld* FieldWorld = World.Get();
+	FLucidLightRegistry* Registry = FLucidLightRegistry::Get( FieldWorld );
+	const int32 MaxLights = GetDefault<AAlexandriaCharacter>()->MaxDynamicLights;
+	const int32 MaxCells = FMath::Max( LucidCostField::CVarCellsPerBatch.GetValueOnGameThread(), 1 );
+	const float Extent = LucidCostField::BucketSize*0.5f;
+
+	TSharedPtr<FBatch, ESPMode::ThreadSafe> Batch = MakeShareable( new FBatch() );
+	Batch->Sun = Sun;
+	Batch->BaseSunIntensity = BaseSunIntensity;
+	Batch->SunTraceParams = FCollisionQueryParams( LucidCostField::TraceTag, TraceSetup.bTraceComplex );
+
+	// Light states come from the snapshot and fixtures are resolved here, the task never touches a light
+	TArray<FLucidLightCandidate> Candidates;
+	while ((DirtyCells.Num() > 0) && (Batch->Cells.Num() < MaxCells))
+	{
+		const NavNodeRef Key = DirtyCells.Pop( false );
+		FCell* Cell = Cells.Find( Key );
+		if ((Cell == nullptr) || !Cell->bDirty)
+		{
+			continue;
+		}
+		Cell->bDirty = false;
+
+		FBatchCell &Entry = Batch->Cells[Batch->Cells.AddUninitialized()];
+		Entry.Key = Key;
+		Entry.Point = Cell->Point;
+		Entry.FirstLight = Batch->Lights.Num();
+		Entry.NumLights = 0;
+		if (Registry == nullptr)
+		{
+			continue;
+		}
+
+		Registry->QueryLights( FBoxSphereBounds( Cell->Point, FVector( Extent ), FVector( Extent ).Size() ), MaxLights, Candidates );
+		for (const FLucidLightCandidate &Candidate : Candidates)
+		{
+			const FLucidLocalLightState* State = Lighting->FindLocalLight( Candidate.Light );
+			if (State == nullptr)
+			{
+				continue;
+			}
+			FBatchLight &Light = Batch->Lights[Batch->Lights.AddDefaulted()];
+			Light.State = *State;
+			Light.TraceParams = FCollisionQueryParams( LucidCostField::TraceTag, TraceSetup.bTraceComplex, Candidate.Light->GetOwner() );
+			Entry.NumLights++;
+		}
+	}
+	if (Batch->Cells.Num() == 0)
+	{
+		return;
+	}
+
+	Batch->Results.SetNumZeroed( Batch->Cells.Num() );
+	InFlight = Batch;
+	const ECollisionChannel Channel = TraceSetup.Channel;
+	const FCollisionResponseParams Response = TraceSetup.Response;
+	InFlightTask = Async<void>( EAsyncExecution::TaskGraph, [FieldWorld, Batch, Channel, Response]()
+	{
+		for (int32 i = 0; i < Batch->Cells.Num(); i++)
+		{
+			Batch->Results[i] = EvaluateCell( FieldWorld, *Batch, Batch->Cells[i], Channel, Response );
+		}
+	} );
+}
+
+float FLucidCostField::EvaluateCell( UWorld* World, const FBatch &Batch, const FBatchCell &Cell, const ECollisionChannel Channel, const FCollisionResponseParams &Response )
+{
+	// One ray as long as the characters' sun rays, scene queries are read only
+	float SunLucidity = 0.f;
+	if (Batch.Sun.bValid && (Batch.Sun.Intensity >= SMALL_NUMBER))
+	{
+		const FVector Start = Cell.Point - Batch.Sun.Direction*FVector::Dist( Batch.Sun.LightPosition, Cell.Point );
+		if (!World->LineTraceTestByChannel( Start, Cell.Point, Channel, Batch.SunTraceParams, Response ))
+		{
+			SunLucidity = Batch.Sun.Intensity / Batch.BaseSunIntensity;
+		}
+	}
+
+	// Averaged over every reaching light as CalcDynamicLightRadiance does, where BaseSunIntensity cancels out
+	float Luminance = 0.f;
+	for (int32 i = Cell.FirstLight; i < Cell.FirstLight + Cell.NumLights; i++)
+	{
+		const FBatchLight &Light = Batch.Lights[i];
+		if (Light.State.Brightness <= SMALL_NUMBER)
+		{
+			continue;
+		}
+		const float Attenuation = AAlexandriaCharacter::CalcLightAttenuation( Light.State, FVector::Dist( Light.State.Position, Cell.Point ) );
+		if ((Attenuation > 0.f) && !World->LineTraceTestByChannel( Light.State.Position, Cell.Point, Channel, Light.TraceParams, Response ))
+		{
+			Luminance += Attenuation;
+		}
+	}
+	if (Cell.NumLights > 0)
+	{
+		Luminance /= (float)Cell.NumLights;
+	}
+	return FMath::Clamp( SunLucidity + Luminance, 0.f, 1.f );
+}
+
+void FLucidCostField::CollectBatch()
+{
+	if (!InFlight.IsValid() || !InFlightTask.IsReady())
+	{
+		return;
+	}
+
+	// Polygons dirtied again while the batch ran wait for their next evaluation
+	int32 NumCollected = 0;
+	for (int32 i = 0; i < InFlight->Cells.Num(); i++)
+	{
+		const NavNodeRef Key = InFlight->Cells[i].Key;
+		const FCell* Cell = Cells.Find( Key );
+		if ((Cell != nullptr) && !Cell->bDirty)
+		{
+			Values.Add( Key, InFlight->Results[i] );
+			NumCollected++;
+		}
+	}
+	bValuesChanged |= (NumCollected > 0);
+	INC_DWORD_STAT_BY( STAT_LucidCostFieldUpdates, NumCollected );
+
+	InFlight.Reset();
+	InFlightTask = TFuture<void>();
+}
+
+void FLucidCostField::Publish()
+{
+	if (!bValuesChanged)
+	{
+		return;
+	}
+
+	// Publish as soon as the field settles, and periodically while it is being rebuilt
+	const double Now = FPlatformTime::Seconds();
+	const bool bSettled = (DirtyCells.Num() == 0) && !InFlight.IsValid();
+	if (!bSettled && (Now - LastPublishTime < LucidCostField::PublishInterval))
+	{
+		return;
+	}
+
+	TSharedRef<FLucidCostGrid, ESPMode::ThreadSafe> NewGrid = MakeShareable( new FLucidCostGrid() );
+	NewGrid->Polys = Values;
+	Grid = NewGrid;
+	bValuesChanged = false;
+	LastPublishTime = Now;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Lucidity.CostField
+
+namespace LucidCostField
+{
+	static void ReportCostField( const TArray<FString> &Args, UWorld* World )
+	{
+		const FLucidCostField* Field = FLucidCostField::Find( World );
+		if (Field == nullptr)
+		{
+			UE_LOG( AlexandriaLog, Display, TEXT( "Lucidity.CostField: no path query has asked for the cost field in this world yet" ) );
+			return;
+		}
+		UE_LOG( AlexandriaLog, Display, TEXT( "Lucidity.CostField: %d polygons, %d waiting for evaluation, %d published" ),
+			Field->NumCells(), Field->NumDirtyCells(), Field->GetGrid()->Num() );
+	}
+
+	static FAutoConsoleCommandWithWorldAndArgs CostFieldCommand(
+		TEXT( "Lucidity.CostField" ),
+		TEXT( "Reports the size of the Lucidity cost field light-aware navigation filters read and how much of it is waiting to be refreshed" ),
+		FConsoleCommandWithWorldAndArgsDelegate::CreateStatic( &ReportCostField ) );
+}
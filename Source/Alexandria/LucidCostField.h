@@ -0,0 +1,155 @@
+// Copyright 1998-2017 Epic Games, Inc. All Rights Reserved.
+#pragma once
+
+#include "Tickable.h"
+#include "LucidityTypes.h"
+#include "LucidLightingSnapshot.h"
+#include "Async/Future.h"
+#include "AI/Navigation/NavigationTypes.h"
+#include "LucidPerWorld.h"
+#include "LucidOccluders.h"
+
+/**
+ * Lucidity over the navigable area as of one refresh, one value per navmesh polygon: the tick Lucidity a
+ * character standing at the polygon's centre would gather from the sun and tagged lights. Never changes
+ * once published, so path queries on any thread sample it without locking.
+ */
+class FLucidCostGrid
+{
+public:
+	/** Lucidity of Poly, Fallback where the field has not evaluated it */
+	FORCEINLINE float Sample( const NavNodeRef Poly, const float Fallback ) const
+	{
+		const float* Found = Polys.Find( Poly );
+		return (Found != nullptr) ? *Found : Fallback;
+	}
+
+	FORCEINLINE int32 Num() const { return Polys.Num(); }
+
+private:
+	friend class FLucidCostField;
+
+	TMap<NavNodeRef, float> Polys;
+};
+
+typedef TSharedRef<const FLucidCostGrid, ESPMode::ThreadSafe> FLucidCostGridRef;
+
+/**
+ * Per-world builder of the Lucidity cost field that light-aware navigation filters read.
+ * Polygons are discovered by sweeping the navmesh a few tiles per frame, so the field follows navmesh
+ * rebuilds and level streaming. Dirty polygons are evaluated in batches on the task graph, one batch in
+ * flight at a time, and the results are published as a new FLucidCostGrid. A sun that turns or dims
+ * dirties every polygon, a tagged light that changes, appears or is hidden only the polygons it reaches,
+ * found through a coarse grid of sample points.
+ */
+class FLucidCostField : public FTickableGameObject
+{
+public:
+	/** Returns the field for World, creating it on first use */
+	static FLucidCostField* Get( UWorld* World );
+
+	/** Returns the field for World if one exists */
+	static FLucidCostField* Find( const UWorld* World );
+
+	/** The latest published grid, game thread only, pass the result to path queries */
+	FORCEINLINE FLucidCostGridRef GetGrid() const { return Grid; }
+
+	FORCEINLINE int32 NumCells() const { return Cells.Num(); }
+	FORCEINLINE int32 NumDirtyCells() const { return DirtyCells.Num(); }
+
+	// FTickableGameObject interface
+	virtual void Tick( float DeltaTime ) override;
+	virtual bool IsTickable() const override;
+	virtual bool IsTickableWhenPaused() const override { return false; }
+	virtual bool IsTickableInEditor() const override { return false; }
+	virtual TStatId GetStatId() const override;
+	// End of FTickableGameObject interface
+
+	~FLucidCostField();
+
+private:
+	explicit FLucidCostField( UWorld* InWorld );
+
+	// One navmesh polygon of the field
+	struct FCell
+	{
+		// Where a character standing at the polygon's centre would sample light
+		FVector Point;
+		// Bucket holding Point
+		uint64 Bucket;
+		uint32 SweepStamp;
+		bool bDirty;
+	};
+
+	// A tagged light reaching a batched cell, with its fixture ignored by the occlusion trace
+	struct FBatchLight
+	{
+		FLucidLocalLightState State;
+		FCollisionQueryParams TraceParams;
+	};
+
+	struct FBatchCell
+	{
+		NavNodeRef Key;
+		FVector Point;
+		int32 FirstLight;
+		int32 NumLights;
+	};
+
+	// Everything a batch needs off the game thread, the task only writes Results
+	struct FBatch
+	{
+		TArray<FBatchCell> Cells;
+		TArray<FBatchLight> Lights;
+		TArray<float> Results;
+		FLucidSunState Sun;
+		float BaseSunIntensity;
+		FCollisionQueryParams SunTraceParams;
+	};
+
+	void SweepNavMesh();
+	void RefreshTraceSetup();
+	void RefreshLighting();
+	void DispatchBatch();
+	void CollectBatch();
+	void Publish();
+
+	void DirtyCell( const NavNodeRef Key );
+	void DirtyAll();
+	void DirtySphere( const FVector &Center, const float Radius );
+
+	static float EvaluateCell( UWorld* World, const FBatch &Batch, const FBatchCell &Cell, const ECollisionChannel Channel, const FCollisionResponseParams &Response );
+
+	TWeakObjectPtr<UWorld> World;
+
+	// Game thread copy of the field, published as Grid
+	TMap<NavNodeRef, FCell> Cells;
+	TMap<NavNodeRef, float> Values;
+	TArray<NavNodeRef> DirtyCells;
+	// Polygons by the bucket their sample point falls in, for finding the ones a light reaches
+	TMap<uint64, TArray<NavNodeRef>> Buckets;
+	FLucidCostGridRef Grid;
+	bool bValuesChanged;
+	double LastPublishTime;
+
+	// Navmesh sweep, polygons not seen for a whole sweep are dropped
+	int32 NextTile;
+	uint32 SweepStamp;
+
+	// Lighting the field was evaluated under
+	TSharedPtr<const FLucidLightingFrame, ESPMode::ThreadSafe> Lighting;
+	FLucidSunState Sun;
+	float BaseSunIntensity;
+
+	TSharedPtr<FBatch, ESPMode::ThreadSafe> InFlight;
+	TFuture<void> InFlightTask;
+
+	// What the batches trace, from FLucidOccluders::GetTraceSetup as of TraceGeneration
+	FLucidTraceSetup TraceSetup;
+	uint32 TraceGeneration;
+	// Characters sample light at their capsule centre, this far above the navmesh
+	float SampleHeight;
+	uint64 LastTickFrame;
+
+	friend class TLucidPerWorld<FLucidCostField>;
+};
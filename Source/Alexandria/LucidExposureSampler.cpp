@@ -0,0 +1,117 @@
+// Copyright 1998-2017 Epic Games, Inc. All Rights Reserved.
+
+#include "Alexandria.h"
+#include "LucidExposureSampler.h"
+
+namespace LucidExposureSampler
+{
+	// Bit reversed visiting order, consecutive samples land in distant strata
+	static const uint8 StratumOrder[FLucidExposureSampler::NumStrata] = { 0, 8, 4, 12, 2, 10, 6, 14, 1, 9, 5, 13, 3, 11, 7, 15 };
+}
+
+FLucidExposureSampler::FLucidExposureSampler() :
+	HistoryWeight( 0.35f ),
+	ResetDistance( 0.f ),
+	ResetAngleDegrees( 1.f ),
+	MinOffset( -50.f, -50.f, -90.f ),
+	MaxOffset( 50.f, 50.f, 100.f ),
+	SequenceIndex( 0 ),
+	KnownStrata( 0 ),
+	Anchor( FVector::ZeroVector ),
+	AnchorSunDirection( FVector::ZeroVector ),
+	bAnchored( false )
+{
+	FMemory::Memzero( History );
+	FMemory::Memzero( SampleLocation );
+	ResetDistance = 0.5f*(MaxOffset - MinOffset).Size();
+}
+
+void FLucidExposureSampler::SetPollVolume( const FVector &InMinOffset, const FVector &InMaxOffset )
+{
+	MinOffset = InMinOffset;
+	MaxOffset = InMaxOffset;
+	ResetDistance = 0.5f*(MaxOffset - MinOffset).Size();
+	Reset();
+}
+
+void FLucidExposureSampler::Reset()
+{
+	KnownStrata = 0;
+	bAnchored = false;
+}
+
+void FLucidExposureSampler::Validate( const FVector &Location, const FVector &SunDirection )
+{
+	const bool bSunTurned = bAnchored && (FVector::DotProduct( SunDirection, AnchorSunDirection ) < FMath::Cos( FMath::DegreesToRadians( ResetAngleDegrees ) ));
+	if (!bAnchored || bSunTurned)
+	{
+		KnownStrata = 0;
+		AnchorSunDirection = SunDirection;
+		bAnchored = true;
+	}
+	Anchor = Location;
+
+	// Strata sampled within a jitter radius of here still describe the same poll volume
+	const float ResetDistanceSq = FMath::Square( ResetDistance );
+	for (int32 Stratum = 0; Stratum < NumStrata; ++Stratum)
+	{
+		if ((KnownStrata & (1u << Stratum)) && (FVector::DistSquared( SampleLocation[Stratum], Location ) > ResetDistanceSq))
+		{
+			KnownStrata &= ~(1u << Stratum);
+		}
+	}
+}
+
+float FLucidExposureSampler::RadicalInverse( uint32 Index, const uint32 Base )
+{
+	const float InvBase = 1.f / Base;
+	float Fraction = InvBase;
+	float Result = 0.f;
+	while (Index > 0)
+	{
+		Result += (Index % Base)*Fraction;
+		Index /= Base;
+		Fraction *= InvBase;
+	}
+	return Result;
+}
+
+FVector FLucidExposureSampler::NextOffset( int32 &OutStratum )
+{
+	// Round robin over strata, with a Halton point inside the stratum for each pass
+	const uint32 Pass = SequenceIndex / NumStrata;
+	OutStratum = LucidExposureSampler::StratumOrder[SequenceIndex % NumStrata];
+	++SequenceIndex;
+
+	const int32 SX = OutStratum % StrataX;
+	const int32 SY = (OutStratum / StrataX) % StrataY;
+	const int32 SZ = OutStratum / (StrataX*StrataY);
+	const FVector Cell(
+		(SX + RadicalInverse( Pass + 1, 2 )) / StrataX,
+		(SY + RadicalInverse( Pass + 1, 3 )) / StrataY,
+		(SZ + RadicalInverse( Pass + 1, 5 )) / StrataZ );
+	return MinOffset + Cell*(MaxOffset - MinOffset);
+}
+
+void FLucidExposureSampler::AddSample( const int32 Stratum, const float Visibility )
+{
+	const uint32 Bit = 1u << Stratum;
+	History[Stratum] = (KnownStrata & Bit) ? FMath::Lerp( History[Stratum], Visibility, HistoryWeight ) : Visibility;
+	SampleLocation[Stratum] = Anchor;
+	KnownStrata |= Bit;
+}
+
+float FLucidExposureSampler::GetExposure( const float Fallback ) const
+{
+	float Sum = 0.f;
+	int32 Count = 0;
+	for (int32 Stratum = 0; Stratum < NumStrata; ++Stratum)
+	{
+		if (KnownStrata & (1u << Stratum))
+		{
+			Sum += History[Stratum];
+			++Count;
+		}
+	}
+	return (Count > 0) ? (Sum / Count) : Fallback;
+}
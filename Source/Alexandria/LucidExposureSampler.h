@@ -0,0 +1,63 @@
+// Copyright 1998-2017 Epic Games, Inc. All Rights Reserved.
+#pragma once
+
+/**
+ * Stratified, low-discrepancy sun sampling over the player's poll volume, carried across ticks.
+ * Each stratum keeps an exponentially weighted history of its ray results, so a steady
+ * exposure estimate only needs one or two rays per tick instead of a fresh set every frame.
+ * A stratum's history is dropped once the player is further than ResetDistance from where it was
+ * last sampled, so while walking the recent strata are kept and only the ones left behind expire.
+ */
+class FLucidExposureSampler
+{
+public:
+	// 2 x 2 x 4 strata over the poll volume
+	static const int32 StrataX = 2;
+	static const int32 StrataY = 2;
+	static const int32 StrataZ = 4;
+	static const int32 NumStrata = StrataX*StrataY*StrataZ;
+
+	FLucidExposureSampler();
+
+	/** Sets the poll volume, relative to the actor location, and ResetDistance to its jitter radius */
+	void SetPollVolume( const FVector &InMinOffset, const FVector &InMaxOffset );
+
+	/** Expires strata sampled further than ResetDistance away, and all of them if the sun turned past ResetAngle */
+	void Validate( const FVector &Location, const FVector &SunDirection );
+
+	/** Next poll point in the sequence, relative to the actor location */
+	FVector NextOffset( int32 &OutStratum );
+
+	/** Folds one ray result (1 lit, 0 shadowed) into a stratum's history */
+	void AddSample( const int32 Stratum, const float Visibility );
+
+	/** Average exposure over the strata sampled since the last reset, or Fallback if there are none */
+	float GetExposure( const float Fallback ) const;
+
+	/** True once every stratum has a result since the last reset */
+	FORCEINLINE bool HasSampledAllStrata() const { return KnownStrata == ((1u << NumStrata) - 1); }
+
+	void Reset();
+
+	// Weight of a new result against the stratum's history
+	float HistoryWeight;
+	// Defaults to half the poll volume's diagonal, the furthest a poll point strays from the actor
+	float ResetDistance;
+	float ResetAngleDegrees;
+
+private:
+	static float RadicalInverse( uint32 Index, const uint32 Base );
+
+	FVector MinOffset;
+	FVector MaxOffset;
+
+	uint32 SequenceIndex;
+	float History[NumStrata];
+	// Where the player was when each stratum was last sampled
+	FVector SampleLocation[NumStrata];
+	uint32 KnownStrata;
+
+	FVector Anchor;
+	FVector AnchorSunDirection;
+	bool bAnchored;
+};
@@ -0,0 +1,59 @@
+// Copyright 1998-2017 Epic Games, Inc. All Rights Reserved.
+
+#include "Alexandria.h"
+#include "LucidFirePool.h"
+#include "LucidityStats.h"
+#include "Particles/ParticleSystemComponent.h"
+#include "GameFramework/WorldSettings.h"
+
+FLucidFirePool* FLucidFirePool::Get( UWorld* World )
+{
+	return TLucidPerWorld<FLucidFirePool>::Get( World );
+}
+
+UParticleSystemComponent* FLucidFirePool::Acquire( UParticleSystem* Template, USceneComponent* Parent, const FName Socket )
+{
+	INC_DWORD_STAT( STAT_LucidFireAcquires );
+	UParticleSystemComponent* Component = nullptr;
+	while ((Component == nullptr) && (Free.Num() > 0))
+	{
+		Component = Free.Pop( false );
+		if (Component->IsPendingKill())
+		{
+			Component = nullptr;
+		}
+	}
+
+	if (Component == nullptr)
+	{
+		// Owned by the world settings, so the emitter outlives whichever character held it last
+		Component = NewObject<UParticleSystemComponent>( World->GetWorldSettings(), NAME_None, RF_Transient );
+		Component->bAutoActivate = false;
+		Component->bAutoDestroy = false;
+		Component->SetTemplate( Template );
+		Component->RegisterComponentWithWorld( World );
+	}
+	else if (Component->Template != Template)
+	{
+		Component->SetTemplate( Template );
+	}
+
+	Component->AttachToComponent( Parent, FAttachmentTransformRules::SnapToTargetNotIncludingScale, Socket );
+	InUse++;
+	return Component;
+}
+
+void FLucidFirePool::Release( UParticleSystemComponent* Component )
+{
+	// Particles left behind would float where the character stood
+	Component->DeactivateSystem();
+	Component->KillParticlesForced();
+	Component->DetachFromComponent( FDetachmentTransformRules::KeepRelativeTransform );
+	Free.Add( Component );
+	InUse--;
+}
+
+void FLucidFirePool::AddReferencedObjects( FReferenceCollector &Collector )
+{
+	Collector.AddReferencedObjects( Free );
+}
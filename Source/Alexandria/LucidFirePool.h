@@ -0,0 +1,40 @@
+// Copyright 1998-2017 Epic Games, Inc. All Rights Reserved.
+#pragma once
+
+#include "LucidPerWorld.h"
+
+class UParticleSystem;
+class UParticleSystemComponent;
+
+/**
+ * Per-world pool of radiance fire emitters.
+ * Only characters whose fire is burning at a LOD that shows it hold a component, everyone else hands
+ * theirs back here, so a crowd keeps as many emitters as are actually burning and relighting one reuses
+ * a registered component instead of creating its render state again.
+ */
+class FLucidFirePool : public FGCObject
+{
+public:
+	/** Returns the pool for World, creating it on first use */
+	static FLucidFirePool* Get( UWorld* World );
+
+	/** An inactive emitter running Template, attached to Parent at Socket */
+	UParticleSystemComponent* Acquire( UParticleSystem* Template, USceneComponent* Parent, const FName Socket );
+
+	/** Kills Component's particles and returns it to the pool */
+	void Release( UParticleSystemComponent* Component );
+
+	FORCEINLINE int32 NumFree() const { return Free.Num(); }
+	FORCEINLINE int32 NumInUse() const { return InUse; }
+
+	virtual void AddReferencedObjects( FReferenceCollector &Collector ) override;
+
+private:
+	explicit FLucidFirePool( UWorld* InWorld ) : World( InWorld ), InUse( 0 ) {}
+
+	UWorld* World;
+	TArray<UParticleSystemComponent*> Free;
+	int32 InUse;
+
+	friend class TLucidPerWorld<FLucidFirePool>;
+};
@@ -0,0 +1,152 @@
+// Copyright 1998-2017 Epic Games, Inc. All Rights Reserved.
+#pragma once
+
+// Lucidity integration rule, free of engine types so it can be built and profiled on its own.
+// The SIMD path reproduces the scalar path bit for bit: every min, clamp and negate below
+// mirrors FMath's comparison order instead of using the hardware min/max.
+// Tools/LucidIntegrationKernel builds it on the host with tests against the rule it replaced and a benchmark.
+
+#include <stdint.h>
+
+#if defined( _M_X64 ) || defined( __SSE2__ )
+	#include <emmintrin.h>
+	#define LUCID_INTEGRATION_SSE 1
+#else
+	#define LUCID_INTEGRATION_SSE 0
+#endif
+
+namespace LucidIntegration
+{
+	// Lucidity holds this long after its last rise before inner radiance lets it decay
+	static const float UptickGraceSeconds = 3.f;
+
+	/** Packed per-agent state, Lucidity and TimeSinceLastUptick are updated in place */
+	struct FAgentArrays
+	{
+		float* Lucidity;
+		const float* TickLucidity;
+		const float* MaxDeltaLucidity;
+		const float* AbsorbVelocity;
+		const float* ConsumeVelocity;
+		const float* InnerRadianceDecayTime;
+		const bool* InnerRadiance;
+		float* TimeSinceLastUptick;
+	};
+
+	namespace Scalar
+	{
+		// Same comparisons as FMath::Min, FMath::Abs and FMath::Clamp
+		inline float Min( const float A, const float B ) { return (A <= B) ? A : B; }
+		inline float Abs( const float A ) { return (A >= 0.f) ? A : -A; }
+		inline float Clamp( const float X, const float Lo, const float Hi ) { return (X < Lo) ? Lo : ((X < Hi) ? X : Hi); }
+	}
+
+	/**
+	 * One integration step of Lucidity towards TickLucidity.
+	 * Rises are scaled by AbsorbVelocity, falls by ConsumeVelocity, both capped at MaxDeltaLucidity.
+	 * Inner radiance speeds up rises, holds Lucidity for UptickGraceSeconds after one, then slows the fall.
+	 */
+	inline float Step( const float Lucidity, const float TickLucidity, const float MaxDeltaLucidity,
+		const float AbsorbVelocity, const float ConsumeVelocity, const float InnerRadianceDecayTime, const bool bInnerRadiance, float &TimeSinceLastUptick )
+	{
+		float DeltaLucidity = TickLucidity - Lucidity;
+		if (DeltaLucidity > 0.f)
+		{
+			TimeSinceLastUptick = 0.f;
+			DeltaLucidity *= AbsorbVelocity;
+			if (bInnerRadiance) {
+				DeltaLucidity *= InnerRadianceDecayTime;
+			}
+			DeltaLucidity = Scalar::Min( DeltaLucidity, MaxDeltaLucidity );
+		}
+		else if (DeltaLucidity < 0.f)
+		{
+			DeltaLucidity *= ConsumeVelocity;
+			DeltaLucidity = -1.f*Scalar::Min( Scalar::Abs( DeltaLucidity ), MaxDeltaLucidity );
+			if (bInnerRadiance) {
+				if (TimeSinceLastUptick < UptickGraceSeconds) {
+					return Lucidity;
+				}
+				DeltaLucidity /= (InnerRadianceDecayTime * 2);
+			}
+		}
+		return Scalar::Clamp( Lucidity + DeltaLucidity, 0.f, 1.f );
+	}
+
+	inline void StepScalar( const FAgentArrays &Agents, const int32_t Begin, const int32_t End )
+	{
+		for (int32_t i = Begin; i < End; i++)
+		{
+			Agents.Lucidity[i] = Step( Agents.Lucidity[i], Agents.TickLucidity[i], Agents.MaxDeltaLucidity[i], Agents.AbsorbVelocity[i],
+				Agents.ConsumeVelocity[i], Agents.InnerRadianceDecayTime[i], Agents.InnerRadiance[i], Agents.TimeSinceLastUptick[i] );
+		}
+	}
+
+#if LUCID_INTEGRATION_SSE
+	namespace Sse
+	{
+		inline __m128 Select( const __m128 Mask, const __m128 A, const __m128 B ) { return _mm_or_ps( _mm_and_ps( Mask, A ), _mm_andnot_ps( Mask, B ) ); }
+		inline __m128 Min( const __m128 A, const __m128 B ) { return Select( _mm_cmple_ps( A, B ), A, B ); }
+		inline __m128 Negate( const __m128 A ) { return _mm_xor_ps( A, _mm_set1_ps( -0.f ) ); }
+		inline __m128 Abs( const __m128 A ) { return Select( _mm_cmpge_ps( A, _mm_setzero_ps() ), A, Negate( A ) ); }
+		inline __m128 Clamp( const __m128 X, const __m128 Lo, const __m128 Hi ) { return Select( _mm_cmplt_ps( X, Lo ), Lo, Select( _mm_cmplt_ps( X, Hi ), X, Hi ) ); }
+
+		inline __m128 LoadMask( const bool* Flags )
+		{
+			return _mm_castsi128_ps( _mm_set_epi32( Flags[3] ? -1 : 0, Flags[2] ? -1 : 0, Flags[1] ? -1 : 0, Flags[0] ? -1 : 0 ) );
+		}
+	}
+
+	/** Four agents at a time, same results as Step */
+	inline void StepSse( const FAgentArrays &Agents, const int32_t Begin, const int32_t End )
+	{
+		const __m128 Zero = _mm_setzero_ps();
+		const __m128 One = _mm_set1_ps( 1.f );
+		const __m128 MinusOne = _mm_set1_ps( -1.f );
+		const __m128 Two = _mm_set1_ps( 2.f );
+		const __m128 Grace = _mm_set1_ps( UptickGraceSeconds );
+
+		for (int32_t i = Begin; i < End; i += 4)
+		{
+			const __m128 Lucidity = _mm_loadu_ps( Agents.Lucidity + i );
+			const __m128 MaxDelta = _mm_loadu_ps( Agents.MaxDeltaLucidity + i );
+			const __m128 Decay = _mm_loadu_ps( Agents.InnerRadianceDecayTime + i );
+			const __m128 Uptick = _mm_loadu_ps( Agents.TimeSinceLastUptick + i );
+			const __m128 Inner = Sse::LoadMask( Agents.InnerRadiance + i );
+
+			const __m128 Delta = _mm_sub_ps( _mm_loadu_ps( Agents.TickLucidity + i ), Lucidity );
+			const __m128 Rising = _mm_cmpgt_ps( Delta, Zero );
+			const __m128 Falling = _mm_cmplt_ps( Delta, Zero );
+
+			// Rising
+			__m128 Up = _mm_mul_ps( Delta, _mm_loadu_ps( Agents.AbsorbVelocity + i ) );
+			Up = Sse::Select( Inner, _mm_mul_ps( Up, Decay ), Up );
+			Up = Sse::Min( Up, MaxDelta );
+
+			// Falling
+			__m128 Down = _mm_mul_ps( Delta, _mm_loadu_ps( Agents.ConsumeVelocity + i ) );
+			Down = _mm_mul_ps( MinusOne, Sse::Min( Sse::Abs( Down ), MaxDelta ) );
+			Down = Sse::Select( Inner, _mm_div_ps( Down, _mm_mul_ps( Decay, Two ) ), Down );
+			const __m128 Hold = _mm_and_ps( Falling, _mm_and_ps( Inner, _mm_cmplt_ps( Uptick, Grace ) ) );
+
+			const __m128 Step = Sse::Select( Rising, Up, Sse::Select( Falling, Down, Delta ) );
+			const __m128 Result = Sse::Select( Hold, Lucidity, Sse::Clamp( _mm_add_ps( Lucidity, Step ), Zero, One ) );
+
+			_mm_storeu_ps( Agents.Lucidity + i, Result );
+			_mm_storeu_ps( Agents.TimeSinceLastUptick + i, Sse::Select( Rising, Zero, Uptick ) );
+		}
+	}
+#endif
+
+	/** Integrates Count agents, in SIMD width where available */
+	inline void StepAgents( const FAgentArrays &Agents, const int32_t Count )
+	{
+#if LUCID_INTEGRATION_SSE
+		const int32_t VectorEnd = Count & ~3;
+		StepSse( Agents, 0, VectorEnd );
+		StepScalar( Agents, VectorEnd, Count );
+#else
+		StepScalar( Agents, 0, Count );
+#endif
+	}
+}
@@ -0,0 +1,186 @@
+// Copyright 1998-2017 Epic Games, Inc. All Rights Reserved.
+
+#include "Alexandria.h"
+#include "LucidLevelData.h"
+#include "AlexandriaGameMode.h"
+#include "LucidLightRegistry.h"
+#include "LucidSunVisibilityVolume.h"
+#include "LucidityStats.h"
+#include "PrecomputedLightVolume.h"
+#include "Engine/Level.h"
+#include "Engine/LevelBounds.h"
+#include "Engine/LevelStreaming.h"
+
+FLucidLevelData* FLucidLevelData::Get( UWorld* World )
+{
+	return TLucidPerWorld<FLucidLevelData, true>::Get( World );
+}
+
+void FLucidLevelData::AddLevel( ULevel* Level )
+{
+	SCOPE_CYCLE_COUNTER( STAT_LucidLevelStreaming );
+	if ((Level->PrecomputedLightVolume == nullptr) || Levels.ContainsByPredicate( [Level]( const FLucidLevelEntry &Entry ) { return Entry.Level.Get() == Level; } ))
+	{
+		return;
+	}
+
+	FLucidLevelEntry Entry;
+	Entry.Level = Level;
+	Entry.Bounds = Level->LevelBoundsActor.IsValid() ? Level->LevelBoundsActor->GetComponentsBoundingBox( true ) : ALevelBounds::CalculateLevelBounds( Level );
+	Levels.Add( Entry );
+	Generation++;
+}
+
+void FLucidLevelData::RemoveLevel( ULevel* Level )
+{
+	if (Levels.RemoveAllSwap( [Level]( const FLucidLevelEntry &Entry ) { return !Entry.Level.IsValid() || (Entry.Level.Get() == Level); } ) > 0)
+	{
+		Generation++;
+	}
+}
+
+void FLucidLevelData::FindLevels( const FVector &Point, TArray<ULevel*, TInlineAllocator<4>> &OutLevels ) const
+{
+	OutLevels.Reset();
+	for (const FLucidLevelEntry &Entry : Levels)
+	{
+		ULevel* Level = Entry.Level.Get();
+		if ((Level != nullptr) && Level->bIsVisible && (!Entry.Bounds.IsValid || Entry.Bounds.IsInside( Point )))
+		{
+			OutLevels.Add( Level );
+		}
+	}
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Lucidity.StreamingSoak
+
+namespace LucidLevelData
+{
+	// Frames slower than this count as hitches
+	static const float HitchSeconds = 1.f / 20.f;
+
+	struct FStreamingSoak
+	{
+		TWeakObjectPtr<UWorld> World;
+		TWeakObjectPtr<APawn> Pawn;
+		FVector PathCenter;
+		float PathRadius;
+		float Duration;
+		float Interval;
+		float Elapsed;
+		float SinceToggle;
+		int32 NextLevel;
+		// Frame times since the last toggle
+		float MaxFrameSeconds;
+		int32 Hitches;
+	};
+
+	static void ReportStreaming( UWorld* World, const FStreamingSoak &Soak, const TCHAR* Event )
+	{
+		const FLucidLightRegistry* Registry = FLucidLightRegistry::Get( World );
+		const int32 Lights = (Registry != nullptr) ? Registry->Num() : 0;
+
+		int32 SidecarBytes = 0;
+		int32 PendingLoads = 0;
+		const FLucidBakedVisibility* Baked = FLucidBakedVisibility::Get( World );
+		if (Baked != nullptr)
+		{
+			SidecarBytes = Baked->GetAllocatedSize();
+			PendingLoads = Baked->NumPendingLoads();
+		}
+		const FLucidLevelData* LevelData = FLucidLevelData::Get( World );
+		const FPlatformMemoryStats Memory = FPlatformMemory::GetStats();
+
+		UE_LOG( AlexandriaLog, Display, TEXT( "Lucidity.StreamingSoak %6.1fs %-32s used %.1f MB, %d lights, %d light volume levels, %.1f KB sidecars (%d loading), worst frame %.1f ms, %d hitches" ),
+			Soak.Elapsed, Event, Memory.UsedPhysical / (1024.0*1024.0), Lights, (LevelData != nullptr) ? LevelData->GetLevels().Num() : 0,
+			SidecarBytes / 1024.f, PendingLoads, Soak.MaxFrameSeconds*1000.f, Soak.Hitches );
+	}
+
+	static bool TickStreamingSoak( float DeltaTime, TSharedRef<FStreamingSoak> Soak )
+	{
+		UWorld* World = Soak->World.Get();
+		if (World == nullptr)
+		{
+			return false;
+		}
+
+		Soak->Elapsed += DeltaTime;
+		Soak->SinceToggle += DeltaTime;
+		Soak->MaxFrameSeconds = FMath::Max( Soak->MaxFrameSeconds, DeltaTime );
+		Soak->Hitches += (DeltaTime > HitchSeconds) ? 1 : 0;
+
+		// Walk a circle so Lucidity keeps querying across level boundaries
+		APawn* Pawn = Soak->Pawn.Get();
+		if (Pawn != nullptr)
+		{
+			const float Angle = Soak->Elapsed*0.25f;
+			const FVector Location = Soak->PathCenter + FVector( FMath::Cos( Angle ), FMath::Sin( Angle ), 0.f )*Soak->PathRadius;
+			Pawn->SetActorLocation( Location, false, nullptr, ETeleportType::TeleportPhysics );
+		}
+
+		if (Soak->Elapsed >= Soak->Duration)
+		{
+			ReportStreaming( World, *Soak, TEXT( "done" ) );
+			return false;
+		}
+		if (Soak->SinceToggle < Soak->Interval)
+		{
+			return true;
+		}
+
+		// Flip the next streamed sublevel in or out
+		const TArray<ULevelStreaming*> &Streaming = World->StreamingLevels;
+		FString Event = TEXT( "no streamed sublevels" );
+		for (int32 Attempt = 0; Attempt < Streaming.Num(); Attempt++)
+		{
+			ULevelStreaming* StreamingLevel = Streaming[Soak->NextLevel++ % Streaming.Num()];
+			if ((StreamingLevel != nullptr) && !StreamingLevel->bIsStatic)
+			{
+				StreamingLevel->bShouldBeLoaded = !StreamingLevel->bShouldBeLoaded;
+				StreamingLevel->bShouldBeVisible = StreamingLevel->bShouldBeLoaded;
+				Event = FString::Printf( TEXT( "%s %s" ), StreamingLevel->bShouldBeLoaded ? TEXT( "in" ) : TEXT( "out" ),
+					*FPackageName::GetShortName( StreamingLevel->GetWorldAssetPackageName() ) );
+				break;
+			}
+		}
+		ReportStreaming( World, *Soak, *Event );
+		Soak->SinceToggle = 0.f;
+		Soak->MaxFrameSeconds = 0.f;
+		Soak->Hitches = 0;
+		return true;
+	}
+
+	static void StreamingSoak( const TArray<FString> &Args, UWorld* World )
+	{
+		if ((World == nullptr) || !World->IsGameWorld())
+		{
+			UE_LOG( AlexandriaLog, Warning, TEXT( "Lucidity.StreamingSoak needs a game world" ) );
+			return;
+		}
+
+		TSharedRef<FStreamingSoak> Soak = MakeShareable( new FStreamingSoak() );
+		Soak->World = World;
+		Soak->Duration = (Args.Num() > 0) ? FMath::Max( FCString::Atof( *Args[0] ), 1.f ) : 60.f;
+		Soak->Interval = (Args.Num() > 1) ? FMath::Max( FCString::Atof( *Args[1] ), 0.1f ) : 5.f;
+		Soak->PathRadius = (Args.Num() > 2) ? FCString::Atof( *Args[2] ) : 2000.f;
+		Soak->Elapsed = 0.f;
+		Soak->SinceToggle = 0.f;
+		Soak->NextLevel = 0;
+		Soak->MaxFrameSeconds = 0.f;
+		Soak->Hitches = 0;
+
+		APlayerController* PlayerController = World->GetFirstPlayerController();
+		Soak->Pawn = (PlayerController != nullptr) ? PlayerController->GetPawn() : nullptr;
+		Soak->PathCenter = Soak->Pawn.IsValid() ? Soak->Pawn->GetActorLocation() : FVector::ZeroVector;
+
+		ReportStreaming( World, *Soak, TEXT( "start" ) );
+		FTicker::GetCoreTicker().AddTicker( FTickerDelegate::CreateStatic( &TickStreamingSoak, Soak ) );
+	}
+
+	static FAutoConsoleCommandWithWorldAndArgs StreamingSoakCommand(
+		TEXT( "Lucidity.StreamingSoak" ),
+		TEXT( "Streams sublevels in and out in turn while the player walks a circle, logging memory, Lucidity level data and hitches.\n" )
+		TEXT( "Usage: Lucidity.StreamingSoak [Seconds=60] [Interval=5] [Radius=2000]" ),
+		FConsoleCommandWithWorldAndArgsDelegate::CreateStatic( &StreamingSoak ) );
+}
@@ -0,0 +1,45 @@
+// Copyright 1998-2017 Epic Games, Inc. All Rights Reserved.
+#pragma once
+
+#include "LucidPerWorld.h"
+
+// A loaded level with a precomputed light volume, as seen by incident radiance queries
+struct FLucidLevelEntry
+{
+	TWeakObjectPtr<ULevel> Level;
+	// Invalid if the level has no bounds, in which case every point may lie in it
+	FBox Bounds;
+};
+
+/**
+ * Per-world list of the streamed-in levels Lucidity may sample baked lighting from.
+ * A level joins when it is added to the world, with its bounds computed once, and leaves when it is
+ * removed, so queries only ever touch loaded levels and never walk the whole level collection.
+ * Tagged lights and sun visibility sidecars follow streaming the same way, see FLucidLightRegistry
+ * and FLucidBakedVisibility.
+ */
+class FLucidLevelData
+{
+public:
+	/** Returns the level data for World, creating it on first use */
+	static FLucidLevelData* Get( UWorld* World );
+
+	void AddLevel( ULevel* Level );
+	void RemoveLevel( ULevel* Level );
+
+	/** Loaded levels whose bounds contain Point */
+	void FindLevels( const FVector &Point, TArray<ULevel*, TInlineAllocator<4>> &OutLevels ) const;
+
+	FORCEINLINE const TArray<FLucidLevelEntry>& GetLevels() const { return Levels; }
+
+	/** Bumped whenever a level joins or leaves, so samples taken before can be refreshed */
+	FORCEINLINE uint32 GetGeneration() const { return Generation; }
+
+private:
+	explicit FLucidLevelData( UWorld* InWorld ) : Generation( 1 ) {}
+
+	TArray<FLucidLevelEntry> Levels;
+	uint32 Generation;
+
+	friend class TLucidPerWorld<FLucidLevelData, true>;
+};
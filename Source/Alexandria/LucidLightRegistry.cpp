@@ -0,0 +1,379 @@
+// Copyright 1998-2017 Epic Games, Inc. All Rights Reserved.
+
+#include "Alexandria.h"
+#include "LucidLightRegistry.h"
+#include "LucidityStats.h"
+#include "Components/PointLightComponent.h"
+#include "Engine/Level.h"
+
+const FName FLucidLightRegistry::LucidityTag( TEXT( "Lucidity" ) );
+
+namespace LucidLightRegistry
+{
+	// Edge length of a grid cell, roughly a room in the library maps
+	static const float DefaultCellSize = 1024.f;
+	// Lights covering more cells than this are kept in the oversized list instead
+	static const int32 MaxCellsPerLight = 64;
+	static const int32 CellCoordBias = 1 << 20;
+	// Actors visited per frame by the rolling scan for lights added or tagged at runtime
+	static const int32 ActorsPerScan = 64;
+}
+
+FLucidLightRegistry::FLucidLightRegistry( UWorld* InWorld ) :
+	World( InWorld ),
+	CellSize( LucidLightRegistry::DefaultCellSize ),
+	QueryCounter( 0 ),
+	LastRefreshFrame( 0 ),
+	ScanLevel( 0 ),
+	ScanActor( 0 ),
+	Generation( 1 )
+{
+	ActorSpawnedHandle = InWorld->AddOnActorSpawnedHandler( FOnActorSpawned::FDelegate::CreateRaw( this, &FLucidLightRegistry::OnActorSpawned ) );
+}
+
+FLucidLightRegistry::~FLucidLightRegistry()
+{
+	if (World.IsValid())
+	{
+		World->RemoveOnActorSpawnedHandler( ActorSpawnedHandle );
+	}
+}
+
+FLucidLightRegistry* FLucidLightRegistry::Get( UWorld* World )
+{
+	return TLucidPerWorld<FLucidLightRegistry, true>::Get( World );
+}
+
+uint64 FLucidLightRegistry::CellKey( const int32 X, const int32 Y, const int32 Z )
+{
+	using namespace LucidLightRegistry;
+	const uint64 Mask = (1ull << 21) - 1;
+	return (((uint64)(X + CellCoordBias) & Mask) << 42) | (((uint64)(Y + CellCoordBias) & Mask) << 21) | ((uint64)(Z + CellCoordBias) & Mask);
+}
+
+FIntVector FLucidLightRegistry::CellOf( const FVector &Point ) const
+{
+	return FIntVector(
+		FMath::FloorToInt( Point.X / CellSize ),
+		FMath::FloorToInt( Point.Y / CellSize ),
+		FMath::FloorToInt( Point.Z / CellSize ) );
+}
+
+void FLucidLightRegistry::RegisterLight( UPointLightComponent* LightComp )
+{
+	if ((LightComp == nullptr) || !LightComp->IsRegistered() || !LightComp->ComponentHasTag( LucidityTag ) || LightIndices.Contains( LightComp ))
+	{
+		return;
+	}
+
+	int32 Index;
+	if (FreeSlots.Num() > 0)
+	{
+		Index = FreeSlots.Pop( false );
+	}
+	else
+	{
+		Index = Lights.AddDefaulted();
+	}
+
+	FLucidLightEntry &Entry = Lights[Index];
+	Entry.Light = LightComp;
+	Entry.Position = LightComp->GetComponentLocation();
+	Entry.AttenuationRadius = LightComp->AttenuationRadius;
+	Entry.bMovable = (LightComp->Mobility == EComponentMobility::Movable);
+	Entry.bOversized = false;
+	Entry.QueryStamp = 0;
+
+	LightIndices.Add( LightComp, Index );
+	AddToCells( Index );
+	Generation++;
+}
+
+void FLucidLightRegistry::UnregisterLight( UPointLightComponent* LightComp )
+{
+	int32 Index = INDEX_NONE;
+	if (LightIndices.RemoveAndCopyValue( LightComp, Index ))
+	{
+		RemoveFromCells( Index );
+		Lights[Index].Light = nullptr;
+		FreeSlots.Add( Index );
+		Generation++;
+	}
+}
+
+void FLucidLightRegistry::AddLevel( ULevel* Level )
+{
+	SCOPE_CYCLE_COUNTER( STAT_LucidLevelStreaming );
+	for (AActor* Actor : Level->Actors)
+	{
+		if (Actor != nullptr)
+		{
+			OnActorSpawned( Actor );
+		}
+	}
+}
+
+void FLucidLightRegistry::OnActorSpawned( AActor* Actor )
+{
+	TInlineComponentArray<UPointLightComponent*> LightComps( Actor );
+	for (UPointLightComponent* LightComp : LightComps)
+	{
+		RegisterLight( LightComp );
+	}
+}
+
+void FLucidLightRegistry::RemoveLevel( ULevel* Level )
+{
+	SCOPE_CYCLE_COUNTER( STAT_LucidLevelStreaming );
+	TArray<int32> Stale;
+	for (const auto &Pair : LightIndices)
+	{
+		UPointLightComponent* LightComp = Pair.Key.Get();
+		if ((LightComp == nullptr) || LightComp->IsIn( Level ))
+		{
+			Stale.Add( Pair.Value );
+		}
+	}
+	for (const int32 Index : Stale)
+	{
+		RemoveEntry( Index );
+	}
+}
+
+void FLucidLightRegistry::RemoveEntry( const int32 Index )
+{
+	RemoveFromCells( Index );
+	LightIndices.Remove( Lights[Index].Light );
+	Lights[Index].Light = nullptr;
+	FreeSlots.Add( Index );
+	Generation++;
+}
+
+void FLucidLightRegistry::AddToCells( const int32 Index )
+{
+	FLucidLightEntry &Entry = Lights[Index];
+	const FVector Extent( Entry.AttenuationRadius );
+	Entry.MinCell = CellOf( Entry.Position - Extent );
+	Entry.MaxCell = CellOf( Entry.Position + Extent );
+
+	const FIntVector Span = Entry.MaxCell - Entry.MinCell + FIntVector( 1, 1, 1 );
+	if (Span.X * Span.Y * Span.Z > LucidLightRegistry::MaxCellsPerLight)
+	{
+		Entry.bOversized = true;
+		OversizedLights.Add( Index );
+		return;
+	}
+
+	Entry.bOversized = false;
+	for (int32 X = Entry.MinCell.X; X <= Entry.MaxCell.X; ++X)
+	{
+		for (int32 Y = Entry.MinCell.Y; Y <= Entry.MaxCell.Y; ++Y)
+		{
+			for (int32 Z = Entry.MinCell.Z; Z <= Entry.MaxCell.Z; ++Z)
+			{
+				Cells.FindOrAdd( CellKey( X, Y, Z ) ).Add( Index );
+			}
+		}
+	}
+}
+
+void FLucidLightRegistry::RemoveFromCells( const int32 Index )
+{
+	const FLucidLightEntry &Entry = Lights[Index];
+	if (Entry.bOversized)
+	{
+		OversizedLights.RemoveSingleSwap( Index, false );
+		return;
+	}
+
+	for (int32 X = Entry.MinCell.X; X <= Entry.MaxCell.X; ++X)
+	{
+		for (int32 Y = Entry.MinCell.Y; Y <= Entry.MaxCell.Y; ++Y)
+		{
+			for (int32 Z = Entry.MinCell.Z; Z <= Entry.MaxCell.Z; ++Z)
+			{
+				const uint64 Key = CellKey( X, Y, Z );
+				TArray<int32>* Bucket = Cells.Find( Key );
+				if (Bucket != nullptr)
+				{
+					Bucket->RemoveSingleSwap( Index, false );
+					if (Bucket->Num() == 0)
+					{
+						Cells.Remove( Key );
+					}
+				}
+			}
+		}
+	}
+}
+
+void FLucidLightRegistry::RefreshMovableLights()
+{
+	if (LastRefreshFrame == GFrameCounter)
+	{
+		return;
+	}
+	LastRefreshFrame = GFrameCounter;
+
+	for (int32 Index = 0; Index < Lights.Num(); ++Index)
+	{
+		FLucidLightEntry &Entry = Lights[Index];
+		const UPointLightComponent* LightComp = Entry.Light.Get();
+		if (LightComp == nullptr)
+		{
+			continue;
+		}
+		// Untagged or unregistered at runtime
+		if (!LightComp->IsRegistered() || !LightComp->ComponentHasTag( LucidityTag ))
+		{
+			RemoveEntry( Index );
+			continue;
+		}
+		if (!Entry.bMovable)
+		{
+			continue;
+		}
+		const FVector Position = LightComp->GetComponentLocation();
+		if (!Position.Equals( Entry.Position ) || (LightComp->AttenuationRadius != Entry.AttenuationRadius))
+		{
+			RemoveFromCells( Index );
+			Entry.Position = Position;
+			Entry.AttenuationRadius = LightComp->AttenuationRadius;
+			AddToCells( Index );
+		}
+	}
+
+	ScanForRuntimeLights();
+}
+
+void FLucidLightRegistry::ScanForRuntimeLights()
+{
+	if (!World.IsValid())
+	{
+		return;
+	}
+	const TArray<ULevel*> &Levels = World->GetLevels();
+	for (int32 Visited = 0; (Visited < LucidLightRegistry::ActorsPerScan) && (Levels.Num() > 0); ++Visited)
+	{
+		if (ScanLevel >= Levels.Num())
+		{
+			ScanLevel = 0;
+			ScanActor = 0;
+		}
+		const ULevel* Level = Levels[ScanLevel];
+		if ((Level == nullptr) || !Level->bIsVisible || (ScanActor >= Level->Actors.Num()))
+		{
+			++ScanLevel;
+			ScanActor = 0;
+			continue;
+		}
+		AActor* Actor = Level->Actors[ScanActor++];
+		if (Actor != nullptr)
+		{
+			OnActorSpawned( Actor );
+		}
+	}
+}
+
+int32 FLucidLightRegistry::QueryLights( const FBoxSphereBounds &Bounds, const int32 MaxLights, TArray<FLucidLightCandidate> &OutLights, const UPrimitiveComponent* Receiver )
+{
+	OutLights.Reset();
+	if (MaxLights <= 0)
+	{
+		return 0;
+	}
+	RefreshMovableLights();
+
+	const uint32 Stamp = ++QueryCounter;
+	const FVector Center = Bounds.Origin;
+	const FVector Extent = Bounds.BoxExtent;
+	TArray<int32, TInlineAllocator<16>> Stale;
+
+	auto VisitEntry = [&]( const int32 Index )
+	{
+		FLucidLightEntry &Entry = Lights[Index];
+		if (Entry.QueryStamp == Stamp)
+		{
+			return;
+		}
+		Entry.QueryStamp = Stamp;
+		INC_DWORD_STAT( STAT_LucidLightsVisited );
+
+		UPointLightComponent* LightComp = Entry.Light.Get();
+		if (LightComp == nullptr)
+		{
+			Stale.Add( Index );
+			return;
+		}
+
+		// Sphere vs. box, rejecting lights that cannot reach any part of the bounds
+		const float DistSqToBox = FMath::Square( FMath::Max( FMath::Abs( Entry.Position.X - Center.X ) - Extent.X, 0.f ) )
+			+ FMath::Square( FMath::Max( FMath::Abs( Entry.Position.Y - Center.Y ) - Extent.Y, 0.f ) )
+			+ FMath::Square( FMath::Max( FMath::Abs( Entry.Position.Z - Center.Z ) - Extent.Z, 0.f ) );
+		if (DistSqToBox >= FMath::Square( Entry.AttenuationRadius ))
+		{
+			return;
+		}
+		// Before the cap, so lights that cannot light the receiver never take a slot
+		if ((Receiver != nullptr) && !LightComp->AffectsPrimitive( Receiver ))
+		{
+			return;
+		}
+
+		FLucidLightCandidate Candidate;
+		Candidate.Light = LightComp;
+		Candidate.Position = Entry.Position;
+		Candidate.AttenuationRadius = Entry.AttenuationRadius;
+		Candidate.Distance = FVector::Dist( Entry.Position, Center );
+		OutLights.Add( Candidate );
+	};
+
+	const FIntVector MinCell = CellOf( Center - Extent );
+	const FIntVector MaxCell = CellOf( Center + Extent );
+	for (int32 X = MinCell.X; X <= MaxCell.X; ++X)
+	{
+		for (int32 Y = MinCell.Y; Y <= MaxCell.Y; ++Y)
+		{
+			for (int32 Z = MinCell.Z; Z <= MaxCell.Z; ++Z)
+			{
+				const TArray<int32>* Bucket = Cells.Find( CellKey( X, Y, Z ) );
+				if (Bucket != nullptr)
+				{
+					for (const int32 Index : *Bucket)
+					{
+						VisitEntry( Index );
+					}
+				}
+			}
+		}
+	}
+	for (const int32 Index : OversizedLights)
+	{
+		VisitEntry( Index );
+	}
+
+	for (const int32 Index : Stale)
+	{
+		RemoveEntry( Index );
+	}
+
+	OutLights.Sort( []( const FLucidLightCandidate &A, const FLucidLightCandidate &B ) { return A.Distance < B.Distance; } );
+	if (OutLights.Num() > MaxLights)
+	{
+		OutLights.SetNum( MaxLights, false );
+	}
+	return OutLights.Num();
+}
+
+void FLucidLightRegistry::GetLights( TArray<UPointLightComponent*> &OutLights ) const
+{
+	OutLights.Reset();
+	for (const FLucidLightEntry &Entry : Lights)
+	{
+		UPointLightComponent* LightComp = Entry.Light.Get();
+		if (LightComp != nullptr)
+		{
+			OutLights.Add( LightComp );
+		}
+	}
+}
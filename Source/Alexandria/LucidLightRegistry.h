@@ -0,0 +1,113 @@
+// Copyright 1998-2017 Epic Games, Inc. All Rights Reserved.
+#pragma once
+
+#include "LucidPerWorld.h"
+
+class UPointLightComponent;
+
+// A "Lucidity" tagged light known to the registry
+struct FLucidLightEntry
+{
+	TWeakObjectPtr<UPointLightComponent> Light;
+	FVector Position;
+	float AttenuationRadius;
+	// Cell range the light's attenuation sphere was bucketed into
+	FIntVector MinCell;
+	FIntVector MaxCell;
+	uint32 bOversized : 1;
+	uint32 bMovable : 1;
+	// Last query that visited this entry, used to skip duplicates across cells
+	uint32 QueryStamp;
+};
+
+// A light whose attenuation radius reaches the queried bounds
+struct FLucidLightCandidate
+{
+	UPointLightComponent* Light;
+	FVector Position;
+	float AttenuationRadius;
+	float Distance;
+};
+
+/**
+ * Per-world spatial hash of "Lucidity" tagged point lights.
+ * Lights join when their level is added to the world (or their actor is spawned into it)
+ * and leave when the level is removed, so a query only visits lights whose attenuation
+ * radius can reach the player. Components added or tagged later are found by a rolling scan
+ * of a few actors per frame, and lights that lose their tag or are unregistered drop out.
+ */
+class FLucidLightRegistry
+{
+public:
+	static const FName LucidityTag;
+
+	/** Returns the registry for World, creating and populating it on first use */
+	static FLucidLightRegistry* Get( UWorld* World );
+
+	void RegisterLight( UPointLightComponent* LightComp );
+	void UnregisterLight( UPointLightComponent* LightComp );
+
+	void AddLevel( ULevel* Level );
+	void RemoveLevel( ULevel* Level );
+
+	/**
+	 * Gathers up to MaxLights lights whose attenuation sphere overlaps Bounds, nearest first.
+	 * With a Receiver, lights that do not affect it are left out before the cap is applied.
+	 * @return number of candidates written to OutLights
+	 */
+	int32 QueryLights( const FBoxSphereBounds &Bounds, const int32 MaxLights, TArray<FLucidLightCandidate> &OutLights, const UPrimitiveComponent* Receiver = nullptr );
+
+	/** Every registered light, in registration slot order */
+	void GetLights( TArray<UPointLightComponent*> &OutLights ) const;
+
+	FORCEINLINE int32 Num() const { return LightIndices.Num(); }
+
+	/** Bumped whenever a light joins or leaves */
+	FORCEINLINE uint32 GetGeneration() const { return Generation; }
+
+	~FLucidLightRegistry();
+
+private:
+	explicit FLucidLightRegistry( UWorld* InWorld );
+
+	static uint64 CellKey( const int32 X, const int32 Y, const int32 Z );
+	FIntVector CellOf( const FVector &Point ) const;
+
+	void AddToCells( const int32 Index );
+	void RemoveFromCells( const int32 Index );
+	void RemoveEntry( const int32 Index );
+
+	// Re-buckets movable lights and continues the rolling scan, at most once per frame
+	void RefreshMovableLights();
+
+	// Registers the tagged lights of the next few actors of the world's visible levels
+	void ScanForRuntimeLights();
+
+	void OnActorSpawned( AActor* Actor );
+
+	TWeakObjectPtr<UWorld> World;
+
+	// Sparse entry storage, slots are recycled through FreeSlots
+	TArray<FLucidLightEntry> Lights;
+	TArray<int32> FreeSlots;
+	TMap<TWeakObjectPtr<UPointLightComponent>, int32> LightIndices;
+
+	// Uniform grid, keyed by packed cell coordinates
+	TMap<uint64, TArray<int32>> Cells;
+	// Lights spanning too many cells to bucket, visited by every query
+	TArray<int32> OversizedLights;
+
+	float CellSize;
+	uint32 QueryCounter;
+	uint64 LastRefreshFrame;
+
+	// Rolling scan cursor, a level index and an actor index within it
+	int32 ScanLevel;
+	int32 ScanActor;
+
+	uint32 Generation;
+
+	FDelegateHandle ActorSpawnedHandle;
+
+	friend class TLucidPerWorld<FLucidLightRegistry, true>;
+};
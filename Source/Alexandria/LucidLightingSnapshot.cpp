@@ -0,0 +1,266 @@
+// Copyright 1998-2017 Epic Games, Inc. All Rights Reserved.
+
+#include "Alexandria.h"
+#include "LucidLightingSnapshot.h"
+#include "LucidLightRegistry.h"
+#include "LucidityStats.h"
+#include "Components/LightComponent.h"
+#include "Components/PointLightComponent.h"
+#include "Runtime/Engine/Classes/Engine/DirectionalLight.h"
+#include "EngineUtils.h"
+
+namespace LucidLightingSnapshot
+{
+	// Static lights checked for being shown or hidden per frame
+	static const int32 StaticLightsPerRefresh = 16;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// FLucidLightingFrame
+
+const FLucidSunState& FLucidLightingFrame::FindSun( const ADirectionalLight* Sun ) const
+{
+	static const FLucidSunState NoSun;
+	const int32 Index = SunKeys.IndexOfByKey( Sun );
+	return (Index != INDEX_NONE) ? Suns[Index] : NoSun;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// FLucidLightingSnapshot
+
+bool FLucidLightingSnapshot::FLightSignature::operator==( const FLightSignature &Other ) const
+{
+	return (Location == Other.Location) && (Rotation == Other.Rotation) && (Color == Other.Color)
+		&& (Intensity == Other.Intensity) && (Temperature == Other.Temperature) && (AttenuationRadius == Other.AttenuationRadius)
+		&& (FalloffExponent == Other.FalloffExponent) && (Flags == Other.Flags);
+}
+
+FLucidLightingSnapshot::FLightSignature FLucidLightingSnapshot::MakeSignature( const ULightComponent* LightComp )
+{
+	FLightSignature Signature;
+	Signature.Location = LightComp->GetComponentLocation();
+	Signature.Rotation = LightComp->GetComponentQuat();
+	Signature.Intensity = LightComp->Intensity;
+	Signature.Flags = (LightComp->bAffectsWorld ? 2 : 0) | (LightComp->IsVisible() ? 4 : 0);
+
+	// Only the sun publishes a colour, a tagged light changing colour leaves its state as it is
+	const UPointLightComponent* PointLight = Cast<UPointLightComponent>( LightComp );
+	if (PointLight != nullptr)
+	{
+		Signature.Color = FLinearColor::White;
+		Signature.Temperature = 0.f;
+		Signature.AttenuationRadius = PointLight->AttenuationRadius;
+		Signature.FalloffExponent = PointLight->LightFalloffExponent;
+		Signature.Flags |= PointLight->bUseInverseSquaredFalloff ? 8 : 0;
+	}
+	else
+	{
+		Signature.Color = LightComp->GetLightColor();
+		Signature.Temperature = LightComp->Temperature;
+		Signature.AttenuationRadius = 0.f;
+		Signature.FalloffExponent = 0.f;
+		Signature.Flags |= LightComp->bUseTemperature ? 1 : 0;
+	}
+	return Signature;
+}
+
+bool FLucidLightingSnapshot::IsShining( const UPointLightComponent* LightComp )
+{
+	return LightComp->IsVisible() && LightComp->bAffectsWorld;
+}
+
+FLucidLightingSnapshot::FLucidLightingSnapshot( UWorld* InWorld ) :
+	World( InWorld ),
+	Frame( MakeShareable( new FLucidLightingFrame() ) ),
+	StaticCursor( 0 ),
+	RegistryGeneration( 0 ),
+	bSunsDirty( true ),
+	LastRefreshFrame( 0 )
+{
+	ActorSpawnedHandle = InWorld->AddOnActorSpawnedHandler( FOnActorSpawned::FDelegate::CreateRaw( this, &FLucidLightingSnapshot::OnActorSpawned ) );
+}
+
+FLucidLightingSnapshot::~FLucidLightingSnapshot()
+{
+	if (World.IsValid())
+	{
+		World->RemoveOnActorSpawnedHandler( ActorSpawnedHandle );
+	}
+}
+
+FLucidLightingSnapshot* FLucidLightingSnapshot::Get( UWorld* World )
+{
+	return TLucidPerWorld<FLucidLightingSnapshot, true>::Get( World );
+}
+
+FLucidLightingFrameRef FLucidLightingSnapshot::GetFrame()
+{
+	check( IsInGameThread() );
+	if (LastRefreshFrame != GFrameCounter)
+	{
+		LastRefreshFrame = GFrameCounter;
+		Refresh();
+	}
+	return Frame.ToSharedRef();
+}
+
+void FLucidLightingSnapshot::FindSuns()
+{
+	SunActors.Reset();
+	for (TActorIterator<ADirectionalLight> It( World.Get() ); It; ++It)
+	{
+		if (It->GetLightComponent() != nullptr)
+		{
+			SunActors.Add( *It );
+		}
+	}
+	bSunsDirty = false;
+}
+
+void FLucidLightingSnapshot::Refresh()
+{
+	SCOPE_CYCLE_COUNTER( STAT_LucidLightingSnapshot );
+	bool bChanged = RefreshSuns();
+
+	// Tagged point lights are tracked by the registry, including streaming and spawning
+	FLucidLightRegistry* Registry = FLucidLightRegistry::Get( World.Get() );
+	if ((Registry != nullptr) && (Registry->GetGeneration() != RegistryGeneration))
+	{
+		SyncLocalLights( *Registry );
+		bChanged = true;
+	}
+	else
+	{
+		bool bStale = false;
+		for (FTrackedLight &Tracked : DynamicLights)
+		{
+			bChanged |= RefreshLocalLight( Tracked, bStale );
+		}
+		const int32 NumStaticChecks = FMath::Min( StaticLights.Num(), LucidLightingSnapshot::StaticLightsPerRefresh );
+		for (int32 i = 0; i < NumStaticChecks; i++)
+		{
+			StaticCursor = (StaticCursor + 1) % StaticLights.Num();
+			bChanged |= RefreshLocalLight( StaticLights[StaticCursor], bStale );
+		}
+
+		// A light was destroyed without the registry hearing of it
+		if (bStale && (Registry != nullptr))
+		{
+			SyncLocalLights( *Registry );
+			bChanged = true;
+		}
+	}
+
+	if (bChanged)
+	{
+		Working.Version = Frame->Version + 1;
+		Frame = MakeShareable( new FLucidLightingFrame( Working ) );
+		INC_DWORD_STAT( STAT_LucidLightingRebuilds );
+	}
+}
+
+bool FLucidLightingSnapshot::RefreshSuns()
+{
+	bool bChanged = bSunsDirty;
+	if (bSunsDirty)
+	{
+		FindSuns();
+	}
+	for (int32 i = 0; !bChanged && (i < SunActors.Num()); i++)
+	{
+		const ADirectionalLight* Sun = SunActors[i].Get();
+		if ((Sun == nullptr) || (Sun->GetLightComponent() == nullptr))
+		{
+			// A directional light went away, find the current set
+			FindSuns();
+			bChanged = true;
+		}
+		else
+		{
+			bChanged = (MakeSignature( Sun->GetLightComponent() ) != SunSignatures[i]);
+		}
+	}
+	if (!bChanged)
+	{
+		return false;
+	}
+
+	// Brightest sun first, it is the default for characters without one assigned
+	SunActors.Sort( []( const TWeakObjectPtr<ADirectionalLight> &A, const TWeakObjectPtr<ADirectionalLight> &B )
+	{
+		return A->GetLightComponent()->ComputeLightBrightness() > B->GetLightComponent()->ComputeLightBrightness();
+	} );
+	Working.SunKeys.Reset();
+	Working.Suns.Reset();
+	SunSignatures.Reset();
+	for (const TWeakObjectPtr<ADirectionalLight> &Sun : SunActors)
+	{
+		Working.SunKeys.Add( Sun.Get() );
+		Working.Suns.Add( FLucidSunState::Gather( Sun.Get() ) );
+		SunSignatures.Add( MakeSignature( Sun->GetLightComponent() ) );
+	}
+	return true;
+}
+
+void FLucidLightingSnapshot::SyncLocalLights( const FLucidLightRegistry &Registry )
+{
+	RegistryGeneration = Registry.GetGeneration();
+	Registry.GetLights( RegistryLights );
+
+	Working.LocalLights.Reset();
+	DynamicLights.Reset();
+	StaticLights.Reset();
+	for (UPointLightComponent* LightComp : RegistryLights)
+	{
+		FTrackedLight Tracked;
+		Tracked.Light = LightComp;
+		Tracked.Key = LightComp;
+		Tracked.Signature = MakeSignature( LightComp );
+		if (LightComp->Mobility == EComponentMobility::Static)
+		{
+			StaticLights.Add( Tracked );
+		}
+		else
+		{
+			DynamicLights.Add( Tracked );
+		}
+		if (IsShining( LightComp ))
+		{
+			Working.LocalLights.Add( LightComp, FLucidLocalLightState::Gather( LightComp ) );
+		}
+	}
+	StaticCursor = 0;
+}
+
+bool FLucidLightingSnapshot::RefreshLocalLight( FTrackedLight &Tracked, bool &bOutStale )
+{
+	const UPointLightComponent* LightComp = Tracked.Light.Get();
+	if (LightComp == nullptr)
+	{
+		bOutStale = true;
+		return false;
+	}
+	const FLightSignature Signature = MakeSignature( LightComp );
+	if (Signature == Tracked.Signature)
+	{
+		return false;
+	}
+	Tracked.Signature = Signature;
+	if (IsShining( LightComp ))
+	{
+		Working.LocalLights.Add( Tracked.Key, FLucidLocalLightState::Gather( LightComp ) );
+	}
+	else
+	{
+		Working.LocalLights.Remove( Tracked.Key );
+	}
+	return true;
+}
+
+void FLucidLightingSnapshot::OnActorSpawned( AActor* Actor )
+{
+	if (Actor->IsA<ADirectionalLight>())
+	{
+		bSunsDirty = true;
+	}
+}
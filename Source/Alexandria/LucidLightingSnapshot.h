@@ -0,0 +1,133 @@
+// Copyright 1998-2017 Epic Games, Inc. All Rights Reserved.
+#pragma once
+
+#include "LucidityTypes.h"
+#include "LucidPerWorld.h"
+
+class ADirectionalLight;
+class UPointLightComponent;
+class FLucidLightRegistry;
+
+/**
+ * Lighting of a world as of one frame: every directional light and every shown "Lucidity" tagged point light,
+ * with colours and intensities already computed. Never changes once published, so it can be read from
+ * any thread without touching the lights themselves. The light pointers are keys only.
+ */
+class FLucidLightingFrame
+{
+public:
+	FLucidLightingFrame() : Version( 0 ) {}
+
+	/** State of Sun, invalid if it is not in this frame */
+	const FLucidSunState& FindSun( const ADirectionalLight* Sun ) const;
+
+	/** State of a tagged point light, nullptr if it is hidden or not in this frame */
+	FORCEINLINE const FLucidLocalLightState* FindLocalLight( const UPointLightComponent* Light ) const { return LocalLights.Find( Light ); }
+
+	/** Every shown tagged point light of this frame */
+	FORCEINLINE const TMap<const UPointLightComponent*, FLucidLocalLightState>& GetLocalLights() const { return LocalLights; }
+
+	/** Brightest directional light */
+	FORCEINLINE ADirectionalLight* GetPrimarySun() const { return (SunKeys.Num() > 0) ? SunKeys[0] : nullptr; }
+
+	/** Bumped whenever a light changes */
+	FORCEINLINE uint32 GetVersion() const { return Version; }
+
+private:
+	friend class FLucidLightingSnapshot;
+
+	uint32 Version;
+	// Brightest first
+	TArray<ADirectionalLight*> SunKeys;
+	TArray<FLucidSunState> Suns;
+	TMap<const UPointLightComponent*, FLucidLocalLightState> LocalLights;
+};
+
+typedef TSharedRef<const FLucidLightingFrame, ESPMode::ThreadSafe> FLucidLightingFrameRef;
+
+/**
+ * Per-world publisher of FLucidLightingFrame.
+ * The first request of a frame checks the lights that can change, and only when one moved, turned or
+ * changed intensity, as the sun does while a sequence animates it, publishes a copy of the working frame
+ * with just that light gathered again. Static lights can only be shown or hidden, so a few of them are
+ * checked per frame, and the tagged set is only walked again when the light registry gains or loses one.
+ * Readers keep the frame they were handed alive for as long as they need it.
+ */
+class FLucidLightingSnapshot
+{
+public:
+	/** Returns the snapshot for World, creating it on first use */
+	static FLucidLightingSnapshot* Get( UWorld* World );
+
+	/** This frame's lighting, game thread only, pass the result to workers */
+	FLucidLightingFrameRef GetFrame();
+
+	// Directional lights are searched for again when a level comes or goes
+	void AddLevel( ULevel* Level ) { bSunsDirty = true; }
+	void RemoveLevel( ULevel* Level ) { bSunsDirty = true; }
+
+	~FLucidLightingSnapshot();
+
+private:
+	explicit FLucidLightingSnapshot( UWorld* InWorld );
+
+	// What a light's published state depends on, compared instead of gathering it again
+	struct FLightSignature
+	{
+		FVector Location;
+		FQuat Rotation;
+		FLinearColor Color;
+		float Intensity;
+		float Temperature;
+		float AttenuationRadius;
+		float FalloffExponent;
+		uint32 Flags;
+
+		bool operator==( const FLightSignature &Other ) const;
+		bool operator!=( const FLightSignature &Other ) const { return !(*this == Other); }
+	};
+	static FLightSignature MakeSignature( const ULightComponent* LightComp );
+
+	// Hidden tagged lights are left out of the frame, so readers see them as gone
+	static bool IsShining( const UPointLightComponent* LightComp );
+
+	// A tagged point light in the working frame, keyed there by Key
+	struct FTrackedLight
+	{
+		TWeakObjectPtr<UPointLightComponent> Light;
+		const UPointLightComponent* Key;
+		FLightSignature Signature;
+	};
+
+	void Refresh();
+	void FindSuns();
+	bool RefreshSuns();
+	void SyncLocalLights( const FLucidLightRegistry &Registry );
+	bool RefreshLocalLight( FTrackedLight &Tracked, bool &bOutStale );
+
+	void OnActorSpawned( AActor* Actor );
+
+	TWeakObjectPtr<UWorld> World;
+	TSharedPtr<const FLucidLightingFrame, ESPMode::ThreadSafe> Frame;
+
+	// Game thread copy of the lighting, patched light by light and copied into Frame when it changes
+	FLucidLightingFrame Working;
+
+	TArray<TWeakObjectPtr<ADirectionalLight>> SunActors;
+	TArray<FLightSignature> SunSignatures;
+
+	// Stationary and movable lights are checked every frame, static ones on a rolling cursor
+	TArray<FTrackedLight> DynamicLights;
+	TArray<FTrackedLight> StaticLights;
+	int32 StaticCursor;
+	TArray<UPointLightComponent*> RegistryLights;
+	uint32 RegistryGeneration;
+
+	// Directional lights are searched for again after a level or directional light comes or goes
+	bool bSunsDirty;
+	uint64 LastRefreshFrame;
+
+	FDelegateHandle ActorSpawnedHandle;
+
+	friend class TLucidPerWorld<FLucidLightingSnapshot, true>;
+};
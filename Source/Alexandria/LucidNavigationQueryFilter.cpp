@@ -0,0 +1,83 @@
+// Copyright 1998-2017 Epic Games, Inc. All Rights Reserved.
+
+#include "Alexandria.h"
+#include "LucidNavigationQueryFilter.h"
+#include "LucidCostField.h"
+#include "AI/Navigation/RecastNavMesh.h"
+
+#if WITH_RECAST
+namespace LucidNavigation
+{
+	/**
+	 * Recast filter scaling each polygon's cost by the shadow on it, from one published cost grid.
+	 * Detour asks once per polygon it expands, so a query pays a lookup per polygon.
+	 */
+	class FLucidRecastQueryFilter : public FRecastQueryFilter
+	{
+	public:
+		FLucidRecastQueryFilter( const FLucidCostGridRef &InGrid, const float InShadowCost, const float InLitLucidity ) :
+			FRecastQueryFilter( true ),
+			Grid( InGrid ),
+			ShadowCost( InShadowCost ),
+			InvLitLucidity( 1.f / FMath::Max( InLitLucidity, KINDA_SMALL_NUMBER ) )
+		{}
+
+		virtual INavigationQueryFilterInterface* CreateCopy() const override
+		{
+			return new FLucidRecastQueryFilter( *this );
+		}
+
+		virtual float getVirtualCost( const float* pa, const float* pb,
+			const dtPolyRef prevRef, const dtMeshTile* prevTile, const dtPoly* prevPoly,
+			const dtPolyRef curRef, const dtMeshTile* curTile, const dtPoly* curPoly,
+			const dtPolyRef nextRef, const dtMeshTile* nextTile, const dtPoly* nextPoly ) const override
+		{
+			const float Cost = FRecastQueryFilter::getVirtualCost( pa, pb, prevRef, prevTile, prevPoly, curRef, curTile, curPoly, nextRef, nextTile, nextPoly );
+			// The step from pa to pb runs across curPoly
+			const float Lit = FMath::Min( Grid->Sample( curRef, 1.f )*InvLitLucidity, 1.f );
+			return Cost*(1.f + ShadowCost*(1.f - Lit));
+		}
+
+	private:
+		FLucidCostGridRef Grid;
+		float ShadowCost;
+		float InvLitLucidity;
+	};
+}
+#endif
+
+ULucidNavigationQueryFilter::ULucidNavigationQueryFilter()
+{
+	ShadowCost = 4.f;
+	LitLucidity = 0.5f;
+
+	// A filter per query, so each one takes the latest published grid
+	bInstantiateForQuerier = true;
+}
+
+void ULucidNavigationQueryFilter::InitializeFilter( const ANavigationData &NavData, const UObject* Querier, FNavigationQueryFilter &Filter ) const
+{
+#if WITH_RECAST
+	// Grids are handed out on the game thread, the query itself may then run on any thread
+	FLucidCostField* Field = IsInGameThread() ? FLucidCostField::Get( NavData.GetWorld() ) : nullptr;
+	const INavigationQueryFilterInterface* Source = Filter.GetImplementation();
+	if ((Field != nullptr) && (Source != nullptr) && NavData.IsA<ARecastNavMesh>())
+	{
+		// Start from the navmesh's default area costs and flags, this filter's areas are applied below
+		LucidNavigation::FLucidRecastQueryFilter LucidFilter( Field->GetGrid(), ShadowCost, LitLucidity );
+		float AreaCosts[RECAST_MAX_AREAS];
+		float FixedAreaCosts[RECAST_MAX_AREAS];
+		Source->GetAllAreaCosts( AreaCosts, FixedAreaCosts, RECAST_MAX_AREAS );
+		for (int32 Area = 0; Area < RECAST_MAX_AREAS; Area++)
+		{
+			LucidFilter.SetAreaCost( Area, AreaCosts[Area] );
+			LucidFilter.SetFixedAreaEnteringCost( Area, FixedAreaCosts[Area] );
+		}
+		LucidFilter.SetIncludeFlags( Source->GetIncludeFlags() );
+		LucidFilter.SetExcludeFlags( Source->GetExcludeFlags() );
+		LucidFilter.SetBacktrackingEnabled( Source->IsBacktrackingEnabled() );
+		Filter.SetFilterImplementation( &LucidFilter );
+	}
+#endif
+	Super::InitializeFilter( NavData, Querier, Filter );
+}
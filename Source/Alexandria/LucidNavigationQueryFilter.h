@@ -0,0 +1,30 @@
+// Copyright 1998-2017 Epic Games, Inc. All Rights Reserved.
+#pragma once
+#include "AI/Navigation/NavFilters/NavigationQueryFilter.h"
+#include "LucidNavigationQueryFilter.generated.h"
+
+/**
+ * Navigation filter that makes shadowed paths cost more, so AI prefers lit routes and avoids the dark
+ * that drains Lucidity. Each polygon a path crosses is scaled by the Lucidity the world's cost field holds
+ * for it, one lookup instead of any trace. Polygons the field has not evaluated yet cost as if lit.
+ * The first query in a world starts building its field, see FLucidCostField.
+ */
+UCLASS()
+class ULucidNavigationQueryFilter : public UNavigationQueryFilter
+{
+	GENERATED_BODY()
+
+public:
+	ULucidNavigationQueryFilter();
+
+	// Extra cost of a fully dark stretch of path, as a multiple of its area cost
+	UPROPERTY( Category = "Lucidity", EditAnywhere, BlueprintReadOnly, meta = (ClampMin = "0", UIMin = "0") )
+	float ShadowCost;
+
+	// Lucidity at and above which a path costs nothing extra
+	UPROPERTY( Category = "Lucidity", EditAnywhere, BlueprintReadOnly, meta = (ClampMin = "0.01", ClampMax = "1", UIMin = "0.01", UIMax = "1") )
+	float LitLucidity;
+
+protected:
+	virtual void InitializeFilter( const ANavigationData &NavData, const UObject* Querier, FNavigationQueryFilter &Filter ) const override;
+};
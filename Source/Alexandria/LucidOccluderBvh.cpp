@@ -0,0 +1,219 @@
+// Copyright 1998-2017 Epic Games, Inc. All Rights Reserved.
+
+#include "Alexandria.h"
+#include "LucidOccluderBvh.h"
+#include "LucidOccluders.h"
+#include "LucidityTypes.h"
+
+using namespace LucidOccluderFormat;
+
+namespace LucidOccluderBvh
+{
+	// Axis parallel rays get a tiny slope instead, an infinite reciprocal could meet a zero distance in a NaN
+	static FORCEINLINE VectorRegister SafeReciprocal( const VectorRegister &Delta )
+	{
+		const VectorRegister Tiny = VectorSetFloat1( KINDA_SMALL_NUMBER );
+		const VectorRegister Signed = VectorSelect( VectorCompareGE( Delta, VectorZero() ), Tiny, VectorNegate( Tiny ) );
+		return VectorReciprocalAccurate( VectorSelect( VectorCompareGT( Tiny, VectorAbs( Delta ) ), Signed, Delta ) );
+	}
+
+	// Lanes whose segment, 0 to 1 along it, overlaps the slabs Lo-Hi on every axis
+	static FORCEINLINE int32 SlabTest( const VectorRegister* Origin, const VectorRegister* InvDelta, const VectorRegister* Lo, const VectorRegister* Hi )
+	{
+		VectorRegister Near = VectorZero();
+		VectorRegister Far = VectorOne();
+		for (int32 k = 0; k < 3; k++)
+		{
+			const VectorRegister T0 = VectorMultiply( VectorSubtract( Lo[k], Origin[k] ), InvDelta[k] );
+			const VectorRegister T1 = VectorMultiply( VectorSubtract( Hi[k], Origin[k] ), InvDelta[k] );
+			Near = VectorMax( Near, VectorMin( T0, T1 ) );
+			Far = VectorMin( Far, VectorMax( T0, T1 ) );
+		}
+		return VectorMaskBits( VectorCompareGE( Far, Near ) );
+	}
+}
+
+void FLucidOccluderBvh::Build( const TArray<FProxy> &Proxies, const bool bConservativeOnly )
+{
+	Nodes.Reset();
+	Boxes.Reset();
+
+	TArray<FOrientedBox> Unordered;
+	TArray<FBox> Bounds;
+	Unordered.Reserve( Proxies.Num() );
+	Bounds.Reserve( Proxies.Num() );
+	for (const FProxy &Proxy : Proxies)
+	{
+		if (bConservativeOnly && !(Proxy.Flags & Conservative))
+		{
+			continue;
+		}
+
+		const FQuat Rotation( Proxy.Rotation[0], Proxy.Rotation[1], Proxy.Rotation[2], Proxy.Rotation[3] );
+		const FVector Axes[3] = { Rotation.GetAxisX(), Rotation.GetAxisY(), Rotation.GetAxisZ() };
+		const FVector Center( Proxy.Center[0], Proxy.Center[1], Proxy.Center[2] );
+
+		FOrientedBox &Box = Unordered[Unordered.AddUninitialized()];
+		FVector Reach = FVector::ZeroVector;
+		for (int32 k = 0; k < 3; k++)
+		{
+			Box.Center[k] = Proxy.Center[k];
+			Box.Extent[k] = Proxy.Extent[k];
+			Box.Axes[k][0] = Axes[k].X;
+			Box.Axes[k][1] = Axes[k].Y;
+			Box.Axes[k][2] = Axes[k].Z;
+			Reach += Axes[k].GetAbs()*Proxy.Extent[k];
+		}
+		Bounds.Add( FBox( Center - Reach, Center + Reach ) );
+	}
+	if (Unordered.Num() == 0)
+	{
+		return;
+	}
+
+	TArray<int32> Order;
+	Order.SetNumUninitialized( Unordered.Num() );
+	for (int32 i = 0; i < Order.Num(); i++)
+	{
+		Order[i] = i;
+	}
+	Nodes.AddUninitialized();
+	BuildNode( 0, 0, Order.Num(), 0, Bounds, Order );
+	Nodes.Shrink();
+
+	Boxes.Reserve( Order.Num() );
+	for (const int32 Index : Order)
+	{
+		Boxes.Add( Unordered[Index] );
+	}
+}
+
+void FLucidOccluderBvh::BuildNode( const int32 NodeIndex, const int32 Begin, const int32 End, const int32 Depth, const TArray<FBox> &Bounds, TArray<int32> &Order )
+{
+	FBox NodeBounds( ForceInit );
+	FBox CentroidBounds( ForceInit );
+	for (int32 i = Begin; i < End; i++)
+	{
+		NodeBounds += Bounds[Order[i]];
+		CentroidBounds += Bounds[Order[i]].GetCenter();
+	}
+
+	FNode &Node = Nodes[NodeIndex];
+	for (int32 k = 0; k < 3; k++)
+	{
+		Node.Min[k] = NodeBounds.Min[k];
+		Node.Max[k] = NodeBounds.Max[k];
+	}
+
+	const int32 Count = End - Begin;
+	if ((Count <= MaxLeafBoxes) || (Depth >= MaxDepth))
+	{
+		Node.First = Begin;
+		Node.NumBoxes = Count;
+		return;
+	}
+
+	// Median split across the widest spread of box centres, keeps the tree balanced and shallow
+	const FVector Spread = CentroidBounds.GetSize();
+	const int32 Axis = ((Spread.X >= Spread.Y) && (Spread.X >= Spread.Z)) ? 0 : ((Spread.Y >= Spread.Z) ? 1 : 2);
+	Sort( Order.GetData() + Begin, Count, [&Bounds, Axis]( const int32 A, const int32 B )
+	{
+		return Bounds[A].GetCenter()[Axis] < Bounds[B].GetCenter()[Axis];
+	} );
+	const int32 Middle = Begin + Count/2;
+
+	// Adding the children may move Node
+	const int32 First = Nodes.AddUninitialized( 2 );
+	Nodes[NodeIndex].First = First;
+	Nodes[NodeIndex].NumBoxes = 0;
+	BuildNode( First, Begin, Middle, Depth + 1, Bounds, Order );
+	BuildNode( First + 1, Middle, End, Depth + 1, Bounds, Order );
+}
+
+uint32 FLucidOccluderBvh::TracePacket( const FLucidSunRay* Rays, const int32 Count, const uint32 LaneMask ) const
+{
+	using namespace LucidOccluderBvh;
+	check( (Count > 0) && (Count <= PacketSize) );
+	const uint32 Lanes = LaneMask & ((1u << Count) - 1);
+	if ((Nodes.Num() == 0) || (Lanes == 0))
+	{
+		return 0;
+	}
+
+	// Structure of arrays, lanes past Count repeat the first ray and are masked out
+	MS_ALIGN( 16 ) float Packed[6][PacketSize] GCC_ALIGN( 16 );
+	for (int32 Lane = 0; Lane < PacketSize; Lane++)
+	{
+		const FLucidSunRay &Ray = Rays[(Lane < Count) ? Lane : 0];
+		const FVector Delta = Ray.End - Ray.Start;
+		for (int32 k = 0; k < 3; k++)
+		{
+			Packed[k][Lane] = Ray.Start[k];
+			Packed[k + 3][Lane] = Delta[k];
+		}
+	}
+	VectorRegister Origin[3];
+	VectorRegister Delta[3];
+	VectorRegister InvDelta[3];
+	for (int32 k = 0; k < 3; k++)
+	{
+		Origin[k] = VectorLoadAligned( Packed[k] );
+		Delta[k] = VectorLoadAligned( Packed[k + 3] );
+		InvDelta[k] = SafeReciprocal( Delta[k] );
+	}
+
+	uint32 Blocked = 0;
+	int32 Stack[MaxDepth];
+	int32 StackSize = 0;
+	int32 NodeIndex = 0;
+	for (;;)
+	{
+		const FNode &Node = Nodes[NodeIndex];
+		const VectorRegister NodeMin[3] = { VectorSetFloat1( Node.Min[0] ), VectorSetFloat1( Node.Min[1] ), VectorSetFloat1( Node.Min[2] ) };
+		const VectorRegister NodeMax[3] = { VectorSetFloat1( Node.Max[0] ), VectorSetFloat1( Node.Max[1] ), VectorSetFloat1( Node.Max[2] ) };
+		if (SlabTest( Origin, InvDelta, NodeMin, NodeMax ) & Lanes & ~Blocked)
+		{
+			if (Node.NumBoxes == 0)
+			{
+				Stack[StackSize++] = Node.First + 1;
+				NodeIndex = Node.First;
+				continue;
+			}
+
+			for (int32 BoxIndex = Node.First; BoxIndex < Node.First + Node.NumBoxes; BoxIndex++)
+			{
+				// Into the box's frame, where it is a plain slab test against its extent
+				const FOrientedBox &Box = Boxes[BoxIndex];
+				const VectorRegister Offset[3] = {
+					VectorSubtract( Origin[0], VectorSetFloat1( Box.Center[0] ) ),
+					VectorSubtract( Origin[1], VectorSetFloat1( Box.Center[1] ) ),
+					VectorSubtract( Origin[2], VectorSetFloat1( Box.Center[2] ) ) };
+				VectorRegister LocalOrigin[3];
+				VectorRegister LocalInvDelta[3];
+				VectorRegister Hi[3];
+				VectorRegister Lo[3];
+				for (int32 k = 0; k < 3; k++)
+				{
+					const VectorRegister X = VectorSetFloat1( Box.Axes[k][0] );
+					const VectorRegister Y = VectorSetFloat1( Box.Axes[k][1] );
+					const VectorRegister Z = VectorSetFloat1( Box.Axes[k][2] );
+					LocalOrigin[k] = VectorMultiplyAdd( Offset[2], Z, VectorMultiplyAdd( Offset[1], Y, VectorMultiply( Offset[0], X ) ) );
+					LocalInvDelta[k] = SafeReciprocal( VectorMultiplyAdd( Delta[2], Z, VectorMultiplyAdd( Delta[1], Y, VectorMultiply( Delta[0], X ) ) ) );
+					Hi[k] = VectorSetFloat1( Box.Extent[k] );
+					Lo[k] = VectorNegate( Hi[k] );
+				}
+				Blocked |= SlabTest( LocalOrigin, LocalInvDelta, Lo, Hi ) & Lanes;
+				if (Blocked == Lanes)
+				{
+					return Blocked;
+				}
+			}
+		}
+
+		if (StackSize == 0)
+		{
+			return Blocked;
+		}
+		NodeIndex = Stack[--StackSize];
+	}
+}
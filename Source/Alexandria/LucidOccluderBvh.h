@@ -0,0 +1,67 @@
+// Copyright 1998-2017 Epic Games, Inc. All Rights Reserved.
+#pragma once
+
+struct FLucidSunRay;
+
+namespace LucidOccluderFormat
+{
+	struct FProxy;
+}
+
+/**
+ * Bounding volume hierarchy over one level's occluder proxies, traced without the physics scene.
+ * Rays are traced in packets: every node and box is tested against the whole packet in one SIMD pass,
+ * and traversal stops once every ray of it is blocked. Sun rays are parallel, so the rays of characters
+ * standing near each other walk the same nodes. Immutable once built, any number of threads may trace it.
+ */
+class FLucidOccluderBvh
+{
+public:
+	// Rays per packet, one per SIMD lane
+	static const int32 PacketSize = 4;
+
+	/** Builds the hierarchy over Proxies, leaving out the non-conservative ones if bConservativeOnly */
+	void Build( const TArray<LucidOccluderFormat::FProxy> &Proxies, const bool bConservativeOnly );
+
+	/**
+	 * Traces up to PacketSize rays from their Start to their End.
+	 * @return bit i set if ray i is blocked, only for the lanes set in LaneMask
+	 */
+	uint32 TracePacket( const FLucidSunRay* Rays, const int32 Count, const uint32 LaneMask ) const;
+
+	FORCEINLINE bool IsEmpty() const { return Nodes.Num() == 0; }
+	FORCEINLINE int32 NumBoxes() const { return Boxes.Num(); }
+	FORCEINLINE int32 NumNodes() const { return Nodes.Num(); }
+	FORCEINLINE SIZE_T GetAllocatedSize() const { return Nodes.GetAllocatedSize() + Boxes.GetAllocatedSize(); }
+
+private:
+	// Leaves hold up to this many boxes
+	static const int32 MaxLeafBoxes = 4;
+	// Bounds the traversal stack, anything deeper is left as one larger leaf
+	static const int32 MaxDepth = 48;
+
+	// The children of an interior node are stored next to each other, at First and First + 1
+	struct FNode
+	{
+		float Min[3];
+		// First child, or first box of a leaf
+		int32 First;
+		float Max[3];
+		// 0 for interior nodes
+		int32 NumBoxes;
+	};
+
+	// Proxies are traced in their own frame, Local[k] = dot( P - Center, Axes[k] )
+	struct FOrientedBox
+	{
+		float Center[3];
+		float Axes[3][3];
+		float Extent[3];
+	};
+
+	void BuildNode( const int32 NodeIndex, const int32 Begin, const int32 End, const int32 Depth, const TArray<FBox> &Bounds, TArray<int32> &Order );
+
+	TArray<FNode> Nodes;
+	// In leaf order
+	TArray<FOrientedBox> Boxes;
+};
@@ -0,0 +1,448 @@
+// Copyright 1998-2017 Epic Games, Inc. All Rights Reserved.
+
+#include "Alexandria.h"
+#include "LucidOccluders.h"
+#include "AlexandriaGameMode.h"
+#include "LucidLightRegistry.h"
+#include "LucidityStats.h"
+#include "Engine/Level.h"
+#include "Engine/CollisionProfile.h"
+#include "Async/Async.h"
+#include "PhysicsEngine/BodySetup.h"
+#include "Components/InstancedStaticMeshComponent.h"
+#include "Components/PointLightComponent.h"
+
+using namespace LucidOccluderFormat;
+
+const FName FLucidOccluders::ProxyActorTag( TEXT( "LucidOccluderProxies" ) );
+
+namespace LucidOccluders
+{
+	static TAutoConsoleVariable<int32> CVarOccluderProxies(
+		TEXT( "lucidity.OccluderProxies" ),
+		1,
+		TEXT( "0: sun and light traces test BlockAll complex collision.\n" )
+		TEXT( "1: trace the baked occluder proxies on the Lucidity channel, conservative boxes only.\n" )
+		TEXT( "2: trace every baked occluder proxy, including mesh bounds that may over-shade.\n" )
+		TEXT( "Only affects levels loaded after it is changed." ),
+		ECVF_Default );
+
+	static TAutoConsoleVariable<int32> CVarOccluderBvh(
+		TEXT( "lucidity.OccluderBvh" ),
+		1,
+		TEXT( "Trace sun rays against a packet traced BVH of the occluder proxies instead of the physics scene,\n" )
+		TEXT( "unless a movable occluder is near the character." ),
+		ECVF_Default );
+
+	// Anything smaller barely shades a character and is left to the rays' noise
+	static const float MinProxyExtent = 10.f;
+
+	// Engine cube, 100 units across with a simple box collision
+	static const TCHAR* ProxyMeshPath = TEXT( "/Engine/BasicShapes/Cube.Cube" );
+	static const float ProxyMeshExtent = 50.f;
+
+	static void AddProxy( TArray<FProxy> &OutProxies, const FTransform &Local, const FVector &Extent, const FTransform &Component, const bool bConservative )
+	{
+		const FTransform World = Local*Component;
+		const FVector WorldExtent = (Extent*Component.GetScale3D()).GetAbs();
+		if (WorldExtent.GetMax() < MinProxyExtent)
+		{
+			return;
+		}
+
+		const FVector Center = World.GetLocation();
+		const FQuat Rotation = World.GetRotation();
+		FProxy &Proxy = OutProxies[OutProxies.AddUninitialized()];
+		Proxy.Center[0] = Center.X;
+		Proxy.Center[1] = Center.Y;
+		Proxy.Center[2] = Center.Z;
+		Proxy.Rotation[0] = Rotation.X;
+		Proxy.Rotation[1] = Rotation.Y;
+		Proxy.Rotation[2] = Rotation.Z;
+		Proxy.Rotation[3] = Rotation.W;
+		Proxy.Extent[0] = WorldExtent.X;
+		Proxy.Extent[1] = WorldExtent.Y;
+		Proxy.Extent[2] = WorldExtent.Z;
+		Proxy.Flags = bConservative ? Conservative : 0;
+	}
+
+	// Only what the sun traces see today and cannot move away
+	static bool IsStaticBlocker( const UStaticMeshComponent* Mesh )
+	{
+		return (Mesh->Mobility == EComponentMobility::Static) && (Mesh->GetStaticMesh() != nullptr) && Mesh->IsCollisionEnabled()
+			&& (Mesh->GetCollisionResponseToChannel( ECC_WorldStatic ) == ECR_Block);
+	}
+
+	// Fixtures of tagged lights would shade their own light
+	static bool IsLightFixture( const AActor* Owner )
+	{
+		if (Owner == nullptr)
+		{
+			return false;
+		}
+		TInlineComponentArray<UPointLightComponent*> Lights( Owner );
+		for (const UPointLightComponent* Light : Lights)
+		{
+			if (Light->ComponentHasTag( FLucidLightRegistry::LucidityTag ))
+			{
+				return true;
+			}
+		}
+		return false;
+	}
+}
+
+//////////////////////////////////////////////////////////////////////////
+// FLucidOccluderSet
+
+FString FLucidOccluderSet::GetSidecarPath( const FString &LevelPackageName )
+{
+	const FString ShortName = FPackageName::GetShortName( UWorld::RemovePIEPrefix( LevelPackageName ) );
+	return FPaths::GameContentDir() / TEXT( "Lucidity" ) / (ShortName + TEXT( ".lucocc" ));
+}
+
+TSharedPtr<FLucidOccluderSet> FLucidOccluderSet::LoadFromFile( const FString &Filename )
+{
+	TArray<uint8> Bytes;
+	if (!FFileHelper::LoadFileToArray( Bytes, *Filename, FILEREAD_Silent ))
+	{
+		return nullptr;
+	}
+
+	FHeader Header;
+	if ((uint64)Bytes.Num() >= sizeof( FHeader ))
+	{
+		FMemory::Memcpy( &Header, Bytes.GetData(), sizeof( FHeader ) );
+	}
+	if (((uint64)Bytes.Num() < sizeof( FHeader )) || (Header.Magic != Magic) || (Header.Version != Version)
+		|| (sizeof( FHeader ) + (uint64)Header.NumProxies*sizeof( FProxy ) != (uint64)Bytes.Num()))
+	{
+		UE_LOG( AlexandriaLog, Warning, TEXT( "Ignoring occluder sidecar %s, it is malformed or from another version" ), *Filename );
+		return nullptr;
+	}
+
+	TSharedPtr<FLucidOccluderSet> Set = MakeShareable( new FLucidOccluderSet() );
+	Set->Proxies.SetNumUninitialized( Header.NumProxies );
+	FMemory::Memcpy( Set->Proxies.GetData(), Bytes.GetData() + sizeof( FHeader ), Header.NumProxies*sizeof( FProxy ) );
+	return Set;
+}
+
+void FLucidOccluderSet::Serialize( const TArray<FProxy> &Proxies, TArray<uint8> &OutBytes )
+{
+	FHeader Header;
+	Header.Magic = Magic;
+	Header.Version = Version;
+	Header.NumProxies = Proxies.Num();
+	OutBytes.SetNumUninitialized( sizeof( FHeader ) + Proxies.Num()*sizeof( FProxy ) );
+	FMemory::Memcpy( OutBytes.GetData(), &Header, sizeof( FHeader ) );
+	FMemory::Memcpy( OutBytes.GetData() + sizeof( FHeader ), Proxies.GetData(), Proxies.Num()*sizeof( FProxy ) );
+}
+
+void FLucidOccluderSet::GatherProxies( const ULevel* Level, TArray<FProxy> &OutProxies )
+{
+	using namespace LucidOccluders;
+	for (const AActor* Actor : Level->Actors)
+	{
+		if ((Actor == nullptr) || IsLightFixture( Actor ))
+		{
+			continue;
+		}
+
+		TInlineComponentArray<UStaticMeshComponent*> Meshes( Actor );
+		for (const UStaticMeshComponent* Mesh : Meshes)
+		{
+			if (!IsStaticBlocker( Mesh ))
+			{
+				continue;
+			}
+
+			const FTransform &Component = Mesh->GetComponentTransform();
+			const UBodySetup* BodySetup = Mesh->GetStaticMesh()->BodySetup;
+			const FKAggregateGeom* Geom = (BodySetup != nullptr) ? &BodySetup->AggGeom : nullptr;
+			if ((Geom == nullptr) || (Geom->GetElementCount() == 0))
+			{
+				// No simple collision, the bounds may shade more than the triangles do
+				const FBox Bounds = Mesh->GetStaticMesh()->GetBoundingBox();
+				AddProxy( OutProxies, FTransform( Bounds.GetCenter() ), Bounds.GetExtent(), Component, false );
+				continue;
+			}
+
+			// Authored boxes are inside the mesh, everything else is replaced by its bounds
+			for (const FKBoxElem &Box : Geom->BoxElems)
+			{
+				AddProxy( OutProxies, Box.GetTransform(), FVector( Box.X, Box.Y, Box.Z )*0.5f, Component, true );
+			}
+			for (const FKConvexElem &Convex : Geom->ConvexElems)
+			{
+				AddProxy( OutProxies, FTransform( Convex.ElemBox.GetCenter() ), Convex.ElemBox.GetExtent(), Component, false );
+			}
+			for (const FKSphereElem &Sphere : Geom->SphereElems)
+			{
+				AddProxy( OutProxies, FTransform( Sphere.Center ), FVector( Sphere.Radius ), Component, false );
+			}
+			for (const FKSphylElem &Sphyl : Geom->SphylElems)
+			{
+				AddProxy( OutProxies, Sphyl.GetTransform(), FVector( Sphyl.Radius, Sphyl.Radius, Sphyl.Radius + Sphyl.Length*0.5f ), Component, false );
+			}
+		}
+	}
+}
+
+bool FLucidOccluderSet::HasStaticBlockers( const ULevel* Level )
+{
+	using namespace LucidOccluders;
+	for (const AActor* Actor : Level->Actors)
+	{
+		if ((Actor == nullptr) || IsLightFixture( Actor ))
+		{
+			continue;
+		}
+
+		TInlineComponentArray<UStaticMeshComponent*> Meshes( Actor );
+		for (const UStaticMeshComponent* Mesh : Meshes)
+		{
+			if (IsStaticBlocker( Mesh ))
+			{
+				return true;
+			}
+		}
+	}
+	return false;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// FLucidOccluders
+
+FLucidOccluders* FLucidOccluders::Get( UWorld* World )
+{
+	FLucidOccluders* Occluders = TLucidPerWorld<FLucidOccluders, true>::Get( World );
+	if ((Occluders != nullptr) && (Occluders->PendingLoads.Num() > 0))
+	{
+		Occluders->CollectLoads();
+	}
+	return Occluders;
+}
+
+bool FLucidOccluders::IsEnabled()
+{
+	return LucidOccluders::CVarOccluderProxies.GetValueOnGameThread() != 0;
+}
+
+FLucidTraceSetup FLucidOccluders::GetTraceSetup( UWorld* World )
+{
+	FLucidTraceSetup Setup;
+	const FLucidOccluders* Occluders = Get( World );
+	if ((Occluders != nullptr) && Occluders->CoversWorld())
+	{
+		// Proxies are plain boxes and ignore everything else, characters included
+		Setup.Channel = TraceChannel;
+		Setup.Response = FCollisionResponseParams::DefaultResponseParam;
+		Setup.bTraceComplex = false;
+	}
+	else
+	{
+		UCollisionProfile::Get()->GetChannelAndResponseParams( UCollisionProfile::BlockAll_ProfileName, Setup.Channel, Setup.Response );
+		Setup.bTraceComplex = true;
+	}
+	return Setup;
+}
+
+AActor* FLucidOccluders::SpawnProxies( ULevel* Level, const FLucidOccluderSet &Set, const bool bConservativeOnly )
+{
+	UWorld* World = Level->OwningWorld;
+	UStaticMesh* Cube = LoadObject<UStaticMesh>( nullptr, LucidOccluders::ProxyMeshPath );
+	if ((World == nullptr) || (Cube == nullptr) || (Set.Proxies.Num() == 0))
+	{
+		return nullptr;
+	}
+
+	FActorSpawnParameters SpawnParams;
+	SpawnParams.OverrideLevel = Level;
+	SpawnParams.ObjectFlags |= RF_Transient;
+	SpawnParams.SpawnCollisionHandlingOverride = ESpawnActorCollisionHandlingMethod::AlwaysSpawn;
+	AActor* Actor = World->SpawnActor<AActor>( AActor::StaticClass(), FTransform::Identity, SpawnParams );
+	if (Actor == nullptr)
+	{
+		return nullptr;
+	}
+	Actor->Tags.Add( ProxyActorTag );
+
+	// Hidden, query only, and invisible to everything but the Lucidity channel
+	UInstancedStaticMeshComponent* Boxes = NewObject<UInstancedStaticMeshComponent>( Actor, TEXT( "OccluderProxies" ) );
+	Boxes->SetMobility( EComponentMobility::Static );
+	Boxes->SetStaticMesh( Cube );
+	Boxes->SetCollisionObjectType( ECC_WorldStatic );
+	Boxes->SetCollisionResponseToAllChannels( ECR_Ignore );
+	Boxes->SetCollisionResponseToChannel( TraceChannel, ECR_Block );
+	Boxes->SetCollisionEnabled( ECollisionEnabled::QueryOnly );
+	Boxes->SetCanEverAffectNavigation( false );
+	Boxes->SetHiddenInGame( true );
+	Boxes->SetVisibility( false );
+	Boxes->CastShadow = false;
+	Actor->SetRootComponent( Boxes );
+
+	for (const FProxy &Proxy : Set.Proxies)
+	{
+		if (bConservativeOnly && !(Proxy.Flags & Conservative))
+		{
+			continue;
+		}
+		const FQuat Rotation( Proxy.Rotation[0], Proxy.Rotation[1], Proxy.Rotation[2], Proxy.Rotation[3] );
+		const FVector Center( Proxy.Center[0], Proxy.Center[1], Proxy.Center[2] );
+		const FVector Scale = FVector( Proxy.Extent[0], Proxy.Extent[1], Proxy.Extent[2] ) / LucidOccluders::ProxyMeshExtent;
+		Boxes->AddInstance( FTransform( Rotation, Center, Scale ) );
+	}
+	Boxes->RegisterComponent();
+	return Actor;
+}
+
+void FLucidOccluders::AddLevel( ULevel* Level )
+{
+	SCOPE_CYCLE_COUNTER( STAT_LucidLevelStreaming );
+	// A new level changes what CoversWorld sees even before its proxies load
+	Generation++;
+	if (!IsEnabled() || Levels.Contains( Level ) || PendingLoads.Contains( Level ))
+	{
+		return;
+	}
+
+	// Read and built into a BVH off the game thread, spawned by CollectLoads once done
+	const FString Filename = FLucidOccluderSet::GetSidecarPath( Level->GetOutermost()->GetName() );
+	const bool bConservativeOnly = (LucidOccluders::CVarOccluderProxies.GetValueOnGameThread() == 1);
+	PendingLoads.Add( Level, Async<TSharedPtr<FLucidOccluderSet>>( EAsyncExecution::ThreadPool, [Filename, bConservativeOnly]()
+	{
+		TSharedPtr<FLucidOccluderSet> Set = FLucidOccluderSet::LoadFromFile( Filename );
+		if (Set.IsValid())
+		{
+			Set->Bvh.Build( Set->Proxies, bConservativeOnly );
+		}
+		return Set;
+	} ) );
+}
+
+void FLucidOccluders::RemoveLevel( ULevel* Level )
+{
+	// Proxies stay in the level with its other actors and are found again if it comes back.
+	// Even a level without proxies changes what CoversWorld sees once it is gone.
+	PendingLoads.Remove( Level );
+	UnblockedLevels.Remove( Level );
+	Levels.Remove( Level );
+	Generation++;
+}
+
+void FLucidOccluders::WaitForLoads()
+{
+	for (const auto &Pair : PendingLoads)
+	{
+		Pair.Value.Wait();
+	}
+	CollectLoads();
+}
+
+void FLucidOccluders::CollectLoads()
+{
+	const bool bConservativeOnly = (LucidOccluders::CVarOccluderProxies.GetValueOnGameThread() == 1);
+	for (auto It = PendingLoads.CreateIterator(); It; ++It)
+	{
+		if (!It.Value().IsReady())
+		{
+			continue;
+		}
+		TSharedPtr<FLucidOccluderSet> Set = It.Value().Get();
+		ULevel* Level = It.Key().Get();
+		if (Set.IsValid() && (Level != nullptr))
+		{
+			FLevelProxies &Entry = Levels.Add( Level );
+			Entry.Set = Set;
+			for (AActor* Actor : Level->Actors)
+			{
+				if ((Actor != nullptr) && Actor->ActorHasTag( ProxyActorTag ))
+				{
+					Entry.Actor = Actor;
+					break;
+				}
+			}
+			if (!Entry.Actor.IsValid())
+			{
+				Entry.Actor = SpawnProxies( Level, *Set, bConservativeOnly );
+			}
+			Generation++;
+		}
+		else if ((Level != nullptr) && !FLucidOccluderSet::HasStaticBlockers( Level ))
+		{
+			UnblockedLevels.Add( Level );
+			Generation++;
+		}
+		It.RemoveCurrent();
+	}
+}
+
+bool FLucidOccluders::CoversWorld() const
+{
+	if (CoverageGeneration != Generation)
+	{
+		CoverageGeneration = Generation;
+		bCoversWorld = CheckCoverage();
+	}
+	return bCoversWorld;
+}
+
+bool FLucidOccluders::CheckCoverage() const
+{
+	if (!World.IsValid() || (Levels.Num() == 0))
+	{
+		return false;
+	}
+	for (ULevel* Level : World->GetLevels())
+	{
+		if ((Level != nullptr) && Level->bIsVisible && !Levels.Contains( Level ) && !UnblockedLevels.Contains( Level ))
+		{
+			UE_LOG( AlexandriaLog, Log, TEXT( "Lucidity traces stay on BlockAll complex collision, %s %s" ), *Level->GetOutermost()->GetName(),
+				PendingLoads.Contains( Level ) ? TEXT( "is still loading its occluder proxies" ) : TEXT( "has no baked occluder proxies, bake it with -run=LucidityBake" ) );
+			return false;
+		}
+	}
+	return true;
+}
+
+int32 FLucidOccluders::NumProxies() const
+{
+	int32 Count = 0;
+	for (const auto &Pair : Levels)
+	{
+		Count += Pair.Value.Set->Proxies.Num();
+	}
+	return Count;
+}
+
+bool FLucidOccluders::CanTraceBvh() const
+{
+	return (LucidOccluders::CVarOccluderBvh.GetValueOnGameThread() != 0) && CoversWorld();
+}
+
+uint32 FLucidOccluders::TracePacket( const FLucidSunRay* Rays, const int32 Count, const uint32 LaneMask ) const
+{
+	uint32 Blocked = 0;
+	for (const auto &Pair : Levels)
+	{
+		Blocked |= Pair.Value.Set->Bvh.TracePacket( Rays, Count, LaneMask & ~Blocked );
+		if (Blocked == LaneMask)
+		{
+			break;
+		}
+	}
+	return Blocked;
+}
+
+void FLucidOccluders::TraceRays( const FLucidSunRay* Rays, const int32 Count, bool* OutLit ) const
+{
+	for (int32 First = 0; First < Count; First += FLucidOccluderBvh::PacketSize)
+	{
+		const int32 PacketCount = FMath::Min( Count - First, FLucidOccluderBvh::PacketSize );
+		const uint32 Blocked = TracePacket( Rays + First, PacketCount, (1u << PacketCount) - 1 );
+		for (int32 Lane = 0; Lane < PacketCount; Lane++)
+		{
+			OutLit[First + Lane] = !(Blocked & (1u << Lane));
+		}
+	}
+}
@@ -0,0 +1,158 @@
+// Copyright 1998-2017 Epic Games, Inc. All Rights Reserved.
+#pragma once
+
+#include "Async/Future.h"
+#include "LucidOccluderBvh.h"
+#include "LucidPerWorld.h"
+
+// On-disk layout of a level's occluder proxies (.lucocc), little endian
+namespace LucidOccluderFormat
+{
+	static const uint32 Magic = 0x434F434C; // "LOCC"
+	static const uint32 Version = 1;
+
+	struct FHeader
+	{
+		uint32 Magic;
+		uint32 Version;
+		uint32 NumProxies;
+	};
+
+	enum EProxyFlags : uint32
+	{
+		// Inside the mesh's own simple collision, so it never blocks light the mesh would let through
+		Conservative = 1,
+	};
+
+	// One oriented box in world space
+	struct FProxy
+	{
+		float Center[3];
+		float Rotation[4];
+		float Extent[3];
+		uint32 Flags;
+	};
+}
+
+/** Which occluders Lucidity's sun and light traces test, see FLucidOccluders::GetTraceSetup */
+struct FLucidTraceSetup
+{
+	ECollisionChannel Channel;
+	FCollisionResponseParams Response;
+	bool bTraceComplex;
+
+	FLucidTraceSetup() : Channel( ECC_WorldStatic ), bTraceComplex( true ) {}
+};
+
+/** Occluder proxies baked for one level */
+class FLucidOccluderSet
+{
+public:
+	/** Loads and validates a sidecar, returns null if missing or out of date */
+	static TSharedPtr<FLucidOccluderSet> LoadFromFile( const FString &Filename );
+
+	/** Where the occluder sidecar for a level package lives */
+	static FString GetSidecarPath( const FString &LevelPackageName );
+
+	/** Builds the proxies for every static mesh of Level that blocks sun traces */
+	static void GatherProxies( const ULevel* Level, TArray<LucidOccluderFormat::FProxy> &OutProxies );
+
+	/** Whether Level has any static mesh GatherProxies would build proxies for */
+	static bool HasStaticBlockers( const ULevel* Level );
+
+	/** Sidecar bytes for Proxies */
+	static void Serialize( const TArray<LucidOccluderFormat::FProxy> &Proxies, TArray<uint8> &OutBytes );
+
+	TArray<LucidOccluderFormat::FProxy> Proxies;
+
+	// Built from Proxies on the thread pool when the level loads, see FLucidOccluders::TracePacket
+	FLucidOccluderBvh Bvh;
+};
+
+/**
+ * Per-world simple collision stand-ins for the static geometry that shades the sun.
+ * Each level's baked proxies are read on the thread pool when it is added and spawned as one hidden,
+ * query-only instanced box component that blocks nothing but the "Lucidity" trace channel. While every
+ * loaded level has its proxies or no static blockers, sun and light traces run on that channel without complex collision, so
+ * they test a few boxes instead of the triangles of bookshelves and columns, and never the characters.
+ * Movable occluders opt in by blocking the "Lucidity" channel in their collision settings.
+ * The same proxies are also kept in a BVH per level, which sun rays can trace in packets off the physics
+ * scene while no movable occluder is near them.
+ */
+class FLucidOccluders
+{
+public:
+	// "Lucidity" in DefaultEngine.ini, ignored by everything unless set to block
+	static const ECollisionChannel TraceChannel = ECC_GameTraceChannel1;
+
+	static const FName ProxyActorTag;
+
+	/** Returns the occluders for World, creating them on first use */
+	static FLucidOccluders* Get( UWorld* World );
+
+	/** Spawns Set into Level as one hidden instanced box component, null if there is nothing to spawn */
+	static AActor* SpawnProxies( ULevel* Level, const FLucidOccluderSet &Set, const bool bConservativeOnly );
+
+	/** Whether sun and light traces should use the proxies, true once every loaded level has them */
+	static bool IsEnabled();
+
+	/**
+	 * The channel, responses and complexity every Lucidity trace in World should use: the proxies on
+	 * TraceChannel while they cover the world, BlockAll complex collision otherwise.
+	 */
+	static FLucidTraceSetup GetTraceSetup( UWorld* World );
+
+	void AddLevel( ULevel* Level );
+	void RemoveLevel( ULevel* Level );
+
+	/** True when every visible level of the world has its proxies spawned or has nothing to proxy */
+	bool CoversWorld() const;
+
+	/** Blocks until every pending sidecar has loaded and spawns them, for commandlets that trace right away */
+	void WaitForLoads();
+
+	/** Bumped whenever a level's proxies come or go */
+	FORCEINLINE uint32 GetGeneration() const { return Generation; }
+
+	int32 NumProxies() const;
+
+	/** Whether sun rays may trace the BVHs instead of the physics scene, true once every loaded level has one */
+	bool CanTraceBvh() const;
+
+	/**
+	 * Traces up to FLucidOccluderBvh::PacketSize rays against every level's BVH. Safe to call from worker threads.
+	 * @return bit i set if ray i is blocked, only for the lanes set in LaneMask
+	 */
+	uint32 TracePacket( const FLucidSunRay* Rays, const int32 Count, const uint32 LaneMask ) const;
+
+	/** Traces Count rays against the BVHs packet by packet, OutLit[i] is true if ray i is unblocked */
+	void TraceRays( const FLucidSunRay* Rays, const int32 Count, bool* OutLit ) const;
+
+private:
+	explicit FLucidOccluders( UWorld* InWorld ) : World( InWorld ), Generation( 1 ), CoverageGeneration( 0 ), bCoversWorld( false ) {}
+
+	struct FLevelProxies
+	{
+		TSharedPtr<FLucidOccluderSet> Set;
+		TWeakObjectPtr<AActor> Actor;
+	};
+
+	// Spawns finished loads, on the game thread
+	void CollectLoads();
+
+	// Walks the visible levels for CoversWorld, logging the first one that keeps traces off the proxies
+	bool CheckCoverage() const;
+
+	TWeakObjectPtr<UWorld> World;
+	TMap<TWeakObjectPtr<ULevel>, FLevelProxies> Levels;
+	TMap<TWeakObjectPtr<ULevel>, TFuture<TSharedPtr<FLucidOccluderSet>>> PendingLoads;
+	// Levels without a sidecar and without static blockers, nothing there for proxies to stand in for
+	TSet<TWeakObjectPtr<ULevel>> UnblockedLevels;
+	uint32 Generation;
+
+	// CoversWorld's answer, worked out again when Generation moves on
+	mutable uint32 CoverageGeneration;
+	mutable bool bCoversWorld;
+
+	friend class TLucidPerWorld<FLucidOccluders, true>;
+};
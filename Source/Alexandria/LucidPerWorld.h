@@ -0,0 +1,106 @@
+// Copyright 1998-2017 Epic Games, Inc. All Rights Reserved.
+#pragma once
+
+/**
+ * One T per world, created from the world by the first Get and dropped when the world is cleaned up.
+ * With bTracksLevels, T follows streaming through AddLevel( ULevel* ) and RemoveLevel( ULevel* ), starting
+ * with the levels already visible when it is created, since those never broadcast LevelAddedToWorld.
+ * Classes with a private constructor befriend their TLucidPerWorld.
+ */
+template<typename T, bool bTracksLevels = false>
+class TLucidPerWorld
+{
+public:
+	/** Returns World's T, creating it on first use */
+	static T* Get( UWorld* World )
+	{
+		if (World == nullptr)
+		{
+			return nullptr;
+		}
+
+		TSharedPtr<T>* Found = Instances.Find( World );
+		if (Found != nullptr)
+		{
+			return Found->Get();
+		}
+
+		static bool bDelegatesBound = false;
+		if (!bDelegatesBound)
+		{
+			BindLevelDelegates( TTracksLevels<bTracksLevels>() );
+			FWorldDelegates::OnWorldCleanup.AddStatic( &TLucidPerWorld::OnWorldCleanup );
+			bDelegatesBound = true;
+		}
+
+		TSharedPtr<T> Instance = MakeShareable( new T( World ) );
+		Instances.Add( World, Instance );
+		AddVisibleLevels( *Instance, World, TTracksLevels<bTracksLevels>() );
+		return Instance.Get();
+	}
+
+	/** Returns World's T if one exists */
+	static T* Find( const UWorld* World )
+	{
+		TSharedPtr<T>* Found = Instances.Find( World );
+		return (Found != nullptr) ? Found->Get() : nullptr;
+	}
+
+private:
+	template<bool bTracks> struct TTracksLevels {};
+
+	static void BindLevelDelegates( TTracksLevels<false> ) {}
+	static void BindLevelDelegates( TTracksLevels<true> )
+	{
+		FWorldDelegates::LevelAddedToWorld.AddStatic( &TLucidPerWorld::OnLevelAdded );
+		FWorldDelegates::LevelRemovedFromWorld.AddStatic( &TLucidPerWorld::OnLevelRemoved );
+	}
+
+	static void AddVisibleLevels( T &Instance, UWorld* World, TTracksLevels<false> ) {}
+	static void AddVisibleLevels( T &Instance, UWorld* World, TTracksLevels<true> )
+	{
+		for (ULevel* Level : World->GetLevels())
+		{
+			if ((Level != nullptr) && Level->bIsVisible)
+			{
+				Instance.AddLevel( Level );
+			}
+		}
+	}
+
+	static void OnLevelAdded( ULevel* Level, UWorld* World )
+	{
+		TSharedPtr<T>* Found = Instances.Find( World );
+		if ((Found != nullptr) && (Level != nullptr))
+		{
+			(*Found)->AddLevel( Level );
+		}
+	}
+
+	static void OnLevelRemoved( ULevel* Level, UWorld* World )
+	{
+		TSharedPtr<T>* Found = Instances.Find( World );
+		if (Found != nullptr)
+		{
+			// A null level means the whole world is going away
+			if (Level == nullptr)
+			{
+				Instances.Remove( World );
+			}
+			else
+			{
+				(*Found)->RemoveLevel( Level );
+			}
+		}
+	}
+
+	static void OnWorldCleanup( UWorld* World, bool bSessionEnded, bool bCleanupResources )
+	{
+		Instances.Remove( World );
+	}
+
+	static TMap<const UWorld*, TSharedPtr<T>> Instances;
+};
+
+template<typename T, bool bTracksLevels>
+TMap<const UWorld*, TSharedPtr<T>> TLucidPerWorld<T, bTracksLevels>::Instances;
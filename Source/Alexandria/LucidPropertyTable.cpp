@@ -0,0 +1,102 @@
+// Copyright 1998-2017 Epic Games, Inc. All Rights Reserved.
+
+#include "Alexandria.h"
+#include "LucidPropertyTable.h"
+#include "AlexandriaCharacter.h"
+#include "Curves/CurveFloat.h"
+
+FLucidPropertyTable::FLucidPropertyTable() :
+	NumProperties( 0 ),
+	InverseLane( 0 ),
+	EndLane( 0 )
+{
+	FMemory::Memzero( Base );
+	FMemory::Memzero( Range );
+	FMemory::Memzero( Alpha );
+	FMemory::Memzero( Values );
+	FMemory::Memzero( Lanes );
+	for (int32 Lane = 0; Lane < MaxLanes; Lane++)
+	{
+		Min[Lane] = 1.f;
+	}
+}
+
+void FLucidPropertyTable::Build( const FLucidMoveProperty* const* Properties, const int32 InNumProperties )
+{
+	check( InNumProperties <= MaxProperties );
+	NumProperties = InNumProperties;
+	CurveTable.Reset();
+	CurveLanes.Reset();
+
+	// Unused lanes evaluate to 0 without dividing by zero
+	for (int32 Lane = 0; Lane < MaxLanes; Lane++)
+	{
+		Base[Lane] = 0.f;
+		Min[Lane] = 1.f;
+		Range[Lane] = 0.f;
+	}
+
+	int32 NumLinear = 0;
+	for (int32 i = 0; i < NumProperties; i++)
+	{
+		NumLinear += Properties[i]->InverseScale ? 0 : 1;
+	}
+	InverseLane = AlignToVector( NumLinear );
+
+	int32 NextLinear = 0;
+	int32 NextInverse = InverseLane;
+	for (int32 i = 0; i < NumProperties; i++)
+	{
+		const FLucidMoveProperty &Property = *Properties[i];
+		const int32 Lane = Property.InverseScale ? NextInverse++ : NextLinear++;
+		Lanes[i] = Lane;
+		Base[Lane] = Property.Base;
+		Min[Lane] = Property.Min;
+		Range[Lane] = Property.Max - Property.Min;
+
+		if (Property.Response != nullptr)
+		{
+			CurveLanes.Add( Lane );
+			for (int32 Sample = 0; Sample < CurveSamples; Sample++)
+			{
+				CurveTable.Add( Property.Response->GetFloatValue( (float)Sample / (CurveSamples - 1) ) );
+			}
+		}
+	}
+	EndLane = AlignToVector( NextInverse );
+}
+
+template<ELucidScale Scale>
+void FLucidPropertyTable::EvaluateRun( const int32 FirstLane, const int32 LastLane )
+{
+	for (int32 Lane = FirstLane; Lane < LastLane; Lane += 4)
+	{
+		const VectorRegister Scalar = VectorMultiplyAdd( VectorLoadAligned( &Alpha[Lane] ), VectorLoadAligned( &Range[Lane] ), VectorLoadAligned( &Min[Lane] ) );
+		VectorStoreAligned( TLucidScale<Scale>::Evaluate( VectorLoadAligned( &Base[Lane] ), Scalar ), &Values[Lane] );
+	}
+}
+
+void FLucidPropertyTable::Evaluate( const float Lucidity )
+{
+	const VectorRegister LucidityVec = VectorSetFloat1( Lucidity );
+	for (int32 Lane = 0; Lane < EndLane; Lane += 4)
+	{
+		VectorStoreAligned( LucidityVec, &Alpha[Lane] );
+	}
+
+	// Curve shaped responses replace their lane's Lucidity with the baked curve value
+	if (CurveLanes.Num() > 0)
+	{
+		const float Position = FMath::Clamp( Lucidity, 0.f, 1.f )*(CurveSamples - 1);
+		const int32 Index = FMath::Min( FMath::FloorToInt( Position ), CurveSamples - 2 );
+		const float Fraction = Position - Index;
+		for (int32 i = 0; i < CurveLanes.Num(); i++)
+		{
+			const float* Samples = &CurveTable[i*CurveSamples];
+			Alpha[CurveLanes[i]] = FMath::Lerp( Samples[Index], Samples[Index + 1], Fraction );
+		}
+	}
+
+	EvaluateRun<ELucidScale::Linear>( 0, InverseLane );
+	EvaluateRun<ELucidScale::Inverse>( InverseLane, EndLane );
+}
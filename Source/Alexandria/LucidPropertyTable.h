@@ -0,0 +1,85 @@
+// Copyright 1998-2017 Epic Games, Inc. All Rights Reserved.
+#pragma once
+
+struct FLucidMoveProperty;
+
+// How a property responds to Lucidity, see FLucidMoveProperty::GetProperty
+enum class ELucidScale : uint8
+{
+	// Base*(Min + L*(Max - Min))
+	Linear,
+	// Base/(Min + L*(Max - Min))
+	Inverse,
+};
+
+template<ELucidScale Scale>
+struct TLucidScale;
+
+template<>
+struct TLucidScale<ELucidScale::Linear>
+{
+	static FORCEINLINE VectorRegister Evaluate( const VectorRegister &Base, const VectorRegister &Scalar )
+	{
+		return VectorMultiply( Base, Scalar );
+	}
+};
+
+template<>
+struct TLucidScale<ELucidScale::Inverse>
+{
+	static FORCEINLINE VectorRegister Evaluate( const VectorRegister &Base, const VectorRegister &Scalar )
+	{
+		return VectorMultiply( Base, VectorReciprocalAccurate( Scalar ) );
+	}
+};
+
+/**
+ * Every Lucidity driven property of a character packed into aligned lanes and evaluated in one SIMD pass.
+ * Linear and inverse properties are sorted into separate runs when the table is built, so evaluation never
+ * branches per property. Response curves are baked into lookup tables at build time.
+ */
+class FLucidPropertyTable
+{
+public:
+	static const int32 MaxProperties = 12;
+	// Lookup table entries per response curve, sampled evenly over 0-1 Lucidity
+	static const int32 CurveSamples = 33;
+
+	FLucidPropertyTable();
+
+	/** Packs Properties, their order is the handle Get() takes */
+	void Build( const FLucidMoveProperty* const* Properties, const int32 NumProperties );
+
+	/** Evaluates every property at Lucidity */
+	void Evaluate( const float Lucidity );
+
+	/** Value of a property as of the last Evaluate */
+	FORCEINLINE float Get( const int32 Handle ) const { return Values[Lanes[Handle]]; }
+
+	FORCEINLINE int32 Num() const { return NumProperties; }
+
+private:
+	template<ELucidScale Scale>
+	void EvaluateRun( const int32 FirstLane, const int32 LastLane );
+
+	static FORCEINLINE int32 AlignToVector( const int32 Lane ) { return (Lane + 3) & ~3; }
+
+	// Lane layout: linear run, then the inverse run starting on a vector boundary
+	static const int32 MaxLanes = MaxProperties + 4;
+
+	MS_ALIGN( 16 ) float Base[MaxLanes] GCC_ALIGN( 16 );
+	MS_ALIGN( 16 ) float Min[MaxLanes] GCC_ALIGN( 16 );
+	MS_ALIGN( 16 ) float Range[MaxLanes] GCC_ALIGN( 16 );
+	// Per lane Lucidity, reshaped by its response curve where there is one
+	MS_ALIGN( 16 ) float Alpha[MaxLanes] GCC_ALIGN( 16 );
+	MS_ALIGN( 16 ) float Values[MaxLanes] GCC_ALIGN( 16 );
+
+	int32 Lanes[MaxProperties];
+	int32 NumProperties;
+	int32 InverseLane;
+	int32 EndLane;
+
+	// Baked response curves, CurveSamples entries each
+	TArray<float> CurveTable;
+	TArray<int32> CurveLanes;
+};
@@ -0,0 +1,63 @@
+// Copyright 1998-2017 Epic Games, Inc. All Rights Reserved.
+
+#include "Alexandria.h"
+#include "LucidRadianceLod.h"
+#include "AlexandriaGameMode.h"
+
+namespace LucidRadianceLod
+{
+	// Level for a significance without hysteresis, one step per threshold it falls under
+	static int32 LevelAt( const FLucidRadianceLodSettings &Settings, const float Significance )
+	{
+		return ((Significance < Settings.ShadowSignificance) ? 1 : 0)
+			+ ((Significance < Settings.LightSignificance) ? 1 : 0)
+			+ ((Significance < Settings.FireSignificance) ? 1 : 0);
+	}
+
+	ELucidRadianceLod Select( const FLucidRadianceLodSettings &Settings, const float Significance, const ELucidRadianceLod Current )
+	{
+		// Any level between the two band edges may stay, so a character sitting on a threshold never flips
+		const float Band = FMath::Max( Settings.Hysteresis, 0.f );
+		const int32 Finest = LevelAt( Settings, Significance + Band );
+		const int32 Coarsest = LevelAt( Settings, Significance - Band );
+		return (ELucidRadianceLod)FMath::Clamp( (int32)Current, Finest, Coarsest );
+	}
+
+	const TCHAR* GetName( const ELucidRadianceLod Lod )
+	{
+		switch (Lod)
+		{
+		case ELucidRadianceLod::Full: return TEXT( "Full" );
+		case ELucidRadianceLod::Unshadowed: return TEXT( "Unshadowed" );
+		case ELucidRadianceLod::Unlit: return TEXT( "Unlit" );
+		case ELucidRadianceLod::Hidden: return TEXT( "Hidden" );
+		default: return TEXT( "Unknown" );
+		}
+	}
+}
+
+FLucidRadianceLodCensus::FLucidRadianceLodCensus()
+{
+	FMemory::Memzero( Characters );
+	FMemory::Memzero( Lights );
+	FMemory::Memzero( Shadows );
+	FMemory::Memzero( Fires );
+}
+
+void FLucidRadianceLodCensus::Add( const ELucidRadianceLod Lod, const bool bLight, const bool bShadows, const bool bFire )
+{
+	const int32 Level = (int32)Lod;
+	Characters[Level]++;
+	Lights[Level] += bLight ? 1 : 0;
+	Shadows[Level] += bShadows ? 1 : 0;
+	Fires[Level] += bFire ? 1 : 0;
+}
+
+void FLucidRadianceLodCensus::Log( const TCHAR* Label ) const
+{
+	for (int32 Level = 0; Level < NumLevels; Level++)
+	{
+		UE_LOG( AlexandriaLog, Display, TEXT( "%s %-10s %4d characters, %4d lights, %4d shadow casters, %4d fires" ),
+			Label, LucidRadianceLod::GetName( (ELucidRadianceLod)Level ), Characters[Level], Lights[Level], Shadows[Level], Fires[Level] );
+	}
+}
@@ -0,0 +1,73 @@
+// Copyright 1998-2017 Epic Games, Inc. All Rights Reserved.
+#pragma once
+
+// Cosmetic detail of a character's radiance, each level drops the next most expensive piece
+enum class ELucidRadianceLod : uint8
+{
+	// Shadow casting light and globe, full fire
+	Full,
+	// Light without shadows, cheap fire
+	Unshadowed,
+	// Globe and cheap fire only
+	Unlit,
+	// Globe only
+	Hidden,
+	Count
+};
+
+/** Significance thresholds of the radiance LOD, see LucidRadianceLod::Select */
+struct FLucidRadianceLodSettings
+{
+	// Below this significance shadows are dropped...
+	float ShadowSignificance;
+	// ...then the light...
+	float LightSignificance;
+	// ...then the fire
+	float FireSignificance;
+	// Half width of the band around each threshold in which the current level is kept
+	float Hysteresis;
+	// The fire lights above IgniteLucidity and goes out below ExtinguishLucidity
+	float IgniteLucidity;
+	float ExtinguishLucidity;
+};
+
+// Level decisions, free of components so they run the same in headless benchmarks
+namespace LucidRadianceLod
+{
+	// Seconds between LOD decisions of a character
+	static const float UpdateInterval = 0.25f;
+
+	/** Level for Significance (0-1). Current is kept until Significance leaves its threshold band */
+	ELucidRadianceLod Select( const FLucidRadianceLodSettings &Settings, const float Significance, const ELucidRadianceLod Current );
+
+	/** Whether the fire burns at Lucidity, given whether it burned before */
+	FORCEINLINE bool ShouldBurn( const FLucidRadianceLodSettings &Settings, const float Lucidity, const bool bBurning )
+	{
+		return Lucidity > (bBurning ? Settings.ExtinguishLucidity : Settings.IgniteLucidity);
+	}
+
+	FORCEINLINE bool HasShadows( const ELucidRadianceLod Lod ) { return Lod == ELucidRadianceLod::Full; }
+	FORCEINLINE bool HasLight( const ELucidRadianceLod Lod ) { return Lod <= ELucidRadianceLod::Unshadowed; }
+	FORCEINLINE bool HasFire( const ELucidRadianceLod Lod ) { return Lod < ELucidRadianceLod::Hidden; }
+	FORCEINLINE bool HasFullFire( const ELucidRadianceLod Lod ) { return Lod == ELucidRadianceLod::Full; }
+
+	const TCHAR* GetName( const ELucidRadianceLod Lod );
+}
+
+/** Characters at each radiance level and the components they keep active, see Lucidity.RadianceLod */
+struct FLucidRadianceLodCensus
+{
+	static const int32 NumLevels = (int32)ELucidRadianceLod::Count;
+
+	int32 Characters[NumLevels];
+	int32 Lights[NumLevels];
+	int32 Shadows[NumLevels];
+	int32 Fires[NumLevels];
+
+	FLucidRadianceLodCensus();
+
+	void Add( const ELucidRadianceLod Lod, const bool bLight, const bool bShadows, const bool bFire );
+
+	/** One log line per level */
+	void Log( const TCHAR* Label ) const;
+};
@@ -0,0 +1,225 @@
+// Copyright 1998-2017 Epic Games, Inc. All Rights Reserved.
+
+#include "Alexandria.h"
+#include "LucidSunVisibilityVolume.h"
+#include "AlexandriaGameMode.h"
+#include "LucidityStats.h"
+#include "Engine/Level.h"
+#include "Async/Async.h"
+
+using namespace LucidVisibilityFormat;
+
+const float FLucidSunVisibilityVolume::DirectionToleranceDegrees = 2.f;
+
+FString FLucidSunVisibilityVolume::GetSidecarPath( const FString &LevelPackageName )
+{
+	const FString ShortName = FPackageName::GetShortName( UWorld::RemovePIEPrefix( LevelPackageName ) );
+	return FPaths::GameContentDir() / TEXT( "Lucidity" ) / (ShortName + TEXT( ".lucvis" ));
+}
+
+TSharedPtr<FLucidSunVisibilityVolume> FLucidSunVisibilityVolume::LoadFromFile( const FString &Filename )
+{
+	TArray<uint8> Bytes;
+	if (!FFileHelper::LoadFileToArray( Bytes, *Filename, FILEREAD_Silent ))
+	{
+		return nullptr;
+	}
+	TSharedPtr<FLucidSunVisibilityVolume> Volume = CreateFromBytes( MoveTemp( Bytes ) );
+	if (!Volume.IsValid())
+	{
+		UE_LOG( AlexandriaLog, Warning, TEXT( "Ignoring sun visibility sidecar %s, it is malformed or from another version" ), *Filename );
+	}
+	return Volume;
+}
+
+TSharedPtr<FLucidSunVisibilityVolume> FLucidSunVisibilityVolume::CreateFromBytes( TArray<uint8> &&Bytes )
+{
+	if ((uint64)Bytes.Num() < sizeof( FHeader ))
+	{
+		return nullptr;
+	}
+
+	FHeader Header;
+	FMemory::Memcpy( &Header, Bytes.GetData(), sizeof( FHeader ) );
+	if ((Header.Magic != Magic) || (Header.Version != Version) || (Header.NumDirections == 0) || (Header.CellSize <= 0.f)
+		|| (Header.Dims[0] <= 0) || (Header.Dims[1] <= 0) || (Header.Dims[2] <= 0))
+	{
+		return nullptr;
+	}
+
+	const FIntVector BrickDims(
+		FMath::DivideAndRoundUp( Header.Dims[0], BrickSize ),
+		FMath::DivideAndRoundUp( Header.Dims[1], BrickSize ),
+		FMath::DivideAndRoundUp( Header.Dims[2], BrickSize ) );
+	const uint64 TableBytes = (uint64)BrickDims.X*BrickDims.Y*BrickDims.Z*sizeof( uint32 );
+	const uint64 DirectionsEnd = sizeof( FHeader ) + (uint64)Header.NumDirections*sizeof( FDirection );
+	if (DirectionsEnd > (uint64)Bytes.Num())
+	{
+		return nullptr;
+	}
+
+	// Every offset is checked once here so sampling never has to
+	const FDirection* Directions = reinterpret_cast<const FDirection*>( Bytes.GetData() + sizeof( FHeader ) );
+	for (uint32 DirIndex = 0; DirIndex < Header.NumDirections; ++DirIndex)
+	{
+		const FDirection &Dir = Directions[DirIndex];
+		if (((uint64)Dir.BrickTableOffset + TableBytes > (uint64)Bytes.Num())
+			|| ((uint64)Dir.BrickDataOffset + (uint64)Dir.NumBricks*BrickVoxels > (uint64)Bytes.Num())
+			|| ((Dir.BrickTableOffset % sizeof( uint32 )) != 0))
+		{
+			return nullptr;
+		}
+	}
+
+	TSharedPtr<FLucidSunVisibilityVolume> Volume = MakeShareable( new FLucidSunVisibilityVolume() );
+	Volume->Data = MoveTemp( Bytes );
+	Volume->Header = Header;
+	Volume->Directions = reinterpret_cast<const FDirection*>( Volume->Data.GetData() + sizeof( FHeader ) );
+	Volume->BrickDims = BrickDims;
+
+	const FVector Origin( Header.Origin[0], Header.Origin[1], Header.Origin[2] );
+	const FVector Size( Header.Dims[0] - 1, Header.Dims[1] - 1, Header.Dims[2] - 1 );
+	Volume->Bounds = FBox( Origin, Origin + Size*Header.CellSize );
+	return Volume;
+}
+
+uint8 FLucidSunVisibilityVolume::FetchVoxel( const FDirection &Dir, int32 X, int32 Y, int32 Z ) const
+{
+	X = FMath::Clamp( X, 0, Header.Dims[0] - 1 );
+	Y = FMath::Clamp( Y, 0, Header.Dims[1] - 1 );
+	Z = FMath::Clamp( Z, 0, Header.Dims[2] - 1 );
+
+	const int32 BrickIndex = ((Z / BrickSize)*BrickDims.Y + (Y / BrickSize))*BrickDims.X + (X / BrickSize);
+	const uint32* BrickTable = reinterpret_cast<const uint32*>( Data.GetData() + Dir.BrickTableOffset );
+	const uint32 Brick = BrickTable[BrickIndex];
+	if (Brick == BrickAllLit)
+	{
+		return 255;
+	}
+	if ((Brick == BrickAllShadowed) || (Brick >= Dir.NumBricks))
+	{
+		return 0;
+	}
+
+	const int32 VoxelIndex = ((Z % BrickSize)*BrickSize + (Y % BrickSize))*BrickSize + (X % BrickSize);
+	return Data[Dir.BrickDataOffset + Brick*BrickVoxels + VoxelIndex];
+}
+
+bool FLucidSunVisibilityVolume::SampleVisibility( const FVector &Point, const FVector &SunDirection, float &OutVisibility ) const
+{
+	if (!Bounds.IsInside( Point ))
+	{
+		return false;
+	}
+
+	// Pick the closest baked direction
+	static const float MinCos = FMath::Cos( FMath::DegreesToRadians( DirectionToleranceDegrees ) );
+	const FDirection* Best = nullptr;
+	float BestCos = MinCos;
+	for (uint32 DirIndex = 0; DirIndex < Header.NumDirections; ++DirIndex)
+	{
+		const FDirection &Dir = Directions[DirIndex];
+		const float Cos = Dir.Direction[0]*SunDirection.X + Dir.Direction[1]*SunDirection.Y + Dir.Direction[2]*SunDirection.Z;
+		if (Cos >= BestCos)
+		{
+			BestCos = Cos;
+			Best = &Dir;
+		}
+	}
+	if (Best == nullptr)
+	{
+		return false;
+	}
+
+	const FVector Local = (Point - Bounds.Min) / Header.CellSize;
+	const int32 X = FMath::FloorToInt( Local.X );
+	const int32 Y = FMath::FloorToInt( Local.Y );
+	const int32 Z = FMath::FloorToInt( Local.Z );
+	const float FX = Local.X - X;
+	const float FY = Local.Y - Y;
+	const float FZ = Local.Z - Z;
+
+	const float C00 = FMath::Lerp<float>( FetchVoxel( *Best, X, Y, Z ), FetchVoxel( *Best, X + 1, Y, Z ), FX );
+	const float C10 = FMath::Lerp<float>( FetchVoxel( *Best, X, Y + 1, Z ), FetchVoxel( *Best, X + 1, Y + 1, Z ), FX );
+	const float C01 = FMath::Lerp<float>( FetchVoxel( *Best, X, Y, Z + 1 ), FetchVoxel( *Best, X + 1, Y, Z + 1 ), FX );
+	const float C11 = FMath::Lerp<float>( FetchVoxel( *Best, X, Y + 1, Z + 1 ), FetchVoxel( *Best, X + 1, Y + 1, Z + 1 ), FX );
+	const float C0 = FMath::Lerp( C00, C10, FY );
+	const float C1 = FMath::Lerp( C01, C11, FY );
+	OutVisibility = FMath::Lerp( C0, C1, FZ ) / 255.f;
+	return true;
+}
+
+FLucidBakedVisibility* FLucidBakedVisibility::Get( UWorld* World )
+{
+	FLucidBakedVisibility* Baked = TLucidPerWorld<FLucidBakedVisibility, true>::Get( World );
+	if ((Baked != nullptr) && (Baked->PendingLoads.Num() > 0))
+	{
+		Baked->CollectLoads();
+	}
+	return Baked;
+}
+
+void FLucidBakedVisibility::AddLevel( ULevel* Level )
+{
+	SCOPE_CYCLE_COUNTER( STAT_LucidLevelStreaming );
+	if (Volumes.Contains( Level ) || PendingLoads.Contains( Level ))
+	{
+		return;
+	}
+
+	// Read and validated off the game thread, picked up by CollectLoads once done
+	const FString Filename = FLucidSunVisibilityVolume::GetSidecarPath( Level->GetOutermost()->GetName() );
+	PendingLoads.Add( Level, Async<TSharedPtr<FLucidSunVisibilityVolume>>( EAsyncExecution::ThreadPool, [Filename]()
+	{
+		return FLucidSunVisibilityVolume::LoadFromFile( Filename );
+	} ) );
+}
+
+void FLucidBakedVisibility::RemoveLevel( ULevel* Level )
+{
+	// A load still in flight finishes on its own and its result is dropped with the future
+	PendingLoads.Remove( Level );
+	Volumes.Remove( Level );
+}
+
+void FLucidBakedVisibility::CollectLoads()
+{
+	for (auto It = PendingLoads.CreateIterator(); It; ++It)
+	{
+		if (!It.Value().IsReady())
+		{
+			continue;
+		}
+		TSharedPtr<FLucidSunVisibilityVolume> Volume = It.Value().Get();
+		if (Volume.IsValid() && It.Key().IsValid())
+		{
+			Volumes.Add( It.Key(), Volume );
+		}
+		It.RemoveCurrent();
+	}
+}
+
+int32 FLucidBakedVisibility::GetAllocatedSize( const ULevel* Level ) const
+{
+	int32 Size = 0;
+	for (const auto &Pair : Volumes)
+	{
+		if ((Level == nullptr) || (Pair.Key.Get() == Level))
+		{
+			Size += Pair.Value->GetAllocatedSize();
+		}
+	}
+	return Size;
+}
+
+bool FLucidBakedVisibility::SampleVisibility( const FVector &Point, const FVector &SunDirection, float &OutVisibility ) const
+{
+	for (const auto &Pair : Volumes)
+	{
+		if (Pair.Value->SampleVisibility( Point, SunDirection, OutVisibility ))
+		{
+			return true;
+		}
+	}
+	return false;
+}
@@ -0,0 +1,112 @@
+// Copyright 1998-2017 Epic Games, Inc. All Rights Reserved.
+#pragma once
+
+#include "LucidPerWorld.h"
+
+// On-disk layout of a baked sun visibility sidecar (.lucvis), little endian
+namespace LucidVisibilityFormat
+{
+	static const uint32 Magic = 0x5656534C; // "LSVV"
+	static const uint32 Version = 1;
+
+	// Voxels per brick edge, bricks that are entirely lit or shadowed are not stored
+	static const int32 BrickSize = 4;
+	static const int32 BrickVoxels = BrickSize*BrickSize*BrickSize;
+
+	static const uint32 BrickAllLit = 0xFFFFFFFF;
+	static const uint32 BrickAllShadowed = 0xFFFFFFFE;
+
+	struct FHeader
+	{
+		uint32 Magic;
+		uint32 Version;
+		uint32 NumDirections;
+		int32 Dims[3];
+		float Origin[3];
+		float CellSize;
+	};
+
+	struct FDirection
+	{
+		// Direction the sun light travels in, as ULightComponent::GetDirection
+		float Direction[3];
+		// Byte offsets from the start of the file
+		uint32 BrickTableOffset;
+		uint32 BrickDataOffset;
+		uint32 NumBricks;
+	};
+}
+
+/**
+ * Sparse sun visibility grid baked for one level against its static collision.
+ * The whole sidecar is kept as one block and sampled in place, so a lookup is a few reads.
+ */
+class FLucidSunVisibilityVolume
+{
+public:
+	/** Loads and validates a sidecar, returns null if missing or out of date */
+	static TSharedPtr<FLucidSunVisibilityVolume> LoadFromFile( const FString &Filename );
+
+	/** Takes ownership of an already read sidecar, returns null if it is malformed */
+	static TSharedPtr<FLucidSunVisibilityVolume> CreateFromBytes( TArray<uint8> &&Bytes );
+
+	/** Where the sidecar for a level package lives */
+	static FString GetSidecarPath( const FString &LevelPackageName );
+
+	/**
+	 * Trilinearly samples sun visibility (0 shadowed, 1 lit) at Point for the baked direction closest to SunDirection.
+	 * @return false if the point is outside the volume or no baked direction is within tolerance
+	 */
+	bool SampleVisibility( const FVector &Point, const FVector &SunDirection, float &OutVisibility ) const;
+
+	FORCEINLINE const FBox& GetBounds() const { return Bounds; }
+	FORCEINLINE int32 GetAllocatedSize() const { return Data.GetAllocatedSize(); }
+
+	// Largest angle between the live sun and a baked direction that still uses the bake
+	static const float DirectionToleranceDegrees;
+
+private:
+	FLucidSunVisibilityVolume() {}
+
+	uint8 FetchVoxel( const LucidVisibilityFormat::FDirection &Dir, int32 X, int32 Y, int32 Z ) const;
+
+	TArray<uint8> Data;
+	LucidVisibilityFormat::FHeader Header;
+	const LucidVisibilityFormat::FDirection* Directions;
+	FIntVector BrickDims;
+	FBox Bounds;
+};
+
+/**
+ * Baked visibility volumes for the levels currently in a world.
+ * A level's sidecar is read on the thread pool when the level is added and only becomes visible to
+ * queries once it has loaded, so streaming never stalls the game thread. It is released, or its
+ * pending load discarded, when the level is removed.
+ */
+class FLucidBakedVisibility
+{
+public:
+	static FLucidBakedVisibility* Get( UWorld* World );
+
+	void AddLevel( ULevel* Level );
+	void RemoveLevel( ULevel* Level );
+
+	bool SampleVisibility( const FVector &Point, const FVector &SunDirection, float &OutVisibility ) const;
+
+	FORCEINLINE bool HasVolumes() const { return Volumes.Num() > 0; }
+	FORCEINLINE int32 NumPendingLoads() const { return PendingLoads.Num(); }
+
+	/** Sidecar bytes held for Level, or for every level if null */
+	int32 GetAllocatedSize( const ULevel* Level = nullptr ) const;
+
+private:
+	// Moves finished loads into Volumes, on the game thread
+	void CollectLoads();
+
+	explicit FLucidBakedVisibility( UWorld* InWorld ) {}
+
+	TMap<TWeakObjectPtr<ULevel>, TSharedPtr<FLucidSunVisibilityVolume>> Volumes;
+	TMap<TWeakObjectPtr<ULevel>, TFuture<TSharedPtr<FLucidSunVisibilityVolume>>> PendingLoads;
+
+	friend class TLucidPerWorld<FLucidBakedVisibility, true>;
+};
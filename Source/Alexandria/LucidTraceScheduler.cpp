@@ -0,0 +1,122 @@
+// Copyright 1998-2017 Epic Games, Inc. All Rights Reserved.
+
+#include "Alexandria.h"
+#include "LucidTraceScheduler.h"
+#include "LucidityStats.h"
+
+namespace LucidTraceScheduler
+{
+	static TAutoConsoleVariable<int32> CVarTraceBudget(
+		TEXT( "lucidity.TraceBudget" ),
+		512,
+		TEXT( "Most Lucidity rays traced per frame across every lucid character in a world, 0 for no limit.\n" )
+		TEXT( "Characters that miss the budget keep their Lucidity and are updated on a later frame." ),
+		ECVF_Default );
+
+	static TAutoConsoleVariable<float> CVarTraceBudgetTargetMs(
+		TEXT( "lucidity.TraceBudgetTargetMs" ),
+		0.f,
+		TEXT( "Frame time the Lucidity trace budget adapts to, shrinking while frames run longer and growing\n" )
+		TEXT( "back up to lucidity.TraceBudget while they run shorter. 0 uses lucidity.TraceBudget as is." ),
+		ECVF_Default );
+
+	static TAutoConsoleVariable<int32> CVarLightOcclusionBudget(
+		TEXT( "lucidity.LightOcclusionBudget" ),
+		16,
+		TEXT( "Most light occlusion rays traced per frame across every lucid character in a world, a hard cap\n" )
+		TEXT( "outside lucidity.TraceBudget. Lights past it keep their cached visibility, 0 traces none." ),
+		ECVF_Default );
+
+	// The adaptive budget never starves the world below this
+	static const int32 MinAdaptiveBudget = 16;
+	// Weight of a new frame time against the smoothed one
+	static const float FrameTimeWeight = 0.1f;
+}
+
+FLucidTraceScheduler::FLucidTraceScheduler() :
+	Budget( LucidTraceScheduler::CVarTraceBudget.GetValueOnGameThread() ),
+	Remaining( Budget ),
+	LightTracesRemaining( LucidTraceScheduler::CVarLightOcclusionBudget.GetValueOnGameThread() ),
+	Cutoff( 0.f ),
+	SmoothedFrameMs( 0.f )
+{
+}
+
+int32 FLucidTraceScheduler::Acquire( const float Priority, const int32 Wanted )
+{
+	if ((Wanted <= 0) || (Budget <= 0))
+	{
+		return FMath::Max( Wanted, 0 );
+	}
+
+	Requests.Add( { Priority, Wanted } );
+	if ((Priority < Cutoff) || (Remaining <= 0))
+	{
+		INC_DWORD_STAT( STAT_LucidDeferredUpdates );
+		return 0;
+	}
+
+	const int32 Granted = FMath::Min( Wanted, Remaining );
+	Remaining -= Granted;
+	return Granted;
+}
+
+bool FLucidTraceScheduler::AcquireLightTrace()
+{
+	if (LightTracesRemaining <= 0)
+	{
+		return false;
+	}
+	--LightTracesRemaining;
+	return true;
+}
+
+void FLucidTraceScheduler::EndFrame( const float FrameSeconds )
+{
+	using namespace LucidTraceScheduler;
+	const int32 MaxBudget = CVarTraceBudget.GetValueOnGameThread();
+	const float TargetMs = CVarTraceBudgetTargetMs.GetValueOnGameThread();
+
+	if ((MaxBudget <= 0) || (TargetMs <= 0.f))
+	{
+		Budget = MaxBudget;
+	}
+	else
+	{
+		const float FrameMs = FrameSeconds*1000.f;
+		SmoothedFrameMs = (SmoothedFrameMs > 0.f) ? FMath::Lerp( SmoothedFrameMs, FrameMs, FrameTimeWeight ) : FrameMs;
+
+		// Back off quickly, recover slowly, and leave a dead band so the budget settles
+		const int32 Floor = FMath::Min( MinAdaptiveBudget, MaxBudget );
+		if (SmoothedFrameMs > TargetMs*1.05f)
+		{
+			Budget = FMath::Max( FMath::FloorToInt( Budget*0.9f ), Floor );
+		}
+		else if (SmoothedFrameMs < TargetMs*0.9f)
+		{
+			Budget = FMath::Min( FMath::CeilToInt( Budget*1.05f ) + 1, MaxBudget );
+		}
+		Budget = FMath::Clamp( Budget, Floor, MaxBudget );
+	}
+	SET_DWORD_STAT( STAT_LucidTraceBudget, FMath::Max( Budget, 0 ) );
+
+	// Highest priority first, the first request that no longer fits sets next frame's cutoff
+	Cutoff = 0.f;
+	if (Budget > 0)
+	{
+		Requests.Sort( []( const FRequest &A, const FRequest &B ) { return A.Priority > B.Priority; } );
+		int32 Spent = 0;
+		for (const FRequest &Request : Requests)
+		{
+			Spent += Request.Wanted;
+			if (Spent > Budget)
+			{
+				Cutoff = Request.Priority;
+				break;
+			}
+		}
+	}
+	Requests.Reset();
+	Remaining = Budget;
+	LightTracesRemaining = CVarLightOcclusionBudget.GetValueOnGameThread();
+}
@@ -0,0 +1,50 @@
+// Copyright 1998-2017 Epic Games, Inc. All Rights Reserved.
+#pragma once
+
+/**
+ * Per-world budget of Lucidity rays per frame, shared by every lucid character.
+ * Requests are admitted against the priority cutoff found by ranking the previous frame's requests,
+ * so the rays go to the most significant and most overdue characters without waiting for all of
+ * them to ask. A request that misses the budget is deferred: its character keeps its old Lucidity,
+ * grows staler and asks again next frame with a higher priority.
+ * The budget is lucidity.TraceBudget, or adapted below it towards lucidity.TraceBudgetTargetMs.
+ * Light occlusion rays come from a separate hard cap, lucidity.LightOcclusionBudget, taken one ray at a time.
+ */
+class FLucidTraceScheduler
+{
+public:
+	FLucidTraceScheduler();
+
+	/** Priority from a character's significance (0-1) and how many of its slowest intervals it is overdue */
+	static FORCEINLINE float CalcPriority( const float Significance, const float Staleness ) { return Significance + Staleness; }
+
+	/**
+	 * Grants up to Wanted rays for this frame.
+	 * @return rays granted, 0 if the request is deferred
+	 */
+	int32 Acquire( const float Priority, const int32 Wanted );
+
+	/** Takes one light occlusion ray from this frame's cap, false once it is spent */
+	bool AcquireLightTrace();
+
+	/** Ranks this frame's requests into next frame's cutoff and adapts the budget to FrameSeconds */
+	void EndFrame( const float FrameSeconds );
+
+	/** Rays per frame, 0 when unlimited */
+	FORCEINLINE int32 GetBudget() const { return Budget; }
+
+private:
+	struct FRequest
+	{
+		float Priority;
+		int32 Wanted;
+	};
+	TArray<FRequest> Requests;
+
+	int32 Budget;
+	int32 Remaining;
+	int32 LightTracesRemaining;
+	// Requests below this priority are deferred this frame
+	float Cutoff;
+	float SmoothedFrameMs;
+};
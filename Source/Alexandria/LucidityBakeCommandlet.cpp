@@ -0,0 +1,423 @@
+// Copyright 1998-2017 Epic Games, Inc. All Rights Reserved.
+
+#include "Alexandria.h"
+#include "LucidityBakeCommandlet.h"
+#include "AlexandriaGameMode.h"
+#include "LucidSunVisibilityVolume.h"
+#include "LucidOccluders.h"
+#include "LucidityTypes.h"
+#include "Engine/CollisionProfile.h"
+#include "Async/ParallelFor.h"
+#include "Engine/DirectionalLight.h"
+#include "Engine/LevelBounds.h"
+#include "Components/LightComponent.h"
+#include "EngineUtils.h"
+
+using namespace LucidVisibilityFormat;
+
+namespace LucidityBake
+{
+	// Rays per voxel, spread inside the voxel so trilinear sampling has partial values to blend
+	static const FVector SampleOffsets[] =
+	{
+		FVector( 0.25f, 0.25f, 0.25f ),
+		FVector( -0.25f, -0.25f, 0.25f ),
+		FVector( -0.25f, 0.25f, -0.25f ),
+		FVector( 0.25f, -0.25f, -0.25f ),
+	};
+	static const int32 NumSamples = ARRAY_COUNT( SampleOffsets );
+
+	static void AppendBytes( TArray<uint8> &Bytes, const void* Src, const int32 Size )
+	{
+		const int32 Offset = Bytes.AddUninitialized( Size );
+		FMemory::Memcpy( Bytes.GetData() + Offset, Src, Size );
+	}
+}
+
+ULucidityBakeCommandlet::ULucidityBakeCommandlet()
+{
+	IsClient = false;
+	IsEditor = true;
+	IsServer = false;
+	LogToConsole = true;
+}
+
+int32 ULucidityBakeCommandlet::Main( const FString &Params )
+{
+	FString MapName;
+	if (!FParse::Value( *Params, TEXT( "Map=" ), MapName ))
+	{
+		UE_LOG( AlexandriaLog, Error, TEXT( "LucidityBake: missing -Map=<package name>" ) );
+		return 1;
+	}
+	float Spacing = 100.f;
+	FParse::Value( *Params, TEXT( "Spacing=" ), Spacing );
+	Spacing = FMath::Max( Spacing, 10.f );
+
+	UPackage* Package = LoadPackage( nullptr, *MapName, LOAD_None );
+	UWorld* World = (Package != nullptr) ? UWorld::FindWorldInPackage( Package ) : nullptr;
+	if (World == nullptr)
+	{
+		UE_LOG( AlexandriaLog, Error, TEXT( "LucidityBake: could not load map %s" ), *MapName );
+		return 1;
+	}
+
+	// Bring up just enough of the world for collision queries
+	World->WorldType = EWorldType::Editor;
+	World->AddToRoot();
+	if (!World->bIsWorldInitialized)
+	{
+		UWorld::InitializationValues IVS;
+		IVS.RequiresHitProxies( false )
+			.ShouldSimulatePhysics( false )
+			.EnableTraceCollision( true )
+			.CreateNavigation( false )
+			.CreateAISystem( false )
+			.AllowAudioPlayback( false )
+			.CreatePhysicsScene( true );
+		World->InitWorld( IVS );
+	}
+	World->UpdateWorldComponents( true, false );
+
+	TArray<FVector> SunDirections;
+	FString DirectionList;
+	if (FParse::Value( *Params, TEXT( "Directions=" ), DirectionList, false ))
+	{
+		TArray<FString> Entries;
+		DirectionList.ParseIntoArray( Entries, TEXT( ";" ) );
+		for (const FString &Entry : Entries)
+		{
+			FString Pitch, Yaw;
+			if (Entry.Split( TEXT( "," ), &Pitch, &Yaw ))
+			{
+				SunDirections.Add( FRotator( FCString::Atof( *Pitch ), FCString::Atof( *Yaw ), 0.f ).Vector() );
+			}
+		}
+	}
+	else
+	{
+		TActorIterator<ADirectionalLight> DLightItr( World );
+		if (DLightItr)
+		{
+			SunDirections.Add( DLightItr->GetLightComponent()->GetDirection().GetSafeNormal() );
+		}
+	}
+	if (SunDirections.Num() == 0)
+	{
+		UE_LOG( AlexandriaLog, Error, TEXT( "LucidityBake: no sun direction given and %s has no directional light" ), *MapName );
+		World->RemoveFromRoot();
+		return 1;
+	}
+
+	const FBox LevelBox = ALevelBounds::CalculateLevelBounds( World->PersistentLevel );
+	if (!LevelBox.IsValid)
+	{
+		UE_LOG( AlexandriaLog, Error, TEXT( "LucidityBake: %s has no bounds to bake" ), *MapName );
+		World->RemoveFromRoot();
+		return 1;
+	}
+
+	bool bSaved = true;
+	if (!FParse::Param( *Params, TEXT( "NoVisibility" ) ))
+	{
+		bSaved &= BakeVisibility( World, Package->GetName(), LevelBox, Spacing, SunDirections );
+	}
+
+	// After the visibility bake, whose object queries would otherwise hit the proxies
+	int32 MeasurePoints = 1000;
+	FParse::Value( *Params, TEXT( "MeasurePoints=" ), MeasurePoints );
+	bSaved &= BakeOccluders( World, Package->GetName(), LevelBox, SunDirections, MeasurePoints );
+
+	World->RemoveFromRoot();
+	return bSaved ? 0 : 1;
+}
+
+bool ULucidityBakeCommandlet::BakeVisibility( UWorld* World, const FString &PackageName, const FBox &LevelBox, const float Spacing, const TArray<FVector> &SunDirections ) const
+{
+	const FVector Origin = LevelBox.Min;
+	const FVector Size = LevelBox.GetSize();
+	const FIntVector Dims(
+		FMath::CeilToInt( Size.X / Spacing ) + 1,
+		FMath::CeilToInt( Size.Y / Spacing ) + 1,
+		FMath::CeilToInt( Size.Z / Spacing ) + 1 );
+	const FIntVector BrickDims(
+		FMath::DivideAndRoundUp( Dims.X, BrickSize ),
+		FMath::DivideAndRoundUp( Dims.Y, BrickSize ),
+		FMath::DivideAndRoundUp( Dims.Z, BrickSize ) );
+	const int32 NumBrickSlots = BrickDims.X*BrickDims.Y*BrickDims.Z;
+
+	UE_LOG( AlexandriaLog, Display, TEXT( "LucidityBake: %s, %dx%dx%d voxels at %.0f, %d direction(s)" ),
+		*PackageName, Dims.X, Dims.Y, Dims.Z, Spacing, SunDirections.Num() );
+
+	FHeader Header;
+	Header.Magic = Magic;
+	Header.Version = Version;
+	Header.NumDirections = SunDirections.Num();
+	Header.Dims[0] = Dims.X;
+	Header.Dims[1] = Dims.Y;
+	Header.Dims[2] = Dims.Z;
+	Header.Origin[0] = Origin.X;
+	Header.Origin[1] = Origin.Y;
+	Header.Origin[2] = Origin.Z;
+	Header.CellSize = Spacing;
+
+	TArray<uint8> Bytes;
+	LucidityBake::AppendBytes( Bytes, &Header, sizeof( FHeader ) );
+	const int32 DirectionTableOffset = Bytes.AddZeroed( SunDirections.Num()*sizeof( FDirection ) );
+
+	for (int32 DirIndex = 0; DirIndex < SunDirections.Num(); ++DirIndex)
+	{
+		TArray<uint8> Voxels;
+		BakeDirection( World, Origin, Dims, Spacing, SunDirections[DirIndex], Voxels );
+
+		// Split into bricks, only bricks with mixed visibility are stored
+		TArray<uint32> BrickTable;
+		TArray<uint8> BrickData;
+		BrickTable.SetNumUninitialized( NumBrickSlots );
+		for (int32 BZ = 0; BZ < BrickDims.Z; ++BZ)
+		{
+			for (int32 BY = 0; BY < BrickDims.Y; ++BY)
+			{
+				for (int32 BX = 0; BX < BrickDims.X; ++BX)
+				{
+					uint8 Brick[BrickVoxels];
+					bool bAllLit = true;
+					bool bAllShadowed = true;
+					for (int32 VZ = 0; VZ < BrickSize; ++VZ)
+					{
+						for (int32 VY = 0; VY < BrickSize; ++VY)
+						{
+							for (int32 VX = 0; VX < BrickSize; ++VX)
+							{
+								const int32 X = FMath::Min( BX*BrickSize + VX, Dims.X - 1 );
+								const int32 Y = FMath::Min( BY*BrickSize + VY, Dims.Y - 1 );
+								const int32 Z = FMath::Min( BZ*BrickSize + VZ, Dims.Z - 1 );
+								const uint8 Value = Voxels[(Z*Dims.Y + Y)*Dims.X + X];
+								Brick[(VZ*BrickSize + VY)*BrickSize + VX] = Value;
+								bAllLit &= (Value == 255);
+								bAllShadowed &= (Value == 0);
+							}
+						}
+					}
+
+					uint32 &Slot = BrickTable[(BZ*BrickDims.Y + BY)*BrickDims.X + BX];
+					if (bAllLit)
+					{
+						Slot = BrickAllLit;
+					}
+					else if (bAllShadowed)
+					{
+						Slot = BrickAllShadowed;
+					}
+					else
+					{
+						Slot = BrickData.Num() / BrickVoxels;
+						LucidityBake::AppendBytes( BrickData, Brick, BrickVoxels );
+					}
+				}
+			}
+		}
+
+		FDirection Dir;
+		Dir.Direction[0] = SunDirections[DirIndex].X;
+		Dir.Direction[1] = SunDirections[DirIndex].Y;
+		Dir.Direction[2] = SunDirections[DirIndex].Z;
+		Dir.BrickTableOffset = Bytes.Num();
+		LucidityBake::AppendBytes( Bytes, BrickTable.GetData(), BrickTable.Num()*sizeof( uint32 ) );
+		Dir.BrickDataOffset = Bytes.Num();
+		Dir.NumBricks = BrickData.Num() / BrickVoxels;
+		LucidityBake::AppendBytes( Bytes, BrickData.GetData(), BrickData.Num() );
+		FMemory::Memcpy( Bytes.GetData() + DirectionTableOffset + DirIndex*sizeof( FDirection ), &Dir, sizeof( FDirection ) );
+
+		UE_LOG( AlexandriaLog, Display, TEXT( "LucidityBake: direction %s, %d of %d bricks stored" ),
+			*SunDirections[DirIndex].ToString(), Dir.NumBricks, NumBrickSlots );
+	}
+
+	const FString Filename = FLucidSunVisibilityVolume::GetSidecarPath( PackageName );
+	IFileManager::Get().MakeDirectory( *FPaths::GetPath( Filename ), true );
+	const bool bSaved = FFileHelper::SaveArrayToFile( Bytes, *Filename );
+	UE_LOG( AlexandriaLog, Display, TEXT( "LucidityBake: %s %s (%d bytes)" ), bSaved ? TEXT( "wrote" ) : TEXT( "failed to write" ), *Filename, Bytes.Num() );
+	return bSaved;
+}
+
+bool ULucidityBakeCommandlet::BakeOccluders( UWorld* World, const FString &PackageName, const FBox &LevelBox, const TArray<FVector> &SunDirections, const int32 MeasurePoints ) const
+{
+	FLucidOccluderSet Set;
+	FLucidOccluderSet::GatherProxies( World->PersistentLevel, Set.Proxies );
+	int32 NumConservative = 0;
+	for (const LucidOccluderFormat::FProxy &Proxy : Set.Proxies)
+	{
+		NumConservative += (Proxy.Flags & LucidOccluderFormat::Conservative) ? 1 : 0;
+	}
+
+	TArray<uint8> Bytes;
+	FLucidOccluderSet::Serialize( Set.Proxies, Bytes );
+	const FString Filename = FLucidOccluderSet::GetSidecarPath( PackageName );
+	IFileManager::Get().MakeDirectory( *FPaths::GetPath( Filename ), true );
+	const bool bSaved = FFileHelper::SaveArrayToFile( Bytes, *Filename );
+	UE_LOG( AlexandriaLog, Display, TEXT( "LucidityBake: %s %s (%d occluder proxies, %d conservative)" ),
+		bSaved ? TEXT( "wrote" ) : TEXT( "failed to write" ), *Filename, Set.Proxies.Num(), NumConservative );
+
+	if (bSaved && (MeasurePoints > 0))
+	{
+		MeasureOccluders( World, Set, LevelBox, SunDirections, MeasurePoints );
+	}
+	return bSaved;
+}
+
+void ULucidityBakeCommandlet::MeasureOccluders( UWorld* World, const FLucidOccluderSet &Set, const FBox &LevelBox, const TArray<FVector> &SunDirections, const int32 NumPoints ) const
+{
+	AActor* ProxyActor = FLucidOccluders::SpawnProxies( World->PersistentLevel, Set, false );
+	if (ProxyActor == nullptr)
+	{
+		UE_LOG( AlexandriaLog, Warning, TEXT( "LucidityBake: no occluder proxies to measure" ) );
+		return;
+	}
+
+	// The same sample points for both, jittered around each point as the characters' poll points are
+	FRandomStream Random( 0x4C756369 );
+	const float TraceLength = LevelBox.GetSize().Size();
+	TArray<FVector> Starts;
+	TArray<FVector> Ends;
+	for (int32 Point = 0; Point < NumPoints; ++Point)
+	{
+		const FVector Center( Random.FRandRange( LevelBox.Min.X, LevelBox.Max.X ), Random.FRandRange( LevelBox.Min.Y, LevelBox.Max.Y ), Random.FRandRange( LevelBox.Min.Z, LevelBox.Max.Z ) );
+		for (const FVector &SunDirection : SunDirections)
+		{
+			for (int32 Sample = 0; Sample < LucidityBake::NumSamples; ++Sample)
+			{
+				const FVector End = Center + LucidityBake::SampleOffsets[Sample]*100.f;
+				Starts.Add( End - SunDirection*TraceLength );
+				Ends.Add( End );
+			}
+		}
+	}
+
+	ECollisionChannel BlockAllChannel = ECC_WorldStatic;
+	FCollisionResponseParams BlockAllResponse;
+	UCollisionProfile::Get()->GetChannelAndResponseParams( UCollisionProfile::BlockAll_ProfileName, BlockAllChannel, BlockAllResponse );
+	const FCollisionQueryParams ComplexParams( FName( TEXT( "LucidityBake" ) ), true );
+	const FCollisionQueryParams ProxyParams( FName( TEXT( "LucidityBake" ) ), false );
+
+	// Single threaded, so the per ray cost compares like for like
+	TArray<bool> ComplexLit;
+	TArray<bool> ProxyLit;
+	ComplexLit.SetNumUninitialized( Starts.Num() );
+	ProxyLit.SetNumUninitialized( Starts.Num() );
+	uint32 StartCycles = FPlatformTime::Cycles();
+	for (int32 i = 0; i < Starts.Num(); ++i)
+	{
+		ComplexLit[i] = !World->LineTraceTestByChannel( Starts[i], Ends[i], BlockAllChannel, ComplexParams, BlockAllResponse );
+	}
+	const uint32 ComplexCycles = FPlatformTime::Cycles() - StartCycles;
+	StartCycles = FPlatformTime::Cycles();
+	for (int32 i = 0; i < Starts.Num(); ++i)
+	{
+		ProxyLit[i] = !World->LineTraceTestByChannel( Starts[i], Ends[i], FLucidOccluders::TraceChannel, ProxyParams );
+	}
+	const uint32 ProxyCycles = FPlatformTime::Cycles() - StartCycles;
+
+	// The same proxies in the BVH sun rays trace at runtime, in packets
+	StartCycles = FPlatformTime::Cycles();
+	FLucidOccluderBvh Bvh;
+	Bvh.Build( Set.Proxies, false );
+	const uint32 BuildCycles = FPlatformTime::Cycles() - StartCycles;
+	TArray<FLucidSunRay> Rays;
+	Rays.SetNumUninitialized( Starts.Num() );
+	for (int32 i = 0; i < Starts.Num(); ++i)
+	{
+		Rays[i].Start = Starts[i];
+		Rays[i].End = Ends[i];
+		Rays[i].Stratum = INDEX_NONE;
+	}
+	TArray<bool> BvhLit;
+	BvhLit.SetNumUninitialized( Starts.Num() );
+	StartCycles = FPlatformTime::Cycles();
+	for (int32 First = 0; First < Rays.Num(); First += FLucidOccluderBvh::PacketSize)
+	{
+		const int32 Count = FMath::Min( Rays.Num() - First, FLucidOccluderBvh::PacketSize );
+		const uint32 Blocked = Bvh.TracePacket( Rays.GetData() + First, Count, (1u << Count) - 1 );
+		for (int32 Lane = 0; Lane < Count; ++Lane)
+		{
+			BvhLit[First + Lane] = !(Blocked & (1u << Lane));
+		}
+	}
+	const uint32 BvhCycles = FMath::Max<uint32>( FPlatformTime::Cycles() - StartCycles, 1 );
+	int32 BvhAgree = 0;
+	for (int32 i = 0; i < Starts.Num(); ++i)
+	{
+		BvhAgree += (BvhLit[i] == ProxyLit[i]) ? 1 : 0;
+	}
+
+	// Ray agreement, and the sun visibility a character would see at each point, the sun's share of its Lucidity.
+	// The BVH is held to BlockAll too, since sun rays trace it rather than the physics scene at runtime.
+	int32 NumAgree = 0;
+	double VisibilityError = 0.0;
+	int32 BvhComplexAgree = 0;
+	int32 BvhOverShaded = 0;
+	double BvhVisibilityError = 0.0;
+	for (int32 First = 0; First < Starts.Num(); First += LucidityBake::NumSamples)
+	{
+		int32 ComplexCount = 0;
+		int32 ProxyCount = 0;
+		int32 BvhCount = 0;
+		for (int32 i = First; i < First + LucidityBake::NumSamples; ++i)
+		{
+			NumAgree += (ComplexLit[i] == ProxyLit[i]) ? 1 : 0;
+			BvhComplexAgree += (ComplexLit[i] == BvhLit[i]) ? 1 : 0;
+			BvhOverShaded += (ComplexLit[i] && !BvhLit[i]) ? 1 : 0;
+			ComplexCount += ComplexLit[i] ? 1 : 0;
+			ProxyCount += ProxyLit[i] ? 1 : 0;
+			BvhCount += BvhLit[i] ? 1 : 0;
+		}
+		VisibilityError += FMath::Abs( ComplexCount - ProxyCount ) / (double)LucidityBake::NumSamples;
+		BvhVisibilityError += FMath::Abs( ComplexCount - BvhCount ) / (double)LucidityBake::NumSamples;
+	}
+
+	const double MicrosecondsPerCycle = FPlatformTime::GetSecondsPerCycle()*1000000.0;
+	UE_LOG( AlexandriaLog, Display, TEXT( "LucidityBake: %d rays, BlockAll complex %.3f us/ray, occluder proxies %.3f us/ray" ),
+		Starts.Num(), ComplexCycles*MicrosecondsPerCycle / Starts.Num(), ProxyCycles*MicrosecondsPerCycle / Starts.Num() );
+	UE_LOG( AlexandriaLog, Display, TEXT( "LucidityBake: %.1f%% of rays agree, mean sun visibility difference %.3f per point" ),
+		100.0*NumAgree / Starts.Num(), VisibilityError*LucidityBake::NumSamples / Starts.Num() );
+	const double SecondsPerCycle = FPlatformTime::GetSecondsPerCycle();
+	UE_LOG( AlexandriaLog, Display, TEXT( "LucidityBake: BVH of %d boxes in %d nodes, %.1f KB, built in %.2f ms" ),
+		Bvh.NumBoxes(), Bvh.NumNodes(), Bvh.GetAllocatedSize() / 1024.0, BuildCycles*SecondsPerCycle*1000.0 );
+	UE_LOG( AlexandriaLog, Display, TEXT( "LucidityBake: %.0f rays/s through the physics scene, %.0f rays/s through the BVH, %.2f%% of rays agree" ),
+		Starts.Num() / (FMath::Max<uint32>( ProxyCycles, 1 )*SecondsPerCycle), Starts.Num() / (BvhCycles*SecondsPerCycle), 100.0*BvhAgree / Starts.Num() );
+	UE_LOG( AlexandriaLog, Display, TEXT( "LucidityBake: BVH against BlockAll complex, %.1f%% of rays agree (%d shaded that BlockAll lets through), mean sun visibility difference %.3f per point" ),
+		100.0*BvhComplexAgree / Starts.Num(), BvhOverShaded, BvhVisibilityError*LucidityBake::NumSamples / Starts.Num() );
+
+	World->DestroyActor( ProxyActor );
+}
+
+void ULucidityBakeCommandlet::BakeDirection( UWorld* World, const FVector &Origin, const FIntVector &Dims, const float Spacing, const FVector &SunDirection, TArray<uint8> &OutVoxels ) const
+{
+	OutVoxels.SetNumZeroed( Dims.X*Dims.Y*Dims.Z );
+
+	const FVector ToSun = -SunDirection.GetSafeNormal();
+	const float TraceLength = WORLD_MAX;
+	const FCollisionObjectQueryParams ObjectParams( ECC_WorldStatic );
+	const FCollisionQueryParams QueryParams( FName( TEXT( "LucidityBake" ) ), true );
+
+	// Scene queries are read-only, so slices can be traced in parallel
+	ParallelFor( Dims.Z, [&]( int32 Z )
+	{
+		for (int32 Y = 0; Y < Dims.Y; ++Y)
+		{
+			for (int32 X = 0; X < Dims.X; ++X)
+			{
+				const FVector Center = Origin + FVector( X, Y, Z )*Spacing;
+				int32 LitCount = 0;
+				for (int32 Sample = 0; Sample < LucidityBake::NumSamples; ++Sample)
+				{
+					const FVector Start = Center + LucidityBake::SampleOffsets[Sample]*Spacing;
+					if (!World->LineTraceTestByObjectType( Start, Start + ToSun*TraceLength, ObjectParams, QueryParams ))
+					{
+						++LitCount;
+					}
+				}
+				OutVoxels[(Z*Dims.Y + Y)*Dims.X + X] = (uint8)((LitCount*255) / LucidityBake::NumSamples);
+			}
+		}
+	} );
+}
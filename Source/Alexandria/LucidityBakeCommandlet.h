@@ -0,0 +1,37 @@
+// Copyright 1998-2017 Epic Games, Inc. All Rights Reserved.
+#pragma once
+#include "Commandlets/Commandlet.h"
+#include "LucidityBakeCommandlet.generated.h"
+
+/**
+ * Bakes a sparse sun visibility grid and the occluder proxies for a level against its static collision.
+ *
+ * Usage: -run=LucidityBake -Map=/Game/Alexandria/Alexandria_Geo [-Spacing=100] [-Directions=Pitch,Yaw;Pitch,Yaw]
+ *        [-NoVisibility] [-MeasurePoints=1000]
+ * Without -Directions the level's first directional light is used. The sidecars are written
+ * next to each other, see FLucidSunVisibilityVolume::GetSidecarPath and FLucidOccluderSet::GetSidecarPath.
+ * The proxies are then traced against BlockAll complex collision from MeasurePoints random points, 0 skips it,
+ * and the rays per second of their packet traced BVH are compared with the physics scene's.
+ */
+UCLASS()
+class ULucidityBakeCommandlet : public UCommandlet
+{
+	GENERATED_BODY()
+
+public:
+	ULucidityBakeCommandlet();
+
+	virtual int32 Main( const FString &Params ) override;
+
+private:
+	bool BakeVisibility( UWorld* World, const FString &PackageName, const FBox &LevelBox, const float Spacing, const TArray<FVector> &SunDirections ) const;
+
+	// Occluder proxies for the level's static meshes, see FLucidOccluders
+	bool BakeOccluders( UWorld* World, const FString &PackageName, const FBox &LevelBox, const TArray<FVector> &SunDirections, const int32 MeasurePoints ) const;
+
+	// Logs trace cost and sun visibility agreement of the proxies against BlockAll complex traces, and of the BVH against the proxies
+	void MeasureOccluders( UWorld* World, const class FLucidOccluderSet &Set, const FBox &LevelBox, const TArray<FVector> &SunDirections, const int32 NumPoints ) const;
+
+	// Visibility (0-255) for every voxel of Dims, laid out X fastest
+	void BakeDirection( UWorld* World, const FVector &Origin, const FIntVector &Dims, const float Spacing, const FVector &SunDirection, TArray<uint8> &OutVoxels ) const;
+};
@@ -0,0 +1,523 @@
+// Copyright 1998-2017 Epic Games, Inc. All Rights Reserved.
+
+#include "Alexandria.h"
+#include "LucidityBenchmarkCommandlet.h"
+#include "AlexandriaGameMode.h"
+#include "AlexandriaCharacter.h"
+#include "LucidityManager.h"
+#include "LucidityStats.h"
+#include "LucidExposureSampler.h"
+#include "LucidOccluders.h"
+#include "EngineUtils.h"
+#include "Engine/DirectionalLight.h"
+#include "Engine/StaticMeshActor.h"
+#include "Components/LightComponent.h"
+#include "Tickable.h"
+#include "UObject/UObjectHash.h"
+#include "Json.h"
+
+namespace LucidityBenchmark
+{
+	static void ParseIntList( const FString &Params, const TCHAR* Key, TArray<int32> &OutValues )
+	{
+		FString List;
+		if (FParse::Value( *Params, Key, List, false ))
+		{
+			OutValues.Reset();
+			TArray<FString> Entries;
+			List.ParseIntoArray( Entries, TEXT( "," ) );
+			for (const FString &Entry : Entries)
+			{
+				OutValues.Add( FMath::Max( FCString::Atoi( *Entry ), 1 ) );
+			}
+		}
+	}
+
+	// Memory owned by an agent: the actor, its components, material instances and body setups
+	static int64 GetAgentBytes( AActor* Agent )
+	{
+		TArray<UObject*> Owned;
+		GetObjectsWithOuter( Agent, Owned, true );
+		Owned.Add( Agent );
+
+		int64 Bytes = 0;
+		for (UObject* Object : Owned)
+		{
+			Bytes += Object->GetClass()->GetStructureSize() + Object->GetResourceSizeBytes( EResourceSizeMode::Exclusive );
+		}
+		return Bytes;
+	}
+
+	// Characters and active components at each radiance LOD
+	static TSharedRef<FJsonObject> GetRadianceLodReport( const TArray<AAlexandriaCharacter*> &Agents )
+	{
+		FLucidRadianceLodCensus Census;
+		for (const AAlexandriaCharacter* Agent : Agents)
+		{
+			Agent->AddToRadianceLodCensus( Census );
+		}
+
+		TSharedRef<FJsonObject> Report = MakeShareable( new FJsonObject() );
+		for (int32 Level = 0; Level < FLucidRadianceLodCensus::NumLevels; Level++)
+		{
+			TSharedRef<FJsonObject> Entry = MakeShareable( new FJsonObject() );
+			Entry->SetNumberField( TEXT( "characters" ), Census.Characters[Level] );
+			Entry->SetNumberField( TEXT( "lights" ), Census.Lights[Level] );
+			Entry->SetNumberField( TEXT( "shadows" ), Census.Shadows[Level] );
+			Entry->SetNumberField( TEXT( "fires" ), Census.Fires[Level] );
+			Report->SetObjectField( LucidRadianceLod::GetName( (ELucidRadianceLod)Level ), Entry );
+		}
+		return Report;
+	}
+
+	// Value at fraction P of the sorted samples
+	static double Percentile( const TArray<double> &Sorted, const float P )
+	{
+		if (Sorted.Num() == 0)
+		{
+			return 0.0;
+		}
+		return Sorted[FMath::Clamp( FMath::FloorToInt( P*(Sorted.Num() - 1) + 0.5f ), 0, Sorted.Num() - 1 )];
+	}
+
+	// Synthetic occluder field, a grid of boxes of random height over a ground slab
+	static const int32 OccluderGrid = 16;
+	static const float OccluderSpacing = 600.f;
+	static const float AgentSpacing = 300.f;
+	static const float AgentPathRadius = 200.f;
+
+	// The view the radiance LOD is chosen for stands this far back from the crowd's near edge, at eye height,
+	// so a large crowd spans the LOD thresholds instead of every agent reading as unseen
+	static const float ViewStandoff = 2000.f;
+	static const float ViewHeight = 170.f;
+
+	// Convergence runs: points traced, the character's poll volume, and the reference each tick is scored against
+	static const int32 ConvergencePoints = 16;
+	static const FVector PollMin( -50.f, -50.f, -90.f );
+	static const FVector PollMax( 50.f, 50.f, 100.f );
+	static const int32 ReferenceGrid = 4;
+	static const float ConvergenceTraceLength = 20000.f;
+}
+
+ULucidityBenchmarkCommandlet::ULucidityBenchmarkCommandlet() :
+	Frames( 300 ),
+	WarmupFrames( 30 ),
+	DeltaSeconds( 1.f / 30.f ),
+	bDecoupled( false ),
+	StandingFraction( 0.f )
+{
+	// Not an editor run, so spawned characters strip their cosmetics as a headless game would, see ShouldCreateCosmetics
+	IsClient = false;
+	IsEditor = false;
+	IsServer = false;
+	LogToConsole = true;
+}
+
+int32 ULucidityBenchmarkCommandlet::Main( const FString &Params )
+{
+	FString MapName;
+	FParse::Value( *Params, TEXT( "Map=" ), MapName );
+
+	TArray<int32> AgentCounts = { 1, 4, 16, 64, 256 };
+	TArray<int32> RayCounts = { 1, 2, 4 };
+	LucidityBenchmark::ParseIntList( Params, TEXT( "Agents=" ), AgentCounts );
+	LucidityBenchmark::ParseIntList( Params, TEXT( "Rays=" ), RayCounts );
+	FParse::Value( *Params, TEXT( "Frames=" ), Frames );
+	FParse::Value( *Params, TEXT( "Warmup=" ), WarmupFrames );
+	Frames = FMath::Max( Frames, 1 );
+	WarmupFrames = FMath::Max( WarmupFrames, 0 );
+	bDecoupled = FParse::Param( *Params, TEXT( "Decoupled" ) );
+	FParse::Value( *Params, TEXT( "Standing=" ), StandingFraction );
+	StandingFraction = FMath::Clamp( StandingFraction, 0.f, 1.f );
+
+	FString OutputPath = FPaths::GameSavedDir() / TEXT( "Lucidity" ) / FString::Printf( TEXT( "Benchmark-%s.json" ), *FDateTime::Now().ToString() );
+	FParse::Value( *Params, TEXT( "Output=" ), OutputPath );
+
+#if UE_BUILD_SHIPPING
+	UE_LOG( AlexandriaLog, Warning, TEXT( "LucidityBenchmark: per phase timing is compiled out of shipping builds" ) );
+#endif
+
+	UWorld* World = CreateWorld( MapName );
+	if (World == nullptr)
+	{
+		UE_LOG( AlexandriaLog, Error, TEXT( "LucidityBenchmark: could not load map %s" ), *MapName );
+		return 1;
+	}
+
+	TSharedRef<FJsonObject> Report = MakeShareable( new FJsonObject() );
+	TArray<TSharedPtr<FJsonValue>> Runs;
+	if (FParse::Param( *Params, TEXT( "Convergence" ) ))
+	{
+		Report->SetObjectField( TEXT( "convergence" ), RunConvergence( World, RayCounts ) );
+	}
+	else
+	{
+		for (const int32 NumAgents : AgentCounts)
+		{
+			for (const int32 RaysPerTick : RayCounts)
+			{
+				Runs.Add( MakeShareable( new FJsonValueObject( RunConfiguration( World, NumAgents, RaysPerTick ) ) ) );
+			}
+		}
+	}
+
+	Report->SetStringField( TEXT( "map" ), MapName.IsEmpty() ? TEXT( "synthetic" ) : MapName );
+	Report->SetNumberField( TEXT( "frames" ), Frames );
+	Report->SetNumberField( TEXT( "deltaSeconds" ), DeltaSeconds );
+	Report->SetBoolField( TEXT( "decoupled" ), bDecoupled );
+	Report->SetBoolField( TEXT( "batched" ), FLucidityManager::IsBatchingEnabled() );
+	Report->SetNumberField( TEXT( "traceBudget" ), IConsoleManager::Get().FindConsoleVariable( TEXT( "lucidity.TraceBudget" ) )->GetInt() );
+	Report->SetBoolField( TEXT( "cosmetics" ), AAlexandriaCharacter::ShouldCreateCosmetics() );
+	Report->SetArrayField( TEXT( "runs" ), Runs );
+
+	FString Json;
+	TSharedRef<TJsonWriter<>> Writer = TJsonWriterFactory<>::Create( &Json );
+	FJsonSerializer::Serialize( Report, Writer );
+
+	GEngine->DestroyWorldContext( World );
+	World->DestroyWorld( false );
+
+	if (!FFileHelper::SaveStringToFile( Json, *OutputPath ))
+	{
+		UE_LOG( AlexandriaLog, Error, TEXT( "LucidityBenchmark: could not write %s" ), *OutputPath );
+		return 1;
+	}
+	UE_LOG( AlexandriaLog, Display, TEXT( "LucidityBenchmark: wrote %s" ), *OutputPath );
+	return 0;
+}
+
+UWorld* ULucidityBenchmarkCommandlet::CreateWorld( const FString &MapName ) const
+{
+	UWorld* World = nullptr;
+	if (MapName.IsEmpty())
+	{
+		World = UWorld::CreateWorld( EWorldType::Game, false, TEXT( "LucidityBenchmark" ) );
+		BuildSyntheticOccluders( World );
+	}
+	else
+	{
+		UPackage* Package = LoadPackage( nullptr, *MapName, LOAD_None );
+		World = (Package != nullptr) ? UWorld::FindWorldInPackage( Package ) : nullptr;
+		if (World == nullptr)
+		{
+			return nullptr;
+		}
+		World->WorldType = EWorldType::Game;
+		if (!World->bIsWorldInitialized)
+		{
+			UWorld::InitializationValues IVS;
+			IVS.RequiresHitProxies( false )
+				.ShouldSimulatePhysics( false )
+				.EnableTraceCollision( true )
+				.CreateNavigation( false )
+				.CreateAISystem( false )
+				.AllowAudioPlayback( false )
+				.CreatePhysicsScene( true );
+			World->InitWorld( IVS );
+		}
+	}
+	World->AddToRoot();
+
+	FWorldContext &Context = GEngine->CreateNewWorldContext( EWorldType::Game );
+	Context.SetCurrentWorld( World );
+
+	// No game mode or players here, begin play on the actors directly
+	World->InitializeActorsForPlay( FURL() );
+	World->GetWorldSettings()->NotifyBeginPlay();
+	return World;
+}
+
+void ULucidityBenchmarkCommandlet::BuildSyntheticOccluders( UWorld* World ) const
+{
+	using namespace LucidityBenchmark;
+
+	ADirectionalLight* Sun = World->SpawnActor<ADirectionalLight>( FVector( 0.f, 0.f, 5000.f ), FRotator( -45.f, 30.f, 0.f ) );
+	Sun->GetLightComponent()->SetIntensity( 10.f );
+
+	UStaticMesh* Cube = LoadObject<UStaticMesh>( nullptr, TEXT( "/Engine/BasicShapes/Cube.Cube" ) );
+	if (Cube == nullptr)
+	{
+		UE_LOG( AlexandriaLog, Warning, TEXT( "LucidityBenchmark: no cube mesh, the synthetic map has no occluders" ) );
+		return;
+	}
+
+	const float HalfExtent = OccluderGrid*OccluderSpacing*0.5f;
+	auto SpawnBox = [World, Cube]( const FVector &Location, const FVector &Scale )
+	{
+		AStaticMeshActor* Box = World->SpawnActor<AStaticMeshActor>( Location, FRotator::ZeroRotator );
+		Box->GetStaticMeshComponent()->SetStaticMesh( Cube );
+		Box->SetActorScale3D( Scale );
+	};
+
+	// The basic cube is 100 units on a side
+	SpawnBox( FVector( 0.f, 0.f, -50.f ), FVector( HalfExtent*2.f / 100.f, HalfExtent*2.f / 100.f, 1.f ) );
+
+	FRandomStream Random( 1234 );
+	for (int32 Y = 0; Y < OccluderGrid; Y++)
+	{
+		for (int32 X = 0; X < OccluderGrid; X++)
+		{
+			const float Height = Random.FRandRange( 100.f, 1200.f );
+			const FVector Location( X*OccluderSpacing - HalfExtent, Y*OccluderSpacing - HalfExtent, Height*0.5f );
+			SpawnBox( Location, FVector( Random.FRandRange( 1.f, 3.f ), Random.FRandRange( 1.f, 3.f ), Height / 100.f ) );
+		}
+	}
+}
+
+void ULucidityBenchmarkCommandlet::TickWorld( UWorld* World ) const
+{
+	++GFrameCounter;
+	World->Tick( LEVELTICK_All, DeltaSeconds );
+	FTickableGameObject::TickObjects( World, LEVELTICK_All, false, DeltaSeconds );
+}
+
+TSharedRef<FJsonObject> ULucidityBenchmarkCommandlet::RunConfiguration( UWorld* World, const int32 NumAgents, const int32 RaysPerTick ) const
+{
+	using namespace LucidityBenchmark;
+
+	// The game's lucid character, so agents carry the blueprint's components and materials
+	UClass* AgentClass = AAlexandriaCharacter::StaticClass();
+	const AAlexandriaGameMode* GameModeCDO = GetDefault<AAlexandriaGameMode>();
+	if ((GameModeCDO->DefaultPawnClass != nullptr) && GameModeCDO->DefaultPawnClass->IsChildOf( AAlexandriaCharacter::StaticClass() ))
+	{
+		AgentClass = GameModeCDO->DefaultPawnClass;
+	}
+
+	const int32 Columns = FMath::CeilToInt( FMath::Sqrt( (float)NumAgents ) );
+	const float GridOffset = (Columns - 1)*AgentSpacing*0.5f;
+	TArray<AAlexandriaCharacter*> Agents;
+	TArray<FVector> Centres;
+	for (int32 i = 0; i < NumAgents; i++)
+	{
+		const FVector Centre( (i % Columns)*AgentSpacing - GridOffset, (i / Columns)*AgentSpacing - GridOffset, 100.f );
+		AAlexandriaCharacter* Agent = World->SpawnActorDeferred<AAlexandriaCharacter>( AgentClass, FTransform( Centre ), nullptr, nullptr, ESpawnActorCollisionHandlingMethod::AlwaysSpawn );
+		if (Agent == nullptr)
+		{
+			continue;
+		}
+		Agent->bDecoupledLucidityTick = bDecoupled;
+		Agent->SunRaysPerTick = RaysPerTick;
+		Agent->FinishSpawning( FTransform( Centre ) );
+		Agents.Add( Agent );
+		Centres.Add( Centre );
+	}
+
+	// No players are logged in here, a bare controller gives CalcViewSignificance a view to measure from
+	const FVector ViewLocation( -GridOffset - ViewStandoff, 0.f, ViewHeight );
+	FActorSpawnParameters ViewParams;
+	ViewParams.SpawnCollisionHandlingOverride = ESpawnActorCollisionHandlingMethod::AlwaysSpawn;
+	APlayerController* View = World->SpawnActor<APlayerController>( ViewLocation, FRotator::ZeroRotator, ViewParams );
+
+	int64 AgentBytes = 0;
+	for (AAlexandriaCharacter* Agent : Agents)
+	{
+		AgentBytes += GetAgentBytes( Agent );
+	}
+
+	const int32 NumStanding = FMath::RoundToInt( StandingFraction*Agents.Num() );
+	TArray<double> FrameSeconds;
+	FrameSeconds.Reserve( Frames );
+	float Time = 0.f;
+	for (int32 Frame = -WarmupFrames; Frame < Frames; Frame++)
+	{
+#if !UE_BUILD_SHIPPING
+		if (Frame == 0)
+		{
+			FLucidityProfile::Reset();
+			FLucidityProfile::bCapturing = true;
+		}
+#endif
+		// Scripted movement, each agent walks its own circle unless it is one of the standing ones
+		Time += DeltaSeconds;
+		for (int32 i = NumStanding; i < Agents.Num(); i++)
+		{
+			const float Angle = Time + i*0.37f;
+			Agents[i]->SetActorLocation( Centres[i] + FVector( FMath::Cos( Angle ), FMath::Sin( Angle ), 0.f )*AgentPathRadius );
+		}
+
+		const double StartTime = FPlatformTime::Seconds();
+		TickWorld( World );
+		if (Frame >= 0)
+		{
+			FrameSeconds.Add( FPlatformTime::Seconds() - StartTime );
+		}
+	}
+
+	TSharedRef<FJsonObject> Run = MakeShareable( new FJsonObject() );
+	Run->SetNumberField( TEXT( "agents" ), Agents.Num() );
+	Run->SetNumberField( TEXT( "sunRaysPerTick" ), RaysPerTick );
+	Run->SetNumberField( TEXT( "standing" ), NumStanding );
+	Run->SetNumberField( TEXT( "bytesPerAgent" ), (Agents.Num() > 0) ? (double)AgentBytes / Agents.Num() : 0.0 );
+
+	double TotalSeconds = 0.0;
+	for (const double Seconds : FrameSeconds)
+	{
+		TotalSeconds += Seconds;
+	}
+	FrameSeconds.Sort();
+	TSharedRef<FJsonObject> FrameCost = MakeShareable( new FJsonObject() );
+	FrameCost->SetNumberField( TEXT( "mean" ), TotalSeconds*1000.0 / FrameSeconds.Num() );
+	FrameCost->SetNumberField( TEXT( "p50" ), Percentile( FrameSeconds, 0.5f )*1000.0 );
+	FrameCost->SetNumberField( TEXT( "p99" ), Percentile( FrameSeconds, 0.99f )*1000.0 );
+	Run->SetObjectField( TEXT( "frameMs" ), FrameCost );
+	Run->SetObjectField( TEXT( "radianceLod" ), GetRadianceLodReport( Agents ) );
+
+#if !UE_BUILD_SHIPPING
+	FLucidityProfile::bCapturing = false;
+
+	// Microseconds per agent per frame
+	const double PhaseScale = FPlatformTime::GetSecondsPerCycle()*1000000.0 / FMath::Max( Agents.Num()*Frames, 1 );
+	TSharedRef<FJsonObject> Phases = MakeShareable( new FJsonObject() );
+	for (int32 Phase = 0; Phase < FLucidityProfile::NumPhases; Phase++)
+	{
+		Phases->SetNumberField( FLucidityProfile::GetPhaseName( (FLucidityProfile::EPhase)Phase ), FLucidityProfile::PhaseCycles[Phase]*PhaseScale );
+	}
+	Run->SetObjectField( TEXT( "phaseUsPerAgentFrame" ), Phases );
+
+	// Per second of game time, the rate the game would issue them at
+	Run->SetNumberField( TEXT( "tracesPerSecond" ), FLucidityProfile::Traces / (Frames*DeltaSeconds) );
+	Run->SetNumberField( TEXT( "tracesPerFrame" ), (double)FLucidityProfile::Traces / Frames );
+	// Share of traced sun updates that reused their visibility instead
+	Run->SetNumberField( TEXT( "sunTraceSkipRate" ), (FLucidityProfile::SunVisibilityLookups > 0) ?
+		(double)FLucidityProfile::SunVisibilityHits / FLucidityProfile::SunVisibilityLookups : 0.0 );
+#endif
+
+	UE_LOG( AlexandriaLog, Display, TEXT( "LucidityBenchmark: %d agents, %d rays, p50 %.3f ms, p99 %.3f ms" ),
+		Agents.Num(), RaysPerTick, Percentile( FrameSeconds, 0.5f )*1000.0, Percentile( FrameSeconds, 0.99f )*1000.0 );
+
+	for (AAlexandriaCharacter* Agent : Agents)
+	{
+		Agent->Destroy();
+	}
+	if (View != nullptr)
+	{
+		View->Destroy();
+	}
+	TickWorld( World );
+	return Run;
+}
+
+TSharedRef<FJsonObject> ULucidityBenchmarkCommandlet::RunConvergence( UWorld* World, const TArray<int32> &RayCounts ) const
+{
+	using namespace LucidityBenchmark;
+	TSharedRef<FJsonObject> Report = MakeShareable( new FJsonObject() );
+
+	const ADirectionalLight* Sun = nullptr;
+	for (TActorIterator<ADirectionalLight> It( World ); It; ++It)
+	{
+		Sun = *It;
+		break;
+	}
+	if (Sun == nullptr)
+	{
+		UE_LOG( AlexandriaLog, Warning, TEXT( "LucidityBenchmark: no directional light to measure convergence under" ) );
+		return Report;
+	}
+	const FVector SunDirection = FLucidSunState::Gather( Sun ).Direction;
+
+	// The occluders the characters trace
+	FLucidOccluders* Occluders = FLucidOccluders::Get( World );
+	if (Occluders != nullptr)
+	{
+		Occluders->WaitForLoads();
+	}
+	const FLucidTraceSetup Setup = FLucidOccluders::GetTraceSetup( World );
+	const FCollisionQueryParams QueryParams( FName( TEXT( "LucidityBenchmark" ) ), Setup.bTraceComplex );
+	auto IsLit = [&]( const FVector &Point )
+	{
+		return !World->LineTraceTestByChannel( Point - SunDirection*ConvergenceTraceLength, Point, Setup.Channel, QueryParams, Setup.Response );
+	};
+
+	const int32 Columns = FMath::CeilToInt( FMath::Sqrt( (float)ConvergencePoints ) );
+	const float GridOffset = (Columns - 1)*AgentSpacing*0.5f;
+	const int32 ReferenceRays = ReferenceGrid*ReferenceGrid*ReferenceGrid;
+	FRandomStream Random( 0x4C756369 );
+
+	for (const bool bWalking : { false, true })
+	{
+		// Squared error against the reference, per ray count
+		TArray<double> IndependentError;
+		TArray<double> TemporalError;
+		IndependentError.SetNumZeroed( RayCounts.Num() );
+		TemporalError.SetNumZeroed( RayCounts.Num() );
+		int64 NumTicks = 0;
+
+		for (int32 Point = 0; Point < ConvergencePoints; Point++)
+		{
+			const FVector Centre( (Point % Columns)*AgentSpacing - GridOffset, (Point / Columns)*AgentSpacing - GridOffset, 100.f );
+			TArray<FLucidExposureSampler> Samplers;
+			Samplers.SetNum( RayCounts.Num() );
+			for (FLucidExposureSampler &Sampler : Samplers)
+			{
+				Sampler.SetPollVolume( PollMin, PollMax );
+			}
+
+			for (int32 Tick = -WarmupFrames; Tick < Frames; Tick++)
+			{
+				// Walking points follow the same circles as the benchmark's agents
+				const float Angle = (Tick + WarmupFrames)*DeltaSeconds + Point*0.37f;
+				const FVector Location = bWalking ? Centre + FVector( FMath::Cos( Angle ), FMath::Sin( Angle ), 0.f )*AgentPathRadius : Centre;
+
+				int32 ReferenceLit = 0;
+				for (int32 i = 0; i < ReferenceRays; i++)
+				{
+					const FVector Cell( (i % ReferenceGrid + 0.5f) / ReferenceGrid, ((i / ReferenceGrid) % ReferenceGrid + 0.5f) / ReferenceGrid, (i / (ReferenceGrid*ReferenceGrid) + 0.5f) / ReferenceGrid );
+					ReferenceLit += IsLit( Location + PollMin + Cell*(PollMax - PollMin) ) ? 1 : 0;
+				}
+				const double Reference = (double)ReferenceLit / ReferenceRays;
+
+				for (int32 Run = 0; Run < RayCounts.Num(); Run++)
+				{
+					const int32 RaysPerTick = RayCounts[Run];
+
+					// A fresh set of uniformly jittered rays every tick
+					int32 IndependentLit = 0;
+					for (int32 Ray = 0; Ray < RaysPerTick; Ray++)
+					{
+						const FVector Offset( Random.FRandRange( PollMin.X, PollMax.X ), Random.FRandRange( PollMin.Y, PollMax.Y ), Random.FRandRange( PollMin.Z, PollMax.Z ) );
+						IndependentLit += IsLit( Location + Offset ) ? 1 : 0;
+					}
+					const double Independent = (double)IndependentLit / RaysPerTick;
+
+					FLucidExposureSampler &Sampler = Samplers[Run];
+					Sampler.Validate( Location, SunDirection );
+					float TickVisibility = 0.f;
+					for (int32 Ray = 0; Ray < RaysPerTick; Ray++)
+					{
+						int32 Stratum = INDEX_NONE;
+						const float Lit = IsLit( Location + Sampler.NextOffset( Stratum ) ) ? 1.f : 0.f;
+						Sampler.AddSample( Stratum, Lit );
+						TickVisibility += Lit / RaysPerTick;
+					}
+					const double Temporal = Sampler.GetExposure( TickVisibility );
+
+					if (Tick >= 0)
+					{
+						IndependentError[Run] += FMath::Square( Independent - Reference );
+						TemporalError[Run] += FMath::Square( Temporal - Reference );
+					}
+				}
+				NumTicks += (Tick >= 0) ? 1 : 0;
+			}
+		}
+
+		TArray<TSharedPtr<FJsonValue>> Entries;
+		for (int32 Run = 0; Run < RayCounts.Num(); Run++)
+		{
+			const double IndependentRmse = FMath::Sqrt( IndependentError[Run] / FMath::Max<int64>( NumTicks, 1 ) );
+			const double TemporalRmse = FMath::Sqrt( TemporalError[Run] / FMath::Max<int64>( NumTicks, 1 ) );
+			TSharedRef<FJsonObject> Entry = MakeShareable( new FJsonObject() );
+			Entry->SetNumberField( TEXT( "sunRaysPerTick" ), RayCounts[Run] );
+			Entry->SetNumberField( TEXT( "independentRmse" ), IndependentRmse );
+			Entry->SetNumberField( TEXT( "temporalRmse" ), TemporalRmse );
+			Entries.Add( MakeShareable( new FJsonValueObject( Entry ) ) );
+			UE_LOG( AlexandriaLog, Display, TEXT( "LucidityBenchmark: %s, %d rays, visibility RMSE %.4f independent, %.4f temporal" ),
+				bWalking ? TEXT( "walking" ) : TEXT( "standing" ), RayCounts[Run], IndependentRmse, TemporalRmse );
+		}
+		Report->SetArrayField( bWalking ? TEXT( "walking" ) : TEXT( "standing" ), Entries );
+	}
+	Report->SetNumberField( TEXT( "points" ), ConvergencePoints );
+	Report->SetNumberField( TEXT( "referenceRays" ), ReferenceRays );
+	Report->SetNumberField( TEXT( "walkSpeed" ), AgentPathRadius );
+	return Report;
+}
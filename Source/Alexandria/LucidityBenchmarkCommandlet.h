@@ -0,0 +1,51 @@
+// Copyright 1998-2017 Epic Games, Inc. All Rights Reserved.
+#pragma once
+#include "Commandlets/Commandlet.h"
+#include "LucidityBenchmarkCommandlet.generated.h"
+
+class AAlexandriaCharacter;
+
+/**
+ * Measures what lucid characters cost without a GPU, sweeping the character count and sun rays per tick.
+ *
+ * Usage: -run=LucidityBenchmark -nullrhi [-Map=/Game/Alexandria/Alexandria_Geo] [-Agents=1,4,16,64,256]
+ *        [-Rays=1,2,4] [-Frames=300] [-Warmup=30] [-Decoupled] [-Standing=0] [-Convergence] [-Output=<file.json>]
+ * Without -Map a synthetic field of box occluders under a single sun is built. Characters walk scripted
+ * circles and update Lucidity every frame unless -Decoupled keeps their significance scheduling. -Standing keeps
+ * that fraction of them still, as readers in the reading room are, against the walk along the colonnade, and
+ * each run reports how often reused sun visibility skipped the sun rays.
+ * The JSON report goes to Saved/Lucidity by default. Headless runs strip the radiance cosmetics, add
+ * -LucidCosmetics to keep them and compare per-agent memory and tick time. Each run also reports how many
+ * characters ended at each radiance LOD and the lights, shadows and fires they kept active, as seen from a view
+ * standing back from one edge of the crowd.
+ * -Convergence measures sun visibility error instead: fresh random rays each tick against the temporal exposure
+ * sampler, both against a dense reference, for points standing still and walking, at each -Rays count.
+ */
+UCLASS()
+class ULucidityBenchmarkCommandlet : public UCommandlet
+{
+	GENERATED_BODY()
+
+public:
+	ULucidityBenchmarkCommandlet();
+
+	virtual int32 Main( const FString &Params ) override;
+
+private:
+	UWorld* CreateWorld( const FString &MapName ) const;
+	void BuildSyntheticOccluders( UWorld* World ) const;
+
+	/** Runs one configuration and returns its report entry */
+	TSharedRef<class FJsonObject> RunConfiguration( UWorld* World, const int32 NumAgents, const int32 RaysPerTick ) const;
+
+	/** Sun visibility error of independent and temporally accumulated rays at each ray count */
+	TSharedRef<class FJsonObject> RunConvergence( UWorld* World, const TArray<int32> &RayCounts ) const;
+
+	void TickWorld( UWorld* World ) const;
+
+	int32 Frames;
+	int32 WarmupFrames;
+	float DeltaSeconds;
+	bool bDecoupled;
+	float StandingFraction;
+};
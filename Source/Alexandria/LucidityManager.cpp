@@ -0,0 +1,335 @@
+// Copyright 1998-2017 Epic Games, Inc. All Rights Reserved.
+
+#include "Alexandria.h"
+#include "LucidityManager.h"
+#include "AlexandriaCharacter.h"
+#include "AlexandriaGameMode.h"
+#include "Runtime/Engine/Classes/Engine/DirectionalLight.h"
+#include "LucidityStats.h"
+#include "LucidOccluders.h"
+#include "Async/ParallelFor.h"
+
+namespace LucidityManager
+{
+	static TAutoConsoleVariable<int32> CVarBatch(
+		TEXT( "lucidity.Batch" ),
+		0,
+		TEXT( "Update lucid characters together from one world-level pass instead of per-character ticks.\n" )
+		TEXT( "Only affects characters that begin play after it is changed." ),
+		ECVF_Default );
+
+	// Below this many rays the task overhead outweighs tracing them in parallel
+	static const int32 MinParallelRays = 16;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// FLucidityBatch
+
+void FLucidityBatch::AddAgent( AAlexandriaCharacter* Agent )
+{
+	Agents.AddUnique( Agent );
+}
+
+void FLucidityBatch::RemoveAgent( AAlexandriaCharacter* Agent )
+{
+	Agents.RemoveSwap( Agent );
+}
+
+int32 FLucidityBatch::Update( const float Now, const float DeltaSeconds, const bool bForce )
+{
+	SCOPE_CYCLE_COUNTER( STAT_LucidBatchUpdate );
+	Agents.RemoveAllSwap( []( const TWeakObjectPtr<AAlexandriaCharacter> &Agent ) { return !Agent.IsValid(); } );
+	Active.Reset();
+	Elapsed.Reset();
+	Lucidity.Reset();
+	TickLucidity.Reset();
+	MaxDeltaLucidity.Reset();
+	AbsorbVelocity.Reset();
+	ConsumeVelocity.Reset();
+	InnerRadianceDecayTime.Reset();
+	InnerRadiance.Reset();
+	TimeSinceLastUptick.Reset();
+	SunScale.Reset();
+	FirstRay.Reset();
+	NumRays.Reset();
+	Rays.Reset();
+	RayOwners.Reset();
+
+	// Gather: exposure that needs no sun rays, and the rays themselves
+	TSharedPtr<const FLucidLightingFrame, ESPMode::ThreadSafe> Lighting;
+	for (const TWeakObjectPtr<AAlexandriaCharacter> &AgentPtr : Agents)
+	{
+		AAlexandriaCharacter* Agent = AgentPtr.Get();
+		if ((Agent == nullptr) || Agent->IsPendingKill() || (!bForce && !Agent->IsLucidityDue( Now )))
+		{
+			continue;
+		}
+		if (!Agent->AcquireLucidityTraces( Now, bForce ))
+		{
+			continue;
+		}
+		const float Step = Agent->BeginLucidityUpdate( Now, DeltaSeconds );
+		if (Step <= 0.f)
+		{
+			continue;
+		}
+
+		const int32 AgentIndex = Active.Add( Agent );
+		const int32 RayStart = Rays.Num();
+		float Scale = 0.f;
+		if (!Lighting.IsValid())
+		{
+			Lighting = Agent->GetLightingFrame();
+		}
+		TickLucidity.Add( Agent->GatherBatchedExposure( Lighting->FindSun( Agent->GetSun() ), Rays, Scale ) );
+		SunScale.Add( Scale );
+		FirstRay.Add( RayStart );
+		NumRays.Add( Rays.Num() - RayStart );
+		for (int32 i = RayStart; i < Rays.Num(); i++)
+		{
+			RayOwners.Add( AgentIndex );
+		}
+
+		Elapsed.Add( Step );
+		Lucidity.Add( Agent->Lucidity );
+		MaxDeltaLucidity.Add( Agent->SunIntensity*Step / Agent->BaseSunIntensity );
+		AbsorbVelocity.Add( Agent->AbsorbVelocity );
+		ConsumeVelocity.Add( Agent->ConsumeVelocity );
+		InnerRadianceDecayTime.Add( Agent->InnerRadianceDecayTime );
+		InnerRadiance.Add( Agent->HasInnerRadiance() );
+		TimeSinceLastUptick.Add( Agent->TimeSinceLastUptick );
+	}
+
+	const int32 NumActive = Active.Num();
+	if (NumActive == 0)
+	{
+		return 0;
+	}
+
+	// Trace every sun ray of the batch in one pass, a packet at a time. Rays of agents clear of movable
+	// occluders share BVH packets whoever owns them, the rest are scene queries, both are read only
+	RayLit.SetNumUninitialized( Rays.Num() );
+	FLucidityProfile::AddTraces( Rays.Num() );
+	const FLucidOccluders* Occluders = FLucidOccluders::Get( Active[0]->GetWorld() );
+	const int32 PacketSize = FLucidOccluderBvh::PacketSize;
+	const int32 NumPackets = (Rays.Num() + PacketSize - 1) / PacketSize;
+	ParallelFor( NumPackets, [this, Occluders, PacketSize]( int32 Packet )
+	{
+		const int32 First = Packet*PacketSize;
+		const int32 Count = FMath::Min( Rays.Num() - First, PacketSize );
+		uint32 BvhLanes = 0;
+		for (int32 Lane = 0; Lane < Count; Lane++)
+		{
+			if (Active[RayOwners[First + Lane]]->bSunRaysOnBvh)
+			{
+				BvhLanes |= 1u << Lane;
+			}
+			else
+			{
+				RayLit[First + Lane] = Active[RayOwners[First + Lane]]->TraceSunRay( Rays[First + Lane] );
+			}
+		}
+		if (BvhLanes != 0)
+		{
+			const uint32 Blocked = Occluders->TracePacket( Rays.GetData() + First, Count, BvhLanes );
+			for (int32 Lane = 0; Lane < Count; Lane++)
+			{
+				if (BvhLanes & (1u << Lane))
+				{
+					RayLit[First + Lane] = !(Blocked & (1u << Lane));
+				}
+			}
+		}
+	}, Rays.Num() < LucidityManager::MinParallelRays );
+
+	// Fold ray results into each agent's exposure history
+	for (int32 i = 0; i < NumActive; i++)
+	{
+		if (SunScale[i] > 0.f)
+		{
+			TickLucidity[i] += SunScale[i]*Active[i]->ResolveSunRays( Rays.GetData() + FirstRay[i], RayLit.GetData() + FirstRay[i], NumRays[i] );
+		}
+	}
+
+	// Integrate over the packed arrays
+	LucidIntegration::FAgentArrays Packed;
+	Packed.Lucidity = Lucidity.GetData();
+	Packed.TickLucidity = TickLucidity.GetData();
+	Packed.MaxDeltaLucidity = MaxDeltaLucidity.GetData();
+	Packed.AbsorbVelocity = AbsorbVelocity.GetData();
+	Packed.ConsumeVelocity = ConsumeVelocity.GetData();
+	Packed.InnerRadianceDecayTime = InnerRadianceDecayTime.GetData();
+	Packed.InnerRadiance = InnerRadiance.GetData();
+	Packed.TimeSinceLastUptick = TimeSinceLastUptick.GetData();
+	LucidIntegration::StepAgents( Packed, NumActive );
+
+	// Scatter results back
+	for (int32 i = 0; i < NumActive; i++)
+	{
+		AAlexandriaCharacter* Agent = Active[i];
+		Agent->TimeSinceLastUptick = TimeSinceLastUptick[i];
+		Agent->LastTickLucidity = TickLucidity[i];
+		Agent->FinishLucidityUpdate( Lucidity[i], Elapsed[i] );
+	}
+	return NumActive;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// FLucidityManager
+
+FLucidityManager::FLucidityManager( UWorld* InWorld ) :
+	World( InWorld ),
+	LastTickFrame( 0 ),
+	LastTickTime( 0.0 )
+{
+}
+
+FLucidityManager* FLucidityManager::Get( UWorld* World )
+{
+	return TLucidPerWorld<FLucidityManager>::Get( World );
+}
+
+FLucidityManager* FLucidityManager::Find( const UWorld* World )
+{
+	return TLucidPerWorld<FLucidityManager>::Find( World );
+}
+
+bool FLucidityManager::IsBatchingEnabled()
+{
+	return LucidityManager::CVarBatch.GetValueOnGameThread() != 0;
+}
+
+bool FLucidityManager::IsTickable() const
+{
+	// Unbatched characters still draw on the trace budget, which is refilled here
+	return World.IsValid();
+}
+
+void FLucidityManager::Tick( float DeltaTime )
+{
+	if (LastTickFrame == GFrameCounter)
+	{
+		return;
+	}
+	LastTickFrame = GFrameCounter;
+
+	// Wall clock frame time, the game clock may be dilated or clamped
+	const double Now = FPlatformTime::Seconds();
+	const float FrameSeconds = (LastTickTime > 0.0) ? (float)(Now - LastTickTime) : DeltaTime;
+	LastTickTime = Now;
+
+	UWorld* TickWorld = World.Get();
+	if (TickWorld->IsPaused())
+	{
+		return;
+	}
+	if (Batch.Num() > 0)
+	{
+		Batch.Update( TickWorld->GetTimeSeconds(), TickWorld->GetDeltaSeconds(), false );
+	}
+
+	// Characters ticked earlier this frame and the batch above have made their requests
+	TraceScheduler.EndFrame( FrameSeconds );
+}
+
+TStatId FLucidityManager::GetStatId() const
+{
+	RETURN_QUICK_DECLARE_CYCLE_STAT( FLucidityManager, STATGROUP_Tickables );
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Lucidity.BenchmarkBatch
+
+namespace LucidityManager
+{
+	static void BenchmarkBatch( const TArray<FString> &Args, UWorld* World )
+	{
+		if ((World == nullptr) || !World->IsGameWorld())
+		{
+			UE_LOG( AlexandriaLog, Warning, TEXT( "Lucidity.BenchmarkBatch needs a game world" ) );
+			return;
+		}
+
+		const int32 MaxAgents = (Args.Num() > 0) ? FMath::Clamp( FCString::Atoi( *Args[0] ), 1, 1024 ) : 256;
+		const int32 Iterations = (Args.Num() > 1) ? FMath::Max( FCString::Atoi( *Args[1] ), 1 ) : 32;
+
+		// Spawn the game's lucid character class so the agents carry their components
+		UClass* AgentClass = AAlexandriaCharacter::StaticClass();
+		AGameModeBase* GameMode = World->GetAuthGameMode();
+		if ((GameMode != nullptr) && (GameMode->DefaultPawnClass != nullptr) && GameMode->DefaultPawnClass->IsChildOf( AAlexandriaCharacter::StaticClass() ))
+		{
+			AgentClass = GameMode->DefaultPawnClass;
+		}
+
+		APlayerController* PlayerController = World->GetFirstPlayerController();
+		const FVector Origin = ((PlayerController != nullptr) && (PlayerController->GetPawn() != nullptr)) ? PlayerController->GetPawn()->GetActorLocation() : FVector::ZeroVector;
+
+		FActorSpawnParameters SpawnParams;
+		SpawnParams.SpawnCollisionHandlingOverride = ESpawnActorCollisionHandlingMethod::AlwaysSpawn;
+
+		TArray<AAlexandriaCharacter*> Spawned;
+		const int32 Columns = FMath::CeilToInt( FMath::Sqrt( (float)MaxAgents ) );
+		for (int32 i = 0; i < MaxAgents; i++)
+		{
+			const FVector Location = Origin + FVector( (i % Columns)*150.f, (i / Columns)*150.f, 0.f );
+			AAlexandriaCharacter* Agent = World->SpawnActor<AAlexandriaCharacter>( AgentClass, Location, FRotator::ZeroRotator, SpawnParams );
+			if (Agent != nullptr)
+			{
+				// Keep the agents out of the world's own batch while measuring
+				FLucidityManager* Manager = FLucidityManager::Find( World );
+				if (Manager != nullptr)
+				{
+					Manager->RemoveAgent( Agent );
+				}
+				Spawned.Add( Agent );
+			}
+		}
+
+		UE_LOG( AlexandriaLog, Log, TEXT( "Lucidity.BenchmarkBatch: %d iterations" ), Iterations );
+		UE_LOG( AlexandriaLog, Log, TEXT( "%8s %16s %16s" ), TEXT( "Agents" ), TEXT( "Single us/agent" ), TEXT( "Batched us/agent" ) );
+
+		// Agents skip updates that take no time, so run on a clock of our own
+		const float DeltaSeconds = 1.f / 30.f;
+		float Now = World->GetTimeSeconds();
+		for (int32 Count = 1; Count <= Spawned.Num(); Count *= 2)
+		{
+			// Per character path, as LucidityTick would run it
+			const double SingleStart = FPlatformTime::Seconds();
+			for (int32 Iteration = 0; Iteration < Iterations; Iteration++)
+			{
+				for (int32 i = 0; i < Count; i++)
+				{
+					Spawned[i]->UpdateLucidity( Now, DeltaSeconds, true );
+				}
+				Now += DeltaSeconds;
+			}
+			const double SingleTime = FPlatformTime::Seconds() - SingleStart;
+
+			FLucidityBatch Batch;
+			for (int32 i = 0; i < Count; i++)
+			{
+				Batch.AddAgent( Spawned[i] );
+			}
+			const double BatchStart = FPlatformTime::Seconds();
+			for (int32 Iteration = 0; Iteration < Iterations; Iteration++)
+			{
+				Batch.Update( Now, DeltaSeconds, true );
+				Now += DeltaSeconds;
+			}
+			const double BatchTime = FPlatformTime::Seconds() - BatchStart;
+
+			const double Scale = 1000000.0 / ((double)Count*Iterations);
+			UE_LOG( AlexandriaLog, Log, TEXT( "%8d %16.2f %16.2f" ), Count, SingleTime*Scale, BatchTime*Scale );
+		}
+
+		for (AAlexandriaCharacter* Agent : Spawned)
+		{
+			Agent->Destroy();
+		}
+	}
+
+	static FAutoConsoleCommandWithWorldAndArgs BenchmarkBatchCommand(
+		TEXT( "Lucidity.BenchmarkBatch" ),
+		TEXT( "Times per-character against batched Lucidity updates for 1 to N agents. Usage: Lucidity.BenchmarkBatch [N=256] [Iterations=32]" ),
+		FConsoleCommandWithWorldAndArgsDelegate::CreateStatic( &BenchmarkBatch ) );
+}
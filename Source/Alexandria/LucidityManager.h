@@ -0,0 +1,100 @@
+// Copyright 1998-2017 Epic Games, Inc. All Rights Reserved.
+#pragma once
+
+#include "Tickable.h"
+#include "LucidityTypes.h"
+#include "LucidTraceScheduler.h"
+#include "LucidPerWorld.h"
+
+class AAlexandriaCharacter;
+class ADirectionalLight;
+
+/**
+ * One batched Lucidity update over a set of characters.
+ * Sun state comes from the world's lighting snapshot, exposure is gathered per character, every sun ray of the
+ * batch is traced in one parallel pass, and the integration step runs over packed arrays.
+ */
+class FLucidityBatch
+{
+public:
+	void AddAgent( AAlexandriaCharacter* Agent );
+	void RemoveAgent( AAlexandriaCharacter* Agent );
+
+	/**
+	 * Updates every agent whose Lucidity interval has elapsed and that the trace budget admits,
+	 * or all of them with unbudgeted rays if bForce.
+	 * @return number of agents updated
+	 */
+	int32 Update( const float Now, const float DeltaSeconds, const bool bForce );
+
+	FORCEINLINE int32 Num() const { return Agents.Num(); }
+
+private:
+	// Weak, the batch is not a UObject and must not keep destroyed characters alive or dangling
+	TArray<TWeakObjectPtr<AAlexandriaCharacter>> Agents;
+
+	// Per updated agent, packed for the integration loop
+	TArray<AAlexandriaCharacter*> Active;
+	TArray<float> Elapsed;
+	TArray<float> Lucidity;
+	TArray<float> TickLucidity;
+	TArray<float> MaxDeltaLucidity;
+	TArray<float> AbsorbVelocity;
+	TArray<float> ConsumeVelocity;
+	TArray<float> InnerRadianceDecayTime;
+	TArray<bool> InnerRadiance;
+	TArray<float> TimeSinceLastUptick;
+	TArray<float> SunScale;
+	TArray<int32> FirstRay;
+	TArray<int32> NumRays;
+
+	// Every sun ray of the batch
+	TArray<FLucidSunRay> Rays;
+	TArray<int32> RayOwners;
+	TArray<bool> RayLit;
+};
+
+/**
+ * Per-world owner of the batched Lucidity update, enabled with lucidity.Batch, and of the trace
+ * budget every lucid character draws its rays from.
+ * Batched characters join in BeginPlay instead of registering their own LucidityTick.
+ */
+class FLucidityManager : public FTickableGameObject
+{
+public:
+	/** Returns the manager for World, creating it on first use */
+	static FLucidityManager* Get( UWorld* World );
+
+	/** Returns the manager for World if one exists */
+	static FLucidityManager* Find( const UWorld* World );
+
+	static bool IsBatchingEnabled();
+
+	FORCEINLINE void AddAgent( AAlexandriaCharacter* Agent ) { Batch.AddAgent( Agent ); }
+	FORCEINLINE void RemoveAgent( AAlexandriaCharacter* Agent ) { Batch.RemoveAgent( Agent ); }
+
+	FORCEINLINE FLucidTraceScheduler& GetTraceScheduler() { return TraceScheduler; }
+
+	// FTickableGameObject interface
+	virtual void Tick( float DeltaTime ) override;
+	virtual bool IsTickable() const override;
+	virtual bool IsTickableWhenPaused() const override { return false; }
+	virtual bool IsTickableInEditor() const override { return false; }
+	virtual TStatId GetStatId() const override;
+	// End of FTickableGameObject interface
+
+	~FLucidityManager() {}
+
+private:
+	explicit FLucidityManager( UWorld* InWorld );
+
+	TWeakObjectPtr<UWorld> World;
+	FLucidityBatch Batch;
+	FLucidTraceScheduler TraceScheduler;
+
+	// Tickables are visited once per ticking world, only update on the first visit of a frame
+	uint64 LastTickFrame;
+	double LastTickTime;
+
+	friend class TLucidPerWorld<FLucidityManager>;
+};
@@ -0,0 +1,327 @@
+// Copyright 1998-2017 Epic Games, Inc. All Rights Reserved.
+
+#include "Alexandria.h"
+#include "LucidityRecorder.h"
+#include "AlexandriaCharacter.h"
+#include "AlexandriaGameMode.h"
+
+using namespace LucidRecordFormat;
+
+bool FLucidityRecorder::bRecording = false;
+bool FLucidityRecorder::bOverflowed = false;
+TArray<uint8> FLucidityRecorder::Buffer;
+int32 FLucidityRecorder::Capacity = 0;
+TMap<FObjectKey, uint16> FLucidityRecorder::AgentIds;
+TArray<FLucidityRecorder::FPendingUpdate> FLucidityRecorder::Pending;
+const AAlexandriaCharacter* FLucidityRecorder::LastAgent = nullptr;
+int32 FLucidityRecorder::LastPending = INDEX_NONE;
+int32 FLucidityRecorder::NumUpdates = 0;
+uint64 FLucidityRecorder::RecordCycles = 0;
+
+namespace LucidityRecorder
+{
+	// Time spent in the hooks, reported when the recording stops
+	struct FCostScope
+	{
+		FCostScope( uint64 &InCycles ) :
+			Cycles( InCycles ),
+			StartCycles( FPlatformTime::Cycles() )
+		{}
+		~FCostScope()
+		{
+			Cycles += FPlatformTime::Cycles() - StartCycles;
+		}
+
+		uint64 &Cycles;
+		uint32 StartCycles;
+	};
+
+	static void CopyVector( const FVector &Vector, float* Out )
+	{
+		Out[0] = Vector.X;
+		Out[1] = Vector.Y;
+		Out[2] = Vector.Z;
+	}
+
+	static void Record( const TArray<FString> &Args )
+	{
+		if ((Args.Num() > 0) && (Args[0] == TEXT( "Stop" )))
+		{
+			FLucidityRecorder::Stop( (Args.Num() > 1) ? Args[1] : FLucidityRecorder::GetDefaultPath() );
+			return;
+		}
+		const int32 Megabytes = (Args.Num() > 1) ? FMath::Max( FCString::Atoi( *Args[1] ), 1 ) : 16;
+		FLucidityRecorder::Start( Megabytes*1024*1024 );
+	}
+
+	static FAutoConsoleCommand RecordCommand(
+		TEXT( "Lucidity.Record" ),
+		TEXT( "Lucidity.Record Start [MB=16] records the inputs of every Lucidity update into a buffer of that size.\n" )
+		TEXT( "Lucidity.Record Stop [File] writes it, to Saved/Lucidity by default. Replay with -run=LucidityReplay" ),
+		FConsoleCommandWithArgsDelegate::CreateStatic( &Record ) );
+}
+
+void FLucidityRecorder::Start( const int32 CapacityBytes )
+{
+	Capacity = FMath::Max( CapacityBytes, (int32)sizeof( FHeader ) );
+	Buffer.Empty( Capacity );
+	AgentIds.Reset();
+	Pending.Reset();
+	LastAgent = nullptr;
+	LastPending = INDEX_NONE;
+	NumUpdates = 0;
+	RecordCycles = 0;
+	bOverflowed = false;
+
+	FHeader Header;
+	Header.Magic = Magic;
+	Header.Version = Version;
+	Append( &Header, sizeof( Header ) );
+	bRecording = true;
+	UE_LOG( AlexandriaLog, Display, TEXT( "Lucidity.Record: recording into %d KB" ), Capacity / 1024 );
+}
+
+bool FLucidityRecorder::Stop( const FString &Filename )
+{
+	bRecording = false;
+	if (Buffer.Num() == 0)
+	{
+		UE_LOG( AlexandriaLog, Warning, TEXT( "Lucidity.Record: nothing recorded" ) );
+		return false;
+	}
+
+	const double MicrosecondsPerUpdate = RecordCycles*FPlatformTime::GetSecondsPerCycle()*1000000.0 / FMath::Max( NumUpdates, 1 );
+	UE_LOG( AlexandriaLog, Display, TEXT( "Lucidity.Record: %d updates of %d characters in %.1f KB, %.2f us recording per update%s" ),
+		NumUpdates, AgentIds.Num(), Buffer.Num() / 1024.f, MicrosecondsPerUpdate, bOverflowed ? TEXT( ", stopped early with the buffer full" ) : TEXT( "" ) );
+
+	const bool bSaved = FFileHelper::SaveArrayToFile( Buffer, *Filename );
+	if (bSaved)
+	{
+		UE_LOG( AlexandriaLog, Display, TEXT( "Lucidity.Record: wrote %s" ), *Filename );
+	}
+	else
+	{
+		UE_LOG( AlexandriaLog, Error, TEXT( "Lucidity.Record: could not write %s" ), *Filename );
+	}
+	Buffer.Empty();
+	AgentIds.Reset();
+	Pending.Empty();
+	LastAgent = nullptr;
+	LastPending = INDEX_NONE;
+	return bSaved;
+}
+
+FString FLucidityRecorder::GetDefaultPath()
+{
+	return FPaths::GameSavedDir() / TEXT( "Lucidity" ) / FString::Printf( TEXT( "Recording-%s.lucrec" ), *FDateTime::Now().ToString() );
+}
+
+FLucidityRecorder::FPendingUpdate* FLucidityRecorder::FindPending( const AAlexandriaCharacter* Agent )
+{
+	if (Agent != LastAgent)
+	{
+		const uint16* Id = AgentIds.Find( Agent );
+		LastAgent = Agent;
+		LastPending = (Id != nullptr) ? (int32)*Id : INDEX_NONE;
+	}
+	if (LastPending == INDEX_NONE)
+	{
+		return nullptr;
+	}
+	FPendingUpdate &Update = Pending[LastPending];
+	return Update.bOpen ? &Update : nullptr;
+}
+
+void FLucidityRecorder::BeginUpdate( const AAlexandriaCharacter* Agent, const float DeltaSeconds )
+{
+	LucidityRecorder::FCostScope Cost( RecordCycles );
+	// Only the player's own character, proxies extrapolate the server's value and AI readers would swamp the buffer
+	if (!Agent->IsLocallyControlled())
+	{
+		return;
+	}
+
+	const uint16* Found = AgentIds.Find( Agent );
+	uint16 Id = 0;
+	if (Found != nullptr)
+	{
+		Id = *Found;
+	}
+	else
+	{
+		if (Pending.Num() > MAX_uint16)
+		{
+			return;
+		}
+		Id = (uint16)Pending.Num();
+		Pending.AddDefaulted();
+		AgentIds.Add( Agent, Id );
+		WriteAgent( Agent, Id );
+	}
+	LastAgent = Agent;
+	LastPending = Id;
+
+	FPendingUpdate &Open = Pending[Id];
+	FMemory::Memzero( Open.Update );
+	Open.Lights.Reset();
+	Open.Rays.Reset();
+	Open.bOpen = true;
+
+	FUpdate &Update = Open.Update;
+	Update.Agent = Id;
+	Update.Flags = (Agent->HasInnerRadiance() ? InnerRadiance : 0) | (Agent->bBatchedLucidity ? Batched : 0);
+	Update.DeltaSeconds = DeltaSeconds;
+	LucidityRecorder::CopyVector( Agent->GetActorLocation(), Update.Location );
+	Update.Lucidity = Agent->Lucidity;
+	Update.TimeSinceLastUptick = Agent->TimeSinceLastUptick;
+}
+
+void FLucidityRecorder::RecordSun( const AAlexandriaCharacter* Agent, const FLucidSunState &SunState )
+{
+	LucidityRecorder::FCostScope Cost( RecordCycles );
+	FPendingUpdate* Open = FindPending( Agent );
+	if (Open != nullptr)
+	{
+		LucidityRecorder::CopyVector( SunState.Direction, Open->Update.SunDirection );
+		if (SunState.bValid && (SunState.Intensity >= SMALL_NUMBER))
+		{
+			Open->Update.Flags |= SunLit;
+		}
+	}
+}
+
+void FLucidityRecorder::RecordSunVisibility( const AAlexandriaCharacter* Agent, const float Visibility, const bool bBaked )
+{
+	LucidityRecorder::FCostScope Cost( RecordCycles );
+	FPendingUpdate* Open = FindPending( Agent );
+	if (Open != nullptr)
+	{
+		Open->Update.SunVisibility = Visibility;
+		if (bBaked)
+		{
+			Open->Update.Flags |= BakedSun;
+		}
+	}
+}
+
+void FLucidityRecorder::RecordSunRays( const AAlexandriaCharacter* Agent, const FLucidSunRay* Rays, const bool* bLit, const int32 Count )
+{
+	LucidityRecorder::FCostScope Cost( RecordCycles );
+	FPendingUpdate* Open = FindPending( Agent );
+	if (Open == nullptr)
+	{
+		return;
+	}
+	for (int32 i = 0; (i < Count) && (Open->Rays.Num() < MAX_uint8); i++)
+	{
+		FRay &Ray = Open->Rays[Open->Rays.AddUninitialized()];
+		LucidityRecorder::CopyVector( Rays[i].Start, Ray.Start );
+		LucidityRecorder::CopyVector( Rays[i].End, Ray.End );
+		Ray.Stratum = (int8)Rays[i].Stratum;
+		Ray.bLit = bLit[i] ? 1 : 0;
+		Ray.Pad[0] = Ray.Pad[1] = 0;
+	}
+}
+
+void FLucidityRecorder::RecordLight( const AAlexandriaCharacter* Agent, const FLucidLocalLightState &Light, const float Visibility )
+{
+	LucidityRecorder::FCostScope Cost( RecordCycles );
+	FPendingUpdate* Open = FindPending( Agent );
+	if ((Open == nullptr) || (Open->Lights.Num() >= MAX_uint8))
+	{
+		return;
+	}
+	FLight &Entry = Open->Lights[Open->Lights.AddZeroed()];
+	LucidityRecorder::CopyVector( Light.Position, Entry.Position );
+	Entry.AttenuationRadius = Light.AttenuationRadius;
+	Entry.FalloffExponent = Light.FalloffExponent;
+	Entry.Brightness = Light.Brightness;
+	Entry.Visibility = Visibility;
+	Entry.bInverseSquaredFalloff = Light.bInverseSquaredFalloff ? 1 : 0;
+}
+
+void FLucidityRecorder::RecordIncidentLuminance( const AAlexandriaCharacter* Agent, const float Luminance )
+{
+	LucidityRecorder::FCostScope Cost( RecordCycles );
+	FPendingUpdate* Open = FindPending( Agent );
+	if (Open != nullptr)
+	{
+		Open->Update.IncidentLuminance = Luminance;
+	}
+}
+
+void FLucidityRecorder::EndUpdate( const AAlexandriaCharacter* Agent, const float ResultLucidity )
+{
+	LucidityRecorder::FCostScope Cost( RecordCycles );
+	FPendingUpdate* Open = FindPending( Agent );
+	if (Open == nullptr)
+	{
+		return;
+	}
+	Open->bOpen = false;
+
+	FUpdate &Update = Open->Update;
+	Update.NumLights = (uint8)Open->Lights.Num();
+	Update.NumRays = (uint8)Open->Rays.Num();
+	// The integration step limit follows the character's sun intensity, also when it has no sun this update
+	Update.SunIntensity = Agent->SunIntensity;
+	Update.ResultLucidity = ResultLucidity;
+
+	const uint8 Type = UpdateRecord;
+	const int32 Bytes = sizeof( Type ) + sizeof( FUpdate ) + Open->Lights.Num()*sizeof( FLight ) + Open->Rays.Num()*sizeof( FRay );
+	if (Buffer.Num() + Bytes > Capacity)
+	{
+		bOverflowed = true;
+		bRecording = false;
+		UE_LOG( AlexandriaLog, Warning, TEXT( "Lucidity.Record: buffer full after %d updates, run Lucidity.Record Stop to save them" ), NumUpdates );
+		return;
+	}
+	Append( &Type, sizeof( Type ) );
+	Append( &Update, sizeof( Update ) );
+	Append( Open->Lights.GetData(), Open->Lights.Num()*sizeof( FLight ) );
+	Append( Open->Rays.GetData(), Open->Rays.Num()*sizeof( FRay ) );
+	NumUpdates++;
+}
+
+void FLucidityRecorder::WriteAgent( const AAlexandriaCharacter* Agent, const uint16 Id )
+{
+	const FTCHARToUTF8 ClassPath( *Agent->GetClass()->GetPathName() );
+
+	FAgent Record;
+	FMemory::Memzero( Record );
+	Record.Agent = Id;
+	Record.ClassPathLength = (uint16)ClassPath.Length();
+	Record.AbsorbVelocity = Agent->AbsorbVelocity;
+	Record.ConsumeVelocity = Agent->ConsumeVelocity;
+	Record.InnerRadianceDecayTime = Agent->InnerRadianceDecayTime;
+	Record.BaseSunIntensity = Agent->BaseSunIntensity;
+	if (Agent->bTemporalSunSampling)
+	{
+		Record.HistoryWeight = Agent->ExposureSampler.HistoryWeight;
+		Record.ResetDistance = Agent->ExposureSampler.ResetDistance;
+		Record.ResetAngleDegrees = Agent->ExposureSampler.ResetAngleDegrees;
+	}
+
+	const uint8 Type = AgentRecord;
+	if (Buffer.Num() + (int32)(sizeof( Type ) + sizeof( Record )) + Record.ClassPathLength > Capacity)
+	{
+		bOverflowed = true;
+		bRecording = false;
+		return;
+	}
+	Append( &Type, sizeof( Type ) );
+	Append( &Record, sizeof( Record ) );
+	Append( ClassPath.Get(), Record.ClassPathLength );
+}
+
+bool FLucidityRecorder::Append( const void* Data, const int32 Bytes )
+{
+	// Never past the capacity reserved in Start, so the buffer is not reallocated mid-session
+	if ((Bytes <= 0) || (Buffer.Num() + Bytes > Capacity))
+	{
+		return false;
+	}
+	const int32 Offset = Buffer.AddUninitialized( Bytes );
+	FMemory::Memcpy( Buffer.GetData() + Offset, Data, Bytes );
+	return true;
+}
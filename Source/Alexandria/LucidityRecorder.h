@@ -0,0 +1,153 @@
+// Copyright 1998-2017 Epic Games, Inc. All Rights Reserved.
+#pragma once
+
+#include "UObject/ObjectKey.h"
+
+class AAlexandriaCharacter;
+struct FLucidSunState;
+struct FLucidLocalLightState;
+struct FLucidSunRay;
+
+// On-disk layout of a Lucidity input recording (.lucrec), little endian
+namespace LucidRecordFormat
+{
+	static const uint32 Magic = 0x434C524C; // "LRLC"
+	static const uint32 Version = 1;
+
+	struct FHeader
+	{
+		uint32 Magic;
+		uint32 Version;
+	};
+
+	// Every record starts with one of these bytes
+	enum ERecordType : uint8
+	{
+		AgentRecord,
+		UpdateRecord,
+	};
+
+	// Once per character, before its first update. Followed by ClassPathLength ANSI characters
+	struct FAgent
+	{
+		uint16 Agent;
+		uint16 ClassPathLength;
+		float AbsorbVelocity;
+		float ConsumeVelocity;
+		float InnerRadianceDecayTime;
+		float BaseSunIntensity;
+		// Exposure sampler settings, zero history weight when temporal sampling is off
+		float HistoryWeight;
+		float ResetDistance;
+		float ResetAngleDegrees;
+	};
+
+	enum EUpdateFlags : uint8
+	{
+		InnerRadiance = 1 << 0,
+		SunLit = 1 << 1,
+		BakedSun = 1 << 2,
+		// Updated by FLucidityManager, which sums the terms in a different order
+		Batched = 1 << 3,
+	};
+
+	// One Lucidity update. Followed by NumLights FLight in accumulation order, then NumRays FRay
+	struct FUpdate
+	{
+		uint16 Agent;
+		uint8 Flags;
+		uint8 NumLights;
+		uint8 NumRays;
+		uint8 Pad[3];
+		float DeltaSeconds;
+		float Location[3];
+		float SunDirection[3];
+		float SunIntensity;
+		// Sun visibility the update used, traced, sampled from the bake or carried over
+		float SunVisibility;
+		float IncidentLuminance;
+		// State before the update...
+		float Lucidity;
+		float TimeSinceLastUptick;
+		// ...and the Lucidity it produced
+		float ResultLucidity;
+	};
+
+	struct FLight
+	{
+		float Position[3];
+		float AttenuationRadius;
+		float FalloffExponent;
+		float Brightness;
+		float Visibility;
+		uint8 bInverseSquaredFalloff;
+		uint8 Pad[3];
+	};
+
+	struct FRay
+	{
+		float Start[3];
+		float End[3];
+		int8 Stratum;
+		uint8 bLit;
+		uint8 Pad[2];
+	};
+}
+
+/**
+ * Records the inputs of every Lucidity update of the locally controlled characters into a buffer allocated up
+ * front: step, location, sun state, the lights that contributed and each sun ray's result. Random poll points
+ * and live trace results make every session different, a recording makes one repeatable, see
+ * ULucidityReplayCommandlet.
+ * The hooks cost nothing while idle, and a few copies per update while recording.
+ * Driven by "Lucidity.Record Start [MB]" and "Lucidity.Record Stop [File]".
+ */
+class FLucidityRecorder
+{
+public:
+	static FORCEINLINE bool IsRecording() { return bRecording; }
+
+	/** Starts a recording into a buffer of CapacityBytes, dropping any unsaved one */
+	static void Start( const int32 CapacityBytes );
+
+	/** Stops recording and writes what was captured to Filename */
+	static bool Stop( const FString &Filename );
+
+	static FString GetDefaultPath();
+
+	// Hooks, only called while IsRecording
+	static void BeginUpdate( const AAlexandriaCharacter* Agent, const float DeltaSeconds );
+	static void RecordSun( const AAlexandriaCharacter* Agent, const FLucidSunState &SunState );
+	static void RecordSunVisibility( const AAlexandriaCharacter* Agent, const float Visibility, const bool bBaked );
+	static void RecordSunRays( const AAlexandriaCharacter* Agent, const FLucidSunRay* Rays, const bool* bLit, const int32 Count );
+	static void RecordLight( const AAlexandriaCharacter* Agent, const FLucidLocalLightState &Light, const float Visibility );
+	static void RecordIncidentLuminance( const AAlexandriaCharacter* Agent, const float Luminance );
+	static void EndUpdate( const AAlexandriaCharacter* Agent, const float ResultLucidity );
+
+private:
+	struct FPendingUpdate
+	{
+		LucidRecordFormat::FUpdate Update;
+		TArray<LucidRecordFormat::FLight, TInlineAllocator<8>> Lights;
+		TArray<LucidRecordFormat::FRay, TInlineAllocator<8>> Rays;
+		bool bOpen;
+	};
+
+	/** The open update of Agent, null if it is not being recorded */
+	static FPendingUpdate* FindPending( const AAlexandriaCharacter* Agent );
+	static void WriteAgent( const AAlexandriaCharacter* Agent, const uint16 Id );
+	static bool Append( const void* Data, const int32 Bytes );
+
+	static bool bRecording;
+	static bool bOverflowed;
+	static TArray<uint8> Buffer;
+	static int32 Capacity;
+	static TMap<FObjectKey, uint16> AgentIds;
+	static TArray<FPendingUpdate> Pending;
+	// Characters update one after another outside the batch, so the last lookup usually hits
+	static const AAlexandriaCharacter* LastAgent;
+	static int32 LastPending;
+
+	static int32 NumUpdates;
+	static uint64 RecordCycles;
+};
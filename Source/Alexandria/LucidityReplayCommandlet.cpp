@@ -0,0 +1,430 @@
+// Copyright 1998-2017 Epic Games, Inc. All Rights Reserved.
+
+#include "Alexandria.h"
+#include "LucidityReplayCommandlet.h"
+#include "AlexandriaGameMode.h"
+#include "AlexandriaCharacter.h"
+#include "LucidityRecorder.h"
+#include "LucidOccluders.h"
+#include "Json.h"
+
+using namespace LucidRecordFormat;
+
+namespace LucidityReplay
+{
+	struct FReplayAgent
+	{
+		FAgent Record;
+		TSharedPtr<FLucidPropertyTable> Properties;
+		FLucidExposureSampler Sampler;
+		// Replayed state, carried from update to update in live replays
+		float Lucidity;
+		float TimeSinceLastUptick;
+		bool bStarted;
+	};
+
+	struct FReplayUpdate
+	{
+		FUpdate Record;
+		TArray<FLight, TInlineAllocator<8>> Lights;
+		TArray<FRay, TInlineAllocator<8>> Rays;
+	};
+
+	enum EPhase
+	{
+		SunPhase,
+		LightsPhase,
+		IntegrationPhase,
+		PropertiesPhase,
+		NumPhases
+	};
+
+	static const TCHAR* PhaseNames[NumPhases] = { TEXT( "sun" ), TEXT( "lights" ), TEXT( "integration" ), TEXT( "properties" ) };
+
+	static FORCEINLINE FVector ToVector( const float* In )
+	{
+		return FVector( In[0], In[1], In[2] );
+	}
+
+	// Records follow their one byte type unaligned, so they are copied out rather than read in place
+	static bool Read( const TArray<uint8> &Bytes, int32 &Offset, void* Out, const int32 Size )
+	{
+		if ((Size < 0) || (Offset + Size > Bytes.Num()))
+		{
+			return false;
+		}
+		FMemory::Memcpy( Out, Bytes.GetData() + Offset, Size );
+		Offset += Size;
+		return true;
+	}
+
+	// The recorded character's own property table, or the default character's if its class is gone
+	static TSharedPtr<FLucidPropertyTable> BuildPropertyTable( const FString &ClassPath )
+	{
+		UClass* Class = LoadObject<UClass>( nullptr, *ClassPath );
+		if ((Class == nullptr) || !Class->IsChildOf( AAlexandriaCharacter::StaticClass() ))
+		{
+			UE_LOG( AlexandriaLog, Warning, TEXT( "LucidityReplay: %s not found, evaluating the default character's properties" ), *ClassPath );
+			Class = AAlexandriaCharacter::StaticClass();
+		}
+		TSharedPtr<FLucidPropertyTable> Table = MakeShareable( new FLucidPropertyTable() );
+		Class->GetDefaultObject<AAlexandriaCharacter>()->BuildLucidPropertyTable( *Table );
+		return Table;
+	}
+
+	static bool LoadRecording( const FString &Filename, TArray<FReplayAgent> &OutAgents, TArray<FReplayUpdate> &OutUpdates )
+	{
+		TArray<uint8> Bytes;
+		if (!FFileHelper::LoadFileToArray( Bytes, *Filename ))
+		{
+			UE_LOG( AlexandriaLog, Error, TEXT( "LucidityReplay: could not read %s" ), *Filename );
+			return false;
+		}
+
+		int32 Offset = 0;
+		FHeader Header;
+		if (!Read( Bytes, Offset, &Header, sizeof( Header ) ) || (Header.Magic != Magic) || (Header.Version != Version))
+		{
+			UE_LOG( AlexandriaLog, Error, TEXT( "LucidityReplay: %s is not a version %u Lucidity recording" ), *Filename, Version );
+			return false;
+		}
+
+		bool bTruncated = false;
+		while ((Offset < Bytes.Num()) && !bTruncated)
+		{
+			uint8 Type = 0;
+			Read( Bytes, Offset, &Type, sizeof( Type ) );
+			if (Type == AgentRecord)
+			{
+				FAgent Record;
+				TArray<ANSICHAR> ClassPath;
+				bTruncated = !Read( Bytes, Offset, &Record, sizeof( Record ) );
+				if (!bTruncated)
+				{
+					ClassPath.SetNumZeroed( Record.ClassPathLength + 1 );
+					bTruncated = !Read( Bytes, Offset, ClassPath.GetData(), Record.ClassPathLength );
+				}
+				if (bTruncated)
+				{
+					break;
+				}
+
+				if (Record.Agent >= OutAgents.Num())
+				{
+					OutAgents.SetNum( Record.Agent + 1 );
+				}
+				FReplayAgent &Agent = OutAgents[Record.Agent];
+				Agent.Record = Record;
+				Agent.Properties = BuildPropertyTable( UTF8_TO_TCHAR( ClassPath.GetData() ) );
+				Agent.Sampler.HistoryWeight = Record.HistoryWeight;
+				Agent.Sampler.ResetDistance = Record.ResetDistance;
+				Agent.Sampler.ResetAngleDegrees = Record.ResetAngleDegrees;
+			}
+			else if (Type == UpdateRecord)
+			{
+				FReplayUpdate Update;
+				bTruncated = !Read( Bytes, Offset, &Update.Record, sizeof( Update.Record ) );
+				if (!bTruncated)
+				{
+					Update.Lights.SetNumUninitialized( Update.Record.NumLights );
+					Update.Rays.SetNumUninitialized( Update.Record.NumRays );
+					bTruncated = !Read( Bytes, Offset, Update.Lights.GetData(), Update.Lights.Num()*sizeof( FLight ) )
+						|| !Read( Bytes, Offset, Update.Rays.GetData(), Update.Rays.Num()*sizeof( FRay ) );
+				}
+				if (bTruncated)
+				{
+					break;
+				}
+
+				if ((Update.Record.Agent >= OutAgents.Num()) || !OutAgents[Update.Record.Agent].Properties.IsValid())
+				{
+					UE_LOG( AlexandriaLog, Error, TEXT( "LucidityReplay: update for unknown character %u at byte %d" ), Update.Record.Agent, Offset );
+					return false;
+				}
+				OutUpdates.Add( MoveTemp( Update ) );
+			}
+			else
+			{
+				UE_LOG( AlexandriaLog, Error, TEXT( "LucidityReplay: corrupt record at byte %d" ), Offset - 1 );
+				return false;
+			}
+		}
+
+		if (bTruncated)
+		{
+			UE_LOG( AlexandriaLog, Warning, TEXT( "LucidityReplay: %s is truncated, replaying its %d complete updates" ), *Filename, OutUpdates.Num() );
+		}
+		if (OutUpdates.Num() == 0)
+		{
+			UE_LOG( AlexandriaLog, Error, TEXT( "LucidityReplay: %s has no updates" ), *Filename );
+			return false;
+		}
+		return true;
+	}
+
+	// Just enough of the map for collision queries, as the bake commandlet does
+	static UWorld* LoadTraceWorld( const FString &MapName )
+	{
+		UPackage* Package = LoadPackage( nullptr, *MapName, LOAD_None );
+		UWorld* World = (Package != nullptr) ? UWorld::FindWorldInPackage( Package ) : nullptr;
+		if (World == nullptr)
+		{
+			return nullptr;
+		}
+
+		World->WorldType = EWorldType::Editor;
+		World->AddToRoot();
+		if (!World->bIsWorldInitialized)
+		{
+			UWorld::InitializationValues IVS;
+			IVS.RequiresHitProxies( false )
+				.ShouldSimulatePhysics( false )
+				.EnableTraceCollision( true )
+				.CreateNavigation( false )
+				.CreateAISystem( false )
+				.AllowAudioPlayback( false )
+				.CreatePhysicsScene( true );
+			World->InitWorld( IVS );
+		}
+		World->UpdateWorldComponents( true, false );
+		return World;
+	}
+
+	struct FTraceSetup
+	{
+		UWorld* World;
+		ECollisionChannel Channel;
+		FCollisionResponseParams Response;
+		FCollisionQueryParams Params;
+		int64 Traces;
+
+		explicit FTraceSetup( UWorld* InWorld ) :
+			World( InWorld ),
+			Traces( 0 )
+		{
+			// Same occluders the characters trace, once every level's proxies are in
+			FLucidOccluders* Occluders = FLucidOccluders::Get( World );
+			if (Occluders != nullptr)
+			{
+				Occluders->WaitForLoads();
+			}
+			const FLucidTraceSetup Setup = FLucidOccluders::GetTraceSetup( World );
+			Channel = Setup.Channel;
+			Response = Setup.Response;
+			Params = FCollisionQueryParams( AAlexandriaCharacter::SunTraceTag, Setup.bTraceComplex );
+		}
+
+		bool IsBlocked( const FVector &Start, const FVector &End )
+		{
+			Traces++;
+			return World->LineTraceTestByChannel( Start, End, Channel, Params, Response );
+		}
+	};
+
+	// Traces the recorded sun rays again and folds them into the agent's exposure history
+	static float TraceSun( FTraceSetup &Trace, FReplayAgent &Agent, const FReplayUpdate &Update )
+	{
+		const bool bTemporal = (Agent.Record.HistoryWeight > 0.f);
+		if (bTemporal)
+		{
+			Agent.Sampler.Validate( ToVector( Update.Record.Location ), ToVector( Update.Record.SunDirection ) );
+		}
+
+		int32 LitCount = 0;
+		for (const FRay &Ray : Update.Rays)
+		{
+			const bool bLit = !Trace.IsBlocked( ToVector( Ray.Start ), ToVector( Ray.End ) );
+			if (bTemporal && (Ray.Stratum >= 0))
+			{
+				Agent.Sampler.AddSample( Ray.Stratum, bLit ? 1.f : 0.f );
+			}
+			LitCount += bLit ? 1 : 0;
+		}
+		const float TickVisibility = (float)LitCount / (float)Update.Rays.Num();
+		return bTemporal ? Agent.Sampler.GetExposure( TickVisibility ) : TickVisibility;
+	}
+}
+
+ULucidityReplayCommandlet::ULucidityReplayCommandlet()
+{
+	IsClient = false;
+	IsEditor = true;
+	IsServer = false;
+	LogToConsole = true;
+}
+
+int32 ULucidityReplayCommandlet::Main( const FString &Params )
+{
+	using namespace LucidityReplay;
+
+	FString InputPath;
+	if (!FParse::Value( *Params, TEXT( "Input=" ), InputPath ))
+	{
+		UE_LOG( AlexandriaLog, Error, TEXT( "LucidityReplay: missing -Input=<file.lucrec>" ) );
+		return 1;
+	}
+	FString MapName;
+	FParse::Value( *Params, TEXT( "Map=" ), MapName );
+	const bool bLive = FParse::Param( *Params, TEXT( "Live" ) );
+	if (bLive && MapName.IsEmpty())
+	{
+		UE_LOG( AlexandriaLog, Error, TEXT( "LucidityReplay: -Live needs -Map=<package name> to trace against" ) );
+		return 1;
+	}
+	int32 Iterations = 1;
+	FParse::Value( *Params, TEXT( "Iterations=" ), Iterations );
+	Iterations = FMath::Max( Iterations, 1 );
+
+	FString OutputPath = FPaths::GameSavedDir() / TEXT( "Lucidity" ) / FString::Printf( TEXT( "Replay-%s.json" ), *FDateTime::Now().ToString() );
+	FParse::Value( *Params, TEXT( "Output=" ), OutputPath );
+
+	TArray<FReplayAgent> Agents;
+	TArray<FReplayUpdate> Updates;
+	if (!LoadRecording( InputPath, Agents, Updates ))
+	{
+		return 1;
+	}
+
+	UWorld* World = nullptr;
+	if (bLive)
+	{
+		World = LoadTraceWorld( MapName );
+		if (World == nullptr)
+		{
+			UE_LOG( AlexandriaLog, Error, TEXT( "LucidityReplay: could not load map %s" ), *MapName );
+			return 1;
+		}
+	}
+	FTraceSetup Trace( World );
+
+	uint64 PhaseCycles[NumPhases] = {};
+	double MaxError = 0.0;
+	double SumError = 0.0;
+	for (int32 Iteration = 0; Iteration < Iterations; Iteration++)
+	{
+		for (FReplayAgent &Agent : Agents)
+		{
+			Agent.Sampler.Reset();
+			Agent.bStarted = false;
+		}
+
+		for (const FReplayUpdate &Update : Updates)
+		{
+			const FUpdate &Record = Update.Record;
+			FReplayAgent &Agent = Agents[Record.Agent];
+			const float BaseSunIntensity = Agent.Record.BaseSunIntensity;
+			const bool bBatched = (Record.Flags & Batched) != 0;
+
+			// Sun, the batch scales visibility by a precomputed ratio and rounds differently
+			uint32 PhaseStart = FPlatformTime::Cycles();
+			float Sun = 0.f;
+			if (Record.Flags & SunLit)
+			{
+				const bool bTraced = bLive && (Record.NumRays > 0) && !(Record.Flags & BakedSun);
+				const float Visibility = bTraced ? TraceSun( Trace, Agent, Update ) : Record.SunVisibility;
+				Sun = bBatched ? Visibility*(Record.SunIntensity / BaseSunIntensity) : Visibility*Record.SunIntensity / BaseSunIntensity;
+			}
+			uint32 PhaseEnd = FPlatformTime::Cycles();
+			PhaseCycles[SunPhase] += PhaseEnd - PhaseStart;
+			PhaseStart = PhaseEnd;
+
+			// Lights, in the order the update accumulated them
+			const FVector Location = ToVector( Record.Location );
+			float Luminance = 0.f;
+			for (const FLight &Light : Update.Lights)
+			{
+				if (Light.Brightness <= SMALL_NUMBER)
+				{
+					continue;
+				}
+				FLucidLocalLightState State;
+				State.Position = ToVector( Light.Position );
+				State.AttenuationRadius = Light.AttenuationRadius;
+				State.FalloffExponent = Light.FalloffExponent;
+				State.Brightness = Light.Brightness;
+				State.bInverseSquaredFalloff = (Light.bInverseSquaredFalloff != 0);
+				const float Brightness = BaseSunIntensity*AAlexandriaCharacter::CalcLightAttenuation( State, FVector::Dist( State.Position, Location ) );
+				if (Brightness > 0.f)
+				{
+					const float Visibility = bLive ? (Trace.IsBlocked( State.Position, Location ) ? 0.f : 1.f) : Light.Visibility;
+					Luminance += Brightness*Visibility;
+				}
+			}
+			if (Update.Lights.Num() > 0)
+			{
+				Luminance /= (float)Update.Lights.Num();
+			}
+			const float Lights = Luminance / BaseSunIntensity;
+			PhaseEnd = FPlatformTime::Cycles();
+			PhaseCycles[LightsPhase] += PhaseEnd - PhaseStart;
+			PhaseStart = PhaseEnd;
+
+			// Integration, from the recorded state unless a live replay carries its own
+			if (!bLive || !Agent.bStarted)
+			{
+				Agent.Lucidity = Record.Lucidity;
+				Agent.TimeSinceLastUptick = Record.TimeSinceLastUptick;
+				Agent.bStarted = true;
+			}
+			const float TickLucidity = bBatched ? ((Lights + Record.IncidentLuminance) + Sun) : (Sun + Lights + Record.IncidentLuminance);
+			const float MaxDeltaLucidity = Record.SunIntensity*Record.DeltaSeconds / BaseSunIntensity;
+			Agent.Lucidity = LucidIntegration::Step( Agent.Lucidity, TickLucidity, MaxDeltaLucidity, Agent.Record.AbsorbVelocity, Agent.Record.ConsumeVelocity,
+				Agent.Record.InnerRadianceDecayTime, (Record.Flags & InnerRadiance) != 0, Agent.TimeSinceLastUptick );
+			PhaseEnd = FPlatformTime::Cycles();
+			PhaseCycles[IntegrationPhase] += PhaseEnd - PhaseStart;
+			PhaseStart = PhaseEnd;
+
+			Agent.Properties->Evaluate( Agent.Lucidity );
+			PhaseCycles[PropertiesPhase] += FPlatformTime::Cycles() - PhaseStart;
+
+			const double Error = FMath::Abs( (double)Agent.Lucidity - (double)Record.ResultLucidity );
+			MaxError = FMath::Max( MaxError, Error );
+			SumError += Error;
+		}
+	}
+
+	const int32 NumReplayed = Updates.Num()*Iterations;
+	const double PhaseScale = FPlatformTime::GetSecondsPerCycle()*1000000.0 / NumReplayed;
+	TSharedRef<FJsonObject> Phases = MakeShareable( new FJsonObject() );
+	double TotalMicroseconds = 0.0;
+	for (int32 Phase = 0; Phase < NumPhases; Phase++)
+	{
+		Phases->SetNumberField( PhaseNames[Phase], PhaseCycles[Phase]*PhaseScale );
+		TotalMicroseconds += PhaseCycles[Phase]*PhaseScale;
+	}
+
+	TSharedRef<FJsonObject> Report = MakeShareable( new FJsonObject() );
+	Report->SetStringField( TEXT( "input" ), InputPath );
+	Report->SetStringField( TEXT( "mode" ), bLive ? TEXT( "live" ) : TEXT( "deterministic" ) );
+	Report->SetStringField( TEXT( "map" ), MapName );
+	Report->SetNumberField( TEXT( "agents" ), Agents.Num() );
+	Report->SetNumberField( TEXT( "updates" ), Updates.Num() );
+	Report->SetNumberField( TEXT( "iterations" ), Iterations );
+	Report->SetObjectField( TEXT( "usPerUpdate" ), Phases );
+	Report->SetNumberField( TEXT( "tracesPerUpdate" ), (double)Trace.Traces / NumReplayed );
+	Report->SetNumberField( TEXT( "maxLucidityError" ), MaxError );
+	Report->SetNumberField( TEXT( "meanLucidityError" ), SumError / NumReplayed );
+
+	UE_LOG( AlexandriaLog, Display, TEXT( "LucidityReplay: %d updates of %d characters x %d, %.3f us per update, Lucidity error max %g mean %g" ),
+		Updates.Num(), Agents.Num(), Iterations, TotalMicroseconds, MaxError, SumError / NumReplayed );
+	if (!bLive && (MaxError > 0.0))
+	{
+		UE_LOG( AlexandriaLog, Warning, TEXT( "LucidityReplay: deterministic replay diverged from the recording, the Lucidity rules changed since it was captured" ) );
+	}
+
+	if (World != nullptr)
+	{
+		World->RemoveFromRoot();
+	}
+
+	FString Json;
+	TSharedRef<TJsonWriter<>> Writer = TJsonWriterFactory<>::Create( &Json );
+	FJsonSerializer::Serialize( Report, Writer );
+	if (!FFileHelper::SaveStringToFile( Json, *OutputPath ))
+	{
+		UE_LOG( AlexandriaLog, Error, TEXT( "LucidityReplay: could not write %s" ), *OutputPath );
+		return 1;
+	}
+	UE_LOG( AlexandriaLog, Display, TEXT( "LucidityReplay: wrote %s" ), *OutputPath );
+	return 0;
+}
@@ -0,0 +1,24 @@
+// Copyright 1998-2017 Epic Games, Inc. All Rights Reserved.
+#pragma once
+#include "Commandlets/Commandlet.h"
+#include "LucidityReplayCommandlet.generated.h"
+
+/**
+ * Feeds a Lucidity recording back through exposure, integration and property evaluation, so a captured
+ * play session can be profiled and compared like a benchmark.
+ *
+ * Usage: -run=LucidityReplay -Input=<file.lucrec> [-Map=/Game/Alexandria/Alexandria_Geo [-Live]] [-Iterations=1] [-Output=<file.json>]
+ * By default every update reuses its recorded ray and light results and starts from its recorded state, so the
+ * replayed Lucidity must match the recorded one exactly. -Live traces the recorded rays against the map instead
+ * and carries the replayed state from update to update. The JSON report goes to Saved/Lucidity by default.
+ */
+UCLASS()
+class ULucidityReplayCommandlet : public UCommandlet
+{
+	GENERATED_BODY()
+
+public:
+	ULucidityReplayCommandlet();
+
+	virtual int32 Main( const FString &Params ) override;
+};
@@ -0,0 +1,57 @@
+// Copyright 1998-2017 Epic Games, Inc. All Rights Reserved.
+
+#include "Alexandria.h"
+#include "LucidityStats.h"
+
+DEFINE_STAT( STAT_LucidCalcLucidity );
+DEFINE_STAT( STAT_LucidSolarIllumination );
+DEFINE_STAT( STAT_LucidDynamicLightRadiance );
+DEFINE_STAT( STAT_LucidIncidentRadiance );
+DEFINE_STAT( STAT_LucidVisualFeedback );
+DEFINE_STAT( STAT_LucidMovementParams );
+DEFINE_STAT( STAT_LucidBatchUpdate );
+DEFINE_STAT( STAT_LucidLightingSnapshot );
+DEFINE_STAT( STAT_LucidLevelStreaming );
+DEFINE_STAT( STAT_LucidCostField );
+DEFINE_STAT( STAT_LucidTraces );
+DEFINE_STAT( STAT_LucidLightsVisited );
+DEFINE_STAT( STAT_LucidLightsAccepted );
+DEFINE_STAT( STAT_LucidLightTraces );
+DEFINE_STAT( STAT_LucidLightVisibilityHits );
+DEFINE_STAT( STAT_LucidDeferredUpdates );
+DEFINE_STAT( STAT_LucidTraceBudget );
+DEFINE_STAT( STAT_LucidLightingRebuilds );
+DEFINE_STAT( STAT_LucidMaterialPushes );
+DEFINE_STAT( STAT_LucidIncidentCacheHits );
+DEFINE_STAT( STAT_LucidIncidentCacheMisses );
+DEFINE_STAT( STAT_LucidIncidentCacheHitRate );
+DEFINE_STAT( STAT_LucidSunVisibilityHits );
+DEFINE_STAT( STAT_LucidSunVisibilityMisses );
+DEFINE_STAT( STAT_LucidSunVisibilityHitRate );
+DEFINE_STAT( STAT_LucidRenderStateUpdates );
+DEFINE_STAT( STAT_LucidRenderStateSkips );
+DEFINE_STAT( STAT_LucidRadianceLodChanges );
+DEFINE_STAT( STAT_LucidFireAcquires );
+DEFINE_STAT( STAT_LucidCostFieldCells );
+DEFINE_STAT( STAT_LucidCostFieldUpdates );
+
+#if !UE_BUILD_SHIPPING
+bool FLucidityProfile::bCapturing = false;
+uint64 FLucidityProfile::PhaseCycles[FLucidityProfile::NumPhases] = {};
+uint64 FLucidityProfile::Traces = 0;
+uint64 FLucidityProfile::SunVisibilityHits = 0;
+uint64 FLucidityProfile::SunVisibilityLookups = 0;
+#endif
+
+const TCHAR* FLucidityProfile::GetPhaseName( const EPhase Phase )
+{
+	switch (Phase)
+	{
+	case CalcLucidity: return TEXT( "CalcLucidity" );
+	case SolarIllumination: return TEXT( "GetSolarIllumination" );
+	case DynamicLightRadiance: return TEXT( "CalcDynamicLightRadiance" );
+	case VisualFeedback: return TEXT( "UpdateVisualFeedback" );
+	case MovementParams: return TEXT( "UpdateMovementParams" );
+	default: return TEXT( "Unknown" );
+	}
+}
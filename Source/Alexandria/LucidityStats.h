@@ -0,0 +1,142 @@
+// Copyright 1998-2017 Epic Games, Inc. All Rights Reserved.
+#pragma once
+
+// "stat Lucidity"
+DECLARE_STATS_GROUP( TEXT( "Lucidity" ), STATGROUP_Lucidity, STATCAT_Advanced );
+
+DECLARE_CYCLE_STAT_EXTERN( TEXT( "CalcLucidity" ), STAT_LucidCalcLucidity, STATGROUP_Lucidity, );
+DECLARE_CYCLE_STAT_EXTERN( TEXT( "GetSolarIllumination" ), STAT_LucidSolarIllumination, STATGROUP_Lucidity, );
+DECLARE_CYCLE_STAT_EXTERN( TEXT( "CalcDynamicLightRadiance" ), STAT_LucidDynamicLightRadiance, STATGROUP_Lucidity, );
+DECLARE_CYCLE_STAT_EXTERN( TEXT( "CalcPlayerIncidentRadiance" ), STAT_LucidIncidentRadiance, STATGROUP_Lucidity, );
+DECLARE_CYCLE_STAT_EXTERN( TEXT( "UpdateVisualFeedback" ), STAT_LucidVisualFeedback, STATGROUP_Lucidity, );
+DECLARE_CYCLE_STAT_EXTERN( TEXT( "UpdateMovementParams" ), STAT_LucidMovementParams, STATGROUP_Lucidity, );
+DECLARE_CYCLE_STAT_EXTERN( TEXT( "Batched Update" ), STAT_LucidBatchUpdate, STATGROUP_Lucidity, );
+DECLARE_CYCLE_STAT_EXTERN( TEXT( "Lighting Snapshot" ), STAT_LucidLightingSnapshot, STATGROUP_Lucidity, );
+DECLARE_CYCLE_STAT_EXTERN( TEXT( "Level Streaming" ), STAT_LucidLevelStreaming, STATGROUP_Lucidity, );
+DECLARE_CYCLE_STAT_EXTERN( TEXT( "Cost Field" ), STAT_LucidCostField, STATGROUP_Lucidity, );
+
+DECLARE_DWORD_COUNTER_STAT_EXTERN( TEXT( "Traces Issued" ), STAT_LucidTraces, STATGROUP_Lucidity, );
+DECLARE_DWORD_COUNTER_STAT_EXTERN( TEXT( "Lights Visited" ), STAT_LucidLightsVisited, STATGROUP_Lucidity, );
+DECLARE_DWORD_COUNTER_STAT_EXTERN( TEXT( "Lights Accepted" ), STAT_LucidLightsAccepted, STATGROUP_Lucidity, );
+DECLARE_DWORD_COUNTER_STAT_EXTERN( TEXT( "Light Occlusion Traces" ), STAT_LucidLightTraces, STATGROUP_Lucidity, );
+DECLARE_DWORD_COUNTER_STAT_EXTERN( TEXT( "Light Visibility Cache Hits" ), STAT_LucidLightVisibilityHits, STATGROUP_Lucidity, );
+DECLARE_DWORD_COUNTER_STAT_EXTERN( TEXT( "Updates Deferred By Trace Budget" ), STAT_LucidDeferredUpdates, STATGROUP_Lucidity, );
+DECLARE_DWORD_ACCUMULATOR_STAT_EXTERN( TEXT( "Trace Budget" ), STAT_LucidTraceBudget, STATGROUP_Lucidity, );
+DECLARE_DWORD_COUNTER_STAT_EXTERN( TEXT( "Lighting Snapshot Rebuilds" ), STAT_LucidLightingRebuilds, STATGROUP_Lucidity, );
+DECLARE_DWORD_COUNTER_STAT_EXTERN( TEXT( "Material Parameter Pushes" ), STAT_LucidMaterialPushes, STATGROUP_Lucidity, );
+DECLARE_DWORD_COUNTER_STAT_EXTERN( TEXT( "Incident Radiance Cache Hits" ), STAT_LucidIncidentCacheHits, STATGROUP_Lucidity, );
+DECLARE_DWORD_COUNTER_STAT_EXTERN( TEXT( "Incident Radiance Cache Misses" ), STAT_LucidIncidentCacheMisses, STATGROUP_Lucidity, );
+DECLARE_FLOAT_COUNTER_STAT_EXTERN( TEXT( "Incident Radiance Cache Hit Rate (%)" ), STAT_LucidIncidentCacheHitRate, STATGROUP_Lucidity, );
+DECLARE_DWORD_COUNTER_STAT_EXTERN( TEXT( "Sun Visibility Reused" ), STAT_LucidSunVisibilityHits, STATGROUP_Lucidity, );
+DECLARE_DWORD_COUNTER_STAT_EXTERN( TEXT( "Sun Visibility Traced" ), STAT_LucidSunVisibilityMisses, STATGROUP_Lucidity, );
+DECLARE_FLOAT_COUNTER_STAT_EXTERN( TEXT( "Sun Trace Skip Rate (%)" ), STAT_LucidSunVisibilityHitRate, STATGROUP_Lucidity, );
+DECLARE_DWORD_COUNTER_STAT_EXTERN( TEXT( "Render State Updates" ), STAT_LucidRenderStateUpdates, STATGROUP_Lucidity, );
+DECLARE_DWORD_COUNTER_STAT_EXTERN( TEXT( "Render State Updates Skipped" ), STAT_LucidRenderStateSkips, STATGROUP_Lucidity, );
+DECLARE_DWORD_COUNTER_STAT_EXTERN( TEXT( "Radiance LOD Changes" ), STAT_LucidRadianceLodChanges, STATGROUP_Lucidity, );
+DECLARE_DWORD_COUNTER_STAT_EXTERN( TEXT( "Pooled Fires Acquired" ), STAT_LucidFireAcquires, STATGROUP_Lucidity, );
+DECLARE_DWORD_ACCUMULATOR_STAT_EXTERN( TEXT( "Cost Field Polygons" ), STAT_LucidCostFieldCells, STATGROUP_Lucidity, );
+DECLARE_DWORD_COUNTER_STAT_EXTERN( TEXT( "Cost Field Polygons Evaluated" ), STAT_LucidCostFieldUpdates, STATGROUP_Lucidity, );
+
+/** Hit rate over the current frame's lookups, so rate stats follow what is happening now rather than since startup */
+struct FLucidFrameHitRate
+{
+	uint64 Frame;
+	uint32 Hits;
+	uint32 Lookups;
+
+	FLucidFrameHitRate() : Frame( 0 ), Hits( 0 ), Lookups( 0 ) {}
+
+	/** Counts one lookup and returns this frame's hit rate so far, in percent */
+	float Add( const bool bHit )
+	{
+		if (Frame != GFrameCounter)
+		{
+			Frame = GFrameCounter;
+			Hits = 0;
+			Lookups = 0;
+		}
+		Hits += bHit ? 1 : 0;
+		++Lookups;
+		return 100.f*Hits / Lookups;
+	}
+};
+
+/**
+ * Wall clock time per Lucidity phase and trace counts, accumulated only while a benchmark captures.
+ * Compiled out of shipping builds along with the stats above.
+ */
+struct FLucidityProfile
+{
+	enum EPhase
+	{
+		CalcLucidity,
+		SolarIllumination,
+		DynamicLightRadiance,
+		VisualFeedback,
+		MovementParams,
+		NumPhases
+	};
+
+#if !UE_BUILD_SHIPPING
+	static bool bCapturing;
+	static uint64 PhaseCycles[NumPhases];
+	static uint64 Traces;
+	// Updates that reused their sun visibility, out of those that could have
+	static uint64 SunVisibilityHits;
+	static uint64 SunVisibilityLookups;
+
+	static void Reset()
+	{
+		FMemory::Memzero( PhaseCycles );
+		Traces = 0;
+		SunVisibilityHits = 0;
+		SunVisibilityLookups = 0;
+	}
+
+	static FORCEINLINE void AddTraces( const int32 Count )
+	{
+		INC_DWORD_STAT_BY( STAT_LucidTraces, Count );
+		if (bCapturing)
+		{
+			Traces += Count;
+		}
+	}
+
+	static FORCEINLINE void AddSunVisibilityLookup( const bool bHit )
+	{
+		if (bCapturing)
+		{
+			SunVisibilityHits += bHit ? 1 : 0;
+			++SunVisibilityLookups;
+		}
+	}
+#else
+	static FORCEINLINE void AddTraces( const int32 Count ) {}
+	static FORCEINLINE void AddSunVisibilityLookup( const bool bHit ) {}
+#endif
+
+	static const TCHAR* GetPhaseName( const EPhase Phase );
+};
+
+#if !UE_BUILD_SHIPPING
+struct FLucidityPhaseScope
+{
+	explicit FLucidityPhaseScope( const FLucidityProfile::EPhase InPhase ) :
+		Phase( InPhase ),
+		StartCycles( FLucidityProfile::bCapturing ? FPlatformTime::Cycles() : 0 )
+	{}
+	~FLucidityPhaseScope()
+	{
+		if (StartCycles != 0)
+		{
+			FLucidityProfile::PhaseCycles[Phase] += FPlatformTime::Cycles() - StartCycles;
+		}
+	}
+
+	FLucidityProfile::EPhase Phase;
+	uint32 StartCycles;
+};
+#define LUCIDITY_PHASE_SCOPE( Phase ) FLucidityPhaseScope LucidityPhaseScope_##Phase( FLucidityProfile::Phase )
+#else
+#define LUCIDITY_PHASE_SCOPE( Phase )
+#endif
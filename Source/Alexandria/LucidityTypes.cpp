@@ -0,0 +1,39 @@
+// Copyright 1998-2017 Epic Games, Inc. All Rights Reserved.
+
+#include "Alexandria.h"
+#include "LucidityTypes.h"
+#include "Components/LightComponent.h"
+#include "Components/PointLightComponent.h"
+#include "Runtime/Engine/Classes/Engine/DirectionalLight.h"
+
+FLucidSunState FLucidSunState::Gather( const ADirectionalLight* Sun )
+{
+	FLucidSunState State;
+	const ULightComponent* LightComp = (Sun != nullptr) ? Sun->GetLightComponent() : nullptr;
+	if (LightComp == nullptr)
+	{
+		return State;
+	}
+
+	State.LightPosition = LightComp->GetLightPosition();
+	State.Direction = LightComp->GetDirection();
+	if (!State.Direction.IsNormalized())
+	{
+		State.Direction.Normalize();
+	}
+	State.Color = (LightComp->bUseTemperature) ? FLinearColor::MakeFromColorTemperature( LightComp->Temperature ) : LightComp->GetLightColor();
+	State.Intensity = LightComp->ComputeLightBrightness();
+	State.bValid = true;
+	return State;
+}
+
+FLucidLocalLightState FLucidLocalLightState::Gather( const UPointLightComponent* LightComp )
+{
+	FLucidLocalLightState State;
+	State.Position = LightComp->GetComponentLocation();
+	State.AttenuationRadius = LightComp->AttenuationRadius;
+	State.Brightness = LightComp->ComputeLightBrightness();
+	State.FalloffExponent = LightComp->LightFalloffExponent;
+	State.bInverseSquaredFalloff = LightComp->bUseInverseSquaredFalloff;
+	return State;
+}
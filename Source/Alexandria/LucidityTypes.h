@@ -0,0 +1,48 @@
+// Copyright 1998-2017 Epic Games, Inc. All Rights Reserved.
+#pragma once
+
+#include "LucidIntegrationKernel.h"
+
+class ADirectionalLight;
+class UPointLightComponent;
+
+// Sun properties read once and shared by everything that needs them this frame
+struct FLucidSunState
+{
+	FVector LightPosition;
+	// Direction the light travels in, normalized
+	FVector Direction;
+	FLinearColor Color;
+	float Intensity;
+	bool bValid;
+
+	FLucidSunState() :
+		LightPosition( FVector::ZeroVector ),
+		Direction( FVector::ForwardVector ),
+		Color( FLinearColor::White ),
+		Intensity( 0.f ),
+		bValid( false )
+	{}
+
+	static FLucidSunState Gather( const ADirectionalLight* Sun );
+};
+
+// A "Lucidity" tagged point light as of one lighting snapshot
+struct FLucidLocalLightState
+{
+	FVector Position;
+	float AttenuationRadius;
+	float Brightness;
+	float FalloffExponent;
+	bool bInverseSquaredFalloff;
+
+	static FLucidLocalLightState Gather( const UPointLightComponent* LightComp );
+};
+
+// One sun visibility ray, Stratum is INDEX_NONE unless it feeds the exposure sampler
+struct FLucidSunRay
+{
+	FVector Start;
+	FVector End;
+	int32 Stratum;
+};
@@ -0,0 +1,112 @@
+// Copyright 1998-2017 Epic Games, Inc. All Rights Reserved.
+#pragma once
+
+// Packed agent state for the kernel tests and benchmark, filled the way the batched manager fills it.
+
+#include "LucidIntegrationKernel.h"
+#include <stdint.h>
+#include <string.h>
+#include <limits>
+#include <memory>
+#include <random>
+#include <vector>
+
+namespace LucidIntegrationAgents
+{
+	struct FAgents
+	{
+		std::vector<float> Lucidity;
+		std::vector<float> TickLucidity;
+		std::vector<float> MaxDeltaLucidity;
+		std::vector<float> AbsorbVelocity;
+		std::vector<float> ConsumeVelocity;
+		std::vector<float> InnerRadianceDecayTime;
+		// Not std::vector<bool>, the kernel wants a plain bool array
+		std::unique_ptr<bool[]> InnerRadiance;
+		std::vector<float> TimeSinceLastUptick;
+		int32_t Num;
+
+		explicit FAgents( const int32_t InNum ) :
+			Lucidity( InNum ),
+			TickLucidity( InNum ),
+			MaxDeltaLucidity( InNum ),
+			AbsorbVelocity( InNum ),
+			ConsumeVelocity( InNum ),
+			InnerRadianceDecayTime( InNum ),
+			InnerRadiance( new bool[InNum > 0 ? InNum : 1]() ),
+			TimeSinceLastUptick( InNum ),
+			Num( InNum )
+		{}
+
+		FAgents( const FAgents &Other ) :
+			FAgents( Other.Num )
+		{
+			*this = Other;
+		}
+
+		FAgents& operator=( const FAgents &Other )
+		{
+			Lucidity = Other.Lucidity;
+			TickLucidity = Other.TickLucidity;
+			MaxDeltaLucidity = Other.MaxDeltaLucidity;
+			AbsorbVelocity = Other.AbsorbVelocity;
+			ConsumeVelocity = Other.ConsumeVelocity;
+			InnerRadianceDecayTime = Other.InnerRadianceDecayTime;
+			InnerRadiance.reset( new bool[Other.Num > 0 ? Other.Num : 1]() );
+			memcpy( InnerRadiance.get(), Other.InnerRadiance.get(), Other.Num*sizeof( bool ) );
+			TimeSinceLastUptick = Other.TimeSinceLastUptick;
+			Num = Other.Num;
+			return *this;
+		}
+
+		LucidIntegration::FAgentArrays GetArrays()
+		{
+			LucidIntegration::FAgentArrays Arrays;
+			Arrays.Lucidity = Lucidity.data();
+			Arrays.TickLucidity = TickLucidity.data();
+			Arrays.MaxDeltaLucidity = MaxDeltaLucidity.data();
+			Arrays.AbsorbVelocity = AbsorbVelocity.data();
+			Arrays.ConsumeVelocity = ConsumeVelocity.data();
+			Arrays.InnerRadianceDecayTime = InnerRadianceDecayTime.data();
+			Arrays.InnerRadiance = InnerRadiance.get();
+			Arrays.TimeSinceLastUptick = TimeSinceLastUptick.data();
+			return Arrays;
+		}
+	};
+
+	/**
+	 * Random agents in the character's tuning ranges. With bEdgeCases, about one value in eight is
+	 * replaced by a boundary: zeros of both signs, exactly 1, Lucidity equal to TickLucidity, the
+	 * 3 second grace boundary, out of range exposure, infinities and NaN.
+	 */
+	inline FAgents MakeAgents( const int32_t Num, const uint32_t Seed, const bool bEdgeCases )
+	{
+		FAgents Agents( Num );
+		std::mt19937 Random( Seed );
+		std::uniform_real_distribution<float> Unit( 0.f, 1.f );
+		std::uniform_int_distribution<int32_t> EdgeChance( 0, 7 );
+		auto Range = [&]( const float Lo, const float Hi ) { return Lo + (Hi - Lo)*Unit( Random ); };
+
+		static const float Edges[] = {
+			0.f, -0.f, 1.f, -1.f, 3.f, 2.f, 0.5f, 1e-30f, -1e-30f, 1e30f,
+			std::numeric_limits<float>::denorm_min(),
+			std::numeric_limits<float>::infinity(),
+			-std::numeric_limits<float>::infinity(),
+			std::numeric_limits<float>::quiet_NaN() };
+		std::uniform_int_distribution<int32_t> EdgeIndex( 0, (int32_t)(sizeof( Edges ) / sizeof( Edges[0] )) - 1 );
+		auto Value = [&]( const float Lo, const float Hi ) { return (bEdgeCases && (EdgeChance( Random ) == 0)) ? Edges[EdgeIndex( Random )] : Range( Lo, Hi ); };
+
+		for (int32_t i = 0; i < Num; i++)
+		{
+			Agents.Lucidity[i] = Value( 0.f, 1.f );
+			Agents.TickLucidity[i] = (bEdgeCases && (EdgeChance( Random ) == 0)) ? Agents.Lucidity[i] : Value( 0.f, 2.f );
+			Agents.MaxDeltaLucidity[i] = Value( 0.f, 0.1f );
+			Agents.AbsorbVelocity[i] = Value( 0.f, 5.f );
+			Agents.ConsumeVelocity[i] = Value( 0.f, 5.f );
+			Agents.InnerRadianceDecayTime[i] = Value( 0.1f, 10.f );
+			Agents.InnerRadiance[i] = (Random() & 1) != 0;
+			Agents.TimeSinceLastUptick[i] = Value( 0.f, 6.f );
+		}
+		return Agents;
+	}
+}
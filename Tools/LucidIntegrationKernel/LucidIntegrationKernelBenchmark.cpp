@@ -0,0 +1,94 @@
+// Copyright 1998-2017 Epic Games, Inc. All Rights Reserved.
+
+// Times the integration kernel against the per-agent loop it replaced, at batch sizes from one
+// character to a crowd. Nanoseconds per agent step, best of several repetitions.
+// Usage: LucidIntegrationKernelBenchmark [--quick]
+
+#include "LucidIntegrationKernel.h"
+#include "LucidIntegrationReference.h"
+#include "LucidIntegrationAgents.h"
+#include <stdio.h>
+#include <string.h>
+#include <chrono>
+
+using LucidIntegrationAgents::FAgents;
+using LucidIntegrationAgents::MakeAgents;
+
+namespace
+{
+	typedef void (*FStepFunction)( const LucidIntegration::FAgentArrays &Agents, const int32_t Count );
+
+	void StepReference( const LucidIntegration::FAgentArrays &Agents, const int32_t Count )
+	{
+		LucidIntegrationReference::StepAgents( Agents, Count );
+	}
+
+	void StepScalar( const LucidIntegration::FAgentArrays &Agents, const int32_t Count )
+	{
+		LucidIntegration::StepScalar( Agents, 0, Count );
+	}
+
+	void StepAgents( const LucidIntegration::FAgentArrays &Agents, const int32_t Count )
+	{
+		LucidIntegration::StepAgents( Agents, Count );
+	}
+
+	// Every run starts from the same agents. Lucidity and exposure trade buffers each frame, so agents keep
+	// chasing a moving target and both the rise and fall branches stay in play
+	double TimeStep( FStepFunction Step, const FAgents &Source, const int32_t Frames, const int32_t Repetitions, float &OutChecksum )
+	{
+		double Best = 1e30;
+		for (int32_t Repetition = 0; Repetition < Repetitions; Repetition++)
+		{
+			FAgents Agents = Source;
+			LucidIntegration::FAgentArrays Arrays = Agents.GetArrays();
+			float* const Buffers[2] = { Agents.Lucidity.data(), Agents.TickLucidity.data() };
+			const auto Start = std::chrono::high_resolution_clock::now();
+			for (int32_t Frame = 0; Frame < Frames; Frame++)
+			{
+				Arrays.Lucidity = Buffers[Frame & 1];
+				Arrays.TickLucidity = Buffers[(Frame + 1) & 1];
+				Step( Arrays, Agents.Num );
+			}
+			const std::chrono::duration<double, std::nano> Elapsed = std::chrono::high_resolution_clock::now() - Start;
+			Best = (Elapsed.count() < Best) ? Elapsed.count() : Best;
+
+			OutChecksum = 0.f;
+			for (int32_t i = 0; i < Agents.Num; i++)
+			{
+				OutChecksum += Agents.Lucidity[i] + Agents.TickLucidity[i];
+			}
+		}
+		return Best / ((double)Frames*Source.Num);
+	}
+}
+
+int main( int argc, char** argv )
+{
+	const bool bQuick = (argc > 1) && (strcmp( argv[1], "--quick" ) == 0);
+	const int32_t AgentCounts[] = { 1, 4, 16, 64, 256, 1024, 4096, 16384, 65536 };
+	const int32_t StepsPerRun = bQuick ? 100000 : 20000000;
+	const int32_t Repetitions = bQuick ? 1 : 5;
+
+	printf( "LucidIntegrationKernel, %s path, ns per agent step\n", LUCID_INTEGRATION_SSE ? "SSE" : "scalar" );
+	printf( "%8s %12s %12s %12s %10s\n", "agents", "reference", "scalar", "StepAgents", "speedup" );
+	for (const int32_t Count : AgentCounts)
+	{
+		const FAgents Source = MakeAgents( Count, 1234, false );
+		const int32_t Frames = (StepsPerRun / Count > 1) ? StepsPerRun / Count : 1;
+
+		float ReferenceChecksum = 0.f;
+		float ScalarChecksum = 0.f;
+		float KernelChecksum = 0.f;
+		const double Reference = TimeStep( &StepReference, Source, Frames, Repetitions, ReferenceChecksum );
+		const double Scalar = TimeStep( &StepScalar, Source, Frames, Repetitions, ScalarChecksum );
+		const double Kernel = TimeStep( &StepAgents, Source, Frames, Repetitions, KernelChecksum );
+		if ((ReferenceChecksum != ScalarChecksum) || (ReferenceChecksum != KernelChecksum))
+		{
+			printf( "Results differ at %d agents: %.9g, %.9g, %.9g\n", Count, ReferenceChecksum, ScalarChecksum, KernelChecksum );
+			return 1;
+		}
+		printf( "%8d %12.3f %12.3f %12.3f %9.2fx\n", Count, Reference, Scalar, Kernel, Reference / Kernel );
+	}
+	return 0;
+}
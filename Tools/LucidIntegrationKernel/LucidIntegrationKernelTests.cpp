@@ -0,0 +1,212 @@
+// Copyright 1998-2017 Epic Games, Inc. All Rights Reserved.
+
+// Checks LucidIntegrationKernel.h against the integration rule it replaced, bit for bit.
+// Usage: LucidIntegrationKernelTests [TestName], every test when no name is given.
+
+#include "LucidIntegrationKernel.h"
+#include "LucidIntegrationReference.h"
+#include "LucidIntegrationAgents.h"
+#include <stdio.h>
+#include <string.h>
+
+using LucidIntegrationAgents::FAgents;
+using LucidIntegrationAgents::MakeAgents;
+
+namespace
+{
+	int32_t Failures = 0;
+
+	uint32_t Bits( const float Value )
+	{
+		uint32_t Result;
+		memcpy( &Result, &Value, sizeof( Result ) );
+		return Result;
+	}
+
+	// NaN payloads are kept too, so a NaN only matches the exact same NaN
+	bool CheckBits( const char* What, const int32_t Index, const float Expected, const float Actual )
+	{
+		if (Bits( Expected ) == Bits( Actual ))
+		{
+			return true;
+		}
+		if (Failures++ < 20)
+		{
+			printf( "  %s[%d]: expected %.9g (0x%08x), got %.9g (0x%08x)\n", What, Index, Expected, Bits( Expected ), Actual, Bits( Actual ) );
+		}
+		return false;
+	}
+
+	bool CheckAgents( const FAgents &Expected, const FAgents &Actual )
+	{
+		bool bSame = true;
+		for (int32_t i = 0; i < Expected.Num; i++)
+		{
+			bSame &= CheckBits( "Lucidity", i, Expected.Lucidity[i], Actual.Lucidity[i] );
+			bSame &= CheckBits( "TimeSinceLastUptick", i, Expected.TimeSinceLastUptick[i], Actual.TimeSinceLastUptick[i] );
+		}
+		return bSame;
+	}
+
+	// LucidIntegration::Step against LucidIntegrateStep, agent by agent
+	bool TestScalarStep()
+	{
+		for (uint32_t Seed = 1; Seed <= 16; Seed++)
+		{
+			FAgents Expected = MakeAgents( 4096, Seed, (Seed & 1) == 0 );
+			FAgents Actual = Expected;
+			for (int32_t i = 0; i < Expected.Num; i++)
+			{
+				Expected.Lucidity[i] = LucidIntegrationReference::LucidIntegrateStep( Expected.Lucidity[i], Expected.TickLucidity[i], Expected.MaxDeltaLucidity[i],
+					Expected.AbsorbVelocity[i], Expected.ConsumeVelocity[i], Expected.InnerRadianceDecayTime[i], Expected.InnerRadiance[i], Expected.TimeSinceLastUptick[i] );
+				Actual.Lucidity[i] = LucidIntegration::Step( Actual.Lucidity[i], Actual.TickLucidity[i], Actual.MaxDeltaLucidity[i],
+					Actual.AbsorbVelocity[i], Actual.ConsumeVelocity[i], Actual.InnerRadianceDecayTime[i], Actual.InnerRadiance[i], Actual.TimeSinceLastUptick[i] );
+			}
+			if (!CheckAgents( Expected, Actual ))
+			{
+				return false;
+			}
+		}
+		return true;
+	}
+
+	// StepAgents, SIMD body and scalar tail, against the old per-agent loop at every tail length
+	bool TestStepAgents()
+	{
+		for (int32_t Count = 0; Count <= 67; Count++)
+		{
+			for (uint32_t Seed = 1; Seed <= 8; Seed++)
+			{
+				FAgents Expected = MakeAgents( Count, Seed*1000 + Count, (Seed & 1) == 0 );
+				FAgents Actual = Expected;
+				LucidIntegrationReference::StepAgents( Expected.GetArrays(), Count );
+				LucidIntegration::StepAgents( Actual.GetArrays(), Count );
+				if (!CheckAgents( Expected, Actual ))
+				{
+					printf( "  with %d agents\n", Count );
+					return false;
+				}
+			}
+		}
+		return true;
+	}
+
+	// Many steps in a row, feeding results back in and aging the uptick timer, so holds, grace expiry
+	// and clamping at both ends all come up on the same agents
+	bool TestSequence()
+	{
+		const float DeltaSeconds = 1.f / 60.f;
+		FAgents Expected = MakeAgents( 1027, 77, false );
+		FAgents Actual = Expected;
+		std::mt19937 Random( 78 );
+		std::uniform_real_distribution<float> Exposure( 0.f, 1.5f );
+		for (int32_t Frame = 0; Frame < 2000; Frame++)
+		{
+			// Exposure flips between lit and dark spells so agents both rise and fall
+			const bool bLit = ((Frame / 250) & 1) == 0;
+			for (int32_t i = 0; i < Expected.Num; i++)
+			{
+				const float Tick = bLit ? Exposure( Random ) : 0.f;
+				Expected.TickLucidity[i] = Actual.TickLucidity[i] = Tick;
+				Expected.TimeSinceLastUptick[i] += DeltaSeconds;
+				Actual.TimeSinceLastUptick[i] += DeltaSeconds;
+			}
+			LucidIntegrationReference::StepAgents( Expected.GetArrays(), Expected.Num );
+			LucidIntegration::StepAgents( Actual.GetArrays(), Actual.Num );
+			if (!CheckAgents( Expected, Actual ))
+			{
+				printf( "  at frame %d\n", Frame );
+				return false;
+			}
+		}
+		return true;
+	}
+
+	struct FCase
+	{
+		const char* Name;
+		float Lucidity;
+		float TickLucidity;
+		float MaxDeltaLucidity;
+		float AbsorbVelocity;
+		float ConsumeVelocity;
+		float InnerRadianceDecayTime;
+		bool bInnerRadiance;
+		float TimeSinceLastUptick;
+		float ExpectedLucidity;
+		float ExpectedUptick;
+	};
+
+	// The rule itself, on hand picked agents with known answers
+	bool TestKnownCases()
+	{
+		static const FCase Cases[] = {
+			{ "rise capped by MaxDelta",           0.2f, 1.f,  0.1f,  1.f, 1.f, 1.f,  false, 5.f,  0.3f,  0.f },
+			{ "rise scaled by absorb",             0.2f, 0.3f, 1.f,   0.5f, 1.f, 1.f, false, 5.f,  0.25f, 0.f },
+			{ "rise scaled by inner radiance",     0.2f, 0.3f, 1.f,   1.f, 1.f, 2.f,  true,  5.f,  0.4f,  0.f },
+			{ "fall capped by MaxDelta",           0.5f, 0.f,  0.1f,  1.f, 1.f, 1.f,  false, 5.f,  0.4f,  5.f },
+			{ "fall held during grace",            0.5f, 0.f,  0.1f,  1.f, 1.f, 1.f,  true,  2.9f, 0.5f,  2.9f },
+			{ "fall slowed once grace ends",       0.5f, 0.f,  0.1f,  1.f, 1.f, 0.5f, true,  3.f,  0.4f,  3.f },
+			{ "no change when exposure matches",   0.5f, 0.5f, 0.1f,  1.f, 1.f, 1.f,  true,  0.f,  0.5f,  0.f },
+			{ "clamped at one",                    0.95f, 2.f, 0.5f,  1.f, 1.f, 1.f,  false, 5.f,  1.f,   0.f },
+			{ "clamped at zero",                   0.05f, 0.f, 0.5f,  1.f, 1.f, 1.f,  false, 5.f,  0.f,   5.f },
+		};
+
+		bool bPassed = true;
+		for (const FCase &Case : Cases)
+		{
+			float Uptick = Case.TimeSinceLastUptick;
+			const float Result = LucidIntegration::Step( Case.Lucidity, Case.TickLucidity, Case.MaxDeltaLucidity, Case.AbsorbVelocity,
+				Case.ConsumeVelocity, Case.InnerRadianceDecayTime, Case.bInnerRadiance, Uptick );
+			const float Tolerance = 1e-6f;
+			const bool bMatches = (Result - Case.ExpectedLucidity <= Tolerance) && (Case.ExpectedLucidity - Result <= Tolerance) && (Bits( Uptick ) == Bits( Case.ExpectedUptick ));
+			if (!bMatches)
+			{
+				printf( "  %s: Lucidity %.9g (expected %.9g), TimeSinceLastUptick %.9g (expected %.9g)\n",
+					Case.Name, Result, Case.ExpectedLucidity, Uptick, Case.ExpectedUptick );
+				bPassed = false;
+			}
+		}
+		return bPassed;
+	}
+
+	struct FTest
+	{
+		const char* Name;
+		bool (*Run)();
+	};
+
+	const FTest Tests[] = {
+		{ "KnownCases", &TestKnownCases },
+		{ "ScalarStep", &TestScalarStep },
+		{ "StepAgents", &TestStepAgents },
+		{ "Sequence", &TestSequence },
+	};
+}
+
+int main( int argc, char** argv )
+{
+	const char* Only = (argc > 1) ? argv[1] : nullptr;
+	printf( "LucidIntegrationKernel, %s path\n", LUCID_INTEGRATION_SSE ? "SSE" : "scalar" );
+
+	int32_t Run = 0;
+	int32_t Failed = 0;
+	for (const FTest &Test : Tests)
+	{
+		if ((Only != nullptr) && (strcmp( Only, Test.Name ) != 0))
+		{
+			continue;
+		}
+		Failures = 0;
+		const bool bPassed = Test.Run();
+		printf( "%-12s %s\n", Test.Name, bPassed ? "passed" : "FAILED" );
+		Failed += bPassed ? 0 : 1;
+		Run++;
+	}
+	if (Run == 0)
+	{
+		printf( "No test named %s\n", Only );
+		return 2;
+	}
+	return (Failed == 0) ? 0 : 1;
+}
@@ -0,0 +1,59 @@
+// Copyright 1998-2017 Epic Games, Inc. All Rights Reserved.
+#pragma once
+
+// The integration rule as it stood in LucidityTypes.h before LucidIntegrationKernel.h replaced it,
+// kept verbatim so the kernel can be checked against it off engine.
+
+#include "LucidIntegrationKernel.h"
+
+namespace LucidIntegrationReference
+{
+	// The FMath templates the original called, as UnrealMathUtility.h defines them
+	struct FMath
+	{
+		template<class T> static inline T Min( const T A, const T B ) { return (A <= B) ? A : B; }
+		template<class T> static inline T Abs( const T A ) { return (A >= (T)0) ? A : -A; }
+		template<class T> static inline T Clamp( const T X, const T Min, const T Max ) { return X < Min ? Min : X < Max ? X : Max; }
+	};
+
+	/**
+	 * One Lucidity integration step towards TickLucidity, shared by the per-character and batched paths.
+	 * TimeSinceLastUptick is reset when Lucidity rises.
+	 */
+	inline float LucidIntegrateStep( const float Lucidity, const float TickLucidity, const float MaxDeltaLucidity,
+		const float AbsorbVelocity, const float ConsumeVelocity, const float InnerRadianceDecayTime, const bool bInnerRadiance, float &TimeSinceLastUptick )
+	{
+		float DeltaLucidity = TickLucidity - Lucidity;
+		if (DeltaLucidity > 0.f)
+		{
+			TimeSinceLastUptick = 0.f;
+			DeltaLucidity *= AbsorbVelocity;
+			if (bInnerRadiance) {
+				DeltaLucidity *= InnerRadianceDecayTime;
+			}
+			DeltaLucidity = FMath::Min<float>( DeltaLucidity, MaxDeltaLucidity );
+		}
+		else if (DeltaLucidity < 0.f)
+		{
+			DeltaLucidity *= ConsumeVelocity;
+			DeltaLucidity = -1.f*FMath::Min<float>( FMath::Abs<float>( DeltaLucidity ), MaxDeltaLucidity );
+			if (bInnerRadiance) {
+				if (TimeSinceLastUptick < 3.0f) {
+					return Lucidity;
+				}
+				DeltaLucidity /= (InnerRadianceDecayTime * 2);
+			}
+		}
+		return FMath::Clamp<float>( Lucidity + DeltaLucidity, 0.f, 1.f );
+	}
+
+	/** The batched manager's per-agent loop */
+	inline void StepAgents( const LucidIntegration::FAgentArrays &Agents, const int32_t Count )
+	{
+		for (int32_t i = 0; i < Count; i++)
+		{
+			Agents.Lucidity[i] = LucidIntegrateStep( Agents.Lucidity[i], Agents.TickLucidity[i], Agents.MaxDeltaLucidity[i], Agents.AbsorbVelocity[i],
+				Agents.ConsumeVelocity[i], Agents.InnerRadianceDecayTime[i], Agents.InnerRadiance[i], Agents.TimeSinceLastUptick[i] );
+		}
+	}
+}